@@ -4,6 +4,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef int (*walloc_fn) (
     void*,      // dst-ptr
     size_t,     // size
@@ -93,4 +97,7 @@ extern void
 wmemp_rmnprint(struct wmemp_t* mp)
 __nonnull((1));
 
+#ifdef __cplusplus
+}
+#endif
 #endif
@@ -60,6 +60,36 @@ const char*
 wuri_last(const char* uri)
 __nonnull((1));
 
+#define WURI_MAXSEGS 32
+
+/** Segment boundaries of a method */
+struct wuri_segs {
+    /** method length, 0 if it has more than WURI_MAXSEGS segments */
+    uint32_t len;
+    /** number of segments described */
+    uint32_t n;
+    /** segment offsets (at their '/'), followed by the end
+     * of the last one (len, or the start of the next one) */
+    uint32_t offs[WURI_MAXSEGS+1];
+};
+
+/** Finds all segment boundaries of <uri> in a single pass,
+ * returns their number */
+int
+wuri_scan(const char* uri, struct wuri_segs* dst)
+__nonnull((1, 2));
+
+/** Returns the instruction set uris are scanned with
+ * ("avx2", "sse2", "neon" or "scalar") */
+const char*
+wuri_get_isa(void);
+
+/** Forces uri scanning instruction set, e.g. for benchmarks.
+ * Returns error if it is not supported */
+int
+wuri_set_isa(const char* isa)
+__nonnull((1));
+
 /** Copies parent method to <buf> */
 int
 wuri_parent(const char* uri, char* buf)
@@ -137,15 +167,22 @@ int womsg_writef(womsg_t* msg, float value) __nonnull((1));
 int womsg_writeb(womsg_t* msg, bool value) __nonnull((1));
 int womsg_writec(womsg_t* msg, char value) __nonnull((1));
 int womsg_writes(womsg_t* msg, const char* str) __nonnull((1, 2));
-
-// TODO:
 int womsg_writev(womsg_t* msg, wvalue_t val) __nonnull((1));
+
+/** Writes <n> elements of type <etype> ('f' or 'i') as an
+ * array, tag has to be set beforehand (e.g. "[fff]") */
+int womsg_writea(womsg_t* msg, char etype, const void* data, int n)
+__nonnull((1));
+
 int womsg_writeh(womsg_t* msg, int64_t value) __nonnull((1));
-int womsg_writet(womsg_t* msg) __nonnull((1));
 int womsg_writed(womsg_t* msg, double value) __nonnull((1));
+int womsg_writet(womsg_t* msg, uint64_t value) __nonnull((1));
+int womsg_writem(womsg_t* msg, const uint8_t midi[4]) __nonnull((1, 2));
+int womsg_writeblob(womsg_t* msg, const void* data, uint32_t len) __nonnull((1));
+
+// TODO:
 int womsg_writer(womsg_t* msg, int32_t value) __nonnull((1));
 int womsg_writen(womsg_t* msg) __nonnull((1));
-int womsg_writem(womsg_t* msg, char midi[]) __nonnull((1, 2));
 int womsg_writeI(womsg_t* msg) __nonnull((1));
 
 int womsg_readi(womsg_t* msg, int32_t* dst) __nonnull((1));
@@ -153,8 +190,76 @@ int womsg_readf(womsg_t* msg, float* dst) __nonnull((1));
 int womsg_readb(womsg_t* msg, bool* dst) __nonnull((1));
 int womsg_readc(womsg_t* msg, char* dst) __nonnull((1));
 int womsg_reads(womsg_t* msg, char** dst) __nonnull((1));
+int womsg_readh(womsg_t* msg, int64_t* dst) __nonnull((1));
+int womsg_readd(womsg_t* msg, double* dst) __nonnull((1));
+int womsg_readt(womsg_t* msg, uint64_t* dst) __nonnull((1));
+int womsg_readm(womsg_t* msg, uint8_t dst[4]) __nonnull((1, 2));
 int womsg_readv(womsg_t* msg, wvalue_t* dst) __nonnull((1));
 
+/** Reads blob without copying it, <data> points into
+ * the message buffer, and dangles with it */
+int womsg_readblob(womsg_t* msg, const byte_t** data, uint32_t* len)
+__nonnull((1, 2, 3));
+
+/** Reads an array of <etype> elements, <data> points
+ * into the message buffer, <n> is the number of elements */
+int womsg_reada(womsg_t* msg, char etype, const void** data, int* n)
+__nonnull((1, 3, 4));
+
+// ------------------------------------------------------------------------------------------------
+// STREAM FRAMING
+// ------------------------------------------------------------------------------------------------
+
+/// max packet size accepted by the deframer
+#define WOSTREAM_MAXLEN 65536
+
+/* OSC packets over a byte stream (e.g. TCP) */
+enum wostream_t {
+    /// OSC 1.0: big-endian int32 size, followed by the packet
+    WOSTREAM_LENGTH,
+    /// OSC 1.1: SLIP encoded (RFC 1055), packets are
+    /// delimited by END bytes on both sides
+    WOSTREAM_SLIP
+};
+
+/** Deframed packet callback */
+typedef void (*wostream_fn) (
+    byte_t*,    // packet
+    uint32_t,   // length
+    void*       // user-data
+);
+
+/* Streaming deframer state, one per connection.
+ * SLIP packets are decoded in place. */
+typedef struct wodeframer {
+    uint32_t rd;        // scanned input bytes
+    uint32_t wr;        // decoded bytes (SLIP)
+    uint8_t framing;
+    bool esc;           // pending SLIP escape
+} wodeframer_t;
+
+/** Resets deframer, for a new connection */
+void
+wodeframer_init(wodeframer_t* dfr, enum wostream_t framing)
+__nonnull((1));
+
+/** Hands every complete packet in <buf> to <fn>. Returns the number
+ * of consumed bytes, which have to be removed from the front of <buf>
+ * before appending new data and calling again: remaining bytes belong
+ * to an incomplete packet, and are kept in their (partially decoded)
+ * state. Returns a negative error if packet exceeds WOSTREAM_MAXLEN */
+int
+wodeframe(wodeframer_t* dfr, byte_t* buf, uint32_t len,
+          wostream_fn fn, void* udata)
+__nonnull((1, 2, 4));
+
+/** Frames packet <src> into <dst>, returns the framed length,
+ * or a negative error if <dst> is too small */
+int
+woframe(enum wostream_t framing, const byte_t* src, uint32_t len,
+        byte_t* dst, uint32_t cap)
+__nonnull((2, 4));
+
 #ifdef __cplusplus
 }
 #endif
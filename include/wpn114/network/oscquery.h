@@ -19,7 +19,16 @@ enum wquery_err {
     WQUERY_TYPE_MISMATCH,
     WQUERY_STRBUF_OVERFLOW,
     WQUERY_JBUF_OVERFLOW,
-    WQUERY_ATTR_UNSUPPORTED
+    WQUERY_ATTR_UNSUPPORTED,
+    WQUERY_THREADERR,
+    WQUERY_ADDR_INVALID,
+    WQUERY_SNAPSHOT_INVALID,
+    WQUERY_SNAPSHOT_OVERFLOW,
+    WQUERY_SNAPSHOT_COLLISION,
+    WQUERY_FILE_ERR,
+    WQUERY_RAMP_FULL,
+    WQUERY_POOL_EMPTY,
+    WQUERY_REPLAY_SPEED
 };
 
 enum wqaccess_t {
@@ -30,28 +39,30 @@ enum wqaccess_t {
 
 enum wqflags_t {
 
-    WQTREE_CREATE_INTERMEDIATE,
+    WQTREE_CREATE_INTERMEDIATE  = 1 << 0,
 
     /// CRITICAL flag: all messages adressing this node will
     /// transit in TCP instead of UDP, in order to guarantee
     /// its delivery.
-    WQNODE_CRITICAL,
+    WQNODE_CRITICAL             = 1 << 1,
 
     /// READONLY flag: node's values and attributes cannot be
     /// modified from outside.
-    WQNODE_READONLY,
+    WQNODE_READONLY             = 1 << 2,
 
     /// WRITEONLY flag: node's values and attributes cannot be
     /// read from outside.
-    WQNODE_WRITEONLY,
+    WQNODE_WRITEONLY            = 1 << 3,
 
     /// NOREPEAT flag: when the received value is the same as
-    /// the previous one, callback function won't be triggered
-    WQNODE_NOREPEAT,
+    /// the current one (or within node's epsilon, for floats),
+    /// it is dropped: no callback, no history sample and
+    /// no LISTEN output
+    WQNODE_NOREPEAT             = 1 << 4,
 
     /// FN_SETPRE flag: value callback function will be triggered
     /// before the value is actually set.
-    WQNODE_FN_SETPRE,   
+    WQNODE_FN_SETPRE            = 1 << 5,
 };
 
 typedef struct wqnode wqnode_t;
@@ -65,9 +76,22 @@ void (*wqnode_fn) (
       void*         // user-data
 );
 
-/** Sets <node> flags. Returns error if incorrect */
+/** Adds <flags> (or'ed wqflags_t) to <node> flags.
+ * Returns error if incorrect. READONLY/WRITEONLY are part of the
+ * namespace, use wqtree_set_node_flags for nodes of a served tree */
 extern int
-wqnode_set_flags(wqnode_t* node, enum wqflags_t flg)
+wqnode_set_flags(wqnode_t* node, int flags)
+__nonnull((1));
+
+/** Removes <flags> (or'ed wqflags_t) from <node> flags */
+extern void
+wqnode_clear_flags(wqnode_t* node, int flags)
+__nonnull((1));
+
+/** Sets NOREPEAT deadband of float <node>: values within
+ * <epsilon> of the current one are considered repeated */
+extern int
+wqnode_set_epsilon(wqnode_t* node, float epsilon)
 __nonnull((1));
 
 /** Sets <node> value callback function, which will be
@@ -81,6 +105,11 @@ extern int
 wqnode_get_access(wqnode_t* node)
 __nonnull((1));
 
+/** Returns <node> value type */
+extern enum wtype_t
+wqnode_get_type(wqnode_t* node)
+__nonnull((1));
+
 /** Returns <node> name */
 extern const char*
 wqnode_get_name(wqnode_t* nd)
@@ -95,12 +124,40 @@ extern int wqnode_setf(wqnode_t* node, float f) __nonnull((1));
 extern int wqnode_setc(wqnode_t* node, char c) __nonnull((1));
 extern int wqnode_setb(wqnode_t* node, bool b) __nonnull((1));
 extern int wqnode_sets(wqnode_t* node, const char* s)  __nonnull((1, 2));
+/** Sets string <node> from the first <len> bytes of <s>,
+ * which doesn't have to be zero-terminated */
+extern int wqnode_setsn(wqnode_t* node, const char* s, uint32_t len) __nonnull((1, 2));
+extern int wqnode_seth(wqnode_t* node, int64_t h) __nonnull((1));
+extern int wqnode_setd(wqnode_t* node, double d) __nonnull((1));
+extern int wqnode_sett(wqnode_t* node, uint64_t t) __nonnull((1));
+extern int wqnode_setm(wqnode_t* node, const uint8_t m[4]) __nonnull((1, 2));
+
+/** Copies <len> bytes of <data> into blob <node> storage */
+extern int wqnode_setblob(wqnode_t* node, const void* data, uint32_t len) __nonnull((1));
 
 extern int wqnode_geti(wqnode_t* node, int* i) __nonnull((1, 2));
 extern int wqnode_getf(wqnode_t* node, float* f) __nonnull((1, 2));
 extern int wqnode_getc(wqnode_t* node, char* c) __nonnull((1, 2));
 extern int wqnode_getb(wqnode_t* node, bool* b) __nonnull((1, 2));
 extern int wqnode_gets(wqnode_t* node, const char** s) __nonnull((1, 2));
+extern int wqnode_getsn(wqnode_t* node, const char** s, uint32_t* len) __nonnull((1, 2, 3));
+extern int wqnode_geth(wqnode_t* node, int64_t* h) __nonnull((1, 2));
+extern int wqnode_getd(wqnode_t* node, double* d) __nonnull((1, 2));
+extern int wqnode_gett(wqnode_t* node, uint64_t* t) __nonnull((1, 2));
+extern int wqnode_getm(wqnode_t* node, uint8_t m[4]) __nonnull((1, 2));
+
+/** Points <data> to blob <node> storage, sets <len> to its size */
+extern int wqnode_getblob(wqnode_t* node, const byte_t** data, uint32_t* len) __nonnull((1, 2, 3));
+
+/** Sets vector or array node values from <n> elements, vector
+ * nodes only accept their exact size. Elements are copied in
+ * place, the callback is given the node's own value */
+extern int wqnode_setfv(wqnode_t* node, const float* v, int n) __nonnull((1, 2));
+extern int wqnode_setiv(wqnode_t* node, const int32_t* v, int n) __nonnull((1, 2));
+
+/** Points <v> to vector or array node elements, sets <n> to their number */
+extern int wqnode_getfv(wqnode_t* node, const float** v, int* n) __nonnull((1, 2, 3));
+extern int wqnode_getiv(wqnode_t* node, const int32_t** v, int* n) __nonnull((1, 2, 3));
 
 extern bool
 wqnode_is_child(wqnode_t* parent, wqnode_t* child)
@@ -123,11 +180,22 @@ extern void
 wqtree_print(wqtree_t* tree)
 __nonnull((1));
 
-/** Sets tree general flags */
+/** Adds <flags> (or'ed WQTREE_* wqflags_t) to tree flags */
 extern int
-wqtree_set_flags(wqtree_t* tree, enum wqflags_t flags)
+wqtree_set_flags(wqtree_t* tree, int flags)
 __nonnull((1));
 
+/** Adds <flags> to (or removes them from) <node> flags, as
+ * wqnode_set_flags (wqnode_clear_flags), bumping <tree> version
+ * if its READONLY/WRITEONLY flags change */
+extern int
+wqtree_set_node_flags(wqtree_t* tree, wqnode_t* node, int flags)
+__nonnull((1, 2));
+
+extern void
+wqtree_clear_node_flags(wqtree_t* tree, wqnode_t* node, int flags)
+__nonnull((1, 2));
+
 /** Adds node to tree, with <wtp> type and <uri>,
  * sets <dst> to point to the newly created node */
 extern int wqtree_addndN(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
@@ -135,17 +203,296 @@ extern int wqtree_addndi(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonn
 extern int wqtree_addndf(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
 extern int wqtree_addndb(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
 extern int wqtree_addndc(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
+extern int wqtree_addndh(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
+extern int wqtree_addndd(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
+extern int wqtree_addndt(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
+extern int wqtree_addndm(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
 
 // note: if strlim == 0, and in malloc mode, no limit for str in size
 extern int wqtree_addnds(wqtree_t* tree, const char* uri, wqnode_t** dst,
                          int strlim) __nonnull((1, 2, 3));
 
+/** Adds string node in view mode: its value is not copied, it
+ * references the received packet (or a copy of the string, when
+ * the packet doesn't live in a pooled buffer). A string pool
+ * has to be set up first (see wqtree_set_strpool) */
+extern int wqtree_addndsv(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
+
+/** Adds blob node, holding up to <cap> bytes (at most 65535) */
+extern int wqtree_addndblob(wqtree_t* tree, const char* uri, wqnode_t** dst,
+                            int cap) __nonnull((1, 2, 3));
+
+/** Adds float vector node (2, 3 or 4 elements), sent as "[ff]",
+ * "[fff]" and "[ffff]" OSC arrays */
+extern int wqtree_addndv2(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
+extern int wqtree_addndv3(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
+extern int wqtree_addndv4(wqtree_t* tree, const char* uri, wqnode_t** dst) __nonnull((1, 2, 3));
+
+/** Adds float/int array node, holding up to <cap>
+ * elements (at most WARR_MAXLEN), initially empty */
+extern int wqtree_addndfa(wqtree_t* tree, const char* uri, wqnode_t** dst,
+                          int cap) __nonnull((1, 2, 3));
+extern int wqtree_addndia(wqtree_t* tree, const char* uri, wqnode_t** dst,
+                          int cap) __nonnull((1, 2, 3));
+
+/** Node description, for wqtree_build */
+struct wqnode_desc {
+    const char* uri;
+    enum wtype_t type;
+    int flags;
+};
+
+/** Adds <n> nodes to <tree> at once, in a single block allocated from
+ * <tree> allocator, and sets <dst> (if not NULL) to point to them.
+ * Nodes have to be given depth-first, each one after its parent
+ * (a plain strcmp sort of the uris will do, unless names contain
+ * characters below '/'), parents may also be nodes already in
+ * <tree>. Only scalar, midi and container nodes can be built this
+ * way. Uris are not copied. Nothing is added if a node is invalid,
+ * or out of order (WQUERY_URI_INVALID) */
+extern int wqtree_build(wqtree_t* tree, const struct wqnode_desc* nodes,
+                        int n, wqnode_t** dst) __nonnull((1, 2));
+
+/* A reference-counted buffer, from a tree string pool */
+typedef struct wqbuf wqbuf_t;
+
+/** Allocates a pool of <nbufs> buffers of <bufsz> bytes each, for
+ * string views. UDP workers receive datagrams straight into pool
+ * buffers when <bufsz> is at least WQUERY_UDP_MTU: a buffer then
+ * stays out of the pool for as long as a string view node
+ * references it, i.e. until the node's next value, or until
+ * the node is dropped */
+extern int
+wqtree_set_strpool(wqtree_t* tree, int nbufs, int bufsz)
+__nonnull((1));
+
+/** Takes another reference on <buf>, e.g. to keep the string of
+ * a view node (wstrv_t) around after the callback returns */
+extern void
+wqbuf_retain(wqbuf_t* buf)
+__nonnull((1));
+
+/** Releases a reference, buffer goes back to its pool after
+ * its last one */
+extern void
+wqbuf_release(wqbuf_t* buf)
+__nonnull((1));
+
+/** Releases the buffer referenced by string view <node>,
+ * its value becomes the empty string */
+extern int
+wqnode_drop(wqnode_t* node)
+__nonnull((1));
+
+/** Returns <tree> structural version, which changes whenever
+ * nodes are added, or their READONLY/WRITEONLY flags are changed
+ * through wqtree_set_node_flags/wqtree_clear_node_flags */
+extern uint32_t
+wqtree_get_version(wqtree_t* tree)
+__nonnull((1));
+
+/** Prints <node> OSCQuery namespace (full path, type, access and
+ * contents, recursively, without values) into <dst>, in json, the
+ * whole tree's if <node> is NULL. <len>
+ * is set to the full json length, even when <cap> is too small for
+ * it, in which case WQUERY_STRBUF_OVERFLOW is returned */
+extern int
+wqtree_print_json(wqtree_t* tree, wqnode_t* node, char* dst,
+                  uint32_t cap, uint32_t* len)
+__nonnull((1, 5));
+
 /** Gets node handle from the tree, returns NULL if
  * target could not be found */
 extern wqnode_t*
 wqtree_get_node(wqtree_t* tree, const char* uri)
 __nonnull((1, 2));
 
+/** Enables the ramp engine of <tree>, with up to <nramps> ramps
+ * running at once, stepped every <tick_ms> milliseconds. When
+ * enabled, OSC messages carrying a float/int value followed by an
+ * int (e.g. "/foo ,fi 0.5 2000") ramp the node from its current
+ * value to the target, over the given number of milliseconds */
+extern int
+wqtree_set_ramps(wqtree_t* tree, int nramps, int tick_ms)
+__nonnull((1));
+
+/** Ramps float, int or vector <node> from its current value to <target>
+ * in <ms> milliseconds, replacing its previous ramp, if any.
+ * Intermediate values are set with the regular setters, so that
+ * callbacks are triggered and LISTEN clients are notified.
+ * Negative <ms> are rejected with WQUERY_ATTR_UNSUPPORTED */
+extern int
+wqtree_ramp(wqtree_t* tree, wqnode_t* node, wvalue_t* target, int ms)
+__nonnull((1, 2, 3));
+
+/** Ramps vector <node> to its <n> components in <v>, see wqtree_ramp */
+extern int
+wqtree_rampfv(wqtree_t* tree, wqnode_t* node, const float* v, int n, int ms)
+__nonnull((1, 2, 3));
+
+/** Steps all ramps that are due. Called by the server after each
+ * poll, or by the application when running a tree on its own.
+ * Returns the number of ramps still running */
+extern int
+wqtree_ramps_advance(wqtree_t* tree)
+__nonnull((1));
+
+/** Returns the ramp tick (in milliseconds), 0 if disabled */
+extern int
+wqtree_ramps_tick(wqtree_t* tree)
+__nonnull((1));
+
+/** A timestamped value sample, as stored in node history rings
+ * and sent in reply to "?HISTORY" queries, preceded by a header
+ * (uint32_t count, uint32_t type tag, uint64_t server time) */
+struct wqsample {
+    uint64_t ts;    // monotonic clock, in nanoseconds
+    union {
+        int32_t i;
+        float f;
+        char c;
+        bool b;
+    } u;
+    uint32_t rsv;
+};
+
+/** Keeps the last <capacity> values of int, float, char or
+ * bool <node>, in a ring allocated from <tree> allocator.
+ * Samples are taken after any other value filtering,
+ * right before the node's callback is triggered */
+extern int
+wqtree_set_history(wqtree_t* tree, wqnode_t* node, int capacity)
+__nonnull((1, 2));
+
+/** Copies up to <max> of the most recent samples of <node>
+ * into <dst>, oldest first. Returns their number, or
+ * -WQUERY_ATTR_UNSUPPORTED if node has no history.
+ * Not synchronized with the server's udp workers, call it
+ * from the node's own callback when they are running */
+extern int
+wqnode_get_history(wqnode_t* node, struct wqsample* dst, int max)
+__nonnull((1, 2));
+
+/** Per-node traffic counters */
+struct wqnode_stats {
+    uint64_t rx;        // updates received
+    uint64_t tx;        // updates pushed to listening clients
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t last;      // last update received, monotonic clock (ns)
+};
+
+/** Hot node, as estimated by the space-saving sketch:
+ * its actual update count is between count-error and count */
+struct wqhot {
+    wqnode_t* node;
+    uint64_t count;
+    uint64_t error;
+};
+
+/** Enables traffic counters for the (up to) <nnodes> nodes of <tree>,
+ * and tracks the <nhot> hottest ones (by updates received). Counters
+ * are kept in a table allocated from <tree> allocator, nodes added
+ * afterwards are not tracked. Hottest nodes are also served
+ * over http, with a ?HOT query */
+extern int
+wqtree_set_stats(wqtree_t* tree, int nnodes, int nhot)
+__nonnull((1));
+
+/** Copies <node> counters into <dst>, returns
+ * WQUERY_ATTR_UNSUPPORTED if node is not tracked */
+extern int
+wqtree_get_stats(wqtree_t* tree, wqnode_t* node, struct wqnode_stats* dst)
+__nonnull((1, 2, 3));
+
+/** Copies up to <max> of the hottest nodes into <dst>, hottest first.
+ * Each server thread keeps its own sketch, which are merged here.
+ * Returns their number, or -WQUERY_ATTR_UNSUPPORTED
+ * if stats are not enabled */
+extern int
+wqtree_get_hot(wqtree_t* tree, struct wqhot* dst, int max)
+__nonnull((1, 2));
+
+/** Records every OSC packet received by <tree> (raw, before
+ * decoding) into log <rec> (see wpn114/network/record.h),
+ * NULL stops recording */
+struct wqrec;
+extern int
+wqtree_set_recorder(wqtree_t* tree, struct wqrec* rec)
+__nonnull((1));
+
+/** Feeds all packets of log <rec> back into <tree>, oldest first.
+ * <speed> scales the original timing (1: real-time, 2: twice as
+ * fast), <= 0 replays as fast as possible. Returns the number
+ * of replayed packets, or -WQUERY_REPLAY_SPEED if <speed> is NaN,
+ * or so low that the scaled log span would overflow */
+extern int
+wqtree_replay(wqtree_t* tree, struct wqrec* rec, double speed)
+__nonnull((1, 2));
+
+/** wqtree bulk callback function type definition,
+ * called once after a batched snapshot restore */
+typedef
+void (*wqtree_fn) (
+      wqtree_t*,    // target-tree
+      int,          // number of restored nodes
+      void*         // user-data
+);
+
+enum wqrestore_t {
+    /// values are set one by one, each node
+    /// value callback being triggered as usual
+    WQRESTORE_NODE_FN,
+    /// values are written in place, node callbacks are
+    /// skipped, and the tree 'restored' callback is
+    /// triggered once at the end
+    WQRESTORE_BULK
+};
+
+/** Sets <tree> callback for WQRESTORE_BULK restores */
+extern int
+wqtree_set_restored_fn(wqtree_t* tree, wqtree_fn fn, void* udata)
+__nonnull((1));
+
+/** Snapshots read and write node values without taking the server's
+ * shard locks: the functions below must not run concurrently with
+ * updates, the server has to be stopped (or not yet started) first */
+
+/** Returns the size (in bytes) of a snapshot of <tree> */
+extern uint32_t
+wqtree_snapshot_size(wqtree_t* tree)
+__nonnull((1));
+
+/** Serializes all values of <tree> (including strings) into <dst>,
+ * a header followed by an index of uri hashes sorted for binary
+ * search, and the values themselves. Sets <len> to the number of
+ * bytes written. Returns WQUERY_SNAPSHOT_COLLISION if two uris of
+ * the tree share the same hash */
+extern int
+wqtree_snapshot(wqtree_t* tree, byte_t* dst, uint32_t cap, uint32_t* len)
+__nonnull((1, 2, 4));
+
+/** Applies snapshot <src> to <tree> in a single pass over the tree.
+ * Nodes missing from the snapshot, or which type has changed since,
+ * are left untouched. LISTEN clients are notified in both modes */
+extern int
+wqtree_restore(wqtree_t* tree, const byte_t* src, uint32_t len,
+               enum wqrestore_t mode)
+__nonnull((1, 2));
+
+/** Writes a snapshot of <tree> to file <path> (through a mapping).
+ * The file is written to <path>.tmp, synced, and renamed over <path>,
+ * which is left untouched on failure */
+extern int
+wqtree_snapshot_save(wqtree_t* tree, const char* path)
+__nonnull((1, 2));
+
+/** Maps snapshot file <path>, and restores <tree> from it */
+extern int
+wqtree_snapshot_load(wqtree_t* tree, const char* path,
+                     enum wqrestore_t mode)
+__nonnull((1, 2));
+
 /** A handle on an oscquery server data structure */
 typedef struct wqserver wqserver_t;
 
@@ -165,6 +512,87 @@ extern int
 wqserver_expose(wqserver_t* server, wqtree_t* tree)
 __nonnull((1, 2));
 
+/** Sets the number of udp worker threads for <server> (default: 0).
+ * When > 0, wqserver_run opens <nworkers> SO_REUSEPORT udp sockets
+ * instead of the mongoose udp binding, each one being drained
+ * by its own thread. Node updates are then serialized per node
+ * through a set of hash-sharded locks, while decoding and lookup
+ * run in parallel. Tree structure must not be modified while
+ * workers are running. Must be called before wqserver_run */
+extern int
+wqserver_set_udp_workers(wqserver_t* server, int nworkers)
+__nonnull((1));
+
+/** Gives the poll loop and each udp worker of <server> its own cache
+ * of recently received addresses, <nlines> of them (2-way set
+ * associative, rounded up to a power of two), so that repeated ones
+ * skip the tree walk. Lines are invalidated whenever nodes are added
+ * to the tree, addresses longer than 48 bytes are not cached. Has to
+ * be called before wqserver_run, caches are allocated from <server>
+ * allocator, 64 bytes a line */
+extern int
+wqserver_set_lookup_cache(wqserver_t* server, int nlines)
+__nonnull((1));
+
+/** Sets <hits> and <misses> to the lookup cache counters, summed over
+ * all threads. Returns WQUERY_ATTR_UNSUPPORTED if caches are not enabled */
+extern int
+wqserver_get_lookup_stats(wqserver_t* server, uint64_t* hits, uint64_t* misses)
+__nonnull((1, 2, 3));
+
+enum wqbackend_t {
+    /// mongoose select/poll loop, for both tcp and udp
+    WQSERVER_BACKEND_MONGOOSE,
+    /// linux io_uring for osc/udp (multishot receive into
+    /// registered buffers, batched LISTEN sends),
+    /// tcp/websocket remains handled by mongoose
+    WQSERVER_BACKEND_URING
+};
+
+/** Selects the udp network backend used by <server>.
+ * Returns WQUERY_ATTR_UNSUPPORTED if the backend has not
+ * been compiled in. Must be called before wqserver_run */
+extern int
+wqserver_set_backend(wqserver_t* server, enum wqbackend_t backend)
+__nonnull((1));
+
+/** Accepts plain OSC-over-TCP connections on <port> when running
+ * <server>, packets being delimited with <framing>. Stream peers
+ * receive every LISTEN value, with a single write per poll cycle.
+ * Must be called before wqserver_run */
+extern int
+wqserver_bind_stream(wqserver_t* server, uint16_t port,
+                     enum wostream_t framing)
+__nonnull((1));
+
+/** Binds an AF_UNIX datagram socket on <path> when running
+ * <server>, accepting raw OSC packets from same-host peers.
+ * <path> is unlinked first, it must outlive the server.
+ * Must be called before wqserver_run */
+extern int
+wqserver_bind_unix(wqserver_t* server, const char* path)
+__nonnull((1, 2));
+
+/** Adds a same-host peer connected through shared-memory rings
+ * (see wpn114/network/shm.h): OSC frames pushed by the peer into
+ * <in> update the tree, LISTEN values are pushed into <out>.
+ * Either of them can be NULL. Must be called before wqserver_run */
+struct wshm;
+extern int
+wqserver_add_shm(wqserver_t* server, struct wshm* in, struct wshm* out)
+__nonnull((1));
+
+/** Streams LISTEN values to multicast <group>:<port>, sending each
+ * of them once for all clients that opted in (with "MULTICAST": true
+ * in START_OSC_STREAMING data), others still get unicast copies.
+ * <iface> is the (IPv4) address of the outgoing interface, NULL for
+ * the default one, "127.0.0.1" to stay on this host.
+ * Must be called before wqserver_run */
+extern int
+wqserver_set_multicast(wqserver_t* server, const char* group,
+                       uint16_t port, const char* iface)
+__nonnull((1, 2));
+
 /** Runs the oscquery <server> on <tcpport> and <udpport> */
 extern int
 wqserver_run(wqserver_t* server, uint16_t udpport, uint16_t tcpport)
@@ -178,6 +606,75 @@ extern int
 wqserver_stop(wqserver_t* server)
 __nonnull((1));
 
+/** Prints <server> packet counters, errors and per-stage latency
+ * histograms (decode, lookup, update, send) into <dst>, in prometheus
+ * text format, also served over http with a ?METRICS query.
+ * Returns WQUERY_ATTR_UNSUPPORTED unless built with WQUERY_METRICS */
+extern int
+wqserver_get_metrics(wqserver_t* server, char* dst, uint32_t cap, uint32_t* len)
+__nonnull((1, 2, 4));
+
+/** Points <dst> to the namespace json of <server> tree, gzipped
+ * if <gzip> is set, as served over http, and <etag> to its http
+ * entity tag, the gzipped one's ending with "-gz". Both are only serialized (and compressed) again when
+ * the tree version changes, then cached: requests carrying the
+ * current etag in an If-None-Match header are answered with a 304.
+ * Compression requires WQUERY_ZLIB, WQUERY_ATTR_UNSUPPORTED
+ * is returned otherwise. Pointers are valid until next call */
+extern int
+wqserver_get_namespace(wqserver_t* server, bool gzip, const void** dst,
+                       uint32_t* len, const char** etag)
+__nonnull((1, 3, 4, 5));
+
+/** Limits what each websocket client is sent to <bps> bytes and <mps>
+ * messages per second (0 for no limit). A client that runs out of
+ * budget, or whose send queue grows past <hiwat> bytes, is lagging
+ * until its queue is back under <lowat> bytes and it has budget
+ * again: meanwhile, it only gets the latest value of each node it
+ * missed, intermediate updates are dropped. Queue watermarks
+ * default to WQUERY_WS_LOWAT and WQUERY_WS_HIWAT, there's no rate
+ * limit by default, <hiwat> 0 disables watermarks */
+extern int
+wqserver_set_client_budget(wqserver_t* server, uint32_t bps, uint32_t mps,
+                           uint32_t lowat, uint32_t hiwat)
+__nonnull((1));
+
+/** Outbound state of a websocket client */
+struct wqclient_lag {
+    char addr[24];          // ip:port
+    uint32_t queued;        // bytes in its send queue, as of last flush
+    uint32_t max_queued;
+    uint32_t pending;       // nodes waiting for their latest value
+    uint64_t sent;          // updates sent
+    uint64_t coalesced;     // updates dropped for a later one
+    uint64_t lag;           // ns spent lagging so far, 0 if it's not
+};
+
+/** Copies the state of up to <max> websocket clients into <dst>,
+ * returns their number. Also part of ?METRICS replies */
+extern int
+wqserver_get_client_lag(wqserver_t* server, struct wqclient_lag* dst, int max)
+__nonnull((1, 2));
+
+/** Starts recording server events (network polls, OSC decoding,
+ * node lookups, node callbacks and http json replies) with their
+ * cpu timestamps, in per-thread rings of WQUERY_TRACE_RINGSZ events,
+ * the oldest ones being overwritten. Tracing is process-wide.
+ * Returns WQUERY_ATTR_UNSUPPORTED unless built with WQUERY_TRACE */
+extern int
+wqtrace_start(void);
+
+/** Stops recording events */
+extern int
+wqtrace_stop(void);
+
+/** Stops recording, and writes events recorded since the last
+ * wqtrace_start() call into <path>, in Chrome trace event
+ * format (chrome://tracing, ui.perfetto.dev) */
+extern int
+wqtrace_write(const char* path)
+__nonnull((1));
+
 /** A handle on an oscquery client data structure */
 typedef struct wqclient wqclient_t;
 
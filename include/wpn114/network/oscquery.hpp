@@ -0,0 +1,242 @@
+#ifndef WPN114_OSCQUERY_HPP
+#define WPN114_OSCQUERY_HPP
+
+#include <wpn114/network/oscquery.h>
+#include <memory_resource>
+#include <string_view>
+#include <cstdint>
+#include <new>
+
+/* Header-only C++17 layer over oscquery.h. Node types are resolved at
+ * compile time (Node<float> calls wqnode_setf/getf directly), callbacks
+ * are bound through template thunks, without std::function, and trees
+ * and servers get their memory from a std::pmr::memory_resource, which
+ * they release on destruction. Everything inlines down to the C calls. */
+
+namespace wpn114::query {
+
+/** Per-type dispatch to the C api, the only place
+ * where node types are mapped to functions */
+template<typename T> struct node_traits;
+
+#define WQUERY_DECL_TRAITS(_tp, _sfx, _m, _wt)                          \
+template<> struct node_traits<_tp> {                                    \
+    static bool is(enum wtype_t t)                                      \
+    { return t == _wt; }                                                \
+    static int add(wqtree_t* t, const char* uri, wqnode_t** dst)        \
+    { return wqtree_addnd##_sfx(t, uri, dst); }                         \
+    static int set(wqnode_t* nd, _tp v)                                 \
+    { return wqnode_set##_sfx(nd, v); }                                 \
+    static int get(wqnode_t* nd, _tp* v)                                \
+    { return wqnode_get##_sfx(nd, v); }                                 \
+    static _tp from(const wvalue_t* v)                                  \
+    { return v->u._m; }                                                 \
+};
+
+WQUERY_DECL_TRAITS(int, i, i, WOSC_TYPE_INT)
+WQUERY_DECL_TRAITS(float, f, f, WOSC_TYPE_FLOAT)
+WQUERY_DECL_TRAITS(char, c, c, WOSC_TYPE_CHAR)
+WQUERY_DECL_TRAITS(bool, b, b, WOSC_TYPE_BOOL)
+WQUERY_DECL_TRAITS(int64_t, h, h, WOSC_TYPE_INT64)
+WQUERY_DECL_TRAITS(double, d, d, WOSC_TYPE_DOUBLE)
+#undef WQUERY_DECL_TRAITS
+
+template<> struct node_traits<std::string_view> {
+    static bool is(enum wtype_t t)
+    { return t == WOSC_TYPE_STRING || t == WOSC_TYPE_STRVIEW; }
+    static int add(wqtree_t* t, const char* uri, wqnode_t** dst, int strlim = 0)
+    { return wqtree_addnds(t, uri, dst, strlim); }
+    static int set(wqnode_t* nd, std::string_view v)
+    { return wqnode_setsn(nd, v.data(), v.size()); }
+    static int get(wqnode_t* nd, std::string_view* v) {
+        const char* s;
+        uint32_t len;
+        int err = wqnode_getsn(nd, &s, &len);
+        if (err == 0)
+            *v = std::string_view(s, len);
+        return err;
+    }
+    static std::string_view from(const wvalue_t* v) {
+        // string nodes either own their storage, or view a pooled buffer
+        if (v->t == WOSC_TYPE_STRVIEW)
+            return std::string_view(v->u.sv->dat, v->u.sv->len);
+        return std::string_view(v->u.s->dat, v->u.s->usd);
+    }
+};
+
+/** Typed node handle, trivially copyable, does not own the node */
+template<typename T>
+class Node {
+public:
+    Node() = default;
+    explicit Node(wqnode_t* nd) : m_node(nd) {}
+
+    int set(T v) { return node_traits<T>::set(m_node, v); }
+    int get(T* v) const { return node_traits<T>::get(m_node, v); }
+
+    /** Returns value, the node type being known
+     * there's no error to report */
+    T get() const {
+        T v{};
+        node_traits<T>::get(m_node, &v);
+        return v;
+    }
+
+    /** Calls <M>(value) on <obj> when the node value changes,
+     * <M> being a member function taking a T */
+    template<auto M, typename C>
+    void bind(C* obj) {
+        wqnode_set_fn(m_node, &member_thunk<M, C>, obj);
+    }
+
+    /** Calls <F>(value) when the node value changes */
+    template<auto F>
+    void bind() {
+        wqnode_set_fn(m_node, &function_thunk<F>, nullptr);
+    }
+
+    wqnode_t* c_node() const { return m_node; }
+    explicit operator bool() const { return m_node != nullptr; }
+
+private:
+    template<auto M, typename C>
+    static void member_thunk(wqnode_t*, wvalue_t* v, void* udt) {
+        (static_cast<C*>(udt)->*M)(node_traits<T>::from(v));
+    }
+
+    template<auto F>
+    static void function_thunk(wqnode_t*, wvalue_t* v, void*) {
+        F(node_traits<T>::from(v));
+    }
+
+    wqnode_t* m_node = nullptr;
+};
+
+/** walloc_t adapter over a memory resource, allocation failures
+ * are reported as negative return values, exceptions must not
+ * cross the C library */
+class Allocator {
+public:
+    explicit Allocator(std::pmr::memory_resource* mr)
+        : m_walloc{ &allocate, &deallocate, mr } {}
+
+    Allocator(const Allocator&) = delete;
+    Allocator& operator=(const Allocator&) = delete;
+
+    struct walloc_t* c_alloc() { return &m_walloc; }
+
+private:
+    static int allocate(void* dst, size_t nbytes, void* mr) {
+        try {
+            *static_cast<void**>(dst) =
+                static_cast<std::pmr::memory_resource*>(mr)->allocate(nbytes);
+            return 0;
+        } catch (...) {
+            return -1;
+        }
+    }
+
+    static int deallocate(void* dst, size_t nbytes, void* mr) {
+        static_cast<std::pmr::memory_resource*>(mr)->deallocate(
+            *static_cast<void**>(dst), nbytes);
+        return 0;
+    }
+
+    struct walloc_t m_walloc;
+};
+
+/** Owns a tree and all of its nodes: the C api has no way of freeing
+ * them one by one, they are all released with the tree's own pool.
+ * Not movable, the tree keeps a pointer to its allocator. */
+class Tree {
+public:
+    explicit Tree(std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+        : m_pool(mr), m_alloc(&m_pool)
+    {
+        if (wqtree_walloc(m_alloc.c_alloc(), &m_tree) < 0)
+            throw std::bad_alloc();
+    }
+
+    Tree(const Tree&) = delete;
+    Tree& operator=(const Tree&) = delete;
+
+    /** Adds container node <uri> */
+    int add(const char* uri) {
+        wqnode_t* nd;
+        return wqtree_addndN(m_tree, uri, &nd);
+    }
+
+    /** Adds node <uri> of type T, extra arguments are forwarded
+     * to the C function (string size limit, for strings) */
+    template<typename T, typename... Args>
+    int add(const char* uri, Node<T>* dst, Args... args) {
+        wqnode_t* nd;
+        int err = node_traits<T>::add(m_tree, uri, &nd, args...);
+        if (err == 0)
+            *dst = Node<T>(nd);
+        return err;
+    }
+
+    /** Returns node <uri>, or an empty
+     * node if it isn't of type T */
+    template<typename T>
+    Node<T> get(const char* uri) {
+        wqnode_t* nd = wqtree_get_node(m_tree, uri);
+        if (nd == nullptr || !node_traits<T>::is(wqnode_get_type(nd)))
+            return Node<T>();
+        return Node<T>(nd);
+    }
+
+    wqtree_t* c_tree() const { return m_tree; }
+
+private:
+    std::pmr::synchronized_pool_resource m_pool;
+    Allocator m_alloc;
+    wqtree_t* m_tree = nullptr;
+};
+
+/** Owns a server, stopped on destruction, the exposed
+ * tree has to outlive it */
+class Server {
+public:
+    explicit Server(std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+        : m_pool(mr), m_alloc(&m_pool)
+    {
+        if (wqserver_walloc(m_alloc.c_alloc(), &m_server) < 0)
+            throw std::bad_alloc();
+    }
+
+    ~Server() { stop(); }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    int expose(Tree& tree) { return wqserver_expose(m_server, tree.c_tree()); }
+
+    int run(uint16_t udpport, uint16_t tcpport) {
+        int err = wqserver_run(m_server, udpport, tcpport);
+        m_running = err == 0;
+        return err;
+    }
+
+    int iterate(int ms) { return wqserver_iterate(m_server, ms); }
+
+    int stop() {
+        if (!m_running)
+            return 0;
+        m_running = false;
+        return wqserver_stop(m_server);
+    }
+
+    wqserver_t* c_server() const { return m_server; }
+
+private:
+    std::pmr::synchronized_pool_resource m_pool;
+    Allocator m_alloc;
+    wqserver_t* m_server = nullptr;
+    bool m_running = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef WPN114_RECORD_H
+#define WPN114_RECORD_H
+
+#include <wpn114/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A handle on a log of raw OSC packets, stamped with the monotonic
+ * clock. The log is a preallocated file, mapped in memory and split
+ * into a ring of fixed-size segments: when the last segment is full,
+ * recording starts over the oldest one. Appending a packet is a clock
+ * read and a copy into the mapping, the kernel writes pages back
+ * whenever it sees fit. */
+typedef struct wqrec wqrec_t;
+
+enum wqrec_err {
+    WQREC_NOERROR,
+    WQREC_FILE_ERR,
+    WQREC_INVALID,
+    WQREC_FRAME_TOO_LARGE,
+    WQREC_READONLY
+};
+
+const char*
+wqrec_strerr(int err);
+
+/** Packet callback, <data> points into the mapping,
+ * <ts> is the packet's timestamp (in nanoseconds) */
+typedef void (*wqrec_fn) (
+    byte_t*,    // data
+    uint32_t,   // length
+    uint64_t,   // timestamp
+    void*       // user-data
+);
+
+/** Allocates <dst> pointer from <allocator> */
+int
+wqrec_walloc(struct walloc_t* allocator, wqrec_t** dst)
+__nonnull((1, 2));
+
+/** Creates (or truncates) log file <path>, with <nsegments>
+ * segments of <segsz> bytes each (multiple of 4096) */
+int
+wqrec_create(wqrec_t* rec, const char* path,
+             uint32_t nsegments, uint32_t segsz)
+__nonnull((1, 2));
+
+/** Maps an existing log file <path>, read-only,
+ * returns WQREC_INVALID if its header does not match its size */
+int
+wqrec_open(wqrec_t* rec, const char* path)
+__nonnull((1, 2));
+
+/** Appends packet to the log, can be called from several threads */
+int
+wqrec_write(wqrec_t* rec, const byte_t* data, uint32_t len)
+__nonnull((1, 2));
+
+/** Hands all packets still in the log to <fn>, oldest first.
+ * Returns the number of packets */
+int
+wqrec_foreach(wqrec_t* rec, wqrec_fn fn, void* udata)
+__nonnull((1, 2));
+
+/** Unmaps log, and closes its file */
+void
+wqrec_close(wqrec_t* rec)
+__nonnull((1));
+
+#ifdef __cplusplus
+}
+#endif
+#endif
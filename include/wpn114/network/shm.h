@@ -0,0 +1,106 @@
+#ifndef WPN114_SHM_H
+#define WPN114_SHM_H
+
+#include <wpn114/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A handle on a single-producer/single-consumer ring of raw
+ * OSC frames, living in a memfd shared by two local processes.
+ * Pushing and popping never enter the kernel, unless the
+ * consumer has parked itself, in which case the producer rings
+ * its doorbell (a datagram socketpair, so that it can be watched
+ * by the same poll loop as the network sockets). */
+typedef struct wshm wshm_t;
+
+enum wshm_err {
+    WSHM_NOERROR,
+    WSHM_FULL,
+    WSHM_FRAME_TOO_LARGE,
+    WSHM_MAP_ERR,
+    WSHM_INVALID
+};
+
+/** Frame callback, <data> points into the shared ring and
+ * is only valid for the duration of the call */
+typedef void (*wshm_fn) (
+    byte_t*,    // data
+    uint32_t,   // length
+    void*       // user-data
+);
+
+/** Allocates <dst> pointer from <allocator> */
+int
+wshm_walloc(struct walloc_t* allocator, wshm_t** dst)
+__nonnull((1, 2));
+
+/** Creates a new ring of <capacity> bytes (power of two) */
+int
+wshm_create(wshm_t* ring, uint32_t capacity)
+__nonnull((1));
+
+/** Maps an existing ring, from file descriptors obtained with
+ * wshm_get_fds (inherited, or received with wshm_recv_fds).
+ * Returns WSHM_INVALID if they don't describe a valid ring */
+int
+wshm_attach(wshm_t* ring, int memfd, int doorbell)
+__nonnull((1));
+
+/** Gets the descriptors the peer process needs for wshm_attach */
+int
+wshm_get_fds(wshm_t* ring, int* memfd, int* doorbell)
+__nonnull((1, 2, 3));
+
+/** Passes the ring's peer descriptors over unix socket <sock> */
+int
+wshm_send_fds(wshm_t* ring, int sock)
+__nonnull((1));
+
+/** Receives ring descriptors sent with wshm_send_fds */
+int
+wshm_recv_fds(int sock, int* memfd, int* doorbell)
+__nonnull((2, 3));
+
+/** Producer side: copies frame into the ring.
+ * Returns WSHM_FULL if there is not enough room */
+int
+wshm_push(wshm_t* ring, const byte_t* data, uint32_t len)
+__nonnull((1, 2));
+
+/** Consumer side: hands all pending frames to <fn>,
+ * returns the number of frames consumed, or -WSHM_INVALID if
+ * the peer wrote an invalid frame, which is dropped along
+ * with the ones following it */
+int
+wshm_pop(wshm_t* ring, wshm_fn fn, void* udata)
+__nonnull((1, 2));
+
+/** Consumer side: announces that consumer is about to sleep on
+ * its doorbell. Returns true if frames arrived in the meantime,
+ * in which case consumer should pop instead of sleeping */
+bool
+wshm_park(wshm_t* ring)
+__nonnull((1));
+
+/** Consumer side: clears parked state, and drains the doorbell */
+void
+wshm_unpark(wshm_t* ring)
+__nonnull((1));
+
+/** Returns the local end of the doorbell, readable when
+ * producer has notified a parked consumer */
+int
+wshm_doorbell(wshm_t* ring)
+__nonnull((1));
+
+/** Unmaps ring and closes its descriptors */
+void
+wshm_close(wshm_t* ring)
+__nonnull((1));
+
+#ifdef __cplusplus
+}
+#endif
+#endif
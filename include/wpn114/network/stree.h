@@ -0,0 +1,85 @@
+#ifndef WPN114_STREE_H
+#define WPN114_STREE_H
+
+#include <wpn114/network/oscquery.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Static trees, for targets where the namespace is fixed at compile
+ * time. Tables are generated by tools/wqgen.py from a JSON namespace,
+ * and are all const (flash-resident), except for the value array.
+ * Uris are looked up through a perfect hash (hash and displace),
+ * which costs two hashes of the uri and a single strcmp,
+ * whatever the size of the tree. */
+
+#define WQSTREE_NONE 0xffff
+
+/* A node, with its position in the tree as indices */
+struct wqsnode {
+    const char* uri;
+    uint16_t parent;    // WQSTREE_NONE for root
+    uint16_t child;     // first child
+    uint16_t sibling;   // next sibling
+    char type;          // wtype_t
+    uint8_t access;     // wqaccess_t
+    // node's object in the pre-rendered namespace
+    uint32_t joff;
+    uint32_t jlen;
+};
+
+struct wqstree {
+    const struct wqsnode* nodes;
+    const uint16_t* disp;   // per-bucket hash seeds
+    const uint16_t* slots;  // hash slot to node index
+    wvalue_t* values;       // one per node, in RAM
+    const char* json;       // namespace, without values
+    uint16_t nnodes;
+    uint16_t nbuckets;
+    uint16_t nslots;
+};
+
+/** Static node value callback, <index> as in the generated enum */
+typedef void (*wqstree_fn) (
+    const struct wqstree*,  // tree
+    int,                    // node index
+    wvalue_t*,              // value
+    void*                   // user-data
+);
+
+/** Uri hash, <seed> is 0 for buckets and the
+ * bucket displacement for slots */
+static inline uint32_t
+wqstree_hash(uint32_t seed, const char* uri)
+{
+    uint32_t h = 2166136261u ^ seed;
+    while (*uri) {
+        h ^= (uint8_t) *uri++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/** Returns index of node <uri>, or -1 if not found */
+extern int
+wqstree_lookup(const struct wqstree* tree, const char* uri)
+__nonnull((1, 2));
+
+/** Decodes OSC message <data>, and sets the addressed node value
+ * (scalar types only), calling <fn> afterwards, if not NULL */
+extern int
+wqstree_update_osc(const struct wqstree* tree, byte_t* data, int len,
+                   wqstree_fn fn, void* udata)
+__nonnull((1, 2));
+
+/** Points <json> to node <index> namespace object,
+ * returns its length */
+extern uint32_t
+wqstree_get_json(const struct wqstree* tree, int index, const char** json)
+__nonnull((1, 3));
+
+#ifdef __cplusplus
+}
+#endif
+#endif
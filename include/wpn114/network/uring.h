@@ -0,0 +1,76 @@
+#ifndef WPN114_URING_H
+#define WPN114_URING_H
+
+#include <wpn114/types.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A handle on a linux io_uring instance, with its own
+ * ring of provided receive buffers */
+typedef struct wuring wuring_t;
+
+/** Receive callback, <data> points directly into one of the
+ * registered buffers and is only valid for the duration of the call */
+typedef void (*wuring_recv_fn) (
+    byte_t*,    // data
+    uint32_t,   // length
+    void*       // user-data
+);
+
+/** Allocates <dst> pointer from <allocator> */
+int
+wuring_walloc(struct walloc_t* allocator, wuring_t** dst)
+__nonnull((1, 2));
+
+/** Sets up the rings (<entries> submission slots), and registers
+ * <nbufs> receive buffers of <bufsz> bytes each.
+ * <nbufs> must be a power of two. Returns 0 on success,
+ * a negative errno otherwise. */
+int
+wuring_init(wuring_t* ring, unsigned int entries,
+            unsigned int nbufs, unsigned int bufsz)
+__nonnull((1));
+
+/** Arms a multishot receive on <fd>, each incoming datagram
+ * will be handed to <fn> from wuring_poll */
+int
+wuring_recv_multishot(wuring_t* ring, int fd,
+                      wuring_recv_fn fn, void* udata)
+__nonnull((1, 3));
+
+/** Queues a sendmsg on <fd>. <msg> (and everything it points to)
+ * must stay valid until wuring_wait_sends returns. Nothing is
+ * handed to the kernel before the next wuring_submit/poll */
+int
+wuring_sendmsg(wuring_t* ring, int fd, struct msghdr* msg)
+__nonnull((1, 3));
+
+/** Submits all queued operations in a single syscall */
+int
+wuring_submit(wuring_t* ring)
+__nonnull((1));
+
+/** Waits until all queued/submitted sends have completed */
+int
+wuring_wait_sends(wuring_t* ring)
+__nonnull((1));
+
+/** Submits pending operations, waits up to <ms> milliseconds
+ * for completions and dispatches them. Returns the number
+ * of processed completions, or a negative errno */
+int
+wuring_poll(wuring_t* ring, int ms)
+__nonnull((1));
+
+/** Unmaps rings and buffers, and closes the io_uring descriptor */
+void
+wuring_close(wuring_t* ring)
+__nonnull((1));
+
+#ifdef __cplusplus
+}
+#endif
+#endif
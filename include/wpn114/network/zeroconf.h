@@ -2,63 +2,138 @@
 #define WPN_ZEROCONF_H
 
 #include <wpn114/alloc.h>
+#include <stdint.h>
+#include <netinet/in.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Minimal mDNS/DNS-SD (RFC 6762/6763) responder and browser,
+ * over IPv4 multicast. Everything is allocated upfront,
+ * the browser cache holds at most WZBROWSER_MAX_RESULTS services */
+
+#define WZ_MAXNAME 64
+#define WZ_DEFAULT_TYPE "_oscjson._tcp"
+
+#ifndef WZBROWSER_MAX_RESULTS
+#define WZBROWSER_MAX_RESULTS 64
+#endif
+#ifndef WZBROWSER_MAX_TARGETS
+#define WZBROWSER_MAX_TARGETS 8
+#endif
+
+enum wzerr {
+    WZ_NOERROR,
+    WZ_SOCKET_ERR,
+    WZ_NAME_TOO_LONG,
+    WZ_ADDR_INVALID,
+    WZ_NOT_RUNNING,
+    WZ_MAX_TARGETS
+};
+
+const char*
+wz_strerr(int err);
+
 typedef struct wzservice wzservice_t;
 
+/** Allocates <dst> pointer from <allocator> */
 extern int
-wzservice_malloc(wzservice_t** dst)
-__nonnull((1));
+wzservice_walloc(struct walloc_t* allocator, wzservice_t** dst)
+__nonnull((1, 2));
 
+/** Sets service type, "_oscjson._tcp" by default */
 extern int
-wzservice_palloc(struct wmemp_t* mp, wzservice_t** dst)
-__nonnull((1,2));
+wzservice_settype(wzservice_t* srv, const char* type)
+__nonnull((1, 2));
 
+/** Sets service instance name, defaults to the host name */
 extern int
-wzservice_settype(wzservice_t* srv, const char* type)
+wzservice_setname(wzservice_t* srv, const char* name)
 __nonnull((1, 2));
 
+/** Sets the (tcp) port advertised in the SRV record */
+extern int
+wzservice_setport(wzservice_t* srv, uint16_t port)
+__nonnull((1));
+
+/** Sets the (IPv4) address of the interface to advertise on,
+ * defaults to the first non-loopback one */
+extern int
+wzservice_setiface(wzservice_t* srv, const char* addr)
+__nonnull((1, 2));
+
+/** Opens the multicast socket and announces the service */
 extern int
 wzservice_publish(wzservice_t* srv)
 __nonnull((1));
 
+/** Answers queries for up to <ms> milliseconds */
 extern int
 wzservice_iter(wzservice_t* srv, int ms)
 __nonnull((1));
 
+/** Sends goodbye records, and closes the socket */
 extern int
 wzservice_stop(wzservice_t* srv)
 __nonnull((1));
 
 typedef struct wzbrowser wzbrowser_t;
 
-extern int
-wzbrowser_malloc(wzbrowser_t** dst)
-__nonnull((1));
+/* A resolved service */
+struct wzresult {
+    char name[WZ_MAXNAME];  // instance name
+    char host[WZ_MAXNAME];  // target host, e.g. "foo.local"
+    struct in_addr addr;
+    uint16_t port;
+    uint32_t ttl;           // remaining time-to-live (seconds)
+};
 
+/** Allocates <dst> pointer from <allocator> */
 extern int
-wzbrowser_palloc(struct wmemp_t* mp, wzbrowser_t** dst)
+wzbrowser_walloc(struct walloc_t* allocator, wzbrowser_t** dst)
 __nonnull((1, 2));
 
+/** Sets browsed service type, "_oscjson._tcp" by default */
 extern int
 wzbrowser_settype(wzbrowser_t* bws, const char* type)
 __nonnull((1, 2));
 
+/** Sets the (IPv4) address of the interface to browse on,
+ * defaults to the first non-loopback one */
+extern int
+wzbrowser_setiface(wzbrowser_t* bws, const char* addr)
+__nonnull((1, 2));
+
+/** Restricts results to instance name <target>,
+ * can be called up to WZBROWSER_MAX_TARGETS times */
 extern int
 wzbrowser_addtarget(wzbrowser_t* bws, const char* target)
 __nonnull((1, 2));
 
+/** Opens the multicast socket and starts querying */
 extern int
 wzbrowser_run(wzbrowser_t* bws)
 __nonnull((1));
 
+/** Processes responses, and sends scheduled queries
+ * (backing off from 1 second up to one hour, plus cache
+ * refreshes), for up to <ms> milliseconds */
 extern int
 wzbrowser_iter(wzbrowser_t* bws, int ms)
 __nonnull((1));
 
+/** Copies up to <max> resolved services into <dst>,
+ * returns their number */
+extern int
+wzbrowser_results(wzbrowser_t* bws, struct wzresult* dst, int max)
+__nonnull((1, 2));
+
+/** Closes the socket, cached results are kept */
+extern int
+wzbrowser_stop(wzbrowser_t* bws)
+__nonnull((1));
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,15 +16,17 @@ typedef uint8_t byte_t;
 // typetag/ctype        | description
 // ---------------------|------------------------------------------------------------------------------------------------
 // i: [int32_t]         | 32-bit big-endian two's complement integer.
-// t: []                | 64-bit big-endian fixed-point time tag, semantics defined below.
+// t: [uint64_t]        | 64-bit big-endian fixed-point time tag, semantics defined below.
 // f: [float]           | 32-bit big-endian IEEE 754 floating point number.
 // s: [const char*]     | A sequence of non-null ASCII characters followed by a null, followed by
 //                        0-3 additional null characters to make the total number of bits a multiple of 32.
-// b: []                | OSC-blob: An int32 size count, followed by that many 8-bit bytes of arbitrary binary
+// b: [wblob_t*]        | OSC-blob: An int32 size count, followed by that many 8-bit bytes of arbitrary binary
 //                        data, followed by 0-3 additional zero bytes to make the total number of bits a multiple of 32.
 // c: [char]            | An ASCII character, sent as 32-bits.
+// h: [int64_t]         | 64-bit big-endian two's complement integer.
+// d: [double]          | 64-bit ("double") IEEE 754 floating point number.
 // r: []                | 32-bit RGBA color.
-// m: [char[[4]]        | 4-bytes MIDI message. Bytes from MSB to LSB are: port id, status, data1, data2
+// m: [uint8_t[4]]     | 4-bytes MIDI message. Bytes from MSB to LSB are: port id, status, data1, data2
 // T: [bool]            | True. No bytes are allocated in the argument data.
 // F: [bool]            | False. No bytes are allocated in the argument data.
 // N: []                | Nil. No bytes are allocated in the argument data.
@@ -41,7 +43,9 @@ enum wtype_t {
     WOSC_TYPE_TRUE          = 'T',
     WOSC_TYPE_BLOB          = 'b',
     WOSC_TYPE_CHAR          = 'c',
+    WOSC_TYPE_DOUBLE        = 'd',
     WOSC_TYPE_FLOAT         = 'f',
+    WOSC_TYPE_INT64         = 'h',
     WOSC_TYPE_INT           = 'i',
     WOSC_TYPE_MIDI          = 'm',
     WOSC_TYPE_STRING        = 's',
@@ -50,11 +54,14 @@ enum wtype_t {
     WOSC_TYPE_VEC2F,    // [ff]
     WOSC_TYPE_VEC3F,    // [fff]
     WOSC_TYPE_VEC4F,    // [ffff]
+    WOSC_TYPE_FARRAY,   // [f...], variable length
+    WOSC_TYPE_IARRAY,   // [i...], variable length
+    WOSC_TYPE_STRVIEW,  // s, held by a pooled buffer
 };
 
 typedef struct {
-    uint16_t usd;
-    uint16_t cap;
+    uint16_t usd;   // string length
+    uint16_t cap;   // terminating zero included
     char dat[];
 } wstr_t;
 
@@ -62,12 +69,60 @@ int
 wstr_walloc(struct walloc_t* alloc, wstr_t** dst, uint16_t strlim)
 __nonnull((1, 2));
 
+/// max number of elements in an array value
+#define WARR_MAXLEN 1024
+
+/* Storage for vector and array values,
+ * elements are either all floats or all ints */
+typedef struct {
+    uint16_t len;   // number of elements
+    uint16_t cap;
+    union {
+        float f;
+        int32_t i;
+    } dat[];
+} warr_t;
+
+int
+warr_walloc(struct walloc_t* alloc, warr_t** dst, uint16_t cap)
+__nonnull((1, 2));
+
+/* Storage for blob values */
+typedef struct {
+    uint16_t len;
+    uint16_t cap;
+    byte_t dat[];
+} wblob_t;
+
+int
+wblob_walloc(struct walloc_t* alloc, wblob_t** dst, uint16_t cap)
+__nonnull((1, 2));
+
+struct wqbuf;
+struct wqbufs;
+
+/* Read-only view on a string, held by a reference-counted
+ * buffer from a pool (see wqtree_set_strpool) */
+typedef struct wstrv {
+    const char* dat;
+    uint32_t len;
+    struct wqbuf* buf;      // NULL for the empty string
+    struct wqbufs* pool;
+} wstrv_t;
+
 union wvariant_t {
     wstr_t* s;
+    warr_t* a;
+    wblob_t* bl;
+    wstrv_t* sv;
     float f;
     char c;
     bool b;
     int i;
+    int64_t h;
+    double d;
+    uint64_t t;
+    uint8_t m[4];
 };
 
 typedef struct {
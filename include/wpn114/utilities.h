@@ -3,7 +3,9 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <wpn114/wpn114.h>
 
 #define WCOLOR_REGULAR  "\x1B[0m"
@@ -47,4 +49,28 @@
     #define WPN_UNUSED
 #endif
 
+/* Monotonic clock, in nanoseconds */
+static inline uint64_t
+wpnclock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+/* Spinlock, for critical sections of a few stores */
+static inline void
+wpnspin_lock(int* lock)
+{
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED))
+            ;
+}
+
+static inline void
+wpnspin_unlock(int* lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
 #endif
@@ -5,7 +5,7 @@ int
 walloc_dynamic(void* dst, size_t nbytes,
                WPN_UNUSED void* data)
 {
-    return -((dst = malloc(nbytes)) == NULL);
+    return -((*(void**)dst = malloc(nbytes)) == NULL);
 }
 
 int
@@ -19,7 +19,7 @@ int
 wfree_dynamic(void* dst, WPN_UNUSED size_t nbytes,
               WPN_UNUSED void* data)
 {
-    free(dst);
+    free(*(void**)dst);
     return 0;
 }
 
@@ -28,8 +28,8 @@ wfree_memp(void* dst, size_t nbytes, void* data)
 {
     int err;
     struct wmemp_t* mp = data;
-    if (!(err = wmemp_free(mp, dst, nbytes)))
-        dst = NULL;
+    if (!(err = wmemp_free(mp, *(void**)dst, nbytes)))
+        *(void**)dst = NULL;
     return err;
 }
 
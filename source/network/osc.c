@@ -1,5 +1,6 @@
 #include <wpn114/network/osc.h>
 #include <wpn114/utilities.h>
+#include <arpa/inet.h>
 
 enum womsg_err {
     WOMSG_NOERROR,
@@ -8,7 +9,8 @@ enum womsg_err {
     WOMSG_TAG_MISMATCH,
     WOMSG_TAG_END,
     WOMSG_BUFFER_OVERFLOW,
-    WOMSG_URI_INVALID
+    WOMSG_URI_INVALID,
+    WOSTREAM_FRAME_TOO_LARGE
 };
 
 int
@@ -23,15 +25,295 @@ wuri_check(const char* uri)
     return 0;
 }
 
+// ------------------------------------------------------------------------------------------------
+// URI SCANNING
+// ------------------------------------------------------------------------------------------------
+
+// methods are scanned a block at a time (16 or 32 bytes), looking for
+// '/' and NUL. Loads are aligned, so that they never cross a page
+// boundary, bytes before the start of the method are masked out.
+// Kernels are picked on first use, from what the cpu supports
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WURI_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define WURI_NEON
+#endif
+
+// aligned blocks may be read past the end of the method
+#define WURI_NOASAN __attribute__((no_sanitize_address))
+#define WURI_KERNEL WURI_NOASAN __always_inline
+
+// block masks: bit n is set when byte n is a '/', <nul> for NUL
+typedef uint64_t (*wuri_maskfn)(const char* p, uint64_t* nul);
+
+// first '/' or NUL at or after <s>
+static WURI_KERNEL const char*
+wuri_find_w(const char* s, wuri_maskfn masks, int w)
+{
+    const char* p = (const char*)((uintptr_t) s & ~(uintptr_t)(w-1));
+    unsigned sh = s-p;
+    uint64_t nul, m = masks(p, &nul);
+    m = (m | nul) >> sh << sh;
+    while (m == 0) {
+        p += w;
+        m = masks(p, &nul);
+        m |= nul;
+    }
+    return p + __builtin_ctzll(m);
+}
+
+// number of '/', sets <last> to the last one
+static WURI_KERNEL int
+wuri_count_w(const char* s, const char** last,
+             wuri_maskfn masks, int w)
+{
+    const char* p = (const char*)((uintptr_t) s & ~(uintptr_t)(w-1));
+    unsigned sh = s-p;
+    int count = 0;
+    uint64_t nul, m = masks(p, &nul);
+    m = m >> sh << sh;
+    nul = nul >> sh << sh;
+    for (;;) {
+        if (nul)
+            // bytes past the end of the method
+            m &= (nul & -nul)-1;
+        if (m) {
+            count += __builtin_popcountll(m);
+            *last = p + 63-__builtin_clzll(m);
+        }
+        if (nul)
+            return count;
+        p += w;
+        m = masks(p, &nul);
+    }
+}
+
+static WURI_KERNEL int
+wuri_scan_w(const char* s, struct wuri_segs* dst,
+            wuri_maskfn masks, int w)
+{
+    const char* p = (const char*)((uintptr_t) s & ~(uintptr_t)(w-1));
+    unsigned sh = s-p;
+    uint64_t nul, m = masks(p, &nul);
+    m = m >> sh << sh;
+    nul = nul >> sh << sh;
+    dst->n = 0;
+    for (;;) {
+        if (nul)
+            m &= (nul & -nul)-1;
+        for (; m; m &= m-1) {
+             uint32_t off = p + __builtin_ctzll(m) - s;
+             if (dst->n == WURI_MAXSEGS) {
+                 // more segments than we can describe
+                 dst->offs[dst->n] = off;
+                 dst->len = 0;
+                 return dst->n;
+             }
+             dst->offs[dst->n++] = off;
+        }
+        if (nul) {
+            dst->len = p + __builtin_ctzll(nul) - s;
+            dst->offs[dst->n] = dst->len;
+            return dst->n;
+        }
+        p += w;
+        m = masks(p, &nul);
+    }
+}
+
+#define WURI_DECL_KERNELS(_isa, _w, _attr)                                      \
+    _attr WURI_NOASAN static const char*                                        \
+    wuri_find_##_isa(const char* s)                                             \
+    { return wuri_find_w(s, wuri_masks_##_isa, _w); }                           \
+    _attr WURI_NOASAN static int                                                \
+    wuri_count_##_isa(const char* s, const char** last)                         \
+    { return wuri_count_w(s, last, wuri_masks_##_isa, _w); }                    \
+    _attr WURI_NOASAN static int                                                \
+    wuri_scan_##_isa(const char* s, struct wuri_segs* dst)                      \
+    { return wuri_scan_w(s, dst, wuri_masks_##_isa, _w); }
+
+#ifdef WURI_X86
+static WURI_KERNEL uint64_t
+wuri_masks_sse2(const char* p, uint64_t* nul)
+{
+    __m128i v = _mm_load_si128((const __m128i*) p);
+    *nul = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    return (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+}
+
+#define WURI_AVX2 __attribute__((target("avx2")))
+
+static WURI_AVX2 WURI_KERNEL uint64_t
+wuri_masks_avx2(const char* p, uint64_t* nul)
+{
+    __m256i v = _mm256_load_si256((const __m256i*) p);
+    *nul = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    return (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+}
+
+WURI_DECL_KERNELS(sse2, 16, __attribute__((target("sse2"))))
+WURI_DECL_KERNELS(avx2, 32, WURI_AVX2)
+#endif
+
+#ifdef WURI_NEON
+// no movemask: bytes are weighted by their bit, then summed per half
+static WURI_KERNEL uint64_t
+wuri_movemask_neon(uint8x16_t v)
+{
+    static const uint8_t bits[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    uint8x16_t b = vandq_u8(v, vld1q_u8(bits));
+    return vaddv_u8(vget_low_u8(b)) | (uint64_t) vaddv_u8(vget_high_u8(b)) << 8;
+}
+
+static WURI_KERNEL uint64_t
+wuri_masks_neon(const char* p, uint64_t* nul)
+{
+    uint8x16_t v = vld1q_u8((const uint8_t*) p);
+    *nul = wuri_movemask_neon(vceqq_u8(v, vdupq_n_u8(0)));
+    return wuri_movemask_neon(vceqq_u8(v, vdupq_n_u8('/')));
+}
+
+WURI_DECL_KERNELS(neon, 16, )
+#endif
+
+static const char*
+wuri_find_scalar(const char* s)
+{
+    while (*s != '/' && *s != 0)
+        s++;
+    return s;
+}
+
+static int
+wuri_count_scalar(const char* s, const char** last)
+{
+    int count = 0;
+    for (; *s; ++s) {
+         if (*s == '/') {
+             *last = s;
+             count++;
+         }
+    }
+    return count;
+}
+
+static int
+wuri_scan_scalar(const char* s, struct wuri_segs* dst)
+{
+    const char* c = s;
+    dst->n = 0;
+    for (; *c; ++c) {
+         if (*c != '/')
+             continue;
+         if (dst->n == WURI_MAXSEGS) {
+             dst->offs[dst->n] = c-s;
+             dst->len = 0;
+             return dst->n;
+         }
+         dst->offs[dst->n++] = c-s;
+    }
+    dst->len = c-s;
+    dst->offs[dst->n] = dst->len;
+    return dst->n;
+}
+
+struct wuri_kernels {
+    const char* isa;
+    const char* (*find)(const char*);
+    int (*count)(const char*, const char**);
+    int (*scan)(const char*, struct wuri_segs*);
+};
+
+#define WURI_KERNELS(_isa) \
+    { #_isa, wuri_find_##_isa, wuri_count_##_isa, wuri_scan_##_isa }
+
+// picked in this order: methods rarely run past 64 bytes,
+// 32 bytes blocks turned out no faster than 16 bytes ones
+static const struct wuri_kernels
+s_wuri_kernels[] = {
+#ifdef WURI_X86
+    WURI_KERNELS(sse2),
+    WURI_KERNELS(avx2),
+#endif
+#ifdef WURI_NEON
+    WURI_KERNELS(neon),
+#endif
+    WURI_KERNELS(scalar),
+};
+
+#define WURI_NKERNELS (sizeof(s_wuri_kernels)/sizeof(struct wuri_kernels))
+
+static const struct wuri_kernels* s_wuri;
+
+static bool
+wuri_supports(const struct wuri_kernels* k)
+{
+#ifdef WURI_X86
+    if (k->find == wuri_find_avx2)
+        return __builtin_cpu_supports("avx2");
+#if defined(__i386__)
+    if (k->find == wuri_find_sse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+#endif
+    return true;
+}
+
+static __always_inline const struct wuri_kernels*
+wuri_kernels(void)
+{
+    const struct wuri_kernels* k = __atomic_load_n(&s_wuri, __ATOMIC_RELAXED);
+    if (__builtin_expect(k == NULL, 0)) {
+        k = &s_wuri_kernels[WURI_NKERNELS-1];
+        for (size_t n = 0; n < WURI_NKERNELS; ++n) {
+             if (wuri_supports(&s_wuri_kernels[n])) {
+                 k = &s_wuri_kernels[n];
+                 break;
+             }
+        }
+        __atomic_store_n(&s_wuri, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+const char*
+wuri_get_isa(void)
+{
+    return wuri_kernels()->isa;
+}
+
+int
+wuri_set_isa(const char* isa)
+{
+    for (size_t n = 0; n < WURI_NKERNELS; ++n) {
+         if (strcmp(s_wuri_kernels[n].isa, isa) == 0) {
+             if (!wuri_supports(&s_wuri_kernels[n]))
+                 break;
+             __atomic_store_n(&s_wuri, &s_wuri_kernels[n], __ATOMIC_RELAXED);
+             return 0;
+         }
+    }
+    return WOMSG_URI_INVALID;
+}
+
+int
+wuri_scan(const char* uri, struct wuri_segs* dst)
+{
+    return wuri_kernels()->scan(uri, dst);
+}
+
 int
 wuri_seglen(const char* uri)
 {
     const char* ucpy = uri;
     if (*ucpy == '/')
         ucpy++;
-    while (*ucpy != '/' && *ucpy != 0)
-        ucpy++;
-    return ucpy-uri;
+    return wuri_kernels()->find(ucpy)-uri;
 }
 
 int
@@ -51,31 +333,25 @@ wuri_segcmp(const char* u1, const char* u2, int* len)
 int
 wuri_depth(const char* uri)
 {
-    unsigned int depth = 0;
-    while (*uri)
-        if (*uri++ == '/')
-            depth++;
-    return depth;
+    const char* last;
+    return wuri_kernels()->count(uri, &last);
 }
 
 bool
 wuri_depth_eq(const char* uri, unsigned int eq)
 {
-    unsigned int depth = 0;
-    while (*uri)
-        if (*uri++ == '/')
-            if (++depth > eq)
-                return false;
-    return depth == eq;
+    return (unsigned int) wuri_depth(uri) == eq;
 }
 
 const char*
 wuri_last(const char* uri)
 {
-    int len = strlen(uri);
-    const char* last = &uri[len-1];
-    while (*--last != '/')
-          ;
+    const char* last = uri;
+    wuri_kernels()->count(uri, &last);
+    // a trailing '/' doesn't start a segment
+    if (last[1] == 0 && last != uri)
+        while (*--last != '/')
+              ;
     return last;
 }
 
@@ -107,6 +383,8 @@ wosc_strerr(int err)
         return "buffer overflow";
     case WOMSG_URI_INVALID:
         return "invalid method/uri";
+    case WOSTREAM_FRAME_TOO_LARGE:
+        return "stream packet exceeds WOSTREAM_MAXLEN";
     default:
         return "unknown error code";
     }
@@ -118,7 +396,7 @@ struct womsg {
     unsigned short ble;  // total buffer length (in bytes)
     unsigned short usd;  // used length (in bytes)
     unsigned short tag;  // tag index (in bytes) (0 is comma)
-    byte_t idx;          // data index
+    unsigned short idx;  // data index
     byte_t mode;         // read-write mode
 };
 
@@ -158,17 +436,27 @@ womsg_printraw(struct womsg* dst)
 int
 womsg_decode(struct womsg* dst, byte_t* src, uint32_t len)
 {
-    int ulen, tlen;
+    uint32_t ulen, tlen;
     dst->buf = src;
     dst->ble = len;
     dst->usd = len;
+    dst->idx = 0;
     dst->mode = WOMSG_R;
 
-    ulen = strlen((char*)src);
+    // packets come from the network, uri and typetag
+    // have to be terminated within them
+    if (len < 4 || src[0] != '/')
+        return WOMSG_URI_INVALID;
+    if ((ulen = strnlen((char*)src, len)) == len)
+        return WOMSG_BUFFER_OVERFLOW;
     ulen += womsg_npads(ulen);
+    if (ulen >= len || src[ulen] != ',')
+        return WOMSG_TAG_MISMATCH;
     dst->tag = ulen;
 
-    tlen = strlen((char*)&src[ulen])+1;
+    // like the uri, typetag is padded with 1 to 4 zeros
+    if ((tlen = strnlen((char*)&src[ulen], len-ulen)) == len-ulen)
+        return WOMSG_BUFFER_OVERFLOW;
     tlen += womsg_npads(tlen);
     dst->rwi = &src[ulen+tlen];
 
@@ -257,10 +545,10 @@ womsg_gettag(struct womsg* msg)
 }
 
 static inline int
-womsg_checkw(struct womsg* msg, char tag, byte_t tpsz)
+womsg_checkw(struct womsg* msg, char tag, uint32_t tpsz)
 {
     // check if <msg> is in write mode
-    int nsz = msg->usd+tpsz;
+    uint32_t nsz = msg->usd+tpsz;
     if (msg->mode > WOMSG_W)
         return WOMSG_READ_ONLY;
     if (msg->mode == WOMSG_WTAGLOCKED) {
@@ -274,14 +562,15 @@ womsg_checkw(struct womsg* msg, char tag, byte_t tpsz)
         // don't forget to add +1 for newtag!
         nsz++;
     }
-    // finally, check if there's enough space in the buffer
-    if (nsz > msg->ble)
+    // finally, check if there's enough space in the buffer,
+    // which also keeps <usd> within its unsigned short
+    if (tpsz > msg->ble || nsz > msg->ble)
         return WOMSG_BUFFER_OVERFLOW;
     return 0;
 }
 
 static inline int
-womsg_write(struct womsg* msg, void* value, size_t sz)
+womsg_write(struct womsg* msg, const void* value, size_t sz)
 {
     memcpy(msg->rwi, value, sz);
     msg->rwi += sz;
@@ -336,6 +625,66 @@ womsg_writec(struct womsg* msg, char value)
     return err;
 }
 
+int
+womsg_writeh(struct womsg* msg, int64_t value)
+{
+    int err;
+    if (!(err = womsg_checkw(msg, 'h', sizeof(int64_t))))
+        womsg_write(msg, &value, sizeof(int64_t));
+    return err;
+}
+
+int
+womsg_writed(struct womsg* msg, double value)
+{
+    int err;
+    if (!(err = womsg_checkw(msg, 'd', sizeof(double))))
+        womsg_write(msg, &value, sizeof(double));
+    return err;
+}
+
+int
+womsg_writet(struct womsg* msg, uint64_t value)
+{
+    int err;
+    if (!(err = womsg_checkw(msg, 't', sizeof(uint64_t))))
+        womsg_write(msg, &value, sizeof(uint64_t));
+    return err;
+}
+
+int
+womsg_writem(struct womsg* msg, const uint8_t midi[4])
+{
+    int err;
+    if (!(err = womsg_checkw(msg, 'm', 4)))
+        womsg_write(msg, midi, 4);
+    return err;
+}
+
+// unlike strings, blobs are padded with 0 to 3 zeros
+static __always_inline int
+womsg_blobpads(uint32_t len) { return (4-(len%4)) & 3; }
+
+int
+womsg_writeblob(struct womsg* msg, const void* data, uint32_t len)
+{
+    int err, npads = womsg_blobpads(len);
+    int32_t sz = len;
+    // size + data + pads can't wrap around past this
+    if (len > msg->ble)
+        return WOMSG_BUFFER_OVERFLOW;
+    if (!(err = womsg_checkw(msg, 'b', sizeof(int32_t)+len+npads))) {
+        memcpy(msg->rwi, &sz, sizeof(int32_t));
+        msg->rwi += sizeof(int32_t);
+        msg->usd += sizeof(int32_t);
+        womsg_write(msg, data, len);
+        if (msg->mode < WOMSG_R)
+            msg->rwi += npads;
+        msg->usd += npads;
+    }
+    return err;
+}
+
 int
 womsg_writeb(struct womsg* msg, bool value)
 {
@@ -362,6 +711,78 @@ womsg_writes(struct womsg* msg, const char* str)
     return 0;
 }
 
+int
+womsg_writev(struct womsg* msg, wvalue_t v)
+{
+    switch (v.t) {
+    case WOSC_TYPE_INT:
+        return womsg_writei(msg, v.u.i);
+    case WOSC_TYPE_FLOAT:
+        return womsg_writef(msg, v.u.f);
+    case WOSC_TYPE_CHAR:
+        return womsg_writec(msg, v.u.c);
+    case WOSC_TYPE_STRING:
+        return womsg_writes(msg, v.u.s->dat);
+    case WOSC_TYPE_STRVIEW:
+        return womsg_writes(msg, v.u.sv->dat);
+    case WOSC_TYPE_INT64:
+        return womsg_writeh(msg, v.u.h);
+    case WOSC_TYPE_DOUBLE:
+        return womsg_writed(msg, v.u.d);
+    case WOSC_TYPE_TIMETAG:
+        return womsg_writet(msg, v.u.t);
+    case WOSC_TYPE_MIDI:
+        return womsg_writem(msg, v.u.m);
+    case WOSC_TYPE_BLOB:
+        return womsg_writeblob(msg, v.u.bl->dat, v.u.bl->len);
+    case WOSC_TYPE_VEC2F:
+    case WOSC_TYPE_VEC3F:
+    case WOSC_TYPE_VEC4F:
+    case WOSC_TYPE_FARRAY:
+        return womsg_writea(msg, 'f', v.u.a->dat, v.u.a->len);
+    case WOSC_TYPE_IARRAY:
+        return womsg_writea(msg, 'i', v.u.a->dat, v.u.a->len);
+    case WOSC_TYPE_TRUE:
+    case WOSC_TYPE_FALSE:
+    case WOSC_TYPE_BOOL:
+        // carried by the tag only
+        return msg->mode == WOMSG_WTAGLOCKED ? 0 : WOMSG_TAG_MISMATCH;
+    default:
+        return WOMSG_TAG_MISMATCH;
+    }
+}
+
+// counts <etype> tags of the array opening at next tag
+static int
+womsg_arrlen(struct womsg* msg, char etype)
+{
+    const char* tag = _tagnc(msg)+msg->idx+1;
+    int n = 0;
+    while (tag[n] == etype)
+        n++;
+    return tag[n] == ']' ? n : -1;
+}
+
+int
+womsg_writea(struct womsg* msg, char etype, const void* data, int n)
+{
+    int err;
+    // arrays can only be written against a locked tag
+    if (msg->mode == WOMSG_WTAGFREE)
+        return WOMSG_TAG_MISMATCH;
+    if (n < 0 || n > msg->ble/4)
+        return WOMSG_BUFFER_OVERFLOW;
+    if ((err = womsg_checkw(msg, '[', n*4)))
+        return err;
+    if (womsg_arrlen(msg, etype) != n)
+        return WOMSG_TAG_MISMATCH;
+    // skip to the closing bracket, which
+    // womsg_write steps over
+    msg->idx += n+1;
+    womsg_write(msg, data, n*4);
+    return 0;
+}
+
 static int
 womsg_checkr(struct womsg* msg, char tp)
 {
@@ -379,9 +800,12 @@ womsg_checkr(struct womsg* msg, char tp)
     return 0;
 }
 
+// arguments must be contained in the received packet
 static inline int
 womsg_read(struct womsg* msg, void* dst, size_t tpsz)
 {
+    if (msg->rwi + tpsz > msg->buf + msg->usd)
+        return WOMSG_BUFFER_OVERFLOW;
     memcpy(dst, msg->rwi, tpsz);
     msg->idx++;
     msg->rwi += tpsz;
@@ -393,7 +817,7 @@ womsg_readi(struct womsg* msg, int32_t* dst)
 {    
     int err;
     if (!(err = womsg_checkr(msg, 'i')))
-        womsg_read(msg, dst, sizeof(int32_t));
+        err = womsg_read(msg, dst, sizeof(int32_t));
     return err;
 }
 
@@ -402,7 +826,7 @@ womsg_readf(struct womsg* msg, float* dst)
 {
     int err;
     if (!(err = womsg_checkr(msg, 'f')))
-        womsg_read(msg, dst, sizeof(float));
+        err = womsg_read(msg, dst, sizeof(float));
     return err;
 }
 
@@ -421,10 +845,9 @@ int
 womsg_readc(struct womsg* msg, char* dst)
 {
     int err, c;
-    if (!(err = womsg_checkr(msg, 'c'))) {
-        womsg_read(msg, &c, sizeof(int32_t));
+    if (!(err = womsg_checkr(msg, 'c')) &&
+        !(err = womsg_read(msg, &c, sizeof(int32_t))))
         *dst = (char) c;
-    }
     return err;
 }
 
@@ -433,16 +856,93 @@ womsg_reads(struct womsg* msg, char** dst)
 {
     int err;
     if (!(err = womsg_checkr(msg, 's'))) {
+        byte_t* end = msg->buf + msg->usd;
+        int len;
+        if (msg->rwi >= end || !memchr(msg->rwi, 0, end - msg->rwi))
+            return WOMSG_BUFFER_OVERFLOW;
+        len = strlen((char*)msg->rwi);
         *dst = (char*)msg->rwi;
+        msg->rwi += len+womsg_npads(len);
         msg->idx++;
     }
     return err;
 }
 
+int
+womsg_readh(struct womsg* msg, int64_t* dst)
+{
+    int err;
+    if (!(err = womsg_checkr(msg, 'h')))
+        err = womsg_read(msg, dst, sizeof(int64_t));
+    return err;
+}
+
+int
+womsg_readd(struct womsg* msg, double* dst)
+{
+    int err;
+    if (!(err = womsg_checkr(msg, 'd')))
+        err = womsg_read(msg, dst, sizeof(double));
+    return err;
+}
+
+int
+womsg_readt(struct womsg* msg, uint64_t* dst)
+{
+    int err;
+    if (!(err = womsg_checkr(msg, 't')))
+        err = womsg_read(msg, dst, sizeof(uint64_t));
+    return err;
+}
+
+int
+womsg_readm(struct womsg* msg, uint8_t dst[4])
+{
+    int err;
+    if (!(err = womsg_checkr(msg, 'm')))
+        err = womsg_read(msg, dst, 4);
+    return err;
+}
+
+int
+womsg_readblob(struct womsg* msg, const byte_t** data, uint32_t* len)
+{
+    int err;
+    int32_t sz;
+    if ((err = womsg_checkr(msg, 'b')))
+        return err;
+    if (msg->rwi + sizeof(int32_t) > msg->buf + msg->usd)
+        return WOMSG_BUFFER_OVERFLOW;
+    memcpy(&sz, msg->rwi, sizeof(int32_t));
+    if (sz < 0 || msg->rwi + sizeof(int32_t) + sz > msg->buf + msg->usd)
+        return WOMSG_BUFFER_OVERFLOW;
+    *data = msg->rwi + sizeof(int32_t);
+    *len = sz;
+    msg->rwi += sizeof(int32_t) + sz + womsg_blobpads(sz);
+    msg->idx++;
+    return 0;
+}
+
+int
+womsg_reada(struct womsg* msg, char etype, const void** data, int* n)
+{
+    int err;
+    if ((err = womsg_checkr(msg, '[')))
+        return err;
+    if ((*n = womsg_arrlen(msg, etype)) < 0)
+        return WOMSG_TAG_MISMATCH;
+    if (msg->rwi + *n*4 > msg->buf + msg->usd)
+        return WOMSG_BUFFER_OVERFLOW;
+    *data = msg->rwi;
+    msg->rwi += *n*4;
+    msg->idx += *n+2;
+    return 0;
+}
+
 int
 womsg_readv(struct womsg* msg, wvalue_t* v)
 {
-    v->t = *womsg_gettag(msg);
+    v->t = _nexttag(msg);
     switch (v->t) {
     case WOSC_TYPE_INT:
         return womsg_readi(msg, &v->u.i);
@@ -457,12 +957,146 @@ womsg_readv(struct womsg* msg, wvalue_t* v)
         int err;
         char* s;
         if (!(err = womsg_reads(msg, &s))) {
-            if (strlen(s) > v->u.s->cap)
-                return 32;
-            strcpy(v->u.s->dat, s);
+            int len = strlen(s);
+            if (len >= v->u.s->cap)
+                return WOMSG_BUFFER_OVERFLOW;
+            memcpy(v->u.s->dat, s, len+1);
+            v->u.s->usd = len;
+        }
+        return err;
+    }
+    case WOSC_TYPE_INT64:
+        return womsg_readh(msg, &v->u.h);
+    case WOSC_TYPE_DOUBLE:
+        return womsg_readd(msg, &v->u.d);
+    case WOSC_TYPE_TIMETAG:
+        return womsg_readt(msg, &v->u.t);
+    case WOSC_TYPE_MIDI:
+        return womsg_readm(msg, v->u.m);
+    case WOSC_TYPE_BLOB: {
+        int err;
+        const byte_t* dat;
+        uint32_t len;
+        if (!(err = womsg_readblob(msg, &dat, &len))) {
+            if (len > v->u.bl->cap)
+                return WOMSG_BUFFER_OVERFLOW;
+            memcpy(v->u.bl->dat, dat, len);
+            v->u.bl->len = len;
         }
         return err;
     }
     default: return 1;
     }
 }
+
+// ------------------------------------------------------------------------------------------------
+// STREAM FRAMING
+// ------------------------------------------------------------------------------------------------
+
+#define SLIP_END        0xc0
+#define SLIP_ESC        0xdb
+#define SLIP_ESC_END    0xdc
+#define SLIP_ESC_ESC    0xdd
+
+void
+wodeframer_init(wodeframer_t* dfr, enum wostream_t framing)
+{
+    memset(dfr, 0, sizeof(wodeframer_t));
+    dfr->framing = framing;
+}
+
+static int
+wodeframe_length(byte_t* buf, uint32_t len, wostream_fn fn, void* udt)
+{
+    uint32_t pos = 0, sz;
+    while (len-pos >= sizeof(uint32_t)) {
+        memcpy(&sz, &buf[pos], sizeof(uint32_t));
+        sz = ntohl(sz);
+        if (sz > WOSTREAM_MAXLEN)
+            return -WOSTREAM_FRAME_TOO_LARGE;
+        if (len-pos-sizeof(uint32_t) < sz)
+            break;
+        pos += sizeof(uint32_t);
+        if (sz)
+            fn(&buf[pos], sz, udt);
+        pos += sz;
+    }
+    return pos;
+}
+
+static int
+wodeframe_slip(wodeframer_t* dfr, byte_t* buf, uint32_t len,
+               wostream_fn fn, void* udt)
+{
+    // decoded bytes of the current packet are in [0, wr),
+    // its remaining raw bytes in [rd, len), wr <= rd
+    uint32_t start = 0;
+    for (uint32_t n = dfr->rd; n < len; ++n) {
+        byte_t b = buf[n];
+        if (dfr->esc) {
+            dfr->esc = false;
+            b = b == SLIP_ESC_END ? SLIP_END :
+                b == SLIP_ESC_ESC ? SLIP_ESC : b;
+        } else if (b == SLIP_ESC) {
+            dfr->esc = true;
+            continue;
+        } else if (b == SLIP_END) {
+            // empty packets are just leading END bytes
+            if (dfr->wr > start)
+                fn(&buf[start], dfr->wr-start, udt);
+            start = dfr->wr = n+1;
+            continue;
+        }
+        if (dfr->wr-start == WOSTREAM_MAXLEN)
+            return -WOSTREAM_FRAME_TOO_LARGE;
+        buf[dfr->wr++] = b;
+    }
+    dfr->rd = len-start;
+    dfr->wr -= start;
+    return start;
+}
+
+int
+wodeframe(wodeframer_t* dfr, byte_t* buf, uint32_t len,
+          wostream_fn fn, void* udt)
+{
+    if (dfr->framing == WOSTREAM_SLIP)
+        return wodeframe_slip(dfr, buf, len, fn, udt);
+    else
+        return wodeframe_length(buf, len, fn, udt);
+}
+
+int
+woframe(enum wostream_t framing, const byte_t* src, uint32_t len,
+        byte_t* dst, uint32_t cap)
+{
+    uint32_t pos = 0;
+    if (framing == WOSTREAM_LENGTH) {
+        uint32_t sz = htonl(len);
+        if (cap < len+sizeof(uint32_t))
+            return -WOMSG_BUFFER_OVERFLOW;
+        memcpy(dst, &sz, sizeof(uint32_t));
+        memcpy(&dst[sizeof(uint32_t)], src, len);
+        return len+sizeof(uint32_t);
+    }
+    // worst case: every byte is escaped
+    if (cap < 2*len+2)
+        return -WOMSG_BUFFER_OVERFLOW;
+    dst[pos++] = SLIP_END;
+    for (uint32_t n = 0; n < len; ++n) {
+        switch (src[n]) {
+        case SLIP_END:
+            dst[pos++] = SLIP_ESC;
+            dst[pos++] = SLIP_ESC_END;
+            break;
+        case SLIP_ESC:
+            dst[pos++] = SLIP_ESC;
+            dst[pos++] = SLIP_ESC_ESC;
+            break;
+        default:
+            dst[pos++] = src[n];
+        }
+    }
+    dst[pos++] = SLIP_END;
+    return pos;
+}
@@ -1,7 +1,19 @@
+#define _GNU_SOURCE // recvmmsg
 #include <wpn114/network/oscquery.h>
+#include <wpn114/network/record.h>
 #include <wpn114/utilities.h>
 #include <dependencies/mjson/mjson.h>
 #include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <errno.h>
+#include <math.h>
 
 const char*
 wquery_strerr(int err)
@@ -18,6 +30,24 @@ wquery_strerr(int err)
     case WQUERY_URI_INVALID:
         return "invalid uri format, "
                "check invalid characters";
+    case WQUERY_THREADERR:
+        return "could not spawn worker thread";
+    case WQUERY_ADDR_INVALID:
+        return "invalid address, or not a multicast group";
+    case WQUERY_SNAPSHOT_INVALID:
+        return "invalid or truncated snapshot";
+    case WQUERY_SNAPSHOT_OVERFLOW:
+        return "snapshot buffer is too small";
+    case WQUERY_SNAPSHOT_COLLISION:
+        return "two tree uris share the same hash";
+    case WQUERY_FILE_ERR:
+        return "could not open or map file";
+    case WQUERY_RAMP_FULL:
+        return "max number of active ramps reached";
+    case WQUERY_POOL_EMPTY:
+        return "no buffer left in the string pool";
+    case WQUERY_REPLAY_SPEED:
+        return "replay speed is invalid or too low for the log span";
     default:
         return "unsupported error code";
     }
@@ -36,12 +66,278 @@ wstr_walloc(struct walloc_t* _allocator, wstr_t** dst, uint16_t strlim)
     return err;
 }
 
+int
+wblob_walloc(struct walloc_t* _allocator, wblob_t** dst, uint16_t cap)
+{
+    int err;
+    if ((err = _allocator->alloc(dst,
+                sizeof(wblob_t)+cap,
+               _allocator->data)) >= 0) {
+        memset(*dst, 0, sizeof(wblob_t)+cap);
+        (*dst)->cap = cap;
+    }
+    return err;
+}
+
+int
+warr_walloc(struct walloc_t* _allocator, warr_t** dst, uint16_t cap)
+{
+    int err;
+    size_t sz = sizeof(warr_t) + cap*sizeof((*dst)->dat[0]);
+    if (cap > WARR_MAXLEN)
+        return -WQUERY_ATTR_UNSUPPORTED;
+    if ((err = _allocator->alloc(dst, sz, _allocator->data)) >= 0) {
+        memset(*dst, 0, sz);
+        (*dst)->cap = cap;
+    }
+    return err;
+}
+
+// ------------------------------------------------------------------------------------------------
+// TRACE
+// ------------------------------------------------------------------------------------------------
+
+// begin/end events of the server hot path, for timeline views: each
+// thread writes into its own ring (single writer, no lock), oldest
+// events being overwritten. timestamps are raw cpu ticks (rdtsc on
+// x86), only converted to microseconds when written out, against the
+// monotonic clock. compiled out entirely unless WQUERY_TRACE is defined
+
+enum wqt_event {
+    WQT_POLL, WQT_DECODE, WQT_LOOKUP, WQT_FN, WQT_JSON, WQT_NEVENTS
+};
+
+#ifdef WQUERY_TRACE
+
+#ifndef WQUERY_TRACE_RINGSZ
+#define WQUERY_TRACE_RINGSZ 65536   // events per thread, power of two
+#endif
+
+#ifndef WQUERY_TRACE_THREADS
+#define WQUERY_TRACE_THREADS 16
+#endif
+
+struct wqtevent {
+    uint64_t ticks;
+    uint32_t event;
+    uint32_t phase;                 // 'B'egin or 'E'nd
+};
+
+struct wqtring {
+    uint64_t head;                  // events written, ever
+    struct wqtevent ev[WQUERY_TRACE_RINGSZ];
+};
+
+struct wqtclock {
+    uint64_t ticks;
+    uint64_t ns;
+};
+
+static struct wqtring s_wqt_rings[WQUERY_TRACE_THREADS];
+static int s_wqt_nrings;
+static int s_wqt_on;
+static struct wqtclock s_wqt_start, s_wqt_stop;
+
+// rings are claimed on first event, threads
+// past WQUERY_TRACE_THREADS are not traced
+static __thread struct wqtring* t_wqt;
+static __thread bool t_wqt_none;
+
+static const char*
+s_wqt_names[] = {
+    "mg_mgr_poll", "womsg_decode", "wqtree_get_node", "wqnode_fn", "json"
+};
+
+static __always_inline uint64_t
+wqt_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return wpnclock_ns();
+#endif
+}
+
+static __always_inline void
+wqt_clock(struct wqtclock* c)
+{
+    c->ticks = wqt_ticks();
+    c->ns = wpnclock_ns();
+}
+
+static inline void
+wqt_record(enum wqt_event event, char phase)
+{
+    struct wqtring* r = t_wqt;
+    uint64_t h;
+    if (!__atomic_load_n(&s_wqt_on, __ATOMIC_RELAXED))
+        return;
+    if (r == NULL) {
+        int n;
+        if (t_wqt_none)
+            return;
+        n = __atomic_fetch_add(&s_wqt_nrings, 1, __ATOMIC_RELAXED);
+        if (n >= WQUERY_TRACE_THREADS) {
+            t_wqt_none = true;
+            return;
+        }
+        r = t_wqt = &s_wqt_rings[n];
+    }
+    h = r->head;
+    r->ev[h & (WQUERY_TRACE_RINGSZ-1)] = (struct wqtevent) {
+        wqt_ticks(), event, phase
+    };
+    __atomic_store_n(&r->head, h+1, __ATOMIC_RELEASE);
+}
+
+#define wqt_begin(_e)   wqt_record(_e, 'B')
+#define wqt_end(_e)     wqt_record(_e, 'E')
+
+int
+wqtrace_start(void)
+{
+    // previous events are not cleared (rings belong to
+    // their threads), only the ones from now on are written
+    wqt_clock(&s_wqt_start);
+    __atomic_store_n(&s_wqt_on, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int
+wqtrace_stop(void)
+{
+    if (__atomic_exchange_n(&s_wqt_on, 0, __ATOMIC_ACQ_REL))
+        wqt_clock(&s_wqt_stop);
+    return 0;
+}
+
+int
+wqtrace_write(const char* path)
+{
+    FILE* f;
+    double us;
+    int nrings;
+    wqtrace_stop();
+    if ((f = fopen(path, "w")) == NULL)
+        return WQUERY_FILE_ERR;
+    // ticks to microseconds, from the capture's own duration
+    us = s_wqt_stop.ticks > s_wqt_start.ticks ?
+         (s_wqt_stop.ns-s_wqt_start.ns)*1e-3/(s_wqt_stop.ticks-s_wqt_start.ticks) : 0;
+    nrings = wpnmin(__atomic_load_n(&s_wqt_nrings, __ATOMIC_RELAXED),
+                    WQUERY_TRACE_THREADS);
+    fprintf(f, "{\"traceEvents\":[");
+    for (int r = 0; r < nrings; ++r) {
+         struct wqtring* ring = &s_wqt_rings[r];
+         uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+         uint64_t h = head > WQUERY_TRACE_RINGSZ ? head-WQUERY_TRACE_RINGSZ : 0;
+         fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%d,\"args\":{\"name\":\"wquery-%d\"}}", r ? "," : "", r, r);
+         for (; h < head; ++h) {
+              struct wqtevent* ev = &ring->ev[h & (WQUERY_TRACE_RINGSZ-1)];
+              if (ev->ticks < s_wqt_start.ticks || ev->ticks > s_wqt_stop.ticks)
+                  continue;
+              fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,"
+                      "\"tid\":%d,\"ts\":%.3f}", s_wqt_names[ev->event],
+                      ev->phase, r, (ev->ticks-s_wqt_start.ticks)*us);
+         }
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) ? WQUERY_FILE_ERR : 0;
+}
+
+#else
+
+#define wqt_begin(_e)
+#define wqt_end(_e)
+
+int
+wqtrace_start(void)
+{
+    return WQUERY_ATTR_UNSUPPORTED;
+}
+
+int
+wqtrace_stop(void)
+{
+    return WQUERY_ATTR_UNSUPPORTED;
+}
+
+int
+wqtrace_write(const char* path)
+{
+    (void) path;
+    return WQUERY_ATTR_UNSUPPORTED;
+}
+
+#endif
+
+// node callbacks, traced
+#define wqnode_call(_nd, _v) do {               \
+    wqt_begin(WQT_FN);                          \
+    (_nd)->fn(_nd, _v, (_nd)->udt);             \
+    wqt_end(WQT_FN);                            \
+} while (0)
+
+// ------------------------------------------------------------------------------------------------
+// STRING POOL
+// ------------------------------------------------------------------------------------------------
+
+struct wqbuf {
+    struct wqbuf* next;     // free list
+    struct wqbufs* pool;
+    int refs;
+    // <bufsz> bytes, followed by a zero that is never
+    // written, so that strings can't run past the buffer
+    byte_t dat[];
+};
+
+struct wqbufs {
+    struct wqbuf* free;
+    uint32_t bufsz;
+    int nbufs;
+    int lock;
+};
+
+// returns a buffer with a single reference, or NULL
+static wqbuf_t*
+wqbufs_get(struct wqbufs* pool)
+{
+    wqbuf_t* buf;
+    wpnspin_lock(&pool->lock);
+    if ((buf = pool->free))
+        pool->free = buf->next;
+    wpnspin_unlock(&pool->lock);
+    if (buf)
+        buf->refs = 1;
+    return buf;
+}
+
+void
+wqbuf_retain(wqbuf_t* buf)
+{
+    __atomic_fetch_add(&buf->refs, 1, __ATOMIC_RELAXED);
+}
+
+void
+wqbuf_release(wqbuf_t* buf)
+{
+    struct wqbufs* pool = buf->pool;
+    if (__atomic_sub_fetch(&buf->refs, 1, __ATOMIC_ACQ_REL))
+        return;
+    wpnspin_lock(&pool->lock);
+    buf->next = pool->free;
+    pool->free = buf;
+    wpnspin_unlock(&pool->lock);
+}
+
 // ------------------------------------------------------------------------------------------------
 // NODE/TREE
 // ------------------------------------------------------------------------------------------------
 
 #define WQNODE_IGNORE 0
 #define WQNODE_LISTEN 1
+// value changed since last LISTEN flush
+#define WQNODE_DIRTY  2
 
 // we want to limit this to 64 bytes
 struct wqnode {
@@ -51,10 +347,29 @@ struct wqnode {
     wqnode_fn fn;
     void* udt;
     wvalue_t value;
-    enum wqflags_t flags;
-    int status;
+    uint16_t flags;
+    uint16_t status;
+    // NOREPEAT deadband (floats)
+    float epsilon;
 };
 
+// nodes have no id: side tables hash their addresses instead
+static __always_inline uint32_t
+wqnode_hash(wqnode_t* nd)
+{
+    // nodes are at least 64 bytes wide, drop the low bits
+    uint32_t h = (uintptr_t) nd >> 6;
+    h *= 0x9e3779b1u;
+    return h ^ (h >> 16);
+}
+
+// counters with a single writer, readers only need untorn values
+static __always_inline void
+wqcount_add(uint64_t* c, uint64_t n)
+{
+    __atomic_store_n(c, *c + n, __ATOMIC_RELAXED);
+}
+
 static inline int
 wqnode_walloc(struct walloc_t* _allocator, wqnode_t** dst)
 {
@@ -72,42 +387,63 @@ wqnode_set_uri(wqnode_t* nd, const char* uri)
     return err;
 }
 
+// node is sampled into a history ring
+#define WQNODE_HISTORY 8
+
+// a history ring takes the place of its node callback,
+// and forwards values to the user's one
+struct wqhistory {
+    wqnode_fn fn;
+    void* udt;
+    uint32_t cap;
+    uint32_t count;
+    uint32_t wr;
+    struct wqsample samples[];
+};
+
 void
 wqnode_set_fn(wqnode_t* nd, wqnode_fn fn, void* udt)
 {
+    if (nd->status & WQNODE_HISTORY) {
+        struct wqhistory* hst = nd->udt;
+        hst->fn = fn;
+        hst->udt = udt;
+        return;
+    }
     nd->fn  = fn;
     nd->udt = udt;
 }
 
+#define WQNODE_FLAGS (WQNODE_CRITICAL | WQNODE_READONLY | WQNODE_WRITEONLY | \
+                      WQNODE_NOREPEAT | WQNODE_FN_SETPRE)
+
+#define WQNODE_ACCESS (WQNODE_READONLY | WQNODE_WRITEONLY)
+
 int
-wqnode_set_flags(wqnode_t* nd, enum wqflags_t fl)
+wqnode_set_flags(wqnode_t* nd, int fl)
 {
-    // TODO: check flags first
-    nd->flags = fl;
+    if (fl & ~WQNODE_FLAGS)
+        return WQUERY_ATTR_UNSUPPORTED;
+    // a node that can't be read nor written makes no sense
+    if (((nd->flags | fl) & (WQNODE_READONLY | WQNODE_WRITEONLY)) ==
+         (WQNODE_READONLY | WQNODE_WRITEONLY))
+        return WQUERY_ATTR_UNSUPPORTED;
+    nd->flags |= fl;
     return 0;
 }
 
-static inline int
-wqnode_add_sibling(wqnode_t* node, wqnode_t* sibling)
+void
+wqnode_clear_flags(wqnode_t* nd, int fl)
 {
-    while (node->sibling)
-        node = node->sibling;
-    node->sibling = sibling;
-//    wpnout(WCOLOR_RED "adding %s as a sibling to %s\n"
-//           WCOLOR_REGULAR, sibling->uri, node->uri);
-    return 0;
+    nd->flags &= ~fl;
 }
 
-static inline int
-wqnode_add_child(wqnode_t* parent, wqnode_t* child)
+int
+wqnode_set_epsilon(wqnode_t* nd, float epsilon)
 {
-    if (parent->child == NULL) {
-        parent->child = child;
-//        wpnout(WCOLOR_RED "adding node %s to parent %s\n"
-//               WCOLOR_REGULAR, child->uri, parent->uri);
-    } else {
-        wqnode_add_sibling(parent->child, child);
-    }
+    if (nd->value.t != WOSC_TYPE_FLOAT)
+        return WQUERY_TYPE_MISMATCH;
+    nd->epsilon = epsilon < 0 ? -epsilon : epsilon;
     return 0;
 }
 
@@ -150,22 +486,62 @@ wqnode_check_type(wqnode_t* nd, enum wtype_t tp)
     return nd->value.t == tp ? 0 : WQUERY_TYPE_MISMATCH;
 }
 
+// marks node for the next LISTEN flush, status can be
+// read and cleared concurrently by the server thread
+static __always_inline void
+wqnode_touch(wqnode_t* nd)
+{
+    if (nd->status & WQNODE_LISTEN)
+        __atomic_fetch_or(&nd->status, WQNODE_DIRTY, __ATOMIC_RELEASE);
+}
+
+// NOREPEAT check, scalar types only
+static __always_inline bool
+wqnode_is_repeat(wqnode_t* nd, wvalue_t* v)
+{
+    switch (v->t) {
+    case WOSC_TYPE_FLOAT: {
+        float d = v->u.f - nd->value.u.f;
+        return d <= nd->epsilon && d >= -nd->epsilon;
+    }
+    case WOSC_TYPE_INT:
+        return v->u.i == nd->value.u.i;
+    case WOSC_TYPE_CHAR:
+        return v->u.c == nd->value.u.c;
+    case WOSC_TYPE_BOOL:
+        return v->u.b == nd->value.u.b;
+    case WOSC_TYPE_INT64:
+        return v->u.h == nd->value.u.h;
+    case WOSC_TYPE_DOUBLE:
+        return v->u.d == nd->value.u.d;
+    case WOSC_TYPE_TIMETAG:
+        return v->u.t == nd->value.u.t;
+    case WOSC_TYPE_MIDI:
+        return !memcmp(v->u.m, nd->value.u.m, 4);
+    default:
+        return false;
+    }
+}
+
 static int
 wqnode_setv(wqnode_t* nd, wvalue_t* v)
 {
     int err;
     if (!(err = wqnode_check_type(nd, v->t))) {
+        if (nd->flags & WQNODE_NOREPEAT && wqnode_is_repeat(nd, v))
+            return 0;
         if (nd->fn) {
             if (nd->flags & WQNODE_FN_SETPRE) {
-                nd->fn(nd, v, nd->udt);
+                wqnode_call(nd, v);
                 nd->value = *v;
             } else {
                 nd->value = *v;
-                nd->fn(nd, v, nd->udt);
+                wqnode_call(nd, v);
             }
         } else {
             nd->value = *v;
         }
+        wqnode_touch(nd);
     }
     return err;
 }
@@ -199,22 +575,150 @@ wqnode_setb(wqnode_t* nd, bool b)
 }
 
 int
-wqnode_sets(wqnode_t* nd, const char* s)
+wqnode_seth(wqnode_t* nd, int64_t h)
+{
+    wvalue_t v = { .t = WOSC_TYPE_INT64, .u.h = h };
+    return wqnode_setv(nd, &v);
+}
+
+int
+wqnode_setd(wqnode_t* nd, double d)
+{
+    wvalue_t v = { .t = WOSC_TYPE_DOUBLE, .u.d = d };
+    return wqnode_setv(nd, &v);
+}
+
+int
+wqnode_sett(wqnode_t* nd, uint64_t t)
+{
+    wvalue_t v = { .t = WOSC_TYPE_TIMETAG, .u.t = t };
+    return wqnode_setv(nd, &v);
+}
+
+int
+wqnode_setm(wqnode_t* nd, const uint8_t m[4])
+{
+    wvalue_t v = { .t = WOSC_TYPE_MIDI };
+    memcpy(v.u.m, m, 4);
+    return wqnode_setv(nd, &v);
+}
+
+int
+wqnode_setblob(wqnode_t* nd, const void* data, uint32_t len)
 {
     int err;
-    if (!(err = wqnode_check_type(nd, WOSC_TYPE_STRING))) {
-        if (strlen(s) > nd->value.u.s->cap)
+    wblob_t* bl;
+    if (!(err = wqnode_check_type(nd, WOSC_TYPE_BLOB))) {
+        bl = nd->value.u.bl;
+        if (len > bl->cap)
             return WQUERY_STRBUF_OVERFLOW;
-        memset(nd->value.u.s->dat, 0, nd->value.u.s->usd);
-        strcpy(nd->value.u.s->dat, s);
-        // we have to store it somewhere..
-        // so we can't really have a SETPRE call
+        if (nd->flags & WQNODE_NOREPEAT && len == bl->len &&
+            !memcmp(bl->dat, data, len))
+            return 0;
+        // stored in place, like strings
+        memcpy(bl->dat, data, len);
+        bl->len = len;
         if (nd->fn)
-            nd->fn(nd, &nd->value, nd->udt);
+            wqnode_call(nd, &nd->value);
+        wqnode_touch(nd);
     }
     return err;
 }
 
+// points <sv> to <s>, which lives in <buf>. If <buf> is NULL,
+// <s> is copied into a buffer taken from the pool. The buffer
+// previously referenced is handed back in <prev>
+static int
+wqstrv_assign(wstrv_t* sv, const char* s, uint32_t len,
+              wqbuf_t* buf, wqbuf_t** prev)
+{
+    if (buf) {
+        wqbuf_retain(buf);
+    } else {
+        if (len >= sv->pool->bufsz)
+            return WQUERY_STRBUF_OVERFLOW;
+        if ((buf = wqbufs_get(sv->pool)) == NULL)
+            return WQUERY_POOL_EMPTY;
+        memcpy(buf->dat, s, len);
+        buf->dat[len] = 0;
+        s = (const char*) buf->dat;
+    }
+    *prev = sv->buf;
+    sv->dat = s;
+    sv->len = len;
+    sv->buf = buf;
+    return 0;
+}
+
+static int
+wqnode_setsv(wqnode_t* nd, const char* s, uint32_t len, wqbuf_t* buf)
+{
+    wstrv_t* sv = nd->value.u.sv;
+    wqbuf_t* prev;
+    int err;
+    if (nd->flags & WQNODE_NOREPEAT &&
+        len == sv->len && !memcmp(sv->dat, s, len))
+        return 0;
+    if ((err = wqstrv_assign(sv, s, len, buf, &prev)))
+        return err;
+    if (nd->fn)
+        wqnode_call(nd, &nd->value);
+    wqnode_touch(nd);
+    // previous value is only released once the callback
+    // is done, callback may have dropped the new one as well
+    if (prev)
+        wqbuf_release(prev);
+    return 0;
+}
+
+int
+wqnode_sets(wqnode_t* nd, const char* s)
+{
+    return wqnode_setsn(nd, s, strlen(s));
+}
+
+int
+wqnode_setsn(wqnode_t* nd, const char* s, uint32_t len)
+{
+    wstr_t* str;
+    if (nd->value.t == WOSC_TYPE_STRVIEW)
+        return wqnode_setsv(nd, s, len, NULL);
+    if (nd->value.t != WOSC_TYPE_STRING)
+        return WQUERY_TYPE_MISMATCH;
+    str = nd->value.u.s;
+    if (len >= str->cap)
+        return WQUERY_STRBUF_OVERFLOW;
+    if (nd->flags & WQNODE_NOREPEAT &&
+        len == str->usd && !memcmp(str->dat, s, len))
+        return 0;
+    memcpy(str->dat, s, len);
+    str->dat[len] = 0;
+    str->usd = len;
+    // we have to store it somewhere..
+    // so we can't really have a SETPRE call
+    if (nd->fn)
+        wqnode_call(nd, &nd->value);
+    wqnode_touch(nd);
+    return 0;
+}
+
+int
+wqnode_drop(wqnode_t* nd)
+{
+    wstrv_t* sv;
+    wqbuf_t* buf;
+    if (nd->value.t != WOSC_TYPE_STRVIEW)
+        return WQUERY_TYPE_MISMATCH;
+    sv = nd->value.u.sv;
+    if ((buf = sv->buf)) {
+        sv->dat = "";
+        sv->len = 0;
+        sv->buf = NULL;
+        wqbuf_release(buf);
+    }
+    return 0;
+}
+
 int
 wqnode_geti(wqnode_t* nd, int* i)
 {
@@ -243,149 +747,640 @@ wqnode_getc(wqnode_t* nd, char* c)
 }
 
 int
-wqnode_gets(wqnode_t* nd, const char** s)
+wqnode_getb(wqnode_t* nd, bool* b)
 {
     int err;
-    if (!(err = wqnode_check_type(nd, WOSC_TYPE_STRING)))
-        *s = nd->value.u.s->dat;
+    if (!(err = wqnode_check_type(nd, WOSC_TYPE_BOOL)))
+        *b = nd->value.u.b;
     return err;
 }
 
-const char*
-wqnode_get_name(wqnode_t* nd)
+int
+wqnode_geth(wqnode_t* nd, int64_t* h)
 {
-    const char* last = wuri_last(nd->uri);
-    return ++last;
+    int err;
+    if (!(err = wqnode_check_type(nd, WOSC_TYPE_INT64)))
+        *h = nd->value.u.h;
+    return err;
 }
 
 int
-wqnode_get_access(wqnode_t* nd)
+wqnode_getd(wqnode_t* nd, double* d)
 {
-    if (nd->flags & WQNODE_READONLY)
-        return WQNODE_ACCESS_R;
-    else if (nd->flags & WQNODE_WRITEONLY)
-        return WQNODE_ACCESS_W;
-    else
-        return WQNODE_ACCESS_RW;
+    int err;
+    if (!(err = wqnode_check_type(nd, WOSC_TYPE_DOUBLE)))
+        *d = nd->value.u.d;
+    return err;
 }
 
-struct wqtree {
-    struct wqnode root;
-    struct walloc_t* alloc;
-    int flags;
-};
-
 int
-wqtree_walloc(struct walloc_t* _allocator, wqtree_t** _dst)
+wqnode_gett(wqnode_t* nd, uint64_t* t)
 {
     int err;
-    if ((err = _allocator->alloc(_dst,
-                sizeof(struct wqtree),
-               _allocator->data)) >= 0) {
-        (*_dst)->flags = 0;
-        (*_dst)->alloc = _allocator;
-        memset(&(*_dst)->root, 0, sizeof(struct wqnode));
-        (*_dst)->root.uri = "/";
-        (*_dst)->root.value.t = 'N';
-        err = 0;
-    }
+    if (!(err = wqnode_check_type(nd, WOSC_TYPE_TIMETAG)))
+        *t = nd->value.u.t;
     return err;
 }
 
-void
-wqnode_print(struct wqnode* node)
+int
+wqnode_getm(wqnode_t* nd, uint8_t m[4])
 {
-    printf("node: %s (%c)\n", node->uri, node->value.t);
-    if (node->child)
-        wqnode_print(node->child);
-    if (node->sibling)
-        wqnode_print(node->sibling);
+    int err;
+    if (!(err = wqnode_check_type(nd, WOSC_TYPE_MIDI)))
+        memcpy(m, nd->value.u.m, 4);
+    return err;
 }
 
-void
-wqtree_print(struct wqtree* tree)
+int
+wqnode_getblob(wqnode_t* nd, const byte_t** data, uint32_t* len)
 {
-    wqnode_print(&tree->root);
+    int err;
+    if (!(err = wqnode_check_type(nd, WOSC_TYPE_BLOB))) {
+        *data = nd->value.u.bl->dat;
+        *len = nd->value.u.bl->len;
+    }
+    return err;
 }
 
-wqnode_t*
-wqtree_get_node(wqtree_t* tree, const char* uri)
+int
+wqnode_gets(wqnode_t* nd, const char** s)
 {
-    wqnode_t* target = &tree->root;
-    const char* utarget, *uuri;
-    int offset = 0, lim;
-    // if query is root, no need to enter the while loop
-    if (strcmp(uri, "/") == 0)
-        return target;
-    // else, start with root's first child
-    target = target->child;
-    while (target) {
-        // get both uri's maximum segment length
-        // and compare the two of them with it
-        utarget = target->uri+offset;
-        uuri = uri+offset;
-        if (wuri_segcmp(utarget, uuri, &lim)) {
-            // if no match
-            // try with sibling
-            target = target->sibling;
-        }  else if (lim == strlen(uuri)) {
-            // segment matches
-            // if this is the last uri segment, return target
-            break;
-        } else if (target->child) {
-            // partial match, follow up with children
-            target = target->child;
-            offset += lim;
-        } else {
-            // no more children,
-            // node can't be found, return NULL
-            return NULL;
-        }
-    }
-    return target;
+    if (nd->value.t == WOSC_TYPE_STRVIEW)
+        *s = nd->value.u.sv->dat;
+    else if (nd->value.t == WOSC_TYPE_STRING)
+        *s = nd->value.u.s->dat;
+    else
+        return WQUERY_TYPE_MISMATCH;
+    return 0;
 }
 
-static wqnode_t*
-wqnode_get_parent(wqtree_t* tree, const char* uri)
+int
+wqnode_getsn(wqnode_t* nd, const char** s, uint32_t* len)
+{
+    if (nd->value.t == WOSC_TYPE_STRVIEW) {
+        *s = nd->value.u.sv->dat;
+        *len = nd->value.u.sv->len;
+    } else if (nd->value.t == WOSC_TYPE_STRING) {
+        *s = nd->value.u.s->dat;
+        *len = nd->value.u.s->usd;
+    } else {
+        return WQUERY_TYPE_MISMATCH;
+    }
+    return 0;
+}
+
+// array element type of <nd>, 0 if not an array/vector node
+static __always_inline char
+wqnode_etype(wqnode_t* nd)
+{
+    switch (nd->value.t) {
+    case WOSC_TYPE_VEC2F:
+    case WOSC_TYPE_VEC3F:
+    case WOSC_TYPE_VEC4F:
+    case WOSC_TYPE_FARRAY:
+        return WOSC_TYPE_FLOAT;
+    case WOSC_TYPE_IARRAY:
+        return WOSC_TYPE_INT;
+    default:
+        return 0;
+    }
+}
+
+static int
+wqnode_seta(wqnode_t* nd, char etype, const void* v, int n)
+{
+    warr_t* a = nd->value.u.a;
+    if (wqnode_etype(nd) != etype)
+        return WQUERY_TYPE_MISMATCH;
+    if (n < 0 || n > a->cap)
+        return WQUERY_STRBUF_OVERFLOW;
+    // vectors have a fixed size
+    if (nd->value.t != WOSC_TYPE_FARRAY &&
+        nd->value.t != WOSC_TYPE_IARRAY && n != a->cap)
+        return WQUERY_TYPE_MISMATCH;
+    if (nd->flags & WQNODE_NOREPEAT && n == a->len &&
+        !memcmp(a->dat, v, n*sizeof(a->dat[0])))
+        return 0;
+    // like strings, stored in place: no SETPRE call
+    memcpy(a->dat, v, n*sizeof(a->dat[0]));
+    a->len = n;
+    if (nd->fn)
+        wqnode_call(nd, &nd->value);
+    wqnode_touch(nd);
+    return 0;
+}
+
+int
+wqnode_setfv(wqnode_t* nd, const float* v, int n)
+{
+    return wqnode_seta(nd, WOSC_TYPE_FLOAT, v, n);
+}
+
+int
+wqnode_setiv(wqnode_t* nd, const int32_t* v, int n)
+{
+    return wqnode_seta(nd, WOSC_TYPE_INT, v, n);
+}
+
+int
+wqnode_getfv(wqnode_t* nd, const float** v, int* n)
+{
+    if (wqnode_etype(nd) != WOSC_TYPE_FLOAT)
+        return WQUERY_TYPE_MISMATCH;
+    *v = &nd->value.u.a->dat[0].f;
+    *n = nd->value.u.a->len;
+    return 0;
+}
+
+int
+wqnode_getiv(wqnode_t* nd, const int32_t** v, int* n)
+{
+    if (wqnode_etype(nd) != WOSC_TYPE_INT)
+        return WQUERY_TYPE_MISMATCH;
+    *v = &nd->value.u.a->dat[0].i;
+    *n = nd->value.u.a->len;
+    return 0;
+}
+
+const char*
+wqnode_get_name(wqnode_t* nd)
+{
+    const char* last = wuri_last(nd->uri);
+    return ++last;
+}
+
+enum wtype_t
+wqnode_get_type(wqnode_t* nd)
+{
+    return nd->value.t;
+}
+
+int
+wqnode_get_access(wqnode_t* nd)
+{
+    if (nd->flags & WQNODE_READONLY)
+        return WQNODE_ACCESS_R;
+    else if (nd->flags & WQNODE_WRITEONLY)
+        return WQNODE_ACCESS_W;
+    else
+        return WQNODE_ACCESS_RW;
+}
+
+// optional tree state, allocated along with the first
+// feature needing it, trees using none of them don't pay for it
+struct wqtree_ext {
+    wqtree_fn restored;
+    void* rudt;
+    struct wqrec* rec;
+    struct wqramps* ramps;
+    struct wqbufs* strpool;
+    struct wqstats* stats;
+    struct wqfanout** fanout;
+};
+
+struct wqtree {
+    struct wqnode root;
+    struct walloc_t* alloc;
+    struct wqtree_ext* ext;
+    uint32_t version;   // bumped on structural changes
+    int flags;
+};
+
+// <_field> of <_tree> optional state, NULL if there's none
+#define wqtree_opt(_tree, _field) \
+    ((_tree)->ext ? (_tree)->ext->_field : NULL)
+
+static int
+wqtree_ext(wqtree_t* tree, struct wqtree_ext** dst)
+{
+    int err;
+    struct wqtree_ext* ext;
+    if (tree->ext == NULL) {
+        if ((err = tree->alloc->alloc(&ext, sizeof(struct wqtree_ext),
+                                      tree->alloc->data)) < 0)
+            return err;
+        memset(ext, 0, sizeof(struct wqtree_ext));
+        // may be read by server threads
+        __atomic_store_n(&tree->ext, ext, __ATOMIC_RELEASE);
+    }
+    *dst = tree->ext;
+    return 0;
+}
+
+int
+wqtree_walloc(struct walloc_t* _allocator, wqtree_t** _dst)
+{
+    int err;
+    if ((err = _allocator->alloc(_dst,
+                sizeof(struct wqtree),
+               _allocator->data)) >= 0) {
+        (*_dst)->flags = 0;
+        (*_dst)->alloc = _allocator;
+        (*_dst)->ext = NULL;
+        (*_dst)->version = 0;
+        memset(&(*_dst)->root, 0, sizeof(struct wqnode));
+        (*_dst)->root.uri = "/";
+        (*_dst)->root.value.t = 'N';
+        err = 0;
+    }
+    return err;
+}
+
+uint32_t
+wqtree_get_version(wqtree_t* tree)
+{
+    return __atomic_load_n(&tree->version, __ATOMIC_ACQUIRE);
+}
+
+int
+wqtree_set_flags(wqtree_t* tree, int fl)
+{
+    if (fl & ~WQTREE_CREATE_INTERMEDIATE)
+        return WQUERY_ATTR_UNSUPPORTED;
+    tree->flags |= fl;
+    return 0;
+}
+
+// access flags are part of the (cached) namespace,
+// changing them is a structural change of the tree
+int
+wqtree_set_node_flags(wqtree_t* tree, wqnode_t* nd, int fl)
+{
+    int err, prev = nd->flags;
+    if ((err = wqnode_set_flags(nd, fl)))
+        return err;
+    if ((prev ^ nd->flags) & WQNODE_ACCESS)
+        __atomic_fetch_add(&tree->version, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void
+wqtree_clear_node_flags(wqtree_t* tree, wqnode_t* nd, int fl)
+{
+    int prev = nd->flags;
+    wqnode_clear_flags(nd, fl);
+    if ((prev ^ nd->flags) & WQNODE_ACCESS)
+        __atomic_fetch_add(&tree->version, 1, __ATOMIC_RELEASE);
+}
+
+int
+wqtree_set_strpool(wqtree_t* tree, int nbufs, int bufsz)
+{
+    int err;
+    struct wqtree_ext* ext;
+    struct wqbufs* pool;
+    byte_t* mem;
+    size_t stride = (sizeof(struct wqbuf) + bufsz+1 + 7) & ~7ul;
+    if (wqtree_opt(tree, strpool) || nbufs <= 0 || bufsz <= 0)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqtree_ext(tree, &ext)) < 0)
+        return err;
+    if ((err = tree->alloc->alloc(&pool, sizeof(struct wqbufs),
+                                  tree->alloc->data)) < 0)
+        return err;
+    if ((err = tree->alloc->alloc(&mem, nbufs*stride,
+                                  tree->alloc->data)) < 0)
+        return err;
+    memset(pool, 0, sizeof(struct wqbufs));
+    memset(mem, 0, nbufs*stride);
+    for (int n = nbufs-1; n >= 0; --n) {
+         wqbuf_t* buf = (wqbuf_t*)(mem + n*stride);
+         buf->pool = pool;
+         buf->next = pool->free;
+         pool->free = buf;
+    }
+    pool->bufsz = bufsz;
+    pool->nbufs = nbufs;
+    ext->strpool = pool;
+    return 0;
+}
+
+void
+wqnode_print(struct wqnode* node)
+{
+    printf("node: %s (%c)\n", node->uri, node->value.t);
+    if (node->child)
+        wqnode_print(node->child);
+    if (node->sibling)
+        wqnode_print(node->sibling);
+}
+
+void
+wqtree_print(struct wqtree* tree)
+{
+    wqnode_print(&tree->root);
+}
+
+// ------------------------------------------------------------------------------------------------
+// FANOUT
+// ------------------------------------------------------------------------------------------------
+
+// parents of WQNODE_FANOUT_MIN children or more also keep them in an
+// array sorted by name hash, searched with a binary search instead
+// of a walk down the sibling list. The list is still there, in
+// insertion order, for everything else
+#define WQNODE_FANOUT 16
+
+#ifndef WQNODE_FANOUT_MIN
+#define WQNODE_FANOUT_MIN 16
+#endif
+
+#define WQTREE_FANOUT_BUCKETS 64
+
+struct wqchild {
+    uint32_t hash;
+    wqnode_t* nd;
+};
+
+struct wqfanout {
+    wqnode_t* parent;
+    wqnode_t* last;         // sibling list tail
+    struct wqfanout* next;  // bucket chain
+    uint32_t count;
+    uint32_t cap;
+    struct wqchild children[];
+};
+
+// fnv-1a of the <len> bytes segment <useg> ("/name")
+static __always_inline uint32_t
+wqfanout_hash(const char* useg, int len)
+{
+    uint32_t h = 2166136261u;
+    for (int n = 1; n < len; ++n) {
+         h ^= (uint8_t) useg[n];
+         h *= 16777619u;
+    }
+    return h;
+}
+
+static __always_inline struct wqfanout**
+wqfanout_bucket(wqtree_t* tree, wqnode_t* parent)
+{
+    return &tree->ext->fanout[wqnode_hash(parent) % WQTREE_FANOUT_BUCKETS];
+}
+
+static inline struct wqfanout*
+wqfanout_get(wqtree_t* tree, wqnode_t* parent)
+{
+    struct wqfanout* fan = *wqfanout_bucket(tree, parent);
+    while (fan->parent != parent)
+           fan = fan->next;
+    return fan;
+}
+
+// first child which hash is not lower than <h>
+static __always_inline uint32_t
+wqfanout_lower(struct wqfanout* fan, uint32_t h)
+{
+    uint32_t lo = 0, hi = fan->count;
+    while (lo < hi) {
+        uint32_t mid = (lo+hi) >> 1;
+        if (fan->children[mid].hash < h)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// does <nd> uri segment at <offset> match <len> bytes segment <useg>?
+static __always_inline bool
+wqnode_segeq(wqnode_t* nd, const char* useg, int len, int offset)
+{
+    const char* u = nd->uri+offset;
+    return !strncmp(u, useg, len) && (u[len] == '/' || u[len] == 0);
+}
+
+static wqnode_t*
+wqfanout_find(struct wqfanout* fan, const char* useg, int len, int offset)
+{
+    uint32_t h = wqfanout_hash(useg, len);
+    for (uint32_t n = wqfanout_lower(fan, h);
+         n < fan->count && fan->children[n].hash == h; ++n) {
+         wqnode_t* nd = fan->children[n].nd;
+         if (wqnode_segeq(nd, useg, len, offset))
+             return nd;
+    }
+    return NULL;
+}
+
+// makes room for <cap> children. Outgrown arrays are not given back:
+// tree memory may come from a mempool, which only frees its top block
+// (nodes are never freed either), they add up to less than the last one
+static int
+wqfanout_reserve(wqtree_t* tree, wqnode_t* parent,
+                 uint32_t cap, struct wqfanout** dst)
+{
+    int err;
+    struct wqtree_ext* ext;
+    struct wqfanout* fan, **slot;
+    if ((err = wqtree_ext(tree, &ext)) < 0)
+        return err;
+    if (ext->fanout == NULL) {
+        if ((err = tree->alloc->alloc(&ext->fanout,
+                    WQTREE_FANOUT_BUCKETS*sizeof(struct wqfanout*),
+                    tree->alloc->data)) < 0)
+            return err;
+        memset(ext->fanout, 0, WQTREE_FANOUT_BUCKETS*sizeof(struct wqfanout*));
+    }
+    slot = wqfanout_bucket(tree, parent);
+    while (*slot && (*slot)->parent != parent)
+           slot = &(*slot)->next;
+    if (*slot && (*slot)->cap >= cap) {
+        *dst = *slot;
+        return 0;
+    }
+    if ((err = tree->alloc->alloc(&fan, sizeof(struct wqfanout) +
+                                  cap*sizeof(struct wqchild),
+                                  tree->alloc->data)) < 0)
+        return err;
+    if (*slot) {
+        memcpy(fan, *slot, sizeof(struct wqfanout) +
+               (*slot)->count*sizeof(struct wqchild));
+    } else {
+        fan->parent = parent;
+        fan->next = NULL;
+        fan->count = 0;
+    }
+    fan->cap = cap;
+    *slot = fan;
+    *dst = fan;
+    return 0;
+}
+
+static int
+wqchild_cmp(const void* a, const void* b)
+{
+    uint32_t ha = ((const struct wqchild*) a)->hash;
+    uint32_t hb = ((const struct wqchild*) b)->hash;
+    return (ha > hb) - (ha < hb);
+}
+
+// (re)builds <parent> array from its sibling list, parent falls back
+// to the list if there's no memory left for it
+static void
+wqtree_index(wqtree_t* tree, wqnode_t* parent)
+{
+    struct wqfanout* fan;
+    uint32_t count = 0;
+    const char* last;
+    for (wqnode_t* nd = parent->child; nd; nd = nd->sibling)
+         count++;
+    if (wqfanout_reserve(tree, parent, count*2, &fan)) {
+        __atomic_fetch_and(&parent->status, ~WQNODE_FANOUT, __ATOMIC_RELAXED);
+        return;
+    }
+    fan->count = 0;
+    for (wqnode_t* nd = parent->child; nd; nd = nd->sibling) {
+         last = wuri_last(nd->uri);
+         fan->children[fan->count].hash = wqfanout_hash(last, strlen(last));
+         fan->children[fan->count++].nd = nd;
+         fan->last = nd;
+    }
+    qsort(fan->children, fan->count, sizeof(struct wqchild), wqchild_cmp);
+    __atomic_fetch_or(&parent->status, WQNODE_FANOUT, __ATOMIC_RELAXED);
+}
+
+// links <child> as the last child of <parent>
+static void
+wqtree_link_child(wqtree_t* tree, wqnode_t* parent, wqnode_t* child)
+{
+    uint32_t count = 1, n;
+    const char* useg;
+    wqnode_t* last;
+    if (parent->status & WQNODE_FANOUT) {
+        struct wqfanout* fan = wqfanout_get(tree, parent);
+        fan->last->sibling = child;
+        fan->last = child;
+        if (fan->count == fan->cap &&
+            wqfanout_reserve(tree, parent, fan->cap*2, &fan)) {
+            __atomic_fetch_and(&parent->status, ~WQNODE_FANOUT, __ATOMIC_RELAXED);
+            return;
+        }
+        useg = wuri_last(child->uri);
+        uint32_t h = wqfanout_hash(useg, strlen(useg));
+        n = wqfanout_lower(fan, h);
+        memmove(&fan->children[n+1], &fan->children[n],
+                (fan->count-n)*sizeof(struct wqchild));
+        fan->children[n].hash = h;
+        fan->children[n].nd = child;
+        fan->count++;
+        return;
+    }
+    if ((last = parent->child) == NULL) {
+        parent->child = child;
+        return;
+    }
+    for (; last->sibling; last = last->sibling)
+         count++;
+    last->sibling = child;
+    if (++count >= WQNODE_FANOUT_MIN)
+        wqtree_index(tree, parent);
+}
+
+static __always_inline wqnode_t*
+wqnode_find_child(wqtree_t* tree, wqnode_t* parent,
+                  const char* useg, int len, int offset)
+{
+    if (parent->status & WQNODE_FANOUT)
+        return wqfanout_find(wqfanout_get(tree, parent), useg, len, offset);
+    for (wqnode_t* nd = parent->child; nd; nd = nd->sibling)
+         if (wqnode_segeq(nd, useg, len, offset))
+             return nd;
+    return NULL;
+}
+
+// iterates over the segments of a method, which is scanned once
+// (or once every WURI_MAXSEGS segments, for deeper ones)
+struct wqsegs {
+    struct wuri_segs sc;
+    const char* uri;
+    uint32_t base;
+    uint32_t s;
+};
+
+static __always_inline void
+wqsegs_begin(struct wqsegs* it, const char* uri)
+{
+    it->uri = uri;
+    it->base = 0;
+    it->s = 0;
+    wuri_scan(uri, &it->sc);
+}
+
+// sets <offset> and <len> of the next segment, <uri> has to start with '/'
+static __always_inline void
+wqsegs_next(struct wqsegs* it, int* offset, int* len)
+{
+    if (it->s == it->sc.n) {
+        it->base += it->sc.offs[it->s];
+        wuri_scan(it->uri+it->base, &it->sc);
+        it->s = 0;
+    }
+    *offset = it->base + it->sc.offs[it->s];
+    *len = it->sc.offs[it->s+1] - it->sc.offs[it->s];
+    it->s++;
+}
+
+// number of segments left after the last one returned, past
+// WURI_MAXSEGS it is not known until the next scan, 2 stands for
+// "one or more" then
+static __always_inline uint32_t
+wqsegs_left(struct wqsegs* it)
+{
+    return it->sc.n - it->s + (it->sc.len ? 0 : 2);
+}
+
+wqnode_t*
+wqtree_get_node(wqtree_t* tree, const char* uri)
+{
+    wqnode_t* target = &tree->root;
+    struct wqsegs it;
+    int offset, len;
+    // if query is root, no need to enter the loop
+    if (uri[0] != '/')
+        return NULL;
+    if (uri[1] == 0)
+        return target;
+    wqsegs_begin(&it, uri);
+    for (;;) {
+        wqsegs_next(&it, &offset, &len);
+        if ((target = wqnode_find_child(tree, target, uri+offset,
+                                        len, offset)) == NULL)
+            return NULL;
+        // if this is the last uri segment, return target
+        if (wqsegs_left(&it) == 0)
+            return target;
+        // partial match, follow up with children, if any
+        if (target->child == NULL)
+            return NULL;
+    }
+}
+
+static wqnode_t*
+wqnode_get_parent(wqtree_t* tree, const char* uri)
 {
     wqnode_t* parent = &tree->root;
     wqnode_t* target;
-    const char* utarget, *uuri;
-    int offset = 0, lim;
+    struct wqsegs it;
+    int offset, len;
+    wqsegs_begin(&it, uri);
     // if depth == 1 (e.g. /foo), parent will be root
-    if (!parent->child || wuri_depth_eq(uri, 1))
+    if (!parent->child || wqsegs_left(&it) == 1)
         return parent;
-    // else start with root's first child
-    target = parent->child;
-    while (target) {
-        // get both uri's maximum segment length
-        // and compare the two of them with it
-        utarget = target->uri+offset;
-        uuri = uri+offset;
-        if (wuri_segcmp(utarget, uuri, &lim)) {
-            // if no match
-            // try with sibling
-            if (target->sibling)
-                target = target->sibling;
-            else
-                // if no siblings, return parent
-                return parent;
-        } else {           
-            // target ends with next segment,
-            if (wuri_depth_eq(uuri+lim, 1)) {
-                return target;
-            }
-            // else, try with children
-            else if (target->child) {
-                parent = target;
-                target = target->child;
-                offset += lim;
-            } else {
-                return parent;
-            }
-        }
+    for (;;) {
+        wqsegs_next(&it, &offset, &len);
+        if ((target = wqnode_find_child(tree, parent, uri+offset,
+                                        len, offset)) == NULL)
+            return parent;
+        // target ends with next segment
+        if (wqsegs_left(&it) == 1)
+            return target;
+        // else, try with children
+        if (target->child == NULL)
+            return parent;
+        parent = target;
     }
-    return target;
 }
 
 static int
@@ -398,11 +1393,13 @@ wqtree_add_node(wqtree_t* tree, const char* uri,
         return WQUERY_URI_INVALID;
     if ((err = wqnode_walloc(tree->alloc, &node)) < 0)
         return err;
+    memset(node, 0, sizeof(struct wqnode));
     parent = wqnode_get_parent(tree, uri);
     assert(parent);
     node->value.t = type;
     wqnode_set_uri(node, uri);
-    wqnode_add_child(parent, node);
+    wqtree_link_child(tree, parent, node);
+    __atomic_fetch_add(&tree->version, 1, __ATOMIC_RELEASE);
     *dst = node;
     return 0;
 }
@@ -416,6 +1413,10 @@ WQTREE_DECL_ADDND(WOSC_TYPE_INT, i);
 WQTREE_DECL_ADDND(WOSC_TYPE_FLOAT, f);
 WQTREE_DECL_ADDND(WOSC_TYPE_BOOL, b);
 WQTREE_DECL_ADDND(WOSC_TYPE_CHAR, c);
+WQTREE_DECL_ADDND(WOSC_TYPE_INT64, h);
+WQTREE_DECL_ADDND(WOSC_TYPE_DOUBLE, d);
+WQTREE_DECL_ADDND(WOSC_TYPE_TIMETAG, t);
+WQTREE_DECL_ADDND(WOSC_TYPE_MIDI, m);
 
 int
 wqtree_addnds(wqtree_t* tree, const char* uri,
@@ -433,288 +1434,3791 @@ wqtree_addnds(wqtree_t* tree, const char* uri,
     return err;
 }
 
-static int
-wqnode_update(wqnode_t* nd, womsg_t* womsg)
+int
+wqtree_addndblob(wqtree_t* tree, const char* uri,
+                 wqnode_t** dst, int cap)
 {
+    wblob_t* bl;
     int err;
-    enum wtype_t type = *womsg_gettag(womsg);
-    if (!(err = wqnode_check_type(nd, type))) {
-        if (type == WOSC_TYPE_STRING) {
-            // todo: errcheck
-            womsg_readv(womsg, &nd->value);
-            if (nd->fn)
-                nd->fn(nd, &nd->value, nd->udt);
-        } else {
-            wvalue_t v;
-            womsg_readv(womsg, &v);
-            wqnode_setv(nd, &v);
-        }
+    if (cap < 0 || cap > UINT16_MAX)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqtree_add_node(tree, uri, WOSC_TYPE_BLOB, dst)))
+        return err;
+    if ((err = wblob_walloc(tree->alloc, &bl, cap)) >= 0) {
+        err = 0;
+        (*dst)->value.u.bl = bl;
     }
     return err;
 }
 
 static int
-wqtree_update_osc(wqtree_t* tree, byte_t* data, int len)
+wqtree_add_array(wqtree_t* tree, const char* uri, enum wtype_t type,
+                 wqnode_t** dst, int cap)
+{
+    warr_t* arr;
+    int err;
+    if (cap < 0 || cap > WARR_MAXLEN)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqtree_add_node(tree, uri, type, dst)))
+        return err;
+    if ((err = warr_walloc(tree->alloc, &arr, cap)) >= 0) {
+        err = 0;
+        // vectors are always full
+        if (type != WOSC_TYPE_FARRAY && type != WOSC_TYPE_IARRAY)
+            arr->len = cap;
+        (*dst)->value.u.a = arr;
+    }
+    return err;
+}
+
+#define WQTREE_DECL_ADDNDV(_Type, _Tag, _N) \
+    int wqtree_addnd##_Tag(wqtree_t* tree, const char* uri, wqnode_t** dst) \
+    { return wqtree_add_array(tree, uri, _Type, dst, _N); }
+
+WQTREE_DECL_ADDNDV(WOSC_TYPE_VEC2F, v2, 2);
+WQTREE_DECL_ADDNDV(WOSC_TYPE_VEC3F, v3, 3);
+WQTREE_DECL_ADDNDV(WOSC_TYPE_VEC4F, v4, 4);
+
+int
+wqtree_addndfa(wqtree_t* tree, const char* uri, wqnode_t** dst, int cap)
+{
+    return wqtree_add_array(tree, uri, WOSC_TYPE_FARRAY, dst, cap);
+}
+
+int
+wqtree_addndia(wqtree_t* tree, const char* uri, wqnode_t** dst, int cap)
+{
+    return wqtree_add_array(tree, uri, WOSC_TYPE_IARRAY, dst, cap);
+}
+
+int
+wqtree_addndsv(wqtree_t* tree, const char* uri, wqnode_t** dst)
+{
+    wstrv_t* sv;
+    int err;
+    if (wqtree_opt(tree, strpool) == NULL)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqtree_add_node(tree, uri, WOSC_TYPE_STRVIEW, dst)))
+        return err;
+    if ((err = tree->alloc->alloc(&sv, sizeof(wstrv_t),
+                                  tree->alloc->data)) >= 0) {
+        err = 0;
+        sv->dat = "";
+        sv->len = 0;
+        sv->buf = NULL;
+        sv->pool = tree->ext->strpool;
+        (*dst)->value.u.sv = sv;
+    }
+    return err;
+}
+
+#define WQTREE_BUILD_DEPTH 32
+
+// is <nd> the direct parent of <uri>?
+static inline bool
+wqnode_is_parent_of(wqnode_t* nd, const char* uri)
+{
+    size_t len = nd->uri[1] ? strlen(nd->uri) : 0;
+    if (len && (strncmp(nd->uri, uri, len) || uri[len] != '/'))
+        return false;
+    return strchr(uri+len+1, '/') == NULL;
+}
+
+// <uri> is somewhere below <parent>
+static inline bool
+wqbuild_under(const char* parent, const char* uri)
+{
+    size_t len = strlen(parent);
+    return !strncmp(parent, uri, len) && uri[len] == '/';
+}
+
+// a parent of the nodes being built, with its last child
+struct wqbuild {
+    wqnode_t* nd;
+    wqnode_t* last;
+    uint32_t count;     // children
+    uint32_t added;     // children from this batch
+};
+
+static inline void
+wqbuild_enter(wqtree_t* tree, struct wqbuild* b, wqnode_t* nd)
+{
+    b->nd = nd;
+    b->last = NULL;
+    b->count = b->added = 0;
+    if (nd->status & WQNODE_FANOUT) {
+        struct wqfanout* fan = wqfanout_get(tree, nd);
+        b->last = fan->last;
+        b->count = fan->count;
+        return;
+    }
+    for (wqnode_t* last = nd->child; last; last = last->sibling) {
+         b->last = last;
+         b->count++;
+    }
+}
+
+// children are indexed once they're all linked
+static inline void
+wqbuild_leave(wqtree_t* tree, struct wqbuild* b)
+{
+    if (b->added && (b->nd->status & WQNODE_FANOUT ||
+                     b->count >= WQNODE_FANOUT_MIN))
+        wqtree_index(tree, b->nd);
+    b->added = 0;
+}
+
+int
+wqtree_build(wqtree_t* tree, const struct wqnode_desc* descs,
+             int n, wqnode_t** dst)
+{
+    int err, depth = 0, top = 0;
+    wqnode_t* nodes;
+    // parents of the current node
+    struct wqbuild stack[WQTREE_BUILD_DEPTH];
+    const char* uris[WQTREE_BUILD_DEPTH];
+    if (n <= 0)
+        return WQUERY_ATTR_UNSUPPORTED;
+    // nothing is added if one of the nodes is invalid
+    for (int i = 0; i < n; ++i) {
+         const struct wqnode_desc* d = &descs[i];
+         if (wuri_check(d->uri) || d->uri[1] == 0)
+             return WQUERY_URI_INVALID;
+         if (wuri_depth(d->uri) >= WQTREE_BUILD_DEPTH)
+             return WQUERY_ATTR_UNSUPPORTED;
+         switch (d->type) {
+         case WOSC_TYPE_NIL: case WOSC_TYPE_INT: case WOSC_TYPE_FLOAT:
+         case WOSC_TYPE_BOOL: case WOSC_TYPE_CHAR: case WOSC_TYPE_INT64:
+         case WOSC_TYPE_DOUBLE: case WOSC_TYPE_TIMETAG: case WOSC_TYPE_MIDI:
+             break;
+         default:
+             return WQUERY_TYPE_MISMATCH;
+         }
+         if ((d->flags & ~WQNODE_FLAGS) ||
+             (d->flags & (WQNODE_READONLY | WQNODE_WRITEONLY)) ==
+                         (WQNODE_READONLY | WQNODE_WRITEONLY))
+             return WQUERY_ATTR_UNSUPPORTED;
+         // parent has to be the last node of the batch still open
+         // (depth-first), or to be in the tree already
+         while (top && !wqbuild_under(uris[top-1], d->uri))
+                top--;
+         if (top ? strchr(d->uri+strlen(uris[top-1])+1, '/') != NULL :
+                  !wqnode_is_parent_of(wqnode_get_parent(tree, d->uri), d->uri))
+             return WQUERY_URI_INVALID;
+         uris[top++] = d->uri;
+    }
+    if ((err = tree->alloc->alloc(&nodes, n*sizeof(struct wqnode),
+                                  tree->alloc->data)) < 0)
+        return err;
+    memset(nodes, 0, n*sizeof(struct wqnode));
+    wqbuild_enter(tree, &stack[0], &tree->root);
+    for (int i = 0; i < n; ++i) {
+         const struct wqnode_desc* d = &descs[i];
+         wqnode_t* nd = &nodes[i];
+         struct wqbuild* b;
+         // leave the subtrees the previous nodes were in
+         while (depth && !wqnode_is_parent_of(stack[depth].nd, d->uri))
+                wqbuild_leave(tree, &stack[depth--]);
+         if (!wqnode_is_parent_of(stack[depth].nd, d->uri)) {
+             // parent is not part of the batch, but already in the tree
+             wqbuild_leave(tree, &stack[0]);
+             wqbuild_enter(tree, &stack[++depth],
+                           wqnode_get_parent(tree, d->uri));
+         }
+         b = &stack[depth];
+         nd->uri = d->uri;
+         nd->value.t = d->type;
+         nd->flags = d->flags;
+         if (b->last)
+             b->last->sibling = nd;
+         else
+             b->nd->child = nd;
+         b->last = nd;
+         b->count++;
+         b->added++;
+         wqbuild_enter(tree, &stack[++depth], nd);
+         if (dst)
+             dst[i] = nd;
+    }
+    while (depth >= 0)
+           wqbuild_leave(tree, &stack[depth--]);
+    __atomic_fetch_add(&tree->version, n, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// RAMPS
+// ------------------------------------------------------------------------------------------------
+
+// node is being ramped
+#define WQNODE_RAMP 4
+
+#ifndef WQRAMP_WHEELSZ
+#define WQRAMP_WHEELSZ 64
+#endif
+
+struct wqramp {
+    struct wqramp* next;
+    wqnode_t* nd;
+    wvalue_t from;
+    wvalue_t to;
+    float vfrom[4];     // vector components
+    float vto[4];
+    uint64_t start;     // ticks
+    uint64_t end;
+    uint32_t rounds;    // full wheel turns left before due
+    uint32_t gen;       // bumped when (re)started or cancelled
+};
+
+// value a ramp is due to be set to, dropped if the
+// ramp's generation has changed in the meantime
+struct wqstep {
+    wqnode_t* nd;
+    struct wqramp* rmp;
+    uint32_t gen;
+    wvalue_t v;
+    float vec[4];
+};
+
+// hashed timer wheel: ramps are linked in the slot of the tick
+// they are next due at. float and vector ramps are due on every
+// tick, int ramps only when their (truncated) value actually changes
+struct wqramps {
+    struct wqramp* wheel[WQRAMP_WHEELSZ];
+    struct wqramp* free;
+    struct wqramp* done;    // final steps not applied yet
+    struct wqramp* pool;
+    struct wqstep* steps;
+    uint64_t tick;      // last processed tick
+    uint64_t t0;        // ns
+    uint32_t tick_ns;
+    int nramps;
+    int nactive;
+    int lock;
+    int stepping;
+};
+
+struct wqworkers;
+
+static pthread_mutex_t*
+wqserver_shard(struct wqworkers* wks, wqnode_t* nd);
+
+int
+wqtree_set_ramps(wqtree_t* tree, int nramps, int tick_ms)
+{
+    int err;
+    struct wqtree_ext* ext;
+    struct wqramps* rps;
+    if (wqtree_opt(tree, ramps) || nramps <= 0 || tick_ms <= 0)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqtree_ext(tree, &ext)) < 0)
+        return err;
+    if ((err = tree->alloc->alloc(&rps, sizeof(struct wqramps),
+                                  tree->alloc->data)) < 0)
+        return err;
+    memset(rps, 0, sizeof(struct wqramps));
+    if ((err = tree->alloc->alloc(&rps->pool, nramps*sizeof(struct wqramp),
+                                  tree->alloc->data)) < 0)
+        return err;
+    if ((err = tree->alloc->alloc(&rps->steps, nramps*sizeof(struct wqstep),
+                                  tree->alloc->data)) < 0)
+        return err;
+    for (int n = 0; n < nramps; ++n) {
+         rps->pool[n].next = rps->free;
+         rps->free = &rps->pool[n];
+    }
+    rps->nramps = nramps;
+    rps->tick_ns = tick_ms*1000000u;
+    rps->t0 = wpnclock_ns();
+    ext->ramps = rps;
+    return 0;
+}
+
+static void
+wqramp_schedule(struct wqramps* rps, struct wqramp* rmp, uint64_t due)
+{
+    uint64_t delta = due > rps->tick ? due - rps->tick : 1;
+    struct wqramp** slot = &rps->wheel[(rps->tick+delta) % WQRAMP_WHEELSZ];
+    rmp->rounds = (delta-1) / WQRAMP_WHEELSZ;
+    rmp->next = *slot;
+    *slot = rmp;
+}
+
+// next tick at which an int ramp changes value
+static uint64_t
+wqramp_next_int(struct wqramp* rmp, int v)
+{
+    uint64_t dur = rmp->end - rmp->start;
+    uint64_t d = llabs((int64_t) rmp->to.u.i - rmp->from.u.i);
+    uint64_t k = llabs((int64_t) v - rmp->from.u.i) + 1;
+    return rmp->start + (k*dur + d-1) / d;
+}
+
+// tick at which <rmp> next has to be stepped, given its current value
+static uint64_t
+wqramp_due(struct wqramps* rps, struct wqramp* rmp, wvalue_t* v)
+{
+    uint64_t next;
+    if (v->t == WOSC_TYPE_FLOAT)
+        return rmp->from.u.f == rmp->to.u.f ? rmp->end : rps->tick+1;
+    if (v->t != WOSC_TYPE_INT)
+        return rps->tick+1;
+    if (rmp->from.u.i == rmp->to.u.i)
+        return rmp->end;
+    next = wqramp_next_int(rmp, v->u.i);
+    return wpnmin(rmp->end, next);
+}
+
+// removes <nd> pending ramp, if any, steps that
+// were already collected for it are dropped
+static void
+wqramp_cancel(struct wqramps* rps, wqnode_t* nd)
+{
+    if (!(nd->status & WQNODE_RAMP))
+        return;
+    __atomic_fetch_and(&nd->status, ~WQNODE_RAMP, __ATOMIC_RELAXED);
+    // final step still pending, ramp is released once applied
+    for (struct wqramp* rmp = rps->done; rmp; rmp = rmp->next) {
+         if (rmp->nd == nd) {
+             rmp->nd = NULL;
+             __atomic_store_n(&rmp->gen, rmp->gen+1, __ATOMIC_RELAXED);
+             return;
+         }
+    }
+    for (int n = 0; n < WQRAMP_WHEELSZ; ++n) {
+         for (struct wqramp** r = &rps->wheel[n]; *r; r = &(*r)->next) {
+              if ((*r)->nd == nd) {
+                  struct wqramp* rmp = *r;
+                  *r = rmp->next;
+                  rmp->next = rps->free;
+                  rps->free = rmp;
+                  rps->nactive--;
+                  __atomic_store_n(&rmp->gen, rmp->gen+1,
+                                   __ATOMIC_RELAXED);
+                  return;
+              }
+         }
+    }
+}
+
+// explicit sets take over ramps in progress
+static void
+wqtree_ramp_cancel(wqtree_t* tree, wqnode_t* nd)
+{
+    struct wqramps* rps = wqtree_opt(tree, ramps);
+    if (rps && nd->status & WQNODE_RAMP) {
+        wpnspin_lock(&rps->lock);
+        wqramp_cancel(rps, nd);
+        wpnspin_unlock(&rps->lock);
+    }
+}
+
+// ramps <nd> towards <to>, or towards <vto> for vectors
+static int
+wqramp_start(struct wqramps* rps, wqnode_t* nd, wvalue_t* to,
+             const float* vto, int ms)
+{
+    struct wqramp* rmp;
+    if (ms < 0)
+        return WQUERY_ATTR_UNSUPPORTED;
+    wpnspin_lock(&rps->lock);
+    // a new ramp replaces the previous one,
+    // starting from the current value
+    wqramp_cancel(rps, nd);
+    if ((rmp = rps->free) == NULL) {
+        wpnspin_unlock(&rps->lock);
+        return WQUERY_RAMP_FULL;
+    }
+    rps->free = rmp->next;
+    __atomic_store_n(&rmp->gen, rmp->gen+1, __ATOMIC_RELAXED);
+    rmp->nd = nd;
+    rmp->from = nd->value;
+    rmp->to = *to;
+    if (vto) {
+        uint16_t n = nd->value.u.a->cap;
+        memcpy(rmp->vfrom, nd->value.u.a->dat, n*sizeof(float));
+        memcpy(rmp->vto, vto, n*sizeof(float));
+    }
+    rmp->start = rps->tick;
+    rmp->end = rps->tick + wpnmax(1, (ms*1000000ull + rps->tick_ns-1)
+                                     / rps->tick_ns);
+    rps->nactive++;
+    __atomic_fetch_or(&nd->status, WQNODE_RAMP, __ATOMIC_RELAXED);
+    wqramp_schedule(rps, rmp, wqramp_due(rps, rmp, &rmp->from));
+    wpnspin_unlock(&rps->lock);
+    return 0;
+}
+
+int
+wqtree_rampfv(wqtree_t* tree, wqnode_t* nd, const float* v, int n, int ms)
+{
+    struct wqramps* rps = wqtree_opt(tree, ramps);
+    if (rps == NULL)
+        return WQUERY_ATTR_UNSUPPORTED;
+    switch (nd->value.t) {
+    case WOSC_TYPE_VEC2F:
+    case WOSC_TYPE_VEC3F:
+    case WOSC_TYPE_VEC4F:
+        break;
+    default:
+        return WQUERY_TYPE_MISMATCH;
+    }
+    if (n != nd->value.u.a->cap)
+        return WQUERY_TYPE_MISMATCH;
+    return wqramp_start(rps, nd, &nd->value, v, ms);
+}
+
+int
+wqtree_ramp(wqtree_t* tree, wqnode_t* nd, wvalue_t* target, int ms)
+{
+    int err;
+    struct wqramps* rps = wqtree_opt(tree, ramps);
+    if (rps == NULL)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqnode_check_type(nd, target->t)))
+        return err;
+    switch (target->t) {
+    case WOSC_TYPE_FLOAT:
+    case WOSC_TYPE_INT:
+        return wqramp_start(rps, nd, target, NULL, ms);
+    case WOSC_TYPE_VEC2F:
+    case WOSC_TYPE_VEC3F:
+    case WOSC_TYPE_VEC4F:
+        return wqtree_rampfv(tree, nd, &target->u.a->dat[0].f,
+                             target->u.a->len, ms);
+    default:
+        return WQUERY_TYPE_MISMATCH;
+    }
+}
+
+// computes <rmp> value for the current tick, and reschedules it,
+// or moves it to the done list, until its final step is applied
+static void
+wqramp_step(struct wqramps* rps, struct wqramp* rmp, struct wqstep* dst)
+{
+    wqnode_t* nd = rmp->nd;
+    wvalue_t v = rmp->to;
+    uint64_t dur = rmp->end - rmp->start;
+    uint64_t e = rps->tick - rmp->start;
+    bool done = rps->tick >= rmp->end;
+    if (done)
+        ;
+    else if (v.t == WOSC_TYPE_FLOAT)
+        v.u.f = rmp->from.u.f + (rmp->to.u.f - rmp->from.u.f)*e/dur;
+    else if (v.t == WOSC_TYPE_INT)
+        v.u.i = rmp->from.u.i + ((int64_t) rmp->to.u.i - rmp->from.u.i)
+                                 *(int64_t) e/(int64_t) dur;
+    if (wqnode_etype(nd)) {
+        for (int c = 0; c < nd->value.u.a->cap; ++c)
+             dst->vec[c] = done ? rmp->vto[c] : rmp->vfrom[c] +
+                           (rmp->vto[c] - rmp->vfrom[c])*e/dur;
+    }
+    if (done) {
+        rmp->next = rps->done;
+        rps->done = rmp;
+        rps->nactive--;
+    } else {
+        wqramp_schedule(rps, rmp, wqramp_due(rps, rmp, &v));
+    }
+    dst->nd = nd;
+    dst->rmp = rmp;
+    dst->gen = rmp->gen;
+    dst->v = v;
+}
+
+// releases ramps which final step has been applied
+static void
+wqramps_release(struct wqramps* rps)
+{
+    struct wqramp* rmp, *next;
+    wpnspin_lock(&rps->lock);
+    for (rmp = rps->done; rmp; rmp = next) {
+         next = rmp->next;
+         if (rmp->nd)
+             __atomic_fetch_and(&rmp->nd->status, ~WQNODE_RAMP,
+                                __ATOMIC_RELAXED);
+         rmp->next = rps->free;
+         rps->free = rmp;
+    }
+    rps->done = NULL;
+    wpnspin_unlock(&rps->lock);
+}
+
+// setters trigger user callbacks, which may start or replace ramps:
+// steps are collected tick by tick under the lock, and applied once
+// it is released, under the node's shard lock when udp workers run.
+// Steps of ramps cancelled in between (by a new ramp, or an explicit
+// set, which holds the same shard lock) are dropped
+static int
+wqramps_advance(struct wqramps* rps, struct wqworkers* wks)
+{
+    uint64_t now = (wpnclock_ns() - rps->t0) / rps->tick_ns;
+    int nactive;
+    // a callback advancing the ramps itself has nothing left to do
+    if (__atomic_exchange_n(&rps->stepping, 1, __ATOMIC_ACQUIRE))
+        return __atomic_load_n(&rps->nactive, __ATOMIC_RELAXED);
+    for (;;) {
+        struct wqramp* rmp, *next, **slot;
+        int nsteps = 0;
+        wpnspin_lock(&rps->lock);
+        if (rps->nactive == 0 || rps->tick >= now) {
+            // idle wheel doesn't have to catch up
+            if (rps->nactive == 0)
+                rps->tick = now;
+            nactive = rps->nactive;
+            wpnspin_unlock(&rps->lock);
+            break;
+        }
+        slot = &rps->wheel[++rps->tick % WQRAMP_WHEELSZ];
+        rmp = *slot;
+        *slot = NULL;
+        for (; rmp; rmp = next) {
+             next = rmp->next;
+             if (rmp->rounds) {
+                 rmp->rounds--;
+                 rmp->next = *slot;
+                 *slot = rmp;
+             } else {
+                 // at most one step per active ramp and tick
+                 wqramp_step(rps, rmp, &rps->steps[nsteps++]);
+             }
+        }
+        wpnspin_unlock(&rps->lock);
+        for (int n = 0; n < nsteps; ++n) {
+             struct wqstep* st = &rps->steps[n];
+             wqnode_t* nd = st->nd;
+             pthread_mutex_t* shard = NULL;
+             if (wks) {
+                 shard = wqserver_shard(wks, nd);
+                 pthread_mutex_lock(shard);
+             }
+             if (__atomic_load_n(&st->rmp->gen, __ATOMIC_RELAXED) != st->gen)
+                 ;
+             else if (wqnode_etype(nd))
+                 wqnode_setfv(nd, st->vec, nd->value.u.a->cap);
+             else
+                 wqnode_setv(nd, &st->v);
+             if (shard)
+                 pthread_mutex_unlock(shard);
+        }
+        if (rps->done)
+            wqramps_release(rps);
+    }
+    __atomic_store_n(&rps->stepping, 0, __ATOMIC_RELEASE);
+    return nactive;
+}
+
+int
+wqtree_ramps_advance(wqtree_t* tree)
+{
+    struct wqramps* rps = wqtree_opt(tree, ramps);
+    return rps ? wqramps_advance(rps, NULL) : 0;
+}
+
+int
+wqtree_ramps_tick(wqtree_t* tree)
+{
+    struct wqramps* rps = wqtree_opt(tree, ramps);
+    return rps ? rps->tick_ns/1000000 : 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// METRICS
+// ------------------------------------------------------------------------------------------------
+
+// server hot-path counters and stage latencies, one set per server
+// thread (poll loop and udp workers), each set having a single
+// writer, so that there's no contention, sets are summed up when
+// read. compiled out entirely unless WQUERY_METRICS is defined
+
+enum wqm_transport {
+    WQM_UDP, WQM_WS, WQM_STREAM, WQM_UNIX, WQM_SHM, WQM_NTRANSPORTS
+};
+
+enum wqm_error {
+    WQM_ERR_DECODE, WQM_ERR_URI, WQM_ERR_UPDATE, WQM_NERRORS
+};
+
+enum wqm_stage {
+    WQM_DECODE, WQM_LOOKUP, WQM_UPDATE, WQM_SEND, WQM_NSTAGES
+};
+
+// bounded text output, keeps counting past <cap>,
+// so that required size is known (also used for json)
+struct wqm_printer {
+    char* dst;
+    uint32_t cap;
+    uint32_t len;
+};
+
+static void __attribute__((format(printf, 2, 3)))
+wqm_printf(struct wqm_printer* p, const char* fmt, ...)
+{
+    int n;
+    va_list args;
+    va_start(args, fmt);
+    n = vsnprintf(p->dst + wpnmin(p->len, p->cap),
+                  p->len < p->cap ? p->cap - p->len : 0, fmt, args);
+    va_end(args);
+    p->len += n;
+}
+
+#ifdef WQUERY_METRICS
+
+// log2 latency buckets, from 64ns up to ~2ms, plus overflow
+#define WQM_NBUCKETS 16
+#define WQM_BUCKET0 6
+
+struct wqmetrics {
+    uint64_t rx[WQM_NTRANSPORTS];
+    uint64_t tx[WQM_NTRANSPORTS];
+    uint64_t err[WQM_NERRORS];
+    uint64_t hist[WQM_NSTAGES][WQM_NBUCKETS+1];
+    uint64_t sum[WQM_NSTAGES];  // ns
+    uint64_t pad[3];            // 64-byte multiple
+};
+
+// current thread's set, NULL outside of server threads
+static __thread struct wqmetrics* t_wqm;
+
+// records time elapsed since <*t> in <stage>, and restarts <*t>
+static inline void
+wqm_observe(enum wqm_stage stage, uint64_t* t)
+{
+    uint64_t now, ns;
+    int b = 0;
+    if (t_wqm == NULL)
+        return;
+    now = wpnclock_ns();
+    ns = now - *t;
+    if (ns > (1u << WQM_BUCKET0))
+        b = wpnmin(64-__builtin_clzll(ns-1)-WQM_BUCKET0, WQM_NBUCKETS);
+    wqcount_add(&t_wqm->hist[stage][b], 1);
+    wqcount_add(&t_wqm->sum[stage], ns);
+    *t = now;
+}
+
+#define wqm_set_thread(_m)      t_wqm = (_m)
+#define wqm_rx(_tp)             do { if (t_wqm) wqcount_add(&t_wqm->rx[_tp], 1); } while (0)
+#define wqm_tx(_tp, _n)         do { if (t_wqm) wqcount_add(&t_wqm->tx[_tp], _n); } while (0)
+#define wqm_err(_e)             do { if (t_wqm) wqcount_add(&t_wqm->err[_e], 1); } while (0)
+#define wqm_clock(_t)           uint64_t _t = t_wqm ? wpnclock_ns() : 0
+#define wqm_lap(_stage, _t)     wqm_observe(_stage, &_t)
+
+static const char*
+s_wqm_transports[] = { "udp", "ws", "stream", "unix", "shm" };
+static const char*
+s_wqm_errors[] = { "decode", "uri", "update" };
+static const char*
+s_wqm_stages[] = { "decode", "lookup", "update", "send" };
+
+// sums up <nsets> metric sets into prometheus text format
+static void
+wqmetrics_print(struct wqmetrics* sets, int nsets, struct wqm_printer* p)
+{
+    struct wqmetrics m;
+    uint64_t* sum = (uint64_t*) &m;
+    memset(&m, 0, sizeof(m));
+    for (int s = 0; s < nsets; ++s) {
+         uint64_t* src = (uint64_t*) &sets[s];
+         for (size_t n = 0; n < sizeof(m)/sizeof(uint64_t); ++n)
+              sum[n] += __atomic_load_n(&src[n], __ATOMIC_RELAXED);
+    }
+    wqm_printf(p, "# TYPE wquery_rx_packets_total counter\n");
+    for (int n = 0; n < WQM_NTRANSPORTS; ++n)
+         wqm_printf(p, "wquery_rx_packets_total{transport=\"%s\"} %" PRIu64 "\n",
+                    s_wqm_transports[n], m.rx[n]);
+    wqm_printf(p, "# TYPE wquery_tx_packets_total counter\n");
+    for (int n = 0; n < WQM_NTRANSPORTS; ++n)
+         wqm_printf(p, "wquery_tx_packets_total{transport=\"%s\"} %" PRIu64 "\n",
+                    s_wqm_transports[n], m.tx[n]);
+    wqm_printf(p, "# TYPE wquery_errors_total counter\n");
+    for (int n = 0; n < WQM_NERRORS; ++n)
+         wqm_printf(p, "wquery_errors_total{kind=\"%s\"} %" PRIu64 "\n",
+                    s_wqm_errors[n], m.err[n]);
+    wqm_printf(p, "# TYPE wquery_stage_seconds histogram\n");
+    for (int s = 0; s < WQM_NSTAGES; ++s) {
+         uint64_t count = 0;
+         for (int b = 0; b < WQM_NBUCKETS; ++b) {
+              count += m.hist[s][b];
+              wqm_printf(p, "wquery_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} "
+                         "%" PRIu64 "\n", s_wqm_stages[s],
+                         (double)(1ull << (b+WQM_BUCKET0))*1e-9, count);
+         }
+         count += m.hist[s][WQM_NBUCKETS];
+         wqm_printf(p, "wquery_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} "
+                    "%" PRIu64 "\n", s_wqm_stages[s], count);
+         wqm_printf(p, "wquery_stage_seconds_sum{stage=\"%s\"} %.9f\n",
+                    s_wqm_stages[s], m.sum[s]*1e-9);
+         wqm_printf(p, "wquery_stage_seconds_count{stage=\"%s\"} %" PRIu64 "\n",
+                    s_wqm_stages[s], count);
+    }
+}
+
+#else
+#define wqm_set_thread(_m)
+#define wqm_rx(_tp)
+#define wqm_tx(_tp, _n)         ((void)(_n))
+#define wqm_err(_e)             ((void)0)
+#define wqm_clock(_t)
+#define wqm_lap(_stage, _t)
+#endif
+
+// ------------------------------------------------------------------------------------------------
+// HISTORY
+// ------------------------------------------------------------------------------------------------
+
+static void
+wqhistory_fn(wqnode_t* nd, wvalue_t* v, void* udt)
+{
+    struct wqhistory* hst = udt;
+    struct wqsample* smp = &hst->samples[hst->wr];
+    smp->ts = wpnclock_ns();
+    memcpy(&smp->u, &v->u, sizeof(smp->u));
+    hst->wr = hst->wr+1 == hst->cap ? 0 : hst->wr+1;
+    if (hst->count < hst->cap)
+        hst->count++;
+    if (hst->fn)
+        hst->fn(nd, v, hst->udt);
+}
+
+int
+wqtree_set_history(wqtree_t* tree, wqnode_t* nd, int capacity)
+{
+    int err;
+    struct wqhistory* hst;
+    switch (nd->value.t) {
+    case WOSC_TYPE_INT:
+    case WOSC_TYPE_FLOAT:
+    case WOSC_TYPE_CHAR:
+    case WOSC_TYPE_BOOL:
+        break;
+    default:
+        return WQUERY_TYPE_MISMATCH;
+    }
+    if (nd->status & WQNODE_HISTORY || capacity <= 0)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = tree->alloc->alloc(&hst, sizeof(struct wqhistory) +
+                  capacity*sizeof(struct wqsample), tree->alloc->data)) < 0)
+        return err;
+    memset(hst, 0, sizeof(struct wqhistory));
+    hst->cap = capacity;
+    hst->fn = nd->fn;
+    hst->udt = nd->udt;
+    nd->fn = wqhistory_fn;
+    nd->udt = hst;
+    __atomic_fetch_or(&nd->status, WQNODE_HISTORY, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// the (at most) two contiguous parts of the ring, oldest first
+static uint32_t
+wqhistory_parts(struct wqhistory* hst, struct wqsample** p1, uint32_t* n1,
+                struct wqsample** p2, uint32_t* n2)
+{
+    uint32_t rd = hst->count < hst->cap ? 0 : hst->wr;
+    *p1 = &hst->samples[rd];
+    *n1 = wpnmin(hst->count, hst->cap-rd);
+    *p2 = hst->samples;
+    *n2 = hst->count - *n1;
+    return hst->count;
+}
+
+int
+wqnode_get_history(wqnode_t* nd, struct wqsample* dst, int max)
+{
+    struct wqsample* p1, *p2;
+    uint32_t n1, n2, skip;
+    if (!(nd->status & WQNODE_HISTORY) || max < 0)
+        return -WQUERY_ATTR_UNSUPPORTED;
+    wqhistory_parts(nd->udt, &p1, &n1, &p2, &n2);
+    // keep the most recent samples
+    skip = n1+n2 > (uint32_t) max ? n1+n2-max : 0;
+    if (skip >= n1) {
+        p2 += skip-n1;
+        n2 -= skip-n1;
+        n1 = 0;
+    } else {
+        p1 += skip;
+        n1 -= skip;
+    }
+    memcpy(dst, p1, n1*sizeof(struct wqsample));
+    memcpy(dst+n1, p2, n2*sizeof(struct wqsample));
+    return n1+n2;
+}
+
+// ------------------------------------------------------------------------------------------------
+// STATS
+// ------------------------------------------------------------------------------------------------
+
+// per-node traffic counters live in a side table, so that nodes
+// stay 64 bytes wide: nodes have no id, and no room for one, so
+// records are found by hashing node addresses (open addressing).
+// the table is filled once, lookups are lock-free.
+// hottest nodes are tracked with space-saving sketches of <maxhot>
+// counters: a node that's not in it replaces the one with the
+// lowest count, inheriting it (as its error), which bounds memory
+// and work whatever the size of the tree. Each server thread counts
+// into its own sketch, under a lock it only shares with readers,
+// and sketches are merged when read. Counters are grouped in buckets
+// of equal counts (stream-summary), so that a hit is O(1)
+
+#ifndef WQSTATS_NSKETCHES
+#define WQSTATS_NSKETCHES 8
+#endif
+
+struct wqnstat {
+    wqnode_t* node;
+    struct wqnode_stats st;
+    int hot[WQSTATS_NSKETCHES]; // index in each sketch, -1 if not in it
+};
+
+struct wqbucket;
+
+struct wqcounter {
+    struct wqnstat* rec;
+    uint64_t error;
+    struct wqbucket* bucket;
+    struct wqcounter* prev;
+    struct wqcounter* next;
+};
+
+// counters sharing the same count, buckets are sorted by count
+struct wqbucket {
+    uint64_t count;
+    struct wqcounter* counters;
+    struct wqbucket* prev;
+    struct wqbucket* next;
+};
+
+struct wqsketch {
+    struct wqcounter* counters;
+    struct wqbucket* buckets;
+    struct wqbucket* min;       // lowest count
+    struct wqbucket* free;
+    int ncounters;
+    int lock;
+};
+
+// merged sketch entry, <pmin> sums the lowest count
+// of each (full) sketch the node was found in
+struct wqmerge {
+    struct wqhot hot;
+    uint64_t pmin;
+};
+
+struct wqstats {
+    struct wqsketch sketches[WQSTATS_NSKETCHES];
+    struct wqmerge* merge;
+    int maxhot;
+    int lock;           // merge buffer only
+    uint32_t count;
+    uint32_t mask;
+    struct wqnstat slots[];
+};
+
+// sketch of the current thread, threads of all trees and
+// servers are spread round-robin over the sketches
+static __thread int t_wqsketch = -1;
+static int s_wqsketch;
+
+static struct wqnstat*
+wqstats_find(struct wqstats* sts, wqnode_t* nd)
+{
+    for (uint32_t n = wqnode_hash(nd);; ++n) {
+        struct wqnstat* rec = &sts->slots[n & sts->mask];
+        if (rec->node == nd)
+            return rec;
+        if (rec->node == NULL)
+            return NULL;
+    }
+}
+
+// table is kept at most half full,
+// nodes that don't fit are not tracked
+static void
+wqstats_insert_all(struct wqstats* sts, wqnode_t* nd)
+{
+    for (; nd; nd = nd->sibling) {
+         uint32_t n = wqnode_hash(nd);
+         struct wqnstat* rec;
+         if (sts->count == (sts->mask+1)/2)
+             return;
+         while (sts->slots[n & sts->mask].node)
+                n++;
+         rec = &sts->slots[n & sts->mask];
+         rec->node = nd;
+         for (int k = 0; k < WQSTATS_NSKETCHES; ++k)
+              rec->hot[k] = -1;
+         sts->count++;
+         wqstats_insert_all(sts, nd->child);
+    }
+}
+
+int
+wqtree_set_stats(wqtree_t* tree, int nnodes, int nhot)
+{
+    int err;
+    uint32_t nslots = 16;
+    size_t sz, hsz;
+    byte_t* dat;
+    struct wqtree_ext* ext;
+    struct wqstats* sts;
+    if (wqtree_opt(tree, stats) || nnodes <= 0 || nhot <= 0)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqtree_ext(tree, &ext)) < 0)
+        return err;
+    while (nslots < 2*(uint32_t)nnodes)
+           nslots <<= 1;
+    sz = sizeof(struct wqstats) + nslots*sizeof(struct wqnstat);
+    if ((err = tree->alloc->alloc(&sts, sz, tree->alloc->data)) < 0)
+        return err;
+    memset(sts, 0, sz);
+    // counters and buckets of all sketches, then the merge buffer
+    hsz = WQSTATS_NSKETCHES*nhot*(sizeof(struct wqcounter) +
+                                  sizeof(struct wqbucket) +
+                                  sizeof(struct wqmerge));
+    if ((err = tree->alloc->alloc(&dat, hsz, tree->alloc->data)) < 0) {
+        tree->alloc->free(&sts, sz, tree->alloc->data);
+        return err;
+    }
+    memset(dat, 0, hsz);
+    for (int k = 0; k < WQSTATS_NSKETCHES; ++k) {
+         struct wqsketch* sk = &sts->sketches[k];
+         sk->counters = (struct wqcounter*) dat;
+         dat += nhot*sizeof(struct wqcounter);
+         sk->buckets = (struct wqbucket*) dat;
+         dat += nhot*sizeof(struct wqbucket);
+         for (int b = 0; b < nhot; ++b) {
+              sk->buckets[b].next = sk->free;
+              sk->free = &sk->buckets[b];
+         }
+    }
+    sts->merge = (struct wqmerge*) dat;
+    sts->maxhot = nhot;
+    sts->mask = nslots-1;
+    wqstats_insert_all(sts, &tree->root);
+    ext->stats = sts;
+    return 0;
+}
+
+static void
+wqbucket_push(struct wqbucket* b, struct wqcounter* c)
+{
+    c->bucket = b;
+    c->prev = NULL;
+    c->next = b->counters;
+    if (b->counters)
+        b->counters->prev = c;
+    b->counters = c;
+}
+
+// bucket of count <count>, right after <prev> (or first if NULL)
+static struct wqbucket*
+wqsketch_bucket(struct wqsketch* sk, struct wqbucket* prev, uint64_t count)
+{
+    struct wqbucket* next = prev ? prev->next : sk->min;
+    struct wqbucket* b;
+    if (next && next->count == count)
+        return next;
+    b = sk->free;
+    sk->free = b->next;
+    b->count = count;
+    b->counters = NULL;
+    b->prev = prev;
+    b->next = next;
+    if (next)
+        next->prev = b;
+    if (prev)
+        prev->next = b;
+    else
+        sk->min = b;
+    return b;
+}
+
+// moves <c> to the next count
+static void
+wqsketch_incr(struct wqsketch* sk, struct wqcounter* c)
+{
+    struct wqbucket* b = c->bucket;
+    if (c->prev == NULL && c->next == NULL &&
+       (b->next == NULL || b->next->count != b->count+1)) {
+        // alone in its bucket, which can be bumped in place
+        b->count++;
+        return;
+    }
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        b->counters = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    wqbucket_push(wqsketch_bucket(sk, b, b->count+1), c);
+    if (b->counters == NULL) {
+        if (b->prev)
+            b->prev->next = b->next;
+        else
+            sk->min = b->next;
+        b->next->prev = b->prev;
+        b->next = sk->free;
+        sk->free = b;
+    }
+}
+
+static void
+wqsketch_hit(struct wqsketch* sk, int k, int max, struct wqnstat* rec)
+{
+    struct wqcounter* c;
+    if (rec->hot[k] >= 0) {
+        wqsketch_incr(sk, &sk->counters[rec->hot[k]]);
+        return;
+    }
+    if (sk->ncounters < max) {
+        rec->hot[k] = sk->ncounters;
+        c = &sk->counters[sk->ncounters++];
+        c->rec = rec;
+        c->error = 0;
+        wqbucket_push(wqsketch_bucket(sk, NULL, 1), c);
+        return;
+    }
+    // evicts a counter with the lowest count
+    c = sk->min->counters;
+    c->rec->hot[k] = -1;
+    c->rec = rec;
+    c->error = sk->min->count;
+    rec->hot[k] = c - sk->counters;
+    wqsketch_incr(sk, c);
+}
+
+// updates received from the network
+static void
+wqstats_rx(wqtree_t* tree, wqnode_t* nd, uint32_t bytes)
+{
+    struct wqnstat* rec;
+    struct wqsketch* sk;
+    struct wqstats* sts = wqtree_opt(tree, stats);
+    if (sts == NULL || (rec = wqstats_find(sts, nd)) == NULL)
+        return;
+    __atomic_fetch_add(&rec->st.rx, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&rec->st.rx_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->st.last, wpnclock_ns(), __ATOMIC_RELAXED);
+    if (t_wqsketch < 0)
+        t_wqsketch = __atomic_fetch_add(&s_wqsketch, 1, __ATOMIC_RELAXED)
+                     % WQSTATS_NSKETCHES;
+    sk = &sts->sketches[t_wqsketch];
+    wpnspin_lock(&sk->lock);
+    wqsketch_hit(sk, t_wqsketch, sts->maxhot, rec);
+    wpnspin_unlock(&sk->lock);
+}
+
+// updates pushed to listening clients
+static void
+wqstats_tx(wqtree_t* tree, wqnode_t* nd, uint32_t bytes)
+{
+    struct wqnstat* rec;
+    struct wqstats* sts = wqtree_opt(tree, stats);
+    if (sts == NULL || (rec = wqstats_find(sts, nd)) == NULL)
+        return;
+    __atomic_fetch_add(&rec->st.tx, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&rec->st.tx_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+int
+wqtree_get_stats(wqtree_t* tree, wqnode_t* nd, struct wqnode_stats* dst)
+{
+    struct wqnstat* rec;
+    struct wqstats* sts = wqtree_opt(tree, stats);
+    if (sts == NULL || (rec = wqstats_find(sts, nd)) == NULL)
+        return WQUERY_ATTR_UNSUPPORTED;
+    dst->rx = __atomic_load_n(&rec->st.rx, __ATOMIC_RELAXED);
+    dst->tx = __atomic_load_n(&rec->st.tx, __ATOMIC_RELAXED);
+    dst->rx_bytes = __atomic_load_n(&rec->st.rx_bytes, __ATOMIC_RELAXED);
+    dst->tx_bytes = __atomic_load_n(&rec->st.tx_bytes, __ATOMIC_RELAXED);
+    dst->last = __atomic_load_n(&rec->st.last, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// merges all sketches: counts and errors of a node add up, and a node
+// missing from a full sketch may have had up to its lowest count there
+int
+wqtree_get_hot(wqtree_t* tree, struct wqhot* dst, int max)
+{
+    struct wqstats* sts = wqtree_opt(tree, stats);
+    uint64_t tmin = 0;
+    int n = 0, m = 0;
+    if (sts == NULL)
+        return -WQUERY_ATTR_UNSUPPORTED;
+    wpnspin_lock(&sts->lock);
+    for (int k = 0; k < WQSTATS_NSKETCHES; ++k) {
+         struct wqsketch* sk = &sts->sketches[k];
+         uint64_t min;
+         wpnspin_lock(&sk->lock);
+         min = sk->ncounters == sts->maxhot ? sk->min->count : 0;
+         for (int c = 0; c < sk->ncounters; ++c) {
+              struct wqcounter* ctr = &sk->counters[c];
+              struct wqmerge* e = sts->merge;
+              while (e < sts->merge+m && e->hot.node != ctr->rec->node)
+                     e++;
+              if (e == sts->merge+m) {
+                  memset(e, 0, sizeof(struct wqmerge));
+                  e->hot.node = ctr->rec->node;
+                  m++;
+              }
+              e->hot.count += ctr->bucket->count;
+              e->hot.error += ctr->error;
+              e->pmin += min;
+         }
+         wpnspin_unlock(&sk->lock);
+         tmin += min;
+    }
+    // keeps the <max> highest counts, sorted
+    for (int h = 0; h < m; ++h) {
+         struct wqhot* hot = &sts->merge[h].hot;
+         int pos = n;
+         hot->count += tmin - sts->merge[h].pmin;
+         hot->error += tmin - sts->merge[h].pmin;
+         while (pos > 0 && dst[pos-1].count < hot->count)
+                pos--;
+         if (pos == max)
+             continue;
+         n = wpnmin(n+1, max);
+         memmove(&dst[pos+1], &dst[pos], (n-1-pos)*sizeof(struct wqhot));
+         dst[pos] = *hot;
+    }
+    wpnspin_unlock(&sts->lock);
+    return n;
+}
+
+static int
+wqnode_update(wqnode_t* nd, womsg_t* womsg)
+{
+    int err;
+    enum wtype_t type = *womsg_gettag(womsg);
+    if (type == '[') {
+        // elements are handed over straight from the packet
+        const void* dat;
+        char etype = wqnode_etype(nd);
+        int n;
+        if (etype == 0)
+            return WQUERY_TYPE_MISMATCH;
+        if ((err = womsg_reada(womsg, etype, &dat, &n)))
+            return err;
+        return wqnode_seta(nd, etype, dat, n);
+    }
+    if (!(err = wqnode_check_type(nd, type))) {
+        if (type == WOSC_TYPE_BLOB) {
+            // one copy, from the packet to the node
+            const byte_t* dat;
+            uint32_t len;
+            if ((err = womsg_readblob(womsg, &dat, &len)))
+                return err;
+            return wqnode_setblob(nd, dat, len);
+        }
+        if (type == WOSC_TYPE_STRING) {
+            char* s;
+            if ((err = womsg_reads(womsg, &s)))
+                return err;
+            return wqnode_sets(nd, s);
+        } else {
+            wvalue_t v;
+            if ((err = womsg_readv(womsg, &v)))
+                return err;
+            return wqnode_setv(nd, &v);
+        }
+    }
+    return err;
+}
+
+// "<target> <ms>" messages start a ramp on float/int nodes.
+// <buf> is the pooled buffer holding the packet, if any
+static int
+wqtree_update_node(wqtree_t* tree, wqnode_t* nd,
+                   womsg_t* womsg, wqbuf_t* buf)
+{
+    int err;
+    const char* tag = womsg_gettag(womsg);
+    wqstats_rx(tree, nd, womsg_getlen(womsg));
+    if (nd->value.t == WOSC_TYPE_STRVIEW && !strcmp(tag, "s")) {
+        // string views point straight into pooled packets
+        char* s;
+        if ((err = womsg_reads(womsg, &s)) ||
+            (err = wqnode_setsv(nd, s, strlen(s), buf)))
+            return err;
+        wqtree_ramp_cancel(tree, nd);
+        return 0;
+    }
+    if (wqtree_opt(tree, ramps) && tag[1] == WOSC_TYPE_INT && tag[2] == 0 &&
+       (tag[0] == WOSC_TYPE_FLOAT || tag[0] == WOSC_TYPE_INT)) {
+        wvalue_t v;
+        int ms;
+        if ((err = womsg_readv(womsg, &v)) ||
+            (err = womsg_readi(womsg, &ms)))
+            return err;
+        return wqtree_ramp(tree, nd, &v, ms);
+    }
+    if (wqtree_opt(tree, ramps) && tag[0] == '[' &&
+        wqnode_etype(nd) == WOSC_TYPE_FLOAT &&
+        strchr(tag, ']') && !strcmp(strchr(tag, ']'), "]i")) {
+        // "[fff]i" ramps vectors, "[fff]" sets them right away
+        const float* v;
+        int n, ms;
+        if ((err = womsg_reada(womsg, WOSC_TYPE_FLOAT,
+                               (const void**) &v, &n)) ||
+            (err = womsg_readi(womsg, &ms)))
+            return err;
+        return wqtree_rampfv(tree, nd, v, n, ms);
+    }
+    if ((err = wqnode_update(nd, womsg)))
+        return err;
+    wqtree_ramp_cancel(tree, nd);
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// LOOKUP CACHE
+// ------------------------------------------------------------------------------------------------
+
+// per-thread, 2-way set associative: lines are keyed on the padded
+// address bytes of received messages, which compare a word at a time.
+// Lines are stamped with the tree version, nodes being added
+// invalidates them all. Unknown addresses are not cached
+
+#define WQCACHE_KEYSZ 48
+
+struct wqcline {
+    uint32_t key[WQCACHE_KEYSZ/4];
+    wqnode_t* node;
+    uint32_t version;
+    uint32_t len;       // padded address length, 0 if empty
+};
+
+struct wqcache {
+    wqtree_t* tree;
+    uint64_t hits;
+    uint64_t misses;
+    uint32_t mask;      // sets-1
+    uint32_t pad[9];    // lines start on a 64 bytes boundary
+    struct wqcline lines[];
+};
+
+// current thread's cache, NULL outside of server threads
+static __thread struct wqcache* t_wqc;
+
+static __always_inline uint32_t
+wqcache_word(const char* uri, uint32_t n)
+{
+    uint32_t w;
+    memcpy(&w, uri+4*n, 4);
+    return w;
+}
+
+static __always_inline bool
+wqcline_eq(const struct wqcline* ln, const char* uri, uint32_t len)
+{
+    uint32_t diff = 0;
+    if (ln->len != len)
+        return false;
+    for (uint32_t n = 0; n < len/4; ++n)
+         diff |= ln->key[n] ^ wqcache_word(uri, n);
+    return diff == 0;
+}
+
+// <len>: padded length of <uri>, as found in the packet
+static wqnode_t*
+wqcache_lookup(struct wqcache* c, wqtree_t* tree,
+               const char* uri, uint32_t len)
+{
+    struct wqcline* set;
+    wqnode_t* nd;
+    uint32_t h = len, version;
+    if (len > WQCACHE_KEYSZ || len & 3)
+        return wqtree_get_node(tree, uri);
+    if (c->tree != tree) {
+        memset(c->lines, 0, 2*(c->mask+1)*sizeof(struct wqcline));
+        c->tree = tree;
+    }
+    for (uint32_t n = 0; n < len/4; ++n)
+         h = (h ^ wqcache_word(uri, n)) * 0x9e3779b1u;
+    // addresses mostly differ in their last bytes,
+    // which only reach the high bits of <h>
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    set = &c->lines[2*(h & c->mask)];
+    version = __atomic_load_n(&tree->version, __ATOMIC_ACQUIRE);
+    for (int w = 0; w < 2; ++w) {
+         if (set[w].version == version && wqcline_eq(&set[w], uri, len)) {
+             wqcount_add(&c->hits, 1);
+             return set[w].node;
+         }
+    }
+    wqcount_add(&c->misses, 1);
+    if ((nd = wqtree_get_node(tree, uri)) == NULL)
+        return NULL;
+    // most recent line first
+    set[1] = set[0];
+    memset(set[0].key, 0, WQCACHE_KEYSZ);
+    memcpy(set[0].key, uri, len);
+    set[0].node = nd;
+    set[0].version = version;
+    set[0].len = len;
+    return nd;
+}
+
+// node lookup for a received message, through
+// the current thread's cache, if any
+static __always_inline wqnode_t*
+wqtree_lookup_osc(wqtree_t* tree, womsg_t* womsg)
+{
+    const char* uri = womsg_geturi(womsg);
+    if (t_wqc == NULL)
+        return wqtree_get_node(tree, uri);
+    // typetag follows the padded address, after its comma
+    return wqcache_lookup(t_wqc, tree, uri, womsg_gettag(womsg)-1-uri);
+}
+
+static int
+wqtree_update_osc(wqtree_t* tree, byte_t* data, int len)
+{
+    int err;
+    struct wqrec* rec;
+    womsg_t* womsg;
+    womsg_alloca(&womsg);
+    wqm_clock(t);
+    if ((rec = wqtree_opt(tree, rec)))
+        wqrec_write(rec, data, len);
+    wqt_begin(WQT_DECODE);
+    err = womsg_decode(womsg, data, len);
+    wqt_end(WQT_DECODE);
+    if (err) {
+        wqm_err(WQM_ERR_DECODE);
+        wpnerr("decoding incoming OSC message (%s)\n",
+               wosc_strerr(err));
+        return err;
+    } else {
+        wqnode_t* target;
+        wqm_lap(WQM_DECODE, t);
+        wqt_begin(WQT_LOOKUP);
+        target = wqtree_lookup_osc(tree, womsg);
+        wqt_end(WQT_LOOKUP);
+        wqm_lap(WQM_LOOKUP, t);
+        if (target == NULL) {
+            wqm_err(WQM_ERR_URI);
+            return WQUERY_URI_INVALID;
+        }
+        if ((err = wqtree_update_node(tree, target, womsg, NULL)))
+            wqm_err(WQM_ERR_UPDATE);
+        wqm_lap(WQM_UPDATE, t);
+        return err;
+    }
+}
+
+int
+wqtree_set_recorder(wqtree_t* tree, struct wqrec* rec)
+{
+    int err;
+    struct wqtree_ext* ext;
+    if (rec == NULL && tree->ext == NULL)
+        return 0;
+    if ((err = wqtree_ext(tree, &ext)) < 0)
+        return err;
+    ext->rec = rec;
+    return 0;
+}
+
+struct wqreplay {
+    wqtree_t* tree;
+    double speed;
+    uint64_t t0;    // first packet timestamp
+    uint64_t t1;    // last packet timestamp
+    struct timespec start;
+};
+
+static void
+wqreplay_span_fn(byte_t* data, uint32_t len, uint64_t ts, void* udt)
+{
+    struct wqreplay* rpl = udt;
+    (void) data;
+    (void) len;
+    if (rpl->t0 == 0)
+        rpl->t0 = ts;
+    rpl->t1 = ts;
+}
+
+static void
+wqreplay_fn(byte_t* data, uint32_t len, uint64_t ts, void* udt)
+{
+    struct wqreplay* rpl = udt;
+    if (rpl->speed > 0) {
+        // timestamps are taken under the log's lock and never go
+        // backwards, clamp anyway rather than wrapping around
+        uint64_t dt = ts > rpl->t0 ? (ts - rpl->t0) / rpl->speed : 0;
+        struct timespec at = {
+            .tv_sec  = rpl->start.tv_sec + dt/1000000000ull,
+            .tv_nsec = rpl->start.tv_nsec + dt%1000000000ull
+        };
+        if (at.tv_nsec >= 1000000000) {
+            at.tv_sec++;
+            at.tv_nsec -= 1000000000;
+        }
+        // returns an error number, only retry when interrupted
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                               &at, NULL) == EINTR)
+            ;
+    }
+    wqtree_update_osc(rpl->tree, data, len);
+}
+
+int
+wqtree_replay(wqtree_t* tree, struct wqrec* rec, double speed)
+{
+    int count;
+    struct wqrec* trec = wqtree_opt(tree, rec);
+    struct wqreplay rpl = { .tree = tree, .speed = speed };
+    if (isnan(speed))
+        return -WQUERY_REPLAY_SPEED;
+    if (speed > 0) {
+        // the whole log span, once scaled, has to fit in the
+        // nanosecond offsets added to the start time
+        wqrec_foreach(rec, wqreplay_span_fn, &rpl);
+        if ((rpl.t1 - rpl.t0) / speed >= (double) INT64_MAX)
+            return -WQUERY_REPLAY_SPEED;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &rpl.start);
+    // don't record what is being replayed
+    if (trec)
+        tree->ext->rec = NULL;
+    count = wqrec_foreach(rec, wqreplay_fn, &rpl);
+    if (trec)
+        tree->ext->rec = trec;
+    return count;
+}
+
+// ------------------------------------------------------------------------------------------------
+// NAMESPACE
+// ------------------------------------------------------------------------------------------------
+
+// OSCQuery json namespace, structure only: values change
+// all the time and are queried on their own, which is what
+// allows replies to be cached (and tagged) per tree version
+
+static void
+wqnode_type_str(wqnode_t* nd, char* dst)
+{
+    switch (nd->value.t) {
+    case WOSC_TYPE_BOOL:
+        strcpy(dst, "T");
+        break;
+    case WOSC_TYPE_VEC2F:
+        strcpy(dst, "ff");
+        break;
+    case WOSC_TYPE_VEC3F:
+        strcpy(dst, "fff");
+        break;
+    case WOSC_TYPE_VEC4F:
+        strcpy(dst, "ffff");
+        break;
+    case WOSC_TYPE_FARRAY:
+        strcpy(dst, "[f]");
+        break;
+    case WOSC_TYPE_IARRAY:
+        strcpy(dst, "[i]");
+        break;
+    case WOSC_TYPE_STRVIEW:
+        strcpy(dst, "s");
+        break;
+    default:
+        dst[0] = nd->value.t;
+        dst[1] = 0;
+    }
+}
+
+static void
+wqnode_print_json(wqnode_t* nd, struct wqm_printer* p)
+{
+    char type[8];
+    bool container = nd->value.t == WOSC_TYPE_NIL;
+    wqm_printf(p, "{\"FULL_PATH\":\"%s\",\"ACCESS\":%d", nd->uri,
+               container ? 0 : wqnode_get_access(nd));
+    if (!container) {
+        wqnode_type_str(nd, type);
+        wqm_printf(p, ",\"TYPE\":\"%s\"", type);
+    }
+    if (nd->child) {
+        wqm_printf(p, ",\"CONTENTS\":{");
+        for (wqnode_t* c = nd->child; c; c = c->sibling) {
+             wqm_printf(p, "%s\"%s\":", c == nd->child ? "" : ",",
+                        wqnode_get_name(c));
+             wqnode_print_json(c, p);
+        }
+        wqm_printf(p, "}");
+    }
+    wqm_printf(p, "}");
+}
+
+int
+wqtree_print_json(wqtree_t* tree, wqnode_t* node, char* dst,
+                  uint32_t cap, uint32_t* len)
+{
+    struct wqm_printer p = { dst, cap, 0 };
+    wqnode_print_json(node ? node : &tree->root, &p);
+    *len = p.len;
+    return p.len < cap ? 0 : WQUERY_STRBUF_OVERFLOW;
+}
+
+// ------------------------------------------------------------------------------------------------
+// SNAPSHOT
+// ------------------------------------------------------------------------------------------------
+
+#define WQSNAP_MAGIC    0x77717370
+#define WQSNAP_VERSION  1
+
+// snapshot layout (host byte order, everything 4-byte aligned):
+// header, index (sorted by hash), then one record per node
+struct wqsnap_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rsv;
+    uint32_t count;
+    uint32_t len;
+};
+
+struct wqsnap_idx {
+    uint32_t hash;
+    uint32_t off;   // record offset from start of snapshot
+};
+
+// followed by either 4 or 8 bytes of value, slen+1 bytes of
+// string, slen bytes of blob (both padded to 4), or slen
+// array elements
+struct wqsnap_rec {
+    uint8_t type;
+    uint8_t rsv;
+    uint16_t slen;
+};
+
+// fnv-1a
+static uint32_t
+wqsnap_hash(const char* uri)
+{
+    uint32_t h = 2166136261u;
+    while (*uri) {
+        h ^= (uint8_t) *uri++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// size of scalar values in records
+static __always_inline uint32_t
+wqsnap_valsz(char type)
+{
+    switch (type) {
+    case WOSC_TYPE_INT64:
+    case WOSC_TYPE_DOUBLE:
+    case WOSC_TYPE_TIMETAG:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+// string views are recorded as plain strings
+static __always_inline char
+wqsnap_type(wqnode_t* nd)
+{
+    return nd->value.t == WOSC_TYPE_STRVIEW ?
+           WOSC_TYPE_STRING : nd->value.t;
+}
+
+static __always_inline const char*
+wqsnap_str(wqnode_t* nd, uint32_t* len)
+{
+    if (nd->value.t == WOSC_TYPE_STRVIEW) {
+        *len = nd->value.u.sv->len;
+        return nd->value.u.sv->dat;
+    }
+    *len = nd->value.u.s->usd;
+    return nd->value.u.s->dat;
+}
+
+static __always_inline uint32_t
+wqsnap_recsz(wqnode_t* nd)
+{
+    uint32_t len;
+    if (wqsnap_type(nd) == WOSC_TYPE_STRING) {
+        wqsnap_str(nd, &len);
+        return sizeof(struct wqsnap_rec) + ((len+4) & ~3u);
+    }
+    if (nd->value.t == WOSC_TYPE_BLOB)
+        return sizeof(struct wqsnap_rec) +
+              ((nd->value.u.bl->len+3) & ~3u);
+    if (wqnode_etype(nd))
+        return sizeof(struct wqsnap_rec) + nd->value.u.a->len*4;
+    return sizeof(struct wqsnap_rec) + wqsnap_valsz(nd->value.t);
+}
+
+struct wqsnap {
+    byte_t* dat;
+    uint32_t count;
+    uint32_t off;
+};
+
+static void
+wqsnap_measure(wqnode_t* nd, struct wqsnap* snap)
+{
+    for (; nd; nd = nd->sibling) {
+         if (nd->value.t != WOSC_TYPE_NIL) {
+             snap->count++;
+             snap->off += wqsnap_recsz(nd);
+         }
+         wqsnap_measure(nd->child, snap);
+    }
+}
+
+static void
+wqsnap_write(wqnode_t* nd, struct wqsnap* snap)
+{
+    for (; nd; nd = nd->sibling) {
+         if (nd->value.t != WOSC_TYPE_NIL) {
+             struct wqsnap_idx* idx = (struct wqsnap_idx*)
+                    (snap->dat + sizeof(struct wqsnap_hdr));
+             struct wqsnap_rec* rec = (struct wqsnap_rec*)
+                    (snap->dat + snap->off);
+             uint32_t sz = wqsnap_recsz(nd);
+             idx[snap->count].hash = wqsnap_hash(nd->uri);
+             idx[snap->count].off = snap->off;
+             memset(rec, 0, sz);
+             rec->type = wqsnap_type(nd);
+             if (rec->type == WOSC_TYPE_STRING) {
+                 uint32_t len;
+                 const char* str = wqsnap_str(nd, &len);
+                 rec->slen = len;
+                 memcpy(rec+1, str, len);
+             } else if (nd->value.t == WOSC_TYPE_BLOB) {
+                 rec->slen = nd->value.u.bl->len;
+                 memcpy(rec+1, nd->value.u.bl->dat, rec->slen);
+             } else if (wqnode_etype(nd)) {
+                 rec->slen = nd->value.u.a->len;
+                 memcpy(rec+1, nd->value.u.a->dat, rec->slen*4);
+             } else {
+                 memcpy(rec+1, &nd->value.u, wqsnap_valsz(rec->type));
+             }
+             snap->count++;
+             snap->off += sz;
+         }
+         wqsnap_write(nd->child, snap);
+    }
+}
+
+static int
+wqsnap_idxcmp(const void* a, const void* b)
+{
+    uint32_t ha = ((const struct wqsnap_idx*) a)->hash;
+    uint32_t hb = ((const struct wqsnap_idx*) b)->hash;
+    return (ha > hb) - (ha < hb);
+}
+
+int
+wqtree_set_restored_fn(wqtree_t* tree, wqtree_fn fn, void* udt)
+{
+    int err;
+    struct wqtree_ext* ext;
+    if ((err = wqtree_ext(tree, &ext)) < 0)
+        return err;
+    ext->restored = fn;
+    ext->rudt = udt;
+    return 0;
+}
+
+uint32_t
+wqtree_snapshot_size(wqtree_t* tree)
+{
+    struct wqsnap snap = { 0 };
+    wqsnap_measure(tree->root.child, &snap);
+    return sizeof(struct wqsnap_hdr) +
+           snap.count*sizeof(struct wqsnap_idx) + snap.off;
+}
+
+int
+wqtree_snapshot(wqtree_t* tree, byte_t* dst, uint32_t cap, uint32_t* len)
+{
+    struct wqsnap snap = { 0 };
+    struct wqsnap_hdr* hdr = (struct wqsnap_hdr*) dst;
+    struct wqsnap_idx* idx;
+    wqsnap_measure(tree->root.child, &snap);
+    *len = sizeof(struct wqsnap_hdr) +
+           snap.count*sizeof(struct wqsnap_idx) + snap.off;
+    if (*len > cap)
+        return WQUERY_SNAPSHOT_OVERFLOW;
+    hdr->magic = WQSNAP_MAGIC;
+    hdr->version = WQSNAP_VERSION;
+    hdr->rsv = 0;
+    hdr->count = snap.count;
+    hdr->len = *len;
+    snap.dat = dst;
+    snap.off = *len - snap.off;
+    snap.count = 0;
+    wqsnap_write(tree->root.child, &snap);
+    idx = (struct wqsnap_idx*)(dst + sizeof(struct wqsnap_hdr));
+    qsort(idx, snap.count, sizeof(struct wqsnap_idx), wqsnap_idxcmp);
+    for (uint32_t n = 1; n < snap.count; ++n)
+         if (idx[n].hash == idx[n-1].hash)
+             return WQUERY_SNAPSHOT_COLLISION;
+    return 0;
+}
+
+struct wqrestore {
+    const byte_t* dat;
+    const struct wqsnap_idx* idx;
+    uint32_t count;
+    uint32_t len;
+    enum wqrestore_t mode;
+    int nrestored;
+    int err;
+};
+
+static const struct wqsnap_rec*
+wqrestore_find(struct wqrestore* rst, const char* uri)
+{
+    uint32_t h = wqsnap_hash(uri);
+    uint32_t lo = 0, hi = rst->count;
+    while (lo < hi) {
+        uint32_t mid = (lo+hi) >> 1;
+        if (rst->idx[mid].hash < h)
+            lo = mid+1;
+        else if (rst->idx[mid].hash > h)
+            hi = mid;
+        else if (rst->idx[mid].off + sizeof(struct wqsnap_rec)+4 > rst->len)
+            return NULL;
+        else
+            return (const struct wqsnap_rec*)(rst->dat + rst->idx[mid].off);
+    }
+    return NULL;
+}
+
+static int
+wqrestore_node(wqnode_t* nd, const struct wqsnap_rec* rec,
+               enum wqrestore_t mode)
+{
+    if (rec->type == WOSC_TYPE_STRING) {
+        const char* s = (const char*)(rec+1);
+        if (mode == WQRESTORE_NODE_FN)
+            return wqnode_sets(nd, s);
+        if (nd->value.t == WOSC_TYPE_STRVIEW) {
+            wqbuf_t* prev;
+            int err;
+            if ((err = wqstrv_assign(nd->value.u.sv, s, rec->slen,
+                                     NULL, &prev)))
+                return err;
+            if (prev)
+                wqbuf_release(prev);
+        } else {
+            if (rec->slen >= nd->value.u.s->cap)
+                return WQUERY_STRBUF_OVERFLOW;
+            memcpy(nd->value.u.s->dat, s, rec->slen+1);
+            nd->value.u.s->usd = rec->slen;
+        }
+    } else if (rec->type == WOSC_TYPE_BLOB) {
+        if (mode == WQRESTORE_NODE_FN)
+            return wqnode_setblob(nd, rec+1, rec->slen);
+        if (rec->slen > nd->value.u.bl->cap)
+            return WQUERY_STRBUF_OVERFLOW;
+        memcpy(nd->value.u.bl->dat, rec+1, rec->slen);
+        nd->value.u.bl->len = rec->slen;
+    } else if (wqnode_etype(nd)) {
+        if (mode == WQRESTORE_NODE_FN)
+            return wqnode_seta(nd, wqnode_etype(nd), rec+1, rec->slen);
+        if (rec->slen > nd->value.u.a->cap)
+            return WQUERY_STRBUF_OVERFLOW;
+        memcpy(nd->value.u.a->dat, rec+1, rec->slen*4);
+        nd->value.u.a->len = rec->slen;
+    } else {
+        wvalue_t v = { .t = rec->type };
+        memcpy(&v.u, rec+1, wqsnap_valsz(rec->type));
+        if (mode == WQRESTORE_NODE_FN)
+            return wqnode_setv(nd, &v);
+        nd->value.u = v.u;
+    }
+    wqnode_touch(nd);
+    return 0;
+}
+
+// record value size, string terminator included
+static __always_inline uint32_t
+wqsnap_paysz(wqnode_t* nd, const struct wqsnap_rec* rec)
+{
+    if (rec->type == WOSC_TYPE_STRING)
+        return rec->slen+1;
+    if (rec->type == WOSC_TYPE_BLOB)
+        return rec->slen;
+    if (wqnode_etype(nd))
+        return rec->slen*4;
+    return wqsnap_valsz(rec->type);
+}
+
+static void
+wqrestore_walk(wqnode_t* nd, struct wqrestore* rst)
+{
+    for (; nd; nd = nd->sibling) {
+         const struct wqsnap_rec* rec;
+         if (nd->value.t != WOSC_TYPE_NIL &&
+            (rec = wqrestore_find(rst, nd->uri)) &&
+             rec->type == wqsnap_type(nd)) {
+             // value must be contained in the snapshot,
+             // and string terminated
+             uint32_t off = (const byte_t*)(rec+1) - rst->dat;
+             if (off + wqsnap_paysz(nd, rec) > rst->len ||
+                (rec->type == WOSC_TYPE_STRING &&
+               ((const char*)(rec+1))[rec->slen])) {
+                 rst->err = WQUERY_SNAPSHOT_INVALID;
+             } else {
+                 int err = wqrestore_node(nd, rec, rst->mode);
+                 if (err)
+                     rst->err = err;
+                 else
+                     rst->nrestored++;
+             }
+         }
+         wqrestore_walk(nd->child, rst);
+    }
+}
+
+int
+wqtree_restore(wqtree_t* tree, const byte_t* src, uint32_t len,
+               enum wqrestore_t mode)
+{
+    const struct wqsnap_hdr* hdr = (const struct wqsnap_hdr*) src;
+    struct wqrestore rst;
+    if (len < sizeof(struct wqsnap_hdr) ||
+        hdr->magic != WQSNAP_MAGIC ||
+        hdr->version != WQSNAP_VERSION ||
+        hdr->len > len ||
+        hdr->count > (hdr->len-sizeof(struct wqsnap_hdr)) /
+                      sizeof(struct wqsnap_idx))
+        return WQUERY_SNAPSHOT_INVALID;
+    rst.dat = src;
+    rst.idx = (const struct wqsnap_idx*)(src + sizeof(struct wqsnap_hdr));
+    rst.count = hdr->count;
+    rst.len = hdr->len;
+    rst.mode = mode;
+    rst.nrestored = 0;
+    rst.err = 0;
+    wqrestore_walk(tree->root.child, &rst);
+    if (mode == WQRESTORE_BULK && wqtree_opt(tree, restored))
+        tree->ext->restored(tree, rst.nrestored, tree->ext->rudt);
+    return rst.err;
+}
+
+// the snapshot is written to <path>.tmp first, and only renamed
+// over <path> once complete and synced, so that a crash or a failed
+// save never leaves a truncated snapshot behind
+int
+wqtree_snapshot_save(wqtree_t* tree, const char* path)
+{
+    int fd, err;
+    uint32_t len = wqtree_snapshot_size(tree);
+    char tmp[PATH_MAX];
+    void* map;
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp))
+        return WQUERY_FILE_ERR;
+    if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        return WQUERY_FILE_ERR;
+    if (ftruncate(fd, len) ||
+       (map = mmap(0, len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        err = WQUERY_FILE_ERR;
+        goto fail;
+    }
+    err = wqtree_snapshot(tree, map, len, &len);
+    if (!err && msync(map, len, MS_SYNC))
+        err = WQUERY_FILE_ERR;
+    munmap(map, len);
+    if (err)
+        goto fail;
+    if (fsync(fd)) {
+        err = WQUERY_FILE_ERR;
+        goto fail;
+    }
+    if (close(fd) || rename(tmp, path)) {
+        unlink(tmp);
+        return WQUERY_FILE_ERR;
+    }
+    return 0;
+fail:
+    close(fd);
+    unlink(tmp);
+    return err;
+}
+
+int
+wqtree_snapshot_load(wqtree_t* tree, const char* path,
+                     enum wqrestore_t mode)
+{
+    int fd, err;
+    struct stat st;
+    void* map;
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return WQUERY_FILE_ERR;
+    if (fstat(fd, &st) || (size_t) st.st_size < sizeof(struct wqsnap_hdr) ||
+       (map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE |
+                   MAP_POPULATE, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return WQUERY_FILE_ERR;
+    }
+    err = wqtree_restore(tree, map, st.st_size, mode);
+    munmap(map, st.st_size);
+    close(fd);
+    return err;
+}
+
+// ------------------------------------------------------------------------------------------------
+// NETWORK
+// ------------------------------------------------------------------------------------------------
+
+#include <dependencies/mongoose/mongoose.h>
+#include <wpn114/network/shm.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef WQUERY_URING
+#include <wpn114/network/uring.h>
+#endif
+#ifdef WQUERY_ZLIB
+#include <zlib.h>
+#endif
+
+#ifndef WQUERY_MAX_UDP_WORKERS
+#define WQUERY_MAX_UDP_WORKERS 8
+#endif
+
+// number of node-update locks shared by udp workers,
+// must be a power of two
+#ifndef WQUERY_UDP_SHARDS
+#define WQUERY_UDP_SHARDS 64
+#endif
+
+// datagrams fetched per recvmmsg call, and their max size
+// (large enough for a few kilobytes of blob)
+#define WQUERY_UDP_BATCH 16
+#ifndef WQUERY_UDP_MTU
+#define WQUERY_UDP_MTU 8192
+#endif
+
+// max number of nodes being listened to at the same time
+#ifndef WQUERY_MAX_LISTEN
+#define WQUERY_MAX_LISTEN 256
+#endif
+
+// outgoing LISTEN messages per flush batch, and their storage
+#define WQUERY_OUT_BATCH 64
+#define WQUERY_OUT_BUFSZ 8192
+
+// max number of shared-memory peers
+#ifndef WQUERY_MAX_SHM
+#define WQUERY_MAX_SHM 4
+#endif
+
+// max number of OSC stream (tcp) peers, and size of
+// their output buffer, flushed once per poll cycle
+#ifndef WQUERY_MAX_STREAMS
+#define WQUERY_MAX_STREAMS 8
+#endif
+#define WQUERY_STREAM_BUFSZ 16384
+
+// prometheus text output, for ?METRICS queries
+#define WQUERY_METRICS_BUFSZ 8192
+
+// default send queue watermarks of websocket clients (bytes),
+// see wqserver_set_client_budget
+#ifndef WQUERY_WS_HIWAT
+#define WQUERY_WS_HIWAT (1 << 20)
+#endif
+#ifndef WQUERY_WS_LOWAT
+#define WQUERY_WS_LOWAT (1 << 18)
+#endif
+
+// hottest nodes, for ?HOT queries
+#define WQUERY_HOT_MAX 32
+#define WQUERY_HOT_BUFSZ 8192
+
+// io_uring: submission slots, registered receive buffers
+#define WQUERY_URING_ENTRIES 256
+#define WQUERY_URING_NBUFS 256
+// max time spent waiting on the ring before mongoose gets polled
+#define WQUERY_URING_WAIT_MS 5
+
+#define HTTP_OK             200
+#define HTTP_NO_CONTENT     204
+#define HTTP_NOT_MODIFIED   304
+#define HTTP_BAD_REQUEST    400
+#define HTTP_FORBIDDEN      403
+#define HTTP_NOT_FOUND      404
+#define HTTP_REQ_TIME_OUT   408
+#define HTTP_SERVER_ERROR   500
+
+#define HTTP_MIME           "Content-Type: "
+#define HTTP_MIME_JSON      HTTP_MIME "application/json"
+#define HTTP_MIME_BINARY    HTTP_MIME "application/octet-stream"
+#define HTTP_MIME_PROMETHEUS HTTP_MIME "text/plain; version=0.0.4"
+
+// outbound state of a websocket client: token buckets,
+// and the listened nodes it missed while lagging
+struct wqlag {
+    double btokens;
+    double mtokens;
+    uint64_t refill;            // ns
+    uint64_t since;             // lagging since (ns), 0 if it's not
+    uint64_t sent;
+    uint64_t coalesced;
+    uint32_t queued;
+    uint32_t max_queued;
+    uint32_t npending;
+    uint8_t pending[WQUERY_MAX_LISTEN/8];
+};
+
+struct wqbudget {
+    uint32_t bps;
+    uint32_t mps;
+    uint32_t lowat;
+    uint32_t hiwat;
+};
+
+struct wqconnection {
+    struct mg_connection* tcp;
+    int udp;
+    bool mcast;     // streams through the group
+};
+
+static __always_inline bool
+wqlag_pending(struct wqlag* lag, int n)
+{
+    return lag->pending[n >> 3] & (1 << (n & 7));
+}
+
+static __always_inline void
+wqlag_clear(struct wqlag* lag, int n)
+{
+    lag->pending[n >> 3] &= ~(1 << (n & 7));
+    lag->npending--;
+}
+
+// marks listened node <n> as missed, an update that was
+// already pending is dropped in favour of this one
+static __always_inline void
+wqlag_defer(struct wqlag* lag, int n)
+{
+    if (wqlag_pending(lag, n)) {
+        __atomic_store_n(&lag->coalesced, lag->coalesced+1, __ATOMIC_RELAXED);
+        return;
+    }
+    lag->pending[n >> 3] |= 1 << (n & 7);
+    lag->npending++;
+}
+
+// listened node <from> moved to slot <to>, replacing
+// the node that was removed from there
+static void
+wqlag_move(struct wqlag* lag, int from, int to)
+{
+    if (wqlag_pending(lag, to))
+        wqlag_clear(lag, to);
+    if (from != to && wqlag_pending(lag, from)) {
+        wqlag_clear(lag, from);
+        wqlag_defer(lag, to);
+    }
+}
+
+// allocated on first LISTEN command: listened nodes,
+// and storage for one batch of outgoing messages,
+// each message being sent to every streaming client
+struct wqoutput {
+    wqnode_t* nodes[WQUERY_MAX_LISTEN];
+    int nnodes;
+    struct wqlag lag[WQUERY_MAX_CONNECTIONS];
+    int niov;
+    uint32_t usd;
+    struct iovec iov[WQUERY_OUT_BATCH];
+    struct mmsghdr msgs[WQUERY_OUT_BATCH*WQUERY_MAX_CONNECTIONS];
+    struct sockaddr_in uaddr[WQUERY_MAX_CONNECTIONS];   // batch destinations
+    byte_t buf[WQUERY_OUT_BUFSZ];
+    uint32_t susd;
+    byte_t sbuf[WQUERY_STREAM_BUFSZ];
+};
+
+// namespace replies, allocated on first request, serialized
+// and compressed again only when the tree structure changes
+struct wqns {
+    uint32_t version;
+    uint32_t boot;              // so that etags don't outlive the server
+    char etag[24];
+    char gzetag[28];            // gzipped reply is another representation
+    char* json;
+    byte_t* gz;
+    uint32_t jlen;
+    uint32_t jcap;
+    uint32_t zlen;
+    uint32_t zcap;
+};
+
+struct wqstream {
+    struct mg_connection* tcp;
+    wodeframer_t dfr;
+};
+
+struct wqworker {
+    struct wqserver* server;
+    pthread_t thread;
+    int fd;
+};
+
+// allocated on demand, only when udp workers are requested
+struct wqworkers {
+    pthread_mutex_t shards[WQUERY_UDP_SHARDS];
+    int nworkers;
+    int nrunning;
+    struct wqworker wk[];
+};
+
+struct wqshm {
+    wshm_t* in;
+    wshm_t* out;
+};
+
+// optional server state (alternate backends, local and stream
+// transports, multicast, client budgets, namespace replies,
+// per-thread metrics and caches), allocated along with the first
+// feature needing it
+struct wqserver_ext {
+    struct wqshm shm[WQUERY_MAX_SHM];
+    struct sockaddr_in mcast;   // multicast group
+    struct in_addr mcast_if;
+    int mfd;                    // group output, not a member
+    const char* unix_path;
+    struct wqstream* streams;   // allocated with wqserver_bind_stream
+    struct wqbudget budget;     // per websocket client
+    struct wqns* ns;            // cached namespace replies
+#ifdef WQUERY_METRICS
+    // poll loop, then udp workers, allocated when running
+    struct wqmetrics* metrics;
+#endif
+    // lookup caches, same order
+    byte_t* caches;
+    uint32_t cache_sets;
+#ifdef WQUERY_URING
+    wuring_t* uring;
+#endif
+    enum wqbackend_t backend;
+    uint16_t sport;
+    uint8_t sframing;
+    int unix_fd;
+    int nshm;
+};
+
+struct wqserver {
+    struct mg_mgr mgr;
+    struct wqconnection cn[WQUERY_MAX_CONNECTIONS];
+    struct wqtree* tree;
+    struct walloc_t* allocator;
+    struct wqserver_ext* ext;
+    struct wqworkers* workers;
+    struct wqoutput* out;
+#ifdef WPN114_MULTITHREAD
+    pthread_t thread;
+#endif
+    bool running;
+    uint16_t uport;
+    int ufd;
+};
+
+// <_field> of <_server> optional state, NULL if there's none
+#define wqserver_opt(_server, _field) \
+    ((_server)->ext ? (_server)->ext->_field : NULL)
+
+// client budget when none was set
+static struct wqbudget
+s_wqbudget = { 0, 0, WQUERY_WS_LOWAT, WQUERY_WS_HIWAT };
+
+int
+wqserver_walloc(struct walloc_t* _allocator, wqserver_t** dst)
+{
+    int err;
+    if ((err = _allocator->alloc(dst,
+                sizeof(struct wqserver),
+               _allocator->data)) >= 0) {
+        memset(*dst, 0, sizeof(struct wqserver));
+        (*dst)->allocator = _allocator;
+        (*dst)->ufd = -1;
+        err = 0;
+    }
+    return err;
+}
+
+static int
+wqserver_ext(wqserver_t* server, struct wqserver_ext** dst)
+{
+    int err;
+    struct wqserver_ext* ext;
+    if (server->ext == NULL) {
+        if ((err = server->allocator->alloc(&ext,
+                    sizeof(struct wqserver_ext),
+                    server->allocator->data)) < 0)
+            return err;
+        memset(ext, 0, sizeof(struct wqserver_ext));
+        ext->unix_fd = -1;
+        ext->mfd = -1;
+        ext->budget = s_wqbudget;
+        server->ext = ext;
+    }
+    *dst = server->ext;
+    return 0;
+}
+
+static inline struct wqbudget*
+wqserver_budget(wqserver_t* server)
+{
+    return server->ext ? &server->ext->budget : &s_wqbudget;
+}
+
+// multicast group LISTEN values are streamed to, NULL if none
+static inline struct sockaddr_in*
+wqserver_group(wqserver_t* server)
+{
+    return server->ext && server->ext->mcast.sin_port ?
+           &server->ext->mcast : NULL;
+}
+
+static inline enum wqbackend_t
+wqserver_backend(wqserver_t* server)
+{
+    return server->ext ? server->ext->backend : WQSERVER_BACKEND_MONGOOSE;
+}
+
+void
+wqserver_set_allocator(struct wqserver* server,
+                       struct walloc_t* allocator)
+{
+    server->allocator = allocator;
+}
+
+int
+wqserver_expose(wqserver_t* server, wqtree_t* tree)
+{
+    server->tree = tree;
+    return 0;
+}
+
+static struct wqconnection*
+wqserver_get_connection(wqserver_t* server, struct mg_connection* mgc)
+{
+    for (int n = 0; n < WQUERY_MAX_CONNECTIONS; ++n)
+         if (server->cn[n].tcp == mgc)
+             return &server->cn[n];
+    return NULL;
+}
+
+static inline int
+wqserver_reply_json(struct mg_connection* mgc,
+                    const char* json)
+{
+    mg_send_head(mgc, HTTP_OK, strlen(json), HTTP_MIME_JSON);
+    mg_printf(mgc, "%.*s", (int)strlen(json), json);
+    return 0;
+}
+
+static int
+wqserver_add_connection(struct wqserver* server,
+                        struct mg_connection* mgc)
+{
+    for (int nc = 0; nc < WQUERY_MAX_CONNECTIONS; ++nc) {
+        if (server->cn[nc].tcp == NULL) {
+            server->cn[nc].tcp = mgc;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void
+wqserver_cmd_listen(wqserver_t* server, char* data, int size,
+                    bool status)
+{
+    wqnode_t* target;
+    char* path;
+    int n = 0;
+    // we don't need to reuse data after that
+    // this way, we don't need extra allocation
+    path = &data[strcspn(data, "/")];
+    while (path[n] != '\"')  n++;
+    path[n] = '\0';
+    if ((target = wqtree_get_node(server->tree, path)) == NULL) {
+        wpnerr("could not find node %s\n", path);
+        return;
+    }
+    if (server->out == NULL) {
+        if (server->allocator->alloc(&server->out, sizeof(struct wqoutput),
+                                     server->allocator->data) < 0) {
+            wpnerr("could not allocate LISTEN storage, ignoring\n");
+            server->out = NULL;
+            return;
+        }
+        memset(server->out, 0, sizeof(struct wqoutput));
+    }
+    if (status && !(target->status & WQNODE_LISTEN)) {
+        if (server->out->nnodes == WQUERY_MAX_LISTEN) {
+            wpnerr("max number of listened nodes reached, "
+                   "ignoring %s\n", path);
+            return;
+        }
+        server->out->nodes[server->out->nnodes++] = target;
+        __atomic_fetch_or(&target->status, WQNODE_LISTEN,
+                          __ATOMIC_RELEASE);
+    } else if (!status && target->status & WQNODE_LISTEN) {
+        struct wqoutput* out = server->out;
+        __atomic_fetch_and(&target->status, ~(WQNODE_LISTEN|WQNODE_DIRTY),
+                           __ATOMIC_RELEASE);
+        for (n = 0; n < out->nnodes; ++n) {
+            if (out->nodes[n] == target) {
+                out->nodes[n] = out->nodes[--out->nnodes];
+                for (int c = 0; c < WQUERY_MAX_CONNECTIONS; ++c)
+                     wqlag_move(&out->lag[c], out->nnodes, n);
+                break;
+            }
+        }
+    }
+}
+
+static void
+wqserver_handle_ws_text(wqserver_t* server,
+                        struct mg_connection* mgc,
+                        struct websocket_message* wm)
+{
+    // parse json
+    char cmd[32], *data = (char*)wm->data;
+    int size = wm->size;
+    mjson_get_string(data, size, "$.COMMAND", cmd, sizeof(cmd));
+
+    if (strcmp(cmd, "LISTEN") == 0)
+        wqserver_cmd_listen(server, data, size, true);
+    else if (strcmp(cmd, "IGNORE") == 0)
+        wqserver_cmd_listen(server, data, size, false);
+
+    else if (strcmp(cmd, "START_OSC_STREAMING") == 0) {
+        struct wqconnection* wqc;
+        double port;
+        int mcast = 0;
+        mjson_get_number(data, size, "$.DATA.LOCAL_SERVER_PORT", &port);
+        mjson_get_bool(data, size, "$.DATA.MULTICAST", &mcast);
+        if ((wqc = wqserver_get_connection(server, mgc))) {
+             wqc->udp = port;
+             // unicast fallback if we're not streaming to a group
+             wqc->mcast = mcast && wqserver_group(server);
+        }
+        else
+            wpnerr("could not find wqconnection, "
+                   "ignoring message: %s\n", wm->data);
+    }
+}
+
+// whole ring in a single binary reply, samples are sent
+// as they are stored, so that clients can backfill at once.
+// udp workers sample the node under its shard lock
+static void
+wqserver_reply_history(wqserver_t* server, struct mg_connection* mgc,
+                       wqnode_t* nd)
+{
+    struct wqsample* p1, *p2;
+    pthread_mutex_t* shard = NULL;
+    uint32_t n1, n2, hdr[4];
+    uint64_t now = wpnclock_ns();
+    if (nd == NULL || !(nd->status & WQNODE_HISTORY)) {
+        mg_send_head(mgc, HTTP_NOT_FOUND, 0, NULL);
+        return;
+    }
+    if (server->workers) {
+        shard = wqserver_shard(server->workers, nd);
+        pthread_mutex_lock(shard);
+    }
+    hdr[0] = wqhistory_parts(nd->udt, &p1, &n1, &p2, &n2);
+    hdr[1] = nd->value.t;
+    memcpy(&hdr[2], &now, sizeof(now));
+    mg_send_head(mgc, HTTP_OK, sizeof(hdr) + hdr[0]*sizeof(struct wqsample),
+                 HTTP_MIME_BINARY);
+    mg_send(mgc, hdr, sizeof(hdr));
+    mg_send(mgc, p1, n1*sizeof(struct wqsample));
+    mg_send(mgc, p2, n2*sizeof(struct wqsample));
+    if (shard)
+        pthread_mutex_unlock(shard);
+}
+
+int
+wqserver_set_client_budget(wqserver_t* server, uint32_t bps, uint32_t mps,
+                           uint32_t lowat, uint32_t hiwat)
+{
+    int err;
+    struct wqserver_ext* ext;
+    if (lowat > hiwat)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqserver_ext(server, &ext)) < 0)
+        return err;
+    ext->budget = (struct wqbudget) { bps, mps, lowat, hiwat };
+    return 0;
+}
+
+int
+wqserver_get_client_lag(wqserver_t* server, struct wqclient_lag* dst, int max)
+{
+    // no state until something is listened to
+    struct wqlag zero = { 0 };
+    uint64_t now = wpnclock_ns();
+    int n = 0;
+    for (int c = 0; c < WQUERY_MAX_CONNECTIONS && n < max; ++c) {
+         struct wqconnection* wqc = &server->cn[c];
+         struct wqlag* lag = &zero;
+         char ip[INET_ADDRSTRLEN];
+         uint64_t since;
+         if (wqc->tcp == NULL)
+             continue;
+         if (server->out)
+             lag = &server->out->lag[c];
+         since = __atomic_load_n(&lag->since, __ATOMIC_RELAXED);
+         inet_ntop(AF_INET, &wqc->tcp->sa.sin.sin_addr, ip, sizeof(ip));
+         snprintf(dst[n].addr, sizeof(dst[n].addr), "%s:%u",
+                  ip, ntohs(wqc->tcp->sa.sin.sin_port));
+         dst[n].queued = __atomic_load_n(&lag->queued, __ATOMIC_RELAXED);
+         dst[n].max_queued = __atomic_load_n(&lag->max_queued, __ATOMIC_RELAXED);
+         dst[n].pending = __atomic_load_n(&lag->npending, __ATOMIC_RELAXED);
+         dst[n].sent = __atomic_load_n(&lag->sent, __ATOMIC_RELAXED);
+         dst[n].coalesced = __atomic_load_n(&lag->coalesced, __ATOMIC_RELAXED);
+         dst[n].lag = since && now > since ? now-since : 0;
+         n++;
+    }
+    return n;
+}
+
+int
+wqserver_get_metrics(wqserver_t* server, char* dst, uint32_t cap, uint32_t* len)
+{
+#ifdef WQUERY_METRICS
+    struct wqm_printer p = { dst, cap, 0 };
+    struct wqclient_lag lag[WQUERY_MAX_CONNECTIONS];
+    int nsets = 1, nclients;
+    if (wqserver_opt(server, metrics) == NULL)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if (server->workers)
+        nsets += server->workers->nworkers;
+    wqmetrics_print(server->ext->metrics, nsets, &p);
+    nclients = wqserver_get_client_lag(server, lag, WQUERY_MAX_CONNECTIONS);
+    if (nclients) {
+        wqm_printf(&p, "# TYPE wquery_client_queued_bytes gauge\n");
+        for (int c = 0; c < nclients; ++c)
+             wqm_printf(&p, "wquery_client_queued_bytes{client=\"%s\"} %" PRIu32 "\n",
+                        lag[c].addr, lag[c].queued);
+        wqm_printf(&p, "# TYPE wquery_client_coalesced_total counter\n");
+        for (int c = 0; c < nclients; ++c)
+             wqm_printf(&p, "wquery_client_coalesced_total{client=\"%s\"} %" PRIu64 "\n",
+                        lag[c].addr, lag[c].coalesced);
+        wqm_printf(&p, "# TYPE wquery_client_lag_seconds gauge\n");
+        for (int c = 0; c < nclients; ++c)
+             wqm_printf(&p, "wquery_client_lag_seconds{client=\"%s\"} %.9f\n",
+                        lag[c].addr, lag[c].lag*1e-9);
+    }
+    *len = p.len;
+    return p.len < cap ? 0 : WQUERY_STRBUF_OVERFLOW;
+#else
+    (void) server; (void) dst; (void) cap; (void) len;
+    return WQUERY_ATTR_UNSUPPORTED;
+#endif
+}
+
+static void
+wqserver_reply_metrics(struct mg_connection* mgc, wqserver_t* server)
+{
+    char buf[WQUERY_METRICS_BUFSZ];
+    uint32_t len;
+    if (wqserver_get_metrics(server, buf, sizeof(buf), &len)) {
+        mg_send_head(mgc, HTTP_NOT_FOUND, 0, NULL);
+        return;
+    }
+    mg_send_head(mgc, HTTP_OK, len, HTTP_MIME_PROMETHEUS);
+    mg_send(mgc, buf, len);
+}
+
+// better to omit fields that are 'false'?
+static const char*
+s_host_ext =
+    "{ "
+        "\"ACCESS\": true,"
+        "\"VALUE\": true,"
+        "\"CRITICAL\": true,"
+        "\"LISTEN\": true,"
+        "\"HISTORY\": true,"
+        "\"OSC_STREAMING\": true"
+//        "\"DESCRIPTION\": false,"
+//        "\"TAGS\": false,"
+//        "\"EXTENDED_TYPE\": false,"
+//        "\"UNIT\": false,"
+//        "\"CLIPMODE\": false,"
+//        "\"PATH_CHANGED\": false,"
+//        "\"PATH_REMOVED\": false,"
+//        "\"PATH_ADDED\": false,"
+//        "\"PATH_RENAMED\": false,"
+//        "\"HTML\": false,"
+//        "\"ECHO\": false, "
+    "}";
+
+#define WJSTR(_str) "\"" _str "\""
+
+static void
+wqserver_reply_hot(struct mg_connection* mgc, wqtree_t* tree)
+{
+    struct wqhot hot[WQUERY_HOT_MAX];
+    struct wqnode_stats st;
+    char buf[WQUERY_HOT_BUFSZ];
+    int n, len = 1;
+    if ((n = wqtree_get_hot(tree, hot, WQUERY_HOT_MAX)) < 0) {
+        mg_send_head(mgc, HTTP_NOT_FOUND, 0, NULL);
+        return;
+    }
+    buf[0] = '[';
+    for (int h = 0; h < n; ++h) {
+         int w;
+         wqtree_get_stats(tree, hot[h].node, &st);
+         w = snprintf(&buf[len], sizeof(buf)-len, "%s{%s:\"%s\", "
+                      "%s:%" PRIu64 ", %s:%" PRIu64 ", %s:%" PRIu64 ", "
+                      "%s:%" PRIu64 ", %s:%" PRIu64 ", %s:%" PRIu64 "}",
+                      h ? ", " : "", WJSTR("FULL_PATH"), hot[h].node->uri,
+                      WJSTR("COUNT"), hot[h].count, WJSTR("ERROR"), hot[h].error,
+                      WJSTR("RX"), st.rx, WJSTR("TX"), st.tx,
+                      WJSTR("RX_BYTES"), st.rx_bytes, WJSTR("TX_BYTES"), st.tx_bytes);
+         // keep room for the closing bracket
+         if (w >= (int) sizeof(buf)-len-1)
+             break;
+         len += w;
+    }
+    buf[len++] = ']';
+    buf[len] = 0;
+    wqserver_reply_json(mgc, buf);
+}
+
+// grows <*buf> to at least <need> bytes, contents are not kept.
+// with some headroom, so that a few nodes can be added without
+// the buffer being given back (which mempools can't always take)
+static int
+wqns_reserve(struct walloc_t* alloc, void* buf, uint32_t* cap, uint32_t need)
+{
+    int err;
+    if (need <= *cap)
+        return 0;
+    if (*cap)
+        alloc->free(buf, *cap, alloc->data);
+    *cap = 0;
+    need += need/4;
+    if ((err = alloc->alloc(buf, need, alloc->data)) < 0)
+        return err;
+    *cap = need;
+    return 0;
+}
+
+#ifdef WQUERY_ZLIB
+// gzip rather than raw deflate, which some browsers mishandle.
+// done once per tree version, so compression level is maxed out
+static int
+wqns_compress(struct walloc_t* alloc, struct wqns* ns)
+{
+    int err;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED,
+                     15+16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqns_reserve(alloc, &ns->gz, &ns->zcap,
+                            deflateBound(&zs, ns->jlen))) == 0) {
+        zs.next_in = (byte_t*) ns->json;
+        zs.avail_in = ns->jlen;
+        zs.next_out = ns->gz;
+        zs.avail_out = ns->zcap;
+        err = deflate(&zs, Z_FINISH) == Z_STREAM_END ?
+              0 : WQUERY_STRBUF_OVERFLOW;
+        ns->zlen = zs.total_out;
+    }
+    deflateEnd(&zs);
+    return err;
+}
+#endif
+
+// brings namespace replies up to date with the tree
+static int
+wqserver_update_ns(wqserver_t* server)
+{
+    struct walloc_t* alloc = server->allocator;
+    struct wqserver_ext* ext;
+    struct wqns* ns = wqserver_opt(server, ns);
+    uint32_t version = wqtree_get_version(server->tree);
+    uint32_t len;
+    int err;
+    if (ns == NULL) {
+        if ((err = wqserver_ext(server, &ext)) < 0)
+            return err;
+        if ((err = alloc->alloc(&ext->ns, sizeof(struct wqns),
+                                alloc->data)) < 0) {
+            ext->ns = NULL;
+            return err;
+        }
+        ns = ext->ns;
+        memset(ns, 0, sizeof(struct wqns));
+        ns->boot = wpnclock_ns() >> 10;
+    } else if (ns->json && ns->version == version) {
+        return 0;
+    }
+    wqtree_print_json(server->tree, &server->tree->root, NULL, 0, &len);
+    if ((err = wqns_reserve(alloc, &ns->json, &ns->jcap, len+1)))
+        return err;
+    wqtree_print_json(server->tree, &server->tree->root,
+                      ns->json, ns->jcap, &ns->jlen);
+    ns->zlen = 0;
+#ifdef WQUERY_ZLIB
+    if ((err = wqns_compress(alloc, ns)))
+        wpnerr("could not compress namespace, serving it as is\n");
+#endif
+    ns->version = version;
+    snprintf(ns->etag, sizeof(ns->etag), "\"%08x-%08x\"",
+             ns->boot, version);
+    snprintf(ns->gzetag, sizeof(ns->gzetag), "\"%08x-%08x-gz\"",
+             ns->boot, version);
+    return 0;
+}
+
+int
+wqserver_get_namespace(wqserver_t* server, bool gzip, const void** dst,
+                       uint32_t* len, const char** etag)
+{
+    int err;
+    struct wqns* ns;
+    if ((err = wqserver_update_ns(server)))
+        return err;
+    ns = server->ext->ns;
+    if (gzip && ns->zlen == 0)
+        return WQUERY_ATTR_UNSUPPORTED;
+    *dst = gzip ? (void*) ns->gz : ns->json;
+    *len = gzip ? ns->zlen : ns->jlen;
+    *etag = gzip ? ns->gzetag : ns->etag;
+    return 0;
+}
+
+// namespace of <target>, only the whole tree is cached,
+// other nodes are serialized on request, but they're all
+// tagged with the tree version, clients revalidate with it
+static void
+wqserver_reply_namespace(wqserver_t* server, struct mg_connection* mgc,
+                         struct http_message* hm, wqnode_t* target)
+{
+    struct mg_str* hdr;
+    struct wqns* ns;
+    const char* etag;
+    char head[160];
+    bool gzip;
+    if (target == NULL) {
+        mg_send_head(mgc, HTTP_NOT_FOUND, 0, NULL);
+        return;
+    }
+    if (wqserver_update_ns(server)) {
+        mg_send_head(mgc, HTTP_SERVER_ERROR, 0, NULL);
+        return;
+    }
+    ns = server->ext->ns;
+    hdr = mg_get_http_header(hm, "Accept-Encoding");
+    gzip = ns->zlen && target == &server->tree->root &&
+           hdr && memmem(hdr->p, hdr->len, "gzip", 4);
+    etag = gzip ? ns->gzetag : ns->etag;
+    hdr = mg_get_http_header(hm, "If-None-Match");
+    if (hdr && hdr->len == strlen(etag) &&
+        memcmp(hdr->p, etag, hdr->len) == 0) {
+        snprintf(head, sizeof(head), "ETag: %s", etag);
+        mg_send_head(mgc, HTTP_NOT_MODIFIED, 0, head);
+        return;
+    }
+    snprintf(head, sizeof(head), "%s\r\nETag: %s\r\nVary: Accept-Encoding%s",
+             HTTP_MIME_JSON, etag, gzip ? "\r\nContent-Encoding: gzip" : "");
+    if (target == &server->tree->root) {
+        mg_send_head(mgc, HTTP_OK, gzip ? ns->zlen : ns->jlen, head);
+        mg_send(mgc, gzip ? (void*) ns->gz : ns->json,
+                gzip ? ns->zlen : ns->jlen);
+    } else {
+        struct walloc_t* alloc = server->allocator;
+        uint32_t len;
+        char* buf;
+        wqtree_print_json(server->tree, target, NULL, 0, &len);
+        if (alloc->alloc(&buf, len+1, alloc->data) < 0) {
+            mg_send_head(mgc, HTTP_SERVER_ERROR, 0, NULL);
+            return;
+        }
+        wqtree_print_json(server->tree, target, buf, len+1, &len);
+        mg_send_head(mgc, HTTP_OK, len, head);
+        mg_send(mgc, buf, len);
+        alloc->free(&buf, len+1, alloc->data);
+    }
+}
+
+static void
+wqserver_handle_request(wqserver_t* server,
+                        struct mg_connection* mgc,
+                        struct http_message* hm)
+{
+    wqnode_t* target = NULL;
+    char uri[256];
+    // request uri is not terminated, it runs into the query string
+    if (hm->uri.len < sizeof(uri)) {
+        memcpy(uri, hm->uri.p, hm->uri.len);
+        uri[hm->uri.len] = 0;
+        target = wqtree_get_node(server->tree, uri);
+    }
+    if (hm->query_string.len) {
+        if (strspn(hm->query_string.p, "HOST_INFO") == 9) {
+            // use server allocator?
+            int err;
+            char* buf, mcast[48] = "";
+            struct sockaddr_in* grp = wqserver_group(server);
+            if (grp) {
+                char group[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &grp->sin_addr, group, sizeof(group));
+                snprintf(mcast, sizeof(mcast), ", %s:\"%s:%d\"",
+                         WJSTR("OSC_MULTICAST"), group, ntohs(grp->sin_port));
+            }
+            if ((err = server->allocator->alloc(&buf, 256,
+                server->allocator->data))) {
+                wpnerr("could not allocate temporary string storage "
+                       "required for http replying, aborting..\n");
+                assert(0);
+            }
+            err = snprintf(buf, 256, "{%s:%s, %s:%d, %s:%s, %s:%s%s}",
+                     WJSTR("NAME"), WJSTR("wqserver"),
+                     WJSTR("OSC_PORT"), server->uport,
+                     WJSTR("OSC_TRANSPORT"), WJSTR("UDP"),
+                     WJSTR("EXTENSIONS"), s_host_ext, mcast);
+            wpnout("replying with host_info: %s\n", buf);
+            server->allocator->free(&buf, 256,
+            server->allocator->data);
+            wqserver_reply_json(mgc, buf);
+        } else if (strspn(hm->query_string.p, "HISTORY") == 7) {
+            wqserver_reply_history(server, mgc, target);
+        } else if (strspn(hm->query_string.p, "HOT") == 3) {
+            wqserver_reply_hot(mgc, server->tree);
+        } else if (strspn(hm->query_string.p, "METRICS") == 7) {
+            wqserver_reply_metrics(mgc, server);
+        } else {
+            // query attribute, we need to allocate, in case value is a looong string for example            
+            int err;
+            char* buf;
+    //            wqnode_attr_printj(target, hm->query_string.p, buf, 128);
+            wqserver_reply_json(mgc, buf);
+        }
+    } else {
+        // query all, including subnodes
+        wqserver_reply_namespace(server, mgc, hm, target);
+    }
+}
+
+static inline pthread_mutex_t*
+wqserver_shard(struct wqworkers* wks, wqnode_t* nd)
+{
+    return &wks->shards[wqnode_hash(nd) & (WQUERY_UDP_SHARDS-1)];
+}
+
+// same as wqtree_update_osc, except node update
+// is guarded by the target's shard lock.
+// decoding and lookup are lock-free (tree is read-only)
+static int
+wqserver_update_osc_sharded(wqserver_t* server, byte_t* data, int len,
+                            wqbuf_t* buf)
+{
+    int err;
+    wqnode_t* target;
+    pthread_mutex_t* shard;
+    struct wqrec* rec;
+    womsg_t* womsg;
+    womsg_alloca(&womsg);
+    wqm_clock(t);
+    if ((rec = wqtree_opt(server->tree, rec)))
+        wqrec_write(rec, data, len);
+    wqt_begin(WQT_DECODE);
+    err = womsg_decode(womsg, data, len);
+    wqt_end(WQT_DECODE);
+    if (err) {
+        wqm_err(WQM_ERR_DECODE);
+        return err;
+    }
+    wqm_lap(WQM_DECODE, t);
+    wqt_begin(WQT_LOOKUP);
+    target = wqtree_lookup_osc(server->tree, womsg);
+    wqt_end(WQT_LOOKUP);
+    wqm_lap(WQM_LOOKUP, t);
+    if (target == NULL) {
+        wqm_err(WQM_ERR_URI);
+        return WQUERY_URI_INVALID;
+    }
+    shard = wqserver_shard(server->workers, target);
+    pthread_mutex_lock(shard);
+    err = wqtree_update_node(server->tree, target, womsg, buf);
+    pthread_mutex_unlock(shard);
+    if (err)
+        wqm_err(WQM_ERR_UPDATE);
+    wqm_lap(WQM_UPDATE, t);
+    return err;
+}
+
+static inline int
+wqserver_update_osc(wqserver_t* server, byte_t* data, int len)
+{
+    if (server->workers)
+        return wqserver_update_osc_sharded(server, data, len, NULL);
+    else
+        return wqtree_update_osc(server->tree, data, len);
+}
+
+static void
+wqserver_tcp_handle(struct mg_connection* mgc, int event, void* data)
+{
+    wqserver_t* server = mgc->mgr->user_data;
+    switch (event) {
+    case MG_EV_WEBSOCKET_HANDSHAKE_DONE:
+        wqserver_add_connection(server, mgc);
+        break;
+    case MG_EV_HTTP_REQUEST:
+        // json replies are serialized on the spot
+        wqt_begin(WQT_JSON);
+        wqserver_handle_request(server, mgc, data);
+        wqt_end(WQT_JSON);
+        break;
+    case MG_EV_WEBSOCKET_FRAME: {
+        struct websocket_message* wm = data;
+        if (wm->flags & WEBSOCKET_OP_TEXT)
+            wqserver_handle_ws_text(server, mgc, wm);
+        else if (wm->flags & WEBSOCKET_OP_BINARY) {
+            // OSC over websocket, update tree
+            wqm_rx(WQM_WS);
+            wqserver_update_osc(server, wm->data, wm->size);
+        }
+        break;
+    }
+    case MG_EV_CLOSE: {
+        if (mgc->flags & MG_F_IS_WEBSOCKET) {
+            struct wqconnection* wqc;
+            if ((wqc = wqserver_get_connection(server, mgc))) {
+                if (server->out)
+                    memset(&server->out->lag[wqc-server->cn], 0,
+                           sizeof(struct wqlag));
+                memset(wqc, 0, sizeof(struct wqconnection));
+            } else
+                wpnerr("couldn't find wqconnection...\n");
+        }
+    }
+    }
+}
+
+static void
+wqserver_udp_handle(struct mg_connection* mgc, int event,
+                    WPN_UNUSED void* data)
+{
+    wqserver_t* server = mgc->mgr->user_data;
+    if (event == MG_EV_RECV) {
+        wqm_rx(WQM_UDP);
+        wqserver_update_osc(server,
+                            (byte_t*)mgc->recv_mbuf.buf,
+                            mgc->recv_mbuf.len);
+    }
+}
+
+static void
+wqserver_unix_handle(struct mg_connection* mgc, int event,
+                     WPN_UNUSED void* data)
+{
+    wqserver_t* server = mgc->mgr->user_data;
+    // mongoose sees a stream socket here: every recv()
+    // is one datagram, consume it before the next one
+    if (event == MG_EV_RECV) {
+        wqm_rx(WQM_UNIX);
+        wqserver_update_osc(server,
+                            (byte_t*)mgc->recv_mbuf.buf,
+                            mgc->recv_mbuf.len);
+        mbuf_remove(&mgc->recv_mbuf, mgc->recv_mbuf.len);
+    }
+}
+
+static void
+wqserver_doorbell_handle(struct mg_connection* mgc, int event,
+                         WPN_UNUSED void* data)
+{
+    // rings are drained after each poll,
+    // the doorbell only needs to wake us up
+    if (event == MG_EV_RECV)
+        mbuf_remove(&mgc->recv_mbuf, mgc->recv_mbuf.len);
+}
+
+static void
+wqserver_stream_recv(byte_t* data, uint32_t len, void* udt)
+{
+    wqm_rx(WQM_STREAM);
+    wqserver_update_osc(udt, data, len);
+}
+
+static void
+wqserver_stream_handle(struct mg_connection* mgc, int event,
+                       WPN_UNUSED void* data)
+{
+    wqserver_t* server = mgc->mgr->user_data;
+    struct wqserver_ext* ext = server->ext;
+    struct wqstream* st = mgc->user_data;
+    switch (event) {
+    case MG_EV_ACCEPT: {
+        int one = 1;
+        for (int n = 0; n < WQUERY_MAX_STREAMS; ++n) {
+            if (ext->streams[n].tcp == NULL) {
+                st = &ext->streams[n];
+                break;
+            }
+        }
+        if (st == NULL) {
+            wpnerr("max number of stream peers reached, closing\n");
+            mgc->flags |= MG_F_CLOSE_IMMEDIATELY;
+            break;
+        }
+        st->tcp = mgc;
+        wodeframer_init(&st->dfr, ext->sframing);
+        mgc->user_data = st;
+        // output is already corked by poll cycle
+        setsockopt(mgc->sock, IPPROTO_TCP, TCP_NODELAY,
+                   &one, sizeof(one));
+        break;
+    }
+    case MG_EV_RECV: {
+        int n = wodeframe(&st->dfr,
+                          (byte_t*)mgc->recv_mbuf.buf,
+                          mgc->recv_mbuf.len,
+                          wqserver_stream_recv, server);
+        if (n < 0) {
+            wpnerr("%s, closing stream\n", wosc_strerr(-n));
+            mgc->flags |= MG_F_CLOSE_IMMEDIATELY;
+        } else
+            mbuf_remove(&mgc->recv_mbuf, n);
+        break;
+    }
+    case MG_EV_CLOSE:
+        if (st)
+            st->tcp = NULL;
+        break;
+    }
+}
+
+int
+wqserver_bind_stream(wqserver_t* server, uint16_t port,
+                     enum wostream_t framing)
+{
+    struct wqserver_ext* ext;
+    size_t sz = sizeof(struct wqstream)*WQUERY_MAX_STREAMS;
+    if (framing != WOSTREAM_LENGTH && framing != WOSTREAM_SLIP)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if (wqserver_ext(server, &ext) < 0)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if (ext->streams == NULL) {
+        if (server->allocator->alloc(&ext->streams, sz,
+                                     server->allocator->data) < 0) {
+            ext->streams = NULL;
+            return WQUERY_ATTR_UNSUPPORTED;
+        }
+        memset(ext->streams, 0, sz);
+    }
+    ext->sport = port;
+    ext->sframing = framing;
+    return 0;
+}
+
+int
+wqserver_bind_unix(wqserver_t* server, const char* path)
+{
+    int err;
+    struct wqserver_ext* ext;
+    if (strlen(path) >= sizeof(((struct sockaddr_un*)0)->sun_path))
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqserver_ext(server, &ext)) < 0)
+        return err;
+    ext->unix_path = path;
+    return 0;
+}
+
+int
+wqserver_add_shm(wqserver_t* server, wshm_t* in, wshm_t* out)
+{
+    int err;
+    struct wqserver_ext* ext;
+    if (!in && !out)
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqserver_ext(server, &ext)) < 0)
+        return err;
+    if (ext->nshm == WQUERY_MAX_SHM)
+        return WQUERY_ATTR_UNSUPPORTED;
+    ext->shm[ext->nshm].in = in;
+    ext->shm[ext->nshm].out = out;
+    ext->nshm++;
+    return 0;
+}
+
+static void
+wqserver_shm_recv(byte_t* data, uint32_t len, void* udt)
+{
+    wqm_rx(WQM_SHM);
+    wqserver_update_osc(udt, data, len);
+}
+
+// fast path: no syscall as long as we keep polling
+static void
+wqserver_drain_shm(wqserver_t* server)
+{
+    struct wqserver_ext* ext = server->ext;
+    for (int n = 0; ext && n < ext->nshm; ++n)
+         if (ext->shm[n].in &&
+             wshm_pop(ext->shm[n].in, wqserver_shm_recv, server) < 0)
+             wpnerr("invalid frame in shm ring %d, dropped\n", n);
+}
+
+// before sleeping: make sure producers ring the doorbell
+static void
+wqserver_park_shm(wqserver_t* server)
+{
+    struct wqserver_ext* ext = server->ext;
+    for (int n = 0; ext && n < ext->nshm; ++n) {
+         wshm_t* in = ext->shm[n].in;
+         if (in && wshm_park(in))
+             wshm_pop(in, wqserver_shm_recv, server);
+    }
+}
+
+static void
+wqserver_unpark_shm(wqserver_t* server)
+{
+    struct wqserver_ext* ext = server->ext;
+    for (int n = 0; ext && n < ext->nshm; ++n)
+         if (ext->shm[n].in)
+             wshm_unpark(ext->shm[n].in);
+}
+
+int
+wqserver_set_multicast(wqserver_t* server, const char* group,
+                       uint16_t port, const char* iface)
+{
+    struct wqserver_ext* ext;
+    struct sockaddr_in addr;
+    struct in_addr mif;
+    int err;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, group, &addr.sin_addr) != 1 ||
+        !IN_MULTICAST(ntohl(addr.sin_addr.s_addr)))
+        return WQUERY_ADDR_INVALID;
+    mif.s_addr = htonl(INADDR_ANY);
+    if (iface && inet_pton(AF_INET, iface, &mif) != 1)
+        return WQUERY_ADDR_INVALID;
+    if ((err = wqserver_ext(server, &ext)) < 0)
+        return err;
+    ext->mcast = addr;
+    ext->mcast_if = mif;
+    return 0;
+}
+
+// sets up the group's LISTEN output socket. It doesn't join
+// the group, senders don't have to, and an ingest socket (udp
+// socket of the ring backend) would read its own output back
+// when the group port is the udp port. Output is looped back
+// on purpose, for subscribers on this host
+static int
+wqserver_run_multicast(wqserver_t* server)
+{
+    struct wqserver_ext* ext = server->ext;
+    unsigned char loop = 1;
+    if ((ext->mfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        return WQUERY_BINDERR_UDP;
+    if (setsockopt(ext->mfd, IPPROTO_IP, IP_MULTICAST_IF,
+                   &ext->mcast_if, sizeof(struct in_addr)) ||
+        setsockopt(ext->mfd, IPPROTO_IP, IP_MULTICAST_LOOP,
+                   &loop, sizeof(loop))) {
+        close(ext->mfd);
+        ext->mfd = -1;
+        return WQUERY_BINDERR_UDP;
+    }
+    return 0;
+}
+
+int
+wqserver_set_udp_workers(wqserver_t* server, int nworkers)
+{
+    int err;
+    size_t sz;
+    struct wqworkers* wks;
+    if (nworkers == 0)
+        return 0;
+    if (server->workers || nworkers < 0 ||
+        nworkers > WQUERY_MAX_UDP_WORKERS ||
+        wqserver_backend(server) != WQSERVER_BACKEND_MONGOOSE)
+        return WQUERY_ATTR_UNSUPPORTED;
+    sz = sizeof(struct wqworkers) + nworkers*sizeof(struct wqworker);
+    if ((err = server->allocator->alloc(&wks, sz,
+               server->allocator->data)) < 0)
+        return err;
+    memset(wks, 0, sz);
+    for (int n = 0; n < WQUERY_UDP_SHARDS; ++n)
+         pthread_mutex_init(&wks->shards[n], NULL);
+    for (int n = 0; n < nworkers; ++n) {
+         wks->wk[n].server = server;
+         wks->wk[n].fd = -1;
+    }
+    wks->nworkers = nworkers;
+    server->workers = wks;
+    return 0;
+}
+
+static inline size_t
+wqserver_cache_size(wqserver_t* server)
+{
+    return sizeof(struct wqcache) + 2*server->ext->cache_sets*sizeof(struct wqcline);
+}
+
+// poll loop's cache, then workers'
+static inline struct wqcache*
+wqserver_cache(wqserver_t* server, int n)
+{
+    if (wqserver_opt(server, caches) == NULL)
+        return NULL;
+    return (struct wqcache*)(server->ext->caches + n*wqserver_cache_size(server));
+}
+
+int
+wqserver_set_lookup_cache(wqserver_t* server, int nlines)
+{
+    int err;
+    struct wqserver_ext* ext;
+    uint32_t nsets = 1;
+    if (server->running || wqserver_opt(server, caches) ||
+        nlines < 2 || nlines > (1 << 16))
+        return WQUERY_ATTR_UNSUPPORTED;
+    if ((err = wqserver_ext(server, &ext)) < 0)
+        return err;
+    while (2*nsets < (uint32_t) nlines)
+           nsets <<= 1;
+    ext->cache_sets = nsets;
+    return 0;
+}
+
+int
+wqserver_get_lookup_stats(wqserver_t* server, uint64_t* hits, uint64_t* misses)
+{
+    int ncaches = 1 + (server->workers ? server->workers->nworkers : 0);
+    if (wqserver_opt(server, caches) == NULL)
+        return WQUERY_ATTR_UNSUPPORTED;
+    *hits = *misses = 0;
+    for (int n = 0; n < ncaches; ++n) {
+         struct wqcache* c = wqserver_cache(server, n);
+         *hits += __atomic_load_n(&c->hits, __ATOMIC_RELAXED);
+         *misses += __atomic_load_n(&c->misses, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+static void*
+wqworker_run(void* v)
+{
+    struct wqworker* wk = v;
+    wqserver_t* server = wk->server;
+    struct wqbufs* pool = wqtree_opt(server->tree, strpool);
+    byte_t buf[WQUERY_UDP_BATCH][WQUERY_UDP_MTU];
+    wqbuf_t* pbuf[WQUERY_UDP_BATCH] = { 0 };
+    struct mmsghdr msgs[WQUERY_UDP_BATCH];
+    struct iovec iov[WQUERY_UDP_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    // datagrams are received straight into pooled
+    // buffers when they are large enough
+    if (pool && pool->bufsz < WQUERY_UDP_MTU)
+        pool = NULL;
+    wqm_set_thread(wqserver_opt(server, metrics) ?
+                   &server->ext->metrics[1 + (wk - server->workers->wk)] : NULL);
+    t_wqc = wqserver_cache(server, 1 + (wk - server->workers->wk));
+    for (int n = 0; n < WQUERY_UDP_BATCH; ++n) {
+        iov[n].iov_len = WQUERY_UDP_MTU;
+        msgs[n].msg_hdr.msg_iov = &iov[n];
+        msgs[n].msg_hdr.msg_iovlen = 1;
+    }
+    while (server->running) {
+        int nmsg;
+        for (int n = 0; n < WQUERY_UDP_BATCH; ++n) {
+             if (pool && pbuf[n] == NULL)
+                 pbuf[n] = wqbufs_get(pool);
+             iov[n].iov_base = pbuf[n] ? pbuf[n]->dat : buf[n];
+        }
+        // socket has a receive timeout, so that we get
+        // to check the running flag periodically
+        nmsg = recvmmsg(wk->fd, msgs, WQUERY_UDP_BATCH,
+                        MSG_WAITFORONE, NULL);
+        for (int n = 0; n < nmsg; ++n) {
+             wqm_rx(WQM_UDP);
+             wqserver_update_osc_sharded(server, iov[n].iov_base,
+                                         msgs[n].msg_len, pbuf[n]);
+             // buffer is now referenced by a string view,
+             // leave it to the node, and take another one
+             if (pbuf[n] && __atomic_load_n(&pbuf[n]->refs,
+                                            __ATOMIC_ACQUIRE) > 1) {
+                 wqbuf_release(pbuf[n]);
+                 pbuf[n] = NULL;
+             }
+        }
+    }
+    for (int n = 0; n < WQUERY_UDP_BATCH; ++n)
+         if (pbuf[n])
+             wqbuf_release(pbuf[n]);
+    return 0;
+}
+
+// group traffic reaches every socket bound to its port, unless the
+// socket only takes the groups it joined: LISTEN output looped back
+// to local subscribers would otherwise be ingested as updates
+static void
+wqudp_own_groups(int fd)
+{
+#ifdef IP_MULTICAST_ALL
+    int zero = 0;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &zero, sizeof(zero));
+#endif
+}
+
+static int
+wqudp_bind(uint16_t port, bool reuseport, int* dst)
+{
+    int fd, one = 1;
+    struct sockaddr_in addr;
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        return WQUERY_BINDERR_UDP;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if ((reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+                                 &one, sizeof(one))) ||
+        bind(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+        close(fd);
+        return WQUERY_BINDERR_UDP;
+    }
+    wqudp_own_groups(fd);
+    *dst = fd;
+    return 0;
+}
+
+static int
+wqworker_bind(struct wqworker* wk, uint16_t port)
+{
+    int err;
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+    if ((err = wqudp_bind(port, true, &wk->fd)))
+        return err;
+    setsockopt(wk->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return 0;
+}
+
+static int
+wqserver_run_workers(wqserver_t* server, uint16_t port)
+{
+    int err;
+    struct wqworkers* wks = server->workers;
+    // bind all sockets first, so that the kernel
+    // distributes datagrams across the whole group
+    for (int n = 0; n < wks->nworkers; ++n)
+         if ((err = wqworker_bind(&wks->wk[n], port)))
+             return err;
+    for (int n = 0; n < wks->nworkers; ++n, wks->nrunning++)
+         if (pthread_create(&wks->wk[n].thread, 0,
+                            wqworker_run, &wks->wk[n]))
+             return WQUERY_THREADERR;
+    return 0;
+}
+
+static void
+wqserver_stop_workers(wqserver_t* server)
+{
+    struct wqworkers* wks = server->workers;
+    for (int n = 0; n < wks->nrunning; ++n)
+         pthread_join(wks->wk[n].thread, 0);
+    for (int n = 0; n < wks->nworkers; ++n) {
+         if (wks->wk[n].fd >= 0)
+             close(wks->wk[n].fd);
+         wks->wk[n].fd = -1;
+    }
+    wks->nrunning = 0;
+}
+
+int
+wqserver_set_backend(wqserver_t* server, enum wqbackend_t backend)
+{
+    int err;
+    struct wqserver_ext* ext;
+    switch (backend) {
+    case WQSERVER_BACKEND_MONGOOSE:
+        break;
+    case WQSERVER_BACKEND_URING:
+#ifdef WQUERY_URING
+        // uring drives a single udp socket from the server loop,
+        // it doesn't mix with reuseport workers
+        if (server->workers)
+            return WQUERY_ATTR_UNSUPPORTED;
+        break;
+#else
+        return WQUERY_ATTR_UNSUPPORTED;
+#endif
+    default:
+        return WQUERY_ATTR_UNSUPPORTED;
+    }
+    if ((err = wqserver_ext(server, &ext)) < 0)
+        return err;
+    ext->backend = backend;
+    return 0;
+}
+
+#ifdef WQUERY_URING
+static void
+wqserver_uring_recv(byte_t* data, uint32_t len, void* udt)
+{
+    // zero-copy: decoded in place, from the registered buffer
+    wqm_rx(WQM_UDP);
+    wqserver_update_osc(udt, data, len);
+}
+
+static int
+wqserver_run_uring(wqserver_t* server, uint16_t port)
 {
     int err;
-    womsg_t* womsg;
-    womsg_alloca(&womsg);
-    if ((err = womsg_decode(womsg, data, len))) {
-        wpnerr("decoding incoming OSC message (%s)\n",
-               wosc_strerr(err));
+    struct wqserver_ext* ext = server->ext;
+    if ((err = wuring_walloc(server->allocator, &ext->uring)))
         return err;
-    } else {
-        wqnode_t* target;
-        const char* uri = womsg_geturi(womsg);
-        if ((target = wqtree_get_node(tree, uri)) == NULL)
-            return WQUERY_URI_INVALID;
-        return wqnode_update(target, womsg);
+    if ((err = wqudp_bind(port, false, &server->ufd)))
+        return err;
+    if ((err = wuring_init(ext->uring, WQUERY_URING_ENTRIES,
+                           WQUERY_URING_NBUFS, WQUERY_UDP_MTU)) ||
+        (err = wuring_recv_multishot(ext->uring, server->ufd,
+                                     wqserver_uring_recv, server)) ||
+        (err = wuring_submit(ext->uring)) < 0) {
+        wpnerr("could not setup io_uring (%s)\n", strerror(-err));
+        return WQUERY_BINDERR_UDP;
     }
+    return 0;
 }
+#endif
 
-// ------------------------------------------------------------------------------------------------
-// NETWORK
-// ------------------------------------------------------------------------------------------------
-
-#include <dependencies/mongoose/mongoose.h>
-
-#define HTTP_OK             200
-#define HTTP_NO_CONTENT     204
-#define HTTP_BAD_REQUEST    400
-#define HTTP_FORBIDDEN      403
-#define HTTP_NOT_FOUND      404
-#define HTTP_REQ_TIME_OUT   408
-
-#define HTTP_MIME           "Content-Type: "
-#define HTTP_MIME_JSON      HTTP_MIME "application/json"
-
-struct wqconnection {
-    struct mg_connection* tcp;
-    int udp;
-};
-
-struct wqserver {
-    struct mg_mgr mgr;
-    struct wqconnection cn[WQUERY_MAX_CONNECTIONS];
-    struct wqtree* tree;
-    struct walloc_t* allocator;
-#ifdef WPN114_MULTITHREAD
-    pthread_t thread;
+static int
+wqserver_run_local(wqserver_t* server)
+{
+    struct wqserver_ext* ext = server->ext;
+    struct sockaddr_un addr;
+    if (ext == NULL)
+        return 0;
+    for (int n = 0; n < ext->nshm; ++n)
+         if (ext->shm[n].in &&
+             mg_add_sock(&server->mgr, wshm_doorbell(ext->shm[n].in),
+                         wqserver_doorbell_handle) == NULL)
+             return WQUERY_BINDERR_UDP;
+    if (ext->unix_path == NULL)
+        return 0;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, ext->unix_path);
+    unlink(ext->unix_path);
+    if ((ext->unix_fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+        return WQUERY_BINDERR_UDP;
+    if (bind(ext->unix_fd, (struct sockaddr*) &addr, sizeof(addr))) {
+        close(ext->unix_fd);
+        ext->unix_fd = -1;
+        return WQUERY_BINDERR_UDP;
+    }
+#ifdef WQUERY_URING
+    if (ext->backend == WQSERVER_BACKEND_URING)
+        return wuring_recv_multishot(ext->uring, ext->unix_fd,
+                                     wqserver_uring_recv, server)
+               ? WQUERY_BINDERR_UDP : 0;
 #endif
-    bool running;
-    uint16_t uport;
-};
+    if (mg_add_sock(&server->mgr, ext->unix_fd,
+                    wqserver_unix_handle) == NULL)
+        return WQUERY_BINDERR_UDP;
+    return 0;
+}
 
-int
-wqserver_walloc(struct walloc_t* _allocator, wqserver_t** dst)
+// encodes <nd> value as an osc message into <buf>,
+// returns its length, or a negative error
+static int
+wqnode_encode(wqnode_t* nd, byte_t* buf, uint32_t len)
 {
     int err;
-    if ((err = _allocator->alloc(dst,
-                sizeof(struct wqserver),
-               _allocator->data)) >= 0) {
-        memset(*dst, 0, sizeof(struct wqserver));
-        err = 0;
+    char tag[WARR_MAXLEN+3] = { nd->value.t, 0 };
+    char etype = wqnode_etype(nd);
+    womsg_t* msg;
+    womsg_alloca(&msg);
+    if (nd->value.t == WOSC_TYPE_BOOL)
+        tag[0] = nd->value.u.b ? WOSC_TYPE_TRUE : WOSC_TYPE_FALSE;
+    else if (nd->value.t == WOSC_TYPE_STRVIEW)
+        tag[0] = WOSC_TYPE_STRING;
+    else if (etype) {
+        int n = nd->value.u.a->len;
+        tag[0] = '[';
+        memset(tag+1, etype, n);
+        tag[n+1] = ']';
+        tag[n+2] = 0;
     }
-    return err;
+    if ((err = womsg_setbuf(msg, buf, len)) ||
+        (err = womsg_seturi(msg, nd->uri)) ||
+        (err = womsg_settag(msg, tag)) ||
+        (err = womsg_writev(msg, nd->value)))
+        return -err;
+    return womsg_getlen(msg);
 }
 
-void
-wqserver_set_allocator(struct wqserver* server,
-                       struct walloc_t* allocator)
+static void
+wqserver_push_shm(wqserver_t* server, byte_t* msg, uint32_t len)
 {
-    server->allocator = allocator;
+    struct wqserver_ext* ext = server->ext;
+    for (int n = 0; ext && n < ext->nshm; ++n)
+         if (ext->shm[n].out) {
+             wshm_push(ext->shm[n].out, msg, len);
+             wqm_tx(WQM_SHM, 1);
+         }
 }
 
-int
-wqserver_expose(wqserver_t* server, wqtree_t* tree)
+// writes what's queued on <mgc> right away, instead of
+// waiting for next poll, mongoose takes care of the rest
+static void
+wqserver_uncork(struct mg_connection* mgc)
 {
-    server->tree = tree;
-    return 0;
+    ssize_t n;
+    if (mgc->send_mbuf.len == 0)
+        return;
+    n = send(mgc->sock, mgc->send_mbuf.buf, mgc->send_mbuf.len,
+             MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n > 0)
+        mbuf_remove(&mgc->send_mbuf, n);
 }
 
-static struct wqconnection*
-wqserver_get_connection(wqserver_t* server, struct mg_connection* mgc)
+static void
+wqserver_flush_streams(wqserver_t* server)
 {
-    for (int n = 0; n < WQUERY_MAX_CONNECTIONS; ++n)
-         if (server->cn[n].tcp == mgc)
-             return &server->cn[n];
-    return NULL;
+    struct wqoutput* out = server->out;
+    for (int n = 0; n < WQUERY_MAX_STREAMS; ++n) {
+        struct mg_connection* mgc = server->ext->streams[n].tcp;
+        if (mgc) {
+            mg_send(mgc, out->sbuf, out->susd);
+            wqserver_uncork(mgc);
+        }
+    }
+    out->susd = 0;
 }
 
-static inline int
-wqserver_reply_json(struct mg_connection* mgc,
-                    const char* json)
+// appends framed <msg> to the stream output buffer
+static void
+wqserver_cork_stream(wqserver_t* server, byte_t* msg, uint32_t len)
 {
-    mg_send_head(mgc, HTTP_OK, strlen(json), HTTP_MIME_JSON);
-    mg_printf(mgc, "%.*s", (int)strlen(json), json);
-    return 0;
+    struct wqoutput* out = server->out;
+    int n = woframe(server->ext->sframing, msg, len, &out->sbuf[out->susd],
+                    WQUERY_STREAM_BUFSZ-out->susd);
+    if (n < 0 && out->susd) {
+        wqserver_flush_streams(server);
+        n = woframe(server->ext->sframing, msg, len,
+                    out->sbuf, WQUERY_STREAM_BUFSZ);
+    }
+    if (n < 0) {
+        wpnerr("%s, not streaming message\n", wosc_strerr(-n));
+    } else {
+        out->susd += n;
+        wqm_tx(WQM_STREAM, 1);
+    }
 }
 
+// sends <nmsg> prepared messages from socket <fd>,
+// returns how many went out, ring submissions being
+// accounted as sent
 static int
-wqserver_add_connection(struct wqserver* server,
-                        struct mg_connection* mgc)
+wqserver_sendmmsg(wqserver_t* server, int fd,
+                  struct mmsghdr* msgs, int nmsg)
 {
-    for (int nc = 0; nc < WQUERY_MAX_CONNECTIONS; ++nc) {
-        if (server->cn[nc].tcp == NULL) {
-            server->cn[nc].tcp = mgc;
-            return 0;
-        }
+    int nsent = 0;
+#ifdef WQUERY_URING
+    if (wqserver_backend(server) == WQSERVER_BACKEND_URING) {
+        for (int n = 0; n < nmsg; ++n)
+             wuring_sendmsg(server->ext->uring, fd, &msgs[n].msg_hdr);
+        // batch storage is reused right after this
+        wuring_wait_sends(server->ext->uring);
+        return nmsg;
     }
-    return 1;
+#endif
+    while (nsent < nmsg) {
+        int n = sendmmsg(fd, &msgs[nsent], nmsg-nsent, 0);
+        if (n <= 0)
+            break;
+        nsent += n;
+    }
+    return nsent;
 }
 
+// sends the current batch of messages to the <ndst> first
+// batch destinations, with a single sendmmsg (or a single
+// ring submission)
 static void
-wqserver_cmd_listen(wqserver_t* server, char* data, int size,
-                    bool status)
+wqserver_send_batch(wqserver_t* server, int ndst)
 {
-    wqnode_t* target;
-    char* path;
-    int n = 0;
-    // we don't need to reuse data after that
-    // this way, we don't need extra allocation
-    path = &data[strcspn(data, "/")];
-    while (path[n] != '\"')  n++;
-    path[n] = '\0';
-    if ((target = wqtree_get_node(server->tree, path)))
-        target->status = status;
-    else
-        wpnerr("could not find node %s\n", path);
+    struct wqoutput* out = server->out;
+    int nmsg = 0, nucast, nsent;
+    wqm_clock(t);
+    for (int i = 0; i < out->niov; ++i)
+         wqserver_push_shm(server, out->iov[i].iov_base,
+                           out->iov[i].iov_len);
+    // group comes last, and has its own socket
+    nucast = ndst;
+    if (ndst && IN_MULTICAST(ntohl(out->uaddr[ndst-1].sin_addr.s_addr)))
+        nucast--;
+    for (int c = 0; c < ndst; ++c) {
+        for (int i = 0; i < out->niov; ++i, ++nmsg) {
+             struct msghdr* hdr = &out->msgs[nmsg].msg_hdr;
+             memset(hdr, 0, sizeof(struct msghdr));
+             hdr->msg_name = &out->uaddr[c];
+             hdr->msg_namelen = sizeof(struct sockaddr_in);
+             hdr->msg_iov = &out->iov[i];
+             hdr->msg_iovlen = 1;
+        }
+    }
+    nsent = wqserver_sendmmsg(server, server->ufd,
+                              out->msgs, nucast*out->niov);
+    if (nucast < ndst)
+        nsent += wqserver_sendmmsg(server, server->ext->mfd,
+                                   &out->msgs[nucast*out->niov],
+                                   nmsg-nucast*out->niov);
+    wqm_tx(WQM_UDP, nsent);
+    wqm_lap(WQM_SEND, t);
+    out->niov = 0;
+    out->usd = 0;
 }
 
+// websocket clients get at most <bps> bytes and <mps> messages per
+// second, through token buckets holding one second worth of tokens
+// (which may go into debt, so that large messages still get through).
+// a client that's out of tokens, or whose send queue is past the
+// high watermark, is lagging until its queue is back under the low
+// watermark and it has tokens again: meanwhile, the updates it can't
+// take are coalesced, only the latest value of each node being sent
+// once it catches up, mongoose's send queue doesn't grow any further
+
 static void
-wqserver_handle_ws_text(wqserver_t* server,
-                        struct mg_connection* mgc,
-                        struct websocket_message* wm)
+wqlag_refill(struct wqbudget* b, struct wqlag* lag, uint64_t now)
 {
-    // parse json
-    char cmd[32], *data = (char*)wm->data;
-    int size = wm->size;
-    mjson_get_string(data, size, "$.COMMAND", cmd, sizeof(cmd));
-
-    if (strcmp(cmd, "LISTEN") == 0)
-        wqserver_cmd_listen(server, data, size, true);
-    else if (strcmp(cmd, "IGNORE") == 0)
-        wqserver_cmd_listen(server, data, size, false);
-
-    else if (strcmp(cmd, "START_OSC_STREAMING") == 0) {
-        struct wqconnection* wqc;
-        double port;
-        mjson_get_number(data, size, "$.DATA.LOCAL_SERVER_PORT", &port);
-        if ((wqc = wqserver_get_connection(server, mgc)))
-             wqc->udp = port;
-        else
-            wpnerr("could not find wqconnection, "
-                   "ignoring message: %s\n", wm->data);
-    }
+    double dt = lag->refill ? (now-lag->refill)*1e-9 : 1;
+    lag->refill = now;
+    lag->btokens = wpnmin(lag->btokens + dt*b->bps, (double) b->bps);
+    lag->mtokens = wpnmin(lag->mtokens + dt*b->mps, (double) b->mps);
 }
 
-// better to omit fields that are 'false'?
-static const char*
-s_host_ext =
-    "{ "
-        "\"ACCESS\": true,"
-        "\"VALUE\": true,"
-        "\"CRITICAL\": true,"
-        "\"LISTEN\": true,"
-        "\"OSC_STREAMING\": true"
-//        "\"DESCRIPTION\": false,"
-//        "\"TAGS\": false,"
-//        "\"EXTENDED_TYPE\": false,"
-//        "\"UNIT\": false,"
-//        "\"CLIPMODE\": false,"
-//        "\"PATH_CHANGED\": false,"
-//        "\"PATH_REMOVED\": false,"
-//        "\"PATH_ADDED\": false,"
-//        "\"PATH_RENAMED\": false,"
-//        "\"HTML\": false,"
-//        "\"ECHO\": false, "
-    "}";
-
-#define WJSTR(_str) "\"" _str "\""
+// whether <mgc> can take another message of <len> bytes right now
+static bool
+wqlag_admit(struct wqbudget* b, struct wqlag* lag, struct mg_connection* mgc,
+            uint32_t len, uint64_t now)
+{
+    uint32_t queued = mgc->send_mbuf.len;
+    __atomic_store_n(&lag->queued, queued, __ATOMIC_RELAXED);
+    if (queued > lag->max_queued)
+        __atomic_store_n(&lag->max_queued, queued, __ATOMIC_RELAXED);
+    if (b->hiwat && queued > (lag->since ? b->lowat : b->hiwat))
+        goto lagging;
+    if ((b->bps && lag->btokens <= 0) || (b->mps && lag->mtokens < 1))
+        goto lagging;
+    lag->btokens -= len;
+    lag->mtokens -= 1;
+    __atomic_store_n(&lag->since, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&lag->sent, lag->sent+1, __ATOMIC_RELAXED);
+    return true;
+lagging:
+    if (lag->since == 0)
+        __atomic_store_n(&lag->since, now, __ATOMIC_RELAXED);
+    return false;
+}
 
+// sends the latest value of the listened nodes <mgc> missed,
+// for as long as it has room for them
 static void
-wqserver_handle_request(wqserver_t* server,
-                        struct mg_connection* mgc,
-                        struct http_message* hm)
+wqserver_flush_pending(wqserver_t* server, struct wqlag* lag,
+                       struct mg_connection* mgc, uint64_t now)
 {
-    wqnode_t* target;
-    target = wqtree_get_node(server->tree, hm->uri.p);
-    if (hm->query_string.len) {
-        if (strspn(hm->query_string.p, "HOST_INFO") == 9) {
-            // use server allocator?
-            int err;
-            char* buf;
-            if ((err = server->allocator->alloc(&buf, 256,
-                server->allocator->data))) {
-                wpnerr("could not allocate temporary string storage "
-                       "required for http replying, aborting..\n");
-                assert(0);
-            }
-            err = snprintf(buf, 256, "{%s:%s, %s:%d, %s:%s, %s:%s}",
-                     WJSTR("NAME"), WJSTR("wqserver"),
-                     WJSTR("OSC_PORT"), server->uport,
-                     WJSTR("OSC_TRANSPORT"), WJSTR("UDP"),
-                     WJSTR("EXTENSIONS"), s_host_ext);
-            wpnout("replying with host_info: %s\n", buf);
-            server->allocator->free(&buf, 256,
-            server->allocator->data);
-            wqserver_reply_json(mgc, buf);
-        } else {
-            // query attribute, we need to allocate, in case value is a looong string for example            
-            int err;
-            char* buf;
-    //            wqnode_attr_printj(target, hm->query_string.p, buf, 128);
-            wqserver_reply_json(mgc, buf);
+    struct wqoutput* out = server->out;
+    byte_t* buf = &out->buf[out->usd];
+    for (int n = 0; n < out->nnodes && lag->npending; ++n) {
+        wqnode_t* nd = out->nodes[n];
+        pthread_mutex_t* shard = NULL;
+        int len;
+        if (!wqlag_pending(lag, n))
+            continue;
+        if (__atomic_load_n(&nd->status, __ATOMIC_ACQUIRE) & WQNODE_DIRTY) {
+            // newer value, on its way with the others
+            wqlag_clear(lag, n);
+            continue;
         }
-    } else {
-        // query all, including subnodes
-//        char buf[WPN114_MAXJSON];
-//            wqnode_printj(target, buf, WPN114_MAXJSON);
-//        wqserver_reply_json(mgc, buf);
+        if (server->workers) {
+            shard = wqserver_shard(server->workers, nd);
+            pthread_mutex_lock(shard);
+        }
+        len = wqnode_encode(nd, buf, WQUERY_OUT_BUFSZ-out->usd);
+        if (shard)
+            pthread_mutex_unlock(shard);
+        if (len < 0) {
+            wqlag_clear(lag, n);
+            continue;
+        }
+        if (!wqlag_admit(wqserver_budget(server), lag, mgc, len, now))
+            return;
+        wqlag_clear(lag, n);
+        mg_send_websocket_frame(mgc, WEBSOCKET_OP_BINARY, buf, len);
+        wqm_tx(WQM_WS, 1);
     }
 }
 
+// pushes the values that changed since last flush
+// to all clients with a streaming udp port (or to their group),
+// critical values go to their websocket instead.
+// stream peers get everything, with a single write per peer
 static void
-wqserver_tcp_handle(struct mg_connection* mgc, int event, void* data)
+wqserver_flush_listen(wqserver_t* server)
 {
-    wqserver_t* server = mgc->mgr->user_data;
-    switch (event) {
-    case MG_EV_WEBSOCKET_HANDSHAKE_DONE:
-        wqserver_add_connection(server, mgc);
-        break;
-    case MG_EV_HTTP_REQUEST:
-        wqserver_handle_request(server, mgc, data);
-        break;
-    case MG_EV_WEBSOCKET_FRAME: {
-        struct websocket_message* wm = data;
-        if (wm->flags & WEBSOCKET_OP_TEXT)
-            wqserver_handle_ws_text(server, mgc, wm);
-        else if (wm->flags & WEBSOCKET_OP_BINARY)
-            // OSC over websocket, update tree
-            wqtree_update_osc(server->tree, wm->data, wm->size);
-        break;
+    struct wqoutput* out = server->out;
+    struct wqconnection* ws[WQUERY_MAX_CONNECTIONS];
+    struct wqlag* lag[WQUERY_MAX_CONNECTIONS];
+    struct wqserver_ext* ext = server->ext;
+    struct wqbudget* budget = wqserver_budget(server);
+    int ndst = 0, nws = 0, nmcast = 0, nstreams = 0;
+    bool wsdirty = false;
+    uint64_t now;
+    if (out == NULL || out->nnodes == 0 || server->ufd < 0)
+        return;
+    for (int n = 0; n < WQUERY_MAX_CONNECTIONS; ++n) {
+         struct wqconnection* wqc = &server->cn[n];
+         if (wqc->tcp == NULL || wqc->udp == 0)
+             continue;
+         ws[nws++] = wqc;
+         if (wqc->mcast) {
+             nmcast++;
+             continue;
+         }
+         // client's host, on its streaming port
+         out->uaddr[ndst] = wqc->tcp->sa.sin;
+         out->uaddr[ndst++].sin_port = htons(wqc->udp);
     }
-    case MG_EV_CLOSE: {
-        if (mgc->flags & MG_F_IS_WEBSOCKET) {
-            struct wqconnection* wqc;
-            if ((wqc = wqserver_get_connection(server, mgc)))
-                memset(wqc, 0, sizeof(struct wqconnection));
-            else
-                wpnerr("couldn't find wqconnection...\n");
-        }
+    // one copy for all clients listening to the group
+    if (nmcast)
+        out->uaddr[ndst++] = ext->mcast;
+    for (int n = 0; ext && ext->streams && n < WQUERY_MAX_STREAMS; ++n)
+         nstreams += ext->streams[n].tcp != NULL;
+    if (ndst == 0 && nstreams == 0 && (ext == NULL || ext->nshm == 0))
+        return;
+    now = wpnclock_ns();
+    for (int c = 0; c < nws; ++c) {
+         lag[c] = &out->lag[ws[c]-server->cn];
+         wqlag_refill(budget, lag[c], now);
+         if (lag[c]->npending) {
+             wqserver_flush_pending(server, lag[c], ws[c]->tcp, now);
+             wsdirty = true;
+         }
     }
+    for (int n = 0; n < out->nnodes; ++n) {
+        int len;
+        wqnode_t* nd = out->nodes[n];
+        pthread_mutex_t* shard = NULL;
+        if (!(__atomic_fetch_and(&nd->status, ~WQNODE_DIRTY,
+              __ATOMIC_ACQ_REL) & WQNODE_DIRTY))
+            continue;
+        if (out->niov == WQUERY_OUT_BATCH)
+            wqserver_send_batch(server, ndst);
+        if (server->workers) {
+            // value might be written concurrently
+            shard = wqserver_shard(server->workers, nd);
+            pthread_mutex_lock(shard);
+        }
+        len = wqnode_encode(nd, &out->buf[out->usd],
+                            WQUERY_OUT_BUFSZ-out->usd);
+        if (len < 0 && out->niov) {
+            // out of batch storage, send and retry
+            wqserver_send_batch(server, ndst);
+            len = wqnode_encode(nd, out->buf, WQUERY_OUT_BUFSZ);
+        }
+        if (shard)
+            pthread_mutex_unlock(shard);
+        if (len < 0) {
+            wpnerr("could not encode %s for streaming\n", nd->uri);
+            continue;
+        }
+        wqstats_tx(server->tree, nd, len);
+        if (nstreams)
+            wqserver_cork_stream(server, &out->buf[out->usd], len);
+        if (nd->flags & WQNODE_CRITICAL) {
+            // guaranteed delivery (of the latest value, for lagging
+            // clients), batch storage is not consumed
+            for (int c = 0; c < nws; ++c) {
+                 if (!wqlag_admit(budget, lag[c], ws[c]->tcp,
+                                  len, now)) {
+                     wqlag_defer(lag[c], n);
+                     continue;
+                 }
+                 mg_send_websocket_frame(ws[c]->tcp, WEBSOCKET_OP_BINARY,
+                                         &out->buf[out->usd], len);
+                 wqm_tx(WQM_WS, 1);
+            }
+            wqserver_push_shm(server, &out->buf[out->usd], len);
+            wsdirty = true;
+            continue;
+        }
+        out->iov[out->niov].iov_base = &out->buf[out->usd];
+        out->iov[out->niov].iov_len = len;
+        out->niov++;
+        out->usd += len;
     }
+    if (out->niov)
+        wqserver_send_batch(server, ndst);
+    if (out->susd)
+        wqserver_flush_streams(server);
+    for (int c = 0; wsdirty && c < nws; ++c)
+         wqserver_uncork(ws[c]->tcp);
 }
 
-static void
-wqserver_udp_handle(struct mg_connection* mgc, int event,
-                    WPN_UNUSED void* data)
+static int
+wqserver_poll(wqserver_t* server, int ms)
 {
-    wqserver_t* server = mgc->mgr->user_data;
-    if (event == MG_EV_RECV)
-        wqtree_update_osc(server->tree,
-                          (byte_t*)mgc->recv_mbuf.buf,
-                          mgc->recv_mbuf.len);
+    int ret;
+    struct wqramps* rps;
+    wqm_set_thread(wqserver_opt(server, metrics));
+    t_wqc = wqserver_cache(server, 0);
+    // don't sleep past the next ramp tick
+    if ((rps = wqtree_opt(server->tree, ramps)) && rps->nactive)
+        ms = wpnmin(ms, wqtree_ramps_tick(server->tree));
+    wqserver_park_shm(server);
+#ifdef WQUERY_URING
+    if (wqserver_backend(server) == WQSERVER_BACKEND_URING) {
+        wqt_begin(WQT_POLL);
+        ret = mg_mgr_poll(&server->mgr, 0);
+        wqt_end(WQT_POLL);
+        wuring_poll(server->ext->uring, wpnmin(ms, WQUERY_URING_WAIT_MS));
+    } else
+#endif
+    {
+        wqt_begin(WQT_POLL);
+        ret = mg_mgr_poll(&server->mgr, ms);
+        wqt_end(WQT_POLL);
+    }
+    wqserver_unpark_shm(server);
+    wqserver_drain_shm(server);
+    if (rps)
+        wqramps_advance(rps, server->workers);
+    wqserver_flush_listen(server);
+    return ret;
 }
 
 static void*
@@ -722,7 +5226,7 @@ wqserver_pthread_run(void* v)
 {
     wqserver_t* server = v;
     while (server->running) {
-        mg_mgr_poll(&server->mgr, 200);
+        wqserver_poll(server, 200);
     }
     return 0;
 }
@@ -730,14 +5234,45 @@ wqserver_pthread_run(void* v)
 int
 wqserver_run(wqserver_t* server, uint16_t udpport, uint16_t wsport)
 {
+    int err;
     char s_tcp[8], s_udp[8];
     char udp_hdr[16] = "udp://";
     struct mg_connection* c_tcp, *c_udp;
+    struct wqserver_ext* ext;
     server->uport = udpport;
 
     sprintf(s_tcp, "%d", wsport);
     sprintf(s_udp, "%d", udpport);
     strcat(udp_hdr, s_udp);
+#ifdef WQUERY_METRICS
+    if (wqserver_opt(server, metrics) == NULL) {
+        int nsets = 1 + (server->workers ? server->workers->nworkers : 0);
+        size_t sz = nsets*sizeof(struct wqmetrics);
+        if (wqserver_ext(server, &ext) < 0 ||
+            server->allocator->alloc(&ext->metrics, sz,
+                                     server->allocator->data) < 0) {
+            wpnerr("could not allocate metrics storage, ignoring\n");
+            if (server->ext)
+                server->ext->metrics = NULL;
+        } else {
+            memset(ext->metrics, 0, sz);
+        }
+    }
+#endif
+    ext = server->ext;
+    if (ext && ext->cache_sets && ext->caches == NULL) {
+        int ncaches = 1 + (server->workers ? server->workers->nworkers : 0);
+        size_t sz = ncaches*wqserver_cache_size(server);
+        if (server->allocator->alloc(&ext->caches, sz,
+                                     server->allocator->data) < 0) {
+            wpnerr("could not allocate lookup caches, ignoring\n");
+            ext->caches = NULL;
+        } else {
+            memset(ext->caches, 0, sz);
+            for (int n = 0; n < ncaches; ++n)
+                 wqserver_cache(server, n)->mask = ext->cache_sets-1;
+        }
+    }
 
     mg_mgr_init(&server->mgr, server);
     if ((c_tcp = mg_bind(&server->mgr, s_tcp,
@@ -745,11 +5280,48 @@ wqserver_run(wqserver_t* server, uint16_t udpport, uint16_t wsport)
         return WQUERY_BINDERR_TCP;
     }
     mg_set_protocol_http_websocket(c_tcp);
-    if ((c_udp = mg_bind(&server->mgr, udp_hdr,
-                 wqserver_udp_handle)) == NULL) {
-        return WQUERY_BINDERR_UDP;
+    if (server->ext && server->ext->sport) {
+        sprintf(s_tcp, "%d", server->ext->sport);
+        if (mg_bind(&server->mgr, s_tcp, wqserver_stream_handle) == NULL)
+            return WQUERY_BINDERR_TCP;
     }
     server->running = true;
+    if (server->workers) {
+        if ((err = wqserver_run_workers(server, udpport))) {
+            server->running = false;
+            wqserver_stop_workers(server);
+            return err;
+        }
+    }
+#ifdef WQUERY_URING
+    else if (wqserver_backend(server) == WQSERVER_BACKEND_URING) {
+        if ((err = wqserver_run_uring(server, udpport))) {
+            server->running = false;
+            return err;
+        }
+    }
+#endif
+    else if ((c_udp = mg_bind(&server->mgr, udp_hdr,
+                      wqserver_udp_handle)) == NULL) {
+        server->running = false;
+        return WQUERY_BINDERR_UDP;
+    } else {
+        wqudp_own_groups(c_udp->sock);
+    }
+    if ((err = wqserver_run_local(server))) {
+        server->running = false;
+        return err;
+    }
+    // LISTEN output socket
+    if (server->ufd < 0 &&
+       (server->ufd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        server->running = false;
+        return WQUERY_BINDERR_UDP;
+    }
+    if (wqserver_group(server) && (err = wqserver_run_multicast(server))) {
+        server->running = false;
+        return err;
+    }
 #ifdef WPN114_MULTITHREAD
     pthread_create(&server->thread, 0, wqserver_pthread_run, server);
 #endif
@@ -759,7 +5331,7 @@ wqserver_run(wqserver_t* server, uint16_t udpport, uint16_t wsport)
 int
 wqserver_iterate(wqserver_t* server, int ms)
 {
-    return mg_mgr_poll(&server->mgr, ms);
+    return wqserver_poll(server, ms);
 }
 
 int
@@ -769,6 +5341,24 @@ wqserver_stop(wqserver_t* server)
 #ifdef WPN114_MULTITHREAD
     pthread_join(server->thread, 0);
 #endif
+    if (server->workers)
+        wqserver_stop_workers(server);
+#ifdef WQUERY_URING
+    if (server->ext && server->ext->uring)
+        wuring_close(server->ext->uring);
+#endif
+    if (server->ufd >= 0)
+        close(server->ufd);
+    if (server->ext && server->ext->unix_fd >= 0) {
+        close(server->ext->unix_fd);
+        unlink(server->ext->unix_path);
+        server->ext->unix_fd = -1;
+    }
+    if (server->ext && server->ext->mfd >= 0) {
+        close(server->ext->mfd);
+        server->ext->mfd = -1;
+    }
+    server->ufd = -1;
     return 0;
 }
 
@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+#include <wpn114/network/record.h>
+#include <wpn114/utilities.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define WQREC_MAGIC     0x77717263
+#define WQREC_VERSION   1
+#define WQREC_HDRSZ     4096
+
+const char*
+wqrec_strerr(int err)
+{
+    switch (err) {
+    case WQREC_NOERROR:
+        return "no error";
+    case WQREC_FILE_ERR:
+        return "could not create, open or map log file";
+    case WQREC_INVALID:
+        return "invalid log file, or segment size";
+    case WQREC_FRAME_TOO_LARGE:
+        return "packet does not fit in a log segment";
+    case WQREC_READONLY:
+        return "log was opened read-only";
+    default:
+        return "unknown error code";
+    }
+}
+
+struct wqrec_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nsegs;
+    uint32_t segsz;
+    uint64_t seq;       // last segment sequence number
+};
+
+// segments with seq == 0 have never been written
+struct wqrec_seg {
+    uint64_t seq;
+    uint32_t used;      // bytes, header excluded
+    uint32_t rsv;
+};
+
+// followed by <len> bytes of packet, padded to 8
+struct wqrec_pkt {
+    uint32_t len;
+    uint32_t rsv;
+    uint64_t ts;
+};
+
+struct wqrec {
+    struct wqrec_hdr* hdr;
+    byte_t* map;
+    size_t mapsz;
+    uint32_t cur;
+    int lock;
+    int fd;
+    bool rdonly;
+};
+
+int
+wqrec_walloc(struct walloc_t* _allocator, wqrec_t** dst)
+{
+    int err;
+    if ((err = _allocator->alloc(dst,
+                sizeof(struct wqrec),
+               _allocator->data)) >= 0) {
+        memset(*dst, 0, sizeof(struct wqrec));
+        (*dst)->fd = -1;
+        err = 0;
+    }
+    return err;
+}
+
+static __always_inline struct wqrec_seg*
+wqrec_seg(wqrec_t* rec, uint32_t n)
+{
+    return (struct wqrec_seg*)
+           (rec->map + WQREC_HDRSZ + (size_t) n*rec->hdr->segsz);
+}
+
+static __always_inline uint32_t
+wqrec_pad8(uint32_t len) { return (len+7) & ~7u; }
+
+static int
+wqrec_map(wqrec_t* rec, size_t mapsz, int prot)
+{
+    void* ptr = mmap(0, mapsz, prot, MAP_SHARED | MAP_POPULATE, rec->fd, 0);
+    if (ptr == MAP_FAILED)
+        return WQREC_FILE_ERR;
+    rec->map = ptr;
+    rec->hdr = ptr;
+    rec->mapsz = mapsz;
+    return 0;
+}
+
+int
+wqrec_create(wqrec_t* rec, const char* path,
+             uint32_t nsegments, uint32_t segsz)
+{
+    size_t mapsz = WQREC_HDRSZ + (size_t) nsegments*segsz;
+    if (nsegments == 0 || segsz == 0 || segsz & (WQREC_HDRSZ-1))
+        return WQREC_INVALID;
+    if ((rec->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        return WQREC_FILE_ERR;
+    // allocate blocks upfront, so that running out of disk
+    // can't fault (SIGBUS) while writing through the mapping
+    if (posix_fallocate(rec->fd, 0, mapsz) ||
+        wqrec_map(rec, mapsz, PROT_READ | PROT_WRITE)) {
+        wqrec_close(rec);
+        return WQREC_FILE_ERR;
+    }
+    rec->hdr->magic = WQREC_MAGIC;
+    rec->hdr->version = WQREC_VERSION;
+    rec->hdr->nsegs = nsegments;
+    rec->hdr->segsz = segsz;
+    rec->hdr->seq = 1;
+    rec->cur = 0;
+    wqrec_seg(rec, 0)->seq = 1;
+    return 0;
+}
+
+int
+wqrec_open(wqrec_t* rec, const char* path)
+{
+    struct wqrec_hdr hdr;
+    struct stat st;
+    size_t mapsz;
+    if ((rec->fd = open(path, O_RDONLY)) < 0)
+        return WQREC_FILE_ERR;
+    if (pread(rec->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != WQREC_MAGIC || hdr.version != WQREC_VERSION ||
+        hdr.nsegs == 0 || hdr.segsz < WQREC_HDRSZ ||
+        hdr.segsz & (WQREC_HDRSZ-1)) {
+        wqrec_close(rec);
+        return WQREC_INVALID;
+    }
+    // a truncated file would fault (SIGBUS) past its end
+    mapsz = WQREC_HDRSZ + (size_t) hdr.nsegs*hdr.segsz;
+    if (fstat(rec->fd, &st) || (size_t) st.st_size < mapsz) {
+        wqrec_close(rec);
+        return WQREC_INVALID;
+    }
+    if (wqrec_map(rec, mapsz, PROT_READ)) {
+        wqrec_close(rec);
+        return WQREC_FILE_ERR;
+    }
+    rec->rdonly = true;
+    return 0;
+}
+
+int
+wqrec_write(wqrec_t* rec, const byte_t* data, uint32_t len)
+{
+    struct wqrec_seg* seg;
+    struct wqrec_pkt* pkt;
+    uint64_t ts;
+    uint32_t need = sizeof(struct wqrec_pkt) + wqrec_pad8(len);
+    uint32_t cap;
+    if (rec->rdonly)
+        return WQREC_READONLY;
+    cap = rec->hdr->segsz - sizeof(struct wqrec_seg);
+    if (need > cap)
+        return WQREC_FRAME_TOO_LARGE;
+    // udp workers may record concurrently, critical section is
+    // only a few stores and a memcpy. timestamp is taken inside,
+    // so that packets are stored in timestamp order
+    wpnspin_lock(&rec->lock);
+    ts = wpnclock_ns();
+    seg = wqrec_seg(rec, rec->cur);
+    if (seg->used + need > cap) {
+        // move on to next segment, overwriting the oldest one
+        rec->cur = (rec->cur+1) % rec->hdr->nsegs;
+        seg = wqrec_seg(rec, rec->cur);
+        seg->used = 0;
+        seg->seq = ++rec->hdr->seq;
+    }
+    pkt = (struct wqrec_pkt*)((byte_t*)(seg+1) + seg->used);
+    pkt->len = len;
+    pkt->rsv = 0;
+    pkt->ts = ts;
+    memcpy(pkt+1, data, len);
+    seg->used += need;
+    wpnspin_unlock(&rec->lock);
+    return 0;
+}
+
+int
+wqrec_foreach(wqrec_t* rec, wqrec_fn fn, void* udt)
+{
+    uint32_t nsegs = rec->hdr->nsegs, last = 0;
+    uint32_t cap = rec->hdr->segsz - sizeof(struct wqrec_seg);
+    uint64_t seq = 0;
+    int count = 0;
+    // sequence numbers increase along the ring,
+    // oldest segment is the one after the last written
+    for (uint32_t n = 0; n < nsegs; ++n) {
+         if (wqrec_seg(rec, n)->seq > seq) {
+             seq = wqrec_seg(rec, n)->seq;
+             last = n;
+         }
+    }
+    for (uint32_t n = 1; n <= nsegs; ++n) {
+         struct wqrec_seg* seg = wqrec_seg(rec, (last+n) % nsegs);
+         uint32_t off = 0, used = seg->used;
+         // never written, or corrupt
+         if (seg->seq == 0 || used > cap)
+             continue;
+         while (off + sizeof(struct wqrec_pkt) <= used) {
+             struct wqrec_pkt* pkt = (struct wqrec_pkt*)
+                    ((byte_t*)(seg+1) + off);
+             uint32_t need = sizeof(struct wqrec_pkt) + wqrec_pad8(pkt->len);
+             if (pkt->len > cap || off + need > used)
+                 break;
+             fn((byte_t*)(pkt+1), pkt->len, pkt->ts, udt);
+             off += need;
+             count++;
+         }
+    }
+    return count;
+}
+
+void
+wqrec_close(wqrec_t* rec)
+{
+    if (rec->map)
+        munmap(rec->map, rec->mapsz);
+    if (rec->fd >= 0)
+        close(rec->fd);
+    memset(rec, 0, sizeof(struct wqrec));
+    rec->fd = -1;
+}
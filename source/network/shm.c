@@ -0,0 +1,272 @@
+#define _GNU_SOURCE // memfd_create
+#include <wpn114/network/shm.h>
+#include <wpn114/utilities.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WSHM_MAGIC      0x7773686d
+#define WSHM_WRAP       0xffffffffu
+#define WSHM_HDRSZ      256
+
+// shared header, producer and consumer
+// positions live on separate cache lines
+struct wshm_hdr {
+    uint32_t magic;
+    uint32_t cap;
+    _Alignas(64) uint64_t head;   // consumer position (bytes)
+    _Alignas(64) uint64_t tail;   // producer position (bytes)
+    _Alignas(64) uint32_t parked; // consumer is (about to be) asleep
+};
+
+struct wshm {
+    struct wshm_hdr* hdr;
+    byte_t* dat;
+    size_t mapsz;
+    uint32_t mask;
+    int memfd;
+    int bell;       // local doorbell end
+    int peer;       // peer doorbell end, creator side only
+};
+
+int
+wshm_walloc(struct walloc_t* _allocator, wshm_t** dst)
+{
+    int err;
+    if ((err = _allocator->alloc(dst,
+                sizeof(struct wshm),
+               _allocator->data)) >= 0) {
+        memset(*dst, 0, sizeof(struct wshm));
+        (*dst)->memfd = (*dst)->bell = (*dst)->peer = -1;
+        err = 0;
+    }
+    return err;
+}
+
+static int
+wshm_map(wshm_t* ring, size_t mapsz)
+{
+    void* ptr = mmap(0, mapsz, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring->memfd, 0);
+    if (ptr == MAP_FAILED)
+        return WSHM_MAP_ERR;
+    ring->hdr = ptr;
+    ring->dat = (byte_t*)ptr + WSHM_HDRSZ;
+    ring->mapsz = mapsz;
+    return 0;
+}
+
+int
+wshm_create(wshm_t* ring, uint32_t cap)
+{
+    int bells[2];
+    size_t mapsz = WSHM_HDRSZ + (size_t)cap;
+    if (cap < 64 || cap & (cap-1))
+        return WSHM_INVALID;
+    if ((ring->memfd = memfd_create("wshm", MFD_CLOEXEC)) < 0)
+        return WSHM_MAP_ERR;
+    if (ftruncate(ring->memfd, mapsz) || wshm_map(ring, mapsz) ||
+        socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK |
+                   SOCK_CLOEXEC, 0, bells)) {
+        wshm_close(ring);
+        return WSHM_MAP_ERR;
+    }
+    ring->bell = bells[0];
+    ring->peer = bells[1];
+    ring->mask = cap-1;
+    ring->hdr->cap = cap;
+    __atomic_store_n(&ring->hdr->magic, WSHM_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int
+wshm_attach(wshm_t* ring, int memfd, int bell)
+{
+    struct wshm_hdr hdr;
+    struct stat st;
+    // header comes from the peer, capacity has to be
+    // what wshm_create accepts, and fit the file
+    if (pread(memfd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != WSHM_MAGIC ||
+        hdr.cap < 64 || hdr.cap & (hdr.cap-1) ||
+        fstat(memfd, &st) ||
+        st.st_size < WSHM_HDRSZ + (off_t)hdr.cap)
+        return WSHM_INVALID;
+    ring->memfd = memfd;
+    ring->bell = bell;
+    ring->mask = hdr.cap-1;
+    return wshm_map(ring, WSHM_HDRSZ + (size_t)hdr.cap);
+}
+
+int
+wshm_get_fds(wshm_t* ring, int* memfd, int* bell)
+{
+    if (ring->peer < 0)
+        return WSHM_INVALID;
+    *memfd = ring->memfd;
+    *bell = ring->peer;
+    return 0;
+}
+
+int
+wshm_send_fds(wshm_t* ring, int sock)
+{
+    int fds[2];
+    char cbuf[CMSG_SPACE(sizeof(fds))], tag = 'w';
+    struct iovec iov = { &tag, 1 };
+    struct msghdr msg;
+    struct cmsghdr* cmsg;
+    if (wshm_get_fds(ring, &fds[0], &fds[1]))
+        return WSHM_INVALID;
+    memset(&msg, 0, sizeof(msg));
+    memset(cbuf, 0, sizeof(cbuf));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    return sendmsg(sock, &msg, 0) == 1 ? 0 : WSHM_INVALID;
+}
+
+int
+wshm_recv_fds(int sock, int* memfd, int* bell)
+{
+    int fds[2];
+    char cbuf[CMSG_SPACE(sizeof(fds))], tag;
+    struct iovec iov = { &tag, 1 };
+    struct msghdr msg;
+    struct cmsghdr* cmsg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1 ||
+       (cmsg = CMSG_FIRSTHDR(&msg)) == NULL ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+        return WSHM_INVALID;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    *memfd = fds[0];
+    *bell = fds[1];
+    return 0;
+}
+
+static __always_inline uint32_t
+wshm_pad4(uint32_t len) { return (len+3) & ~3u; }
+
+int
+wshm_push(wshm_t* ring, const byte_t* data, uint32_t len)
+{
+    struct wshm_hdr* hdr = ring->hdr;
+    uint64_t tail = hdr->tail;
+    uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+    uint32_t need = sizeof(uint32_t) + wshm_pad4(len);
+    uint32_t off = tail & ring->mask;
+    uint32_t contig = ring->mask+1-off;
+    if (need > ring->mask+1)
+        return WSHM_FRAME_TOO_LARGE;
+    // frames are never split, if it doesn't fit
+    // before the end of the ring, skip to its start
+    if (tail + need + (need > contig ? contig : 0) - head > ring->mask+1)
+        return WSHM_FULL;
+    if (need > contig) {
+        *(uint32_t*)&ring->dat[off] = WSHM_WRAP;
+        tail += contig;
+        off = 0;
+    }
+    *(uint32_t*)&ring->dat[off] = len;
+    memcpy(&ring->dat[off+sizeof(uint32_t)], data, len);
+    __atomic_store_n(&hdr->tail, tail+need, __ATOMIC_RELEASE);
+    // pairs with the fence in wshm_park: either consumer
+    // sees the new tail, or we see it parked
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&hdr->parked, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&hdr->parked, 0, __ATOMIC_ACQ_REL))
+        send(ring->bell, "", 1, MSG_DONTWAIT);
+    return 0;
+}
+
+int
+wshm_pop(wshm_t* ring, wshm_fn fn, void* udt)
+{
+    struct wshm_hdr* hdr = ring->hdr;
+    uint32_t cap = ring->mask+1;
+    uint64_t head = hdr->head;
+    uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+    int count = 0;
+    // tail and frame lengths are written by the peer, nothing
+    // is read past what it published, or past the ring's end
+    if (tail-head > cap || head & 3)
+        goto invalid;
+    while (head != tail) {
+        uint32_t off = head & ring->mask;
+        uint32_t len = *(uint32_t*)&ring->dat[off];
+        if (len == WSHM_WRAP) {
+            if (cap-off > tail-head)
+                goto invalid;
+            head += cap-off;
+            continue;
+        }
+        if (len > cap-off-sizeof(uint32_t) ||
+            sizeof(uint32_t) + wshm_pad4(len) > tail-head)
+            goto invalid;
+        fn(&ring->dat[off+sizeof(uint32_t)], len, udt);
+        head += sizeof(uint32_t) + wshm_pad4(len);
+        count++;
+    }
+    __atomic_store_n(&hdr->head, head, __ATOMIC_RELEASE);
+    return count;
+invalid:
+    // ring can't be trusted, drop what's left of it
+    __atomic_store_n(&hdr->head, tail, __ATOMIC_RELEASE);
+    return -WSHM_INVALID;
+}
+
+bool
+wshm_park(wshm_t* ring)
+{
+    struct wshm_hdr* hdr = ring->hdr;
+    __atomic_store_n(&hdr->parked, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&hdr->tail, __ATOMIC_RELAXED) != hdr->head) {
+        __atomic_store_n(&hdr->parked, 0, __ATOMIC_RELAXED);
+        return true;
+    }
+    return false;
+}
+
+void
+wshm_unpark(wshm_t* ring)
+{
+    char buf[16];
+    __atomic_store_n(&ring->hdr->parked, 0, __ATOMIC_RELAXED);
+    while (recv(ring->bell, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        ;
+}
+
+int
+wshm_doorbell(wshm_t* ring)
+{
+    return ring->bell;
+}
+
+void
+wshm_close(wshm_t* ring)
+{
+    if (ring->hdr)
+        munmap(ring->hdr, ring->mapsz);
+    if (ring->memfd >= 0)
+        close(ring->memfd);
+    if (ring->bell >= 0)
+        close(ring->bell);
+    if (ring->peer >= 0)
+        close(ring->peer);
+    memset(ring, 0, sizeof(struct wshm));
+    ring->memfd = ring->bell = ring->peer = -1;
+}
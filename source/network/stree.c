@@ -0,0 +1,58 @@
+#include <wpn114/network/stree.h>
+#include <wpn114/utilities.h>
+
+int
+wqstree_lookup(const struct wqstree* tree, const char* uri)
+{
+    uint32_t d = tree->disp[wqstree_hash(0, uri) % tree->nbuckets];
+    uint16_t n = tree->slots[wqstree_hash(d, uri) % tree->nslots];
+    // uris that are not part of the tree still land on some slot
+    if (n == WQSTREE_NONE || strcmp(tree->nodes[n].uri, uri))
+        return -1;
+    return n;
+}
+
+static __always_inline bool
+wqstree_check_type(char type, char tag)
+{
+    if (type == WOSC_TYPE_BOOL)
+        return tag == WOSC_TYPE_TRUE || tag == WOSC_TYPE_FALSE;
+    return type == tag;
+}
+
+int
+wqstree_update_osc(const struct wqstree* tree, byte_t* data, int len,
+                   wqstree_fn fn, void* udt)
+{
+    int err, n;
+    wvalue_t v;
+    womsg_t* msg;
+    womsg_alloca(&msg);
+    if ((err = womsg_decode(msg, data, len)))
+        return err;
+    if ((n = wqstree_lookup(tree, womsg_geturi(msg))) < 0)
+        return WQUERY_URI_INVALID;
+    switch (tree->nodes[n].type) {
+    case WOSC_TYPE_NIL:
+    case WOSC_TYPE_STRING:
+    case WOSC_TYPE_BLOB:
+        return WQUERY_TYPE_MISMATCH;
+    }
+    if (!(tree->nodes[n].access & WQNODE_ACCESS_W))
+        return WQUERY_ATTR_UNSUPPORTED;
+    if (!wqstree_check_type(tree->nodes[n].type, *womsg_gettag(msg)))
+        return WQUERY_TYPE_MISMATCH;
+    if ((err = womsg_readv(msg, &v)))
+        return err;
+    tree->values[n].u = v.u;
+    if (fn)
+        fn(tree, n, &tree->values[n], udt);
+    return 0;
+}
+
+uint32_t
+wqstree_get_json(const struct wqstree* tree, int n, const char** json)
+{
+    *json = tree->json + tree->nodes[n].joff;
+    return tree->nodes[n].jlen;
+}
@@ -0,0 +1,354 @@
+#include <wpn114/network/uring.h>
+#include <wpn114/utilities.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define WURING_MAX_RECV     8
+#define WURING_BGID         0x77
+
+// user_data tags, recv slot index is stored in the low bits
+#define WURING_UD_SEND      (1ull << 62)
+#define WURING_UD_RECV      (1ull << 63)
+
+struct wuring_recv {
+    wuring_recv_fn fn;
+    void* udt;
+    int fd;
+};
+
+struct wuring {
+    int fd;
+    // submission queue
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local;      // local tail, published on submit
+    unsigned sq_submitted;  // last published tail
+    struct io_uring_sqe* sqes;
+    // completion queue
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    // mappings
+    void* sq_ptr;
+    void* cq_ptr;
+    size_t sq_sz;
+    size_t cq_sz;
+    size_t sqes_sz;
+    // provided buffers
+    struct io_uring_buf_ring* br;
+    byte_t* bufs;
+    size_t br_sz;
+    unsigned nbufs;
+    unsigned bufsz;
+    // multishot receivers
+    struct wuring_recv rcv[WURING_MAX_RECV];
+    int nrecv;
+    unsigned nsends;
+};
+
+int
+wuring_walloc(struct walloc_t* _allocator, wuring_t** dst)
+{
+    int err;
+    if ((err = _allocator->alloc(dst,
+                sizeof(struct wuring),
+               _allocator->data)) >= 0) {
+        memset(*dst, 0, sizeof(struct wuring));
+        (*dst)->fd = -1;
+        err = 0;
+    }
+    return err;
+}
+
+static inline int
+wuring_enter(wuring_t* ring, unsigned nsubmit, unsigned nwait,
+             unsigned flags, void* arg, size_t argsz)
+{
+    int ret = syscall(__NR_io_uring_enter, ring->fd, nsubmit,
+                      nwait, flags, arg, argsz);
+    return ret < 0 ? -errno : ret;
+}
+
+static int
+wuring_map(wuring_t* ring, struct io_uring_params* p)
+{
+    byte_t* sq, *cq;
+    ring->sq_sz = p->sq_off.array + p->sq_entries*sizeof(unsigned);
+    ring->cq_sz = p->cq_off.cqes + p->cq_entries*sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP)
+        ring->sq_sz = ring->cq_sz = wpnmax(ring->sq_sz, ring->cq_sz);
+
+    ring->sq_ptr = mmap(0, ring->sq_sz, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED)
+        return -errno;
+    if (p->features & IORING_FEAT_SINGLE_MMAP)
+        ring->cq_ptr = ring->sq_ptr;
+    else if ((ring->cq_ptr = mmap(0, ring->cq_sz, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, ring->fd,
+                                  IORING_OFF_CQ_RING)) == MAP_FAILED)
+        return -errno;
+
+    ring->sqes_sz = p->sq_entries*sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(0, ring->sqes_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        return -errno;
+
+    sq = ring->sq_ptr;
+    cq = ring->cq_ptr;
+    ring->sq_head    = (unsigned*)(sq+p->sq_off.head);
+    ring->sq_tail    = (unsigned*)(sq+p->sq_off.tail);
+    ring->sq_array   = (unsigned*)(sq+p->sq_off.array);
+    ring->sq_mask    = *(unsigned*)(sq+p->sq_off.ring_mask);
+    ring->sq_entries = p->sq_entries;
+    ring->sq_local   = *ring->sq_tail;
+    ring->sq_submitted = ring->sq_local;
+    ring->cq_head    = (unsigned*)(cq+p->cq_off.head);
+    ring->cq_tail    = (unsigned*)(cq+p->cq_off.tail);
+    ring->cq_mask    = *(unsigned*)(cq+p->cq_off.ring_mask);
+    ring->cqes       = (struct io_uring_cqe*)(cq+p->cq_off.cqes);
+    return 0;
+}
+
+static inline void
+wuring_recycle(wuring_t* ring, uint16_t bid, unsigned offset)
+{
+    struct io_uring_buf* b;
+    unsigned short tail = ring->br->tail;
+    b = &ring->br->bufs[(tail+offset) & (ring->nbufs-1)];
+    b->addr = (uint64_t)(uintptr_t)&ring->bufs[(size_t)bid*ring->bufsz];
+    b->len  = ring->bufsz;
+    b->bid  = bid;
+}
+
+static inline void
+wuring_recycle_commit(wuring_t* ring, unsigned count)
+{
+    __atomic_store_n(&ring->br->tail, ring->br->tail+count,
+                     __ATOMIC_RELEASE);
+}
+
+static int
+wuring_register_buffers(wuring_t* ring, unsigned nbufs, unsigned bufsz)
+{
+    struct io_uring_buf_reg reg;
+    if (nbufs == 0 || nbufs & (nbufs-1) || nbufs > 32768)
+        return -EINVAL;
+    ring->nbufs = nbufs;
+    ring->bufsz = bufsz;
+    // buffer ring has to be page-aligned,
+    // buffers follow it in the same mapping
+    ring->br_sz = nbufs*sizeof(struct io_uring_buf) + (size_t)nbufs*bufsz;
+    ring->br = mmap(0, ring->br_sz, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->br == MAP_FAILED) {
+        ring->br = NULL;
+        return -errno;
+    }
+    ring->bufs = (byte_t*)ring->br + nbufs*sizeof(struct io_uring_buf);
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->br;
+    reg.ring_entries = nbufs;
+    reg.bgid = WURING_BGID;
+    if (syscall(__NR_io_uring_register, ring->fd,
+                IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return -errno;
+    ring->br->tail = 0;
+    for (unsigned n = 0; n < nbufs; ++n)
+         wuring_recycle(ring, n, n);
+    wuring_recycle_commit(ring, nbufs);
+    return 0;
+}
+
+int
+wuring_init(wuring_t* ring, unsigned int entries,
+            unsigned int nbufs, unsigned int bufsz)
+{
+    int err;
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if ((ring->fd = syscall(__NR_io_uring_setup, entries, &p)) < 0)
+        return -errno;
+    if ((err = wuring_map(ring, &p)) ||
+        (err = wuring_register_buffers(ring, nbufs, bufsz))) {
+        wuring_close(ring);
+        return err;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe*
+wuring_get_sqe(wuring_t* ring)
+{
+    struct io_uring_sqe* sqe;
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned idx;
+    if (ring->sq_local-head >= ring->sq_entries) {
+        // submission queue is full, flush it first
+        wuring_submit(ring);
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_local-head >= ring->sq_entries)
+            return NULL;
+    }
+    idx = ring->sq_local & ring->sq_mask;
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    ring->sq_local++;
+    return sqe;
+}
+
+static int
+wuring_arm_recv(wuring_t* ring, int slot)
+{
+    struct io_uring_sqe* sqe;
+    if ((sqe = wuring_get_sqe(ring)) == NULL)
+        return -EBUSY;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = ring->rcv[slot].fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = WURING_BGID;
+    sqe->user_data = WURING_UD_RECV | slot;
+    return 0;
+}
+
+int
+wuring_recv_multishot(wuring_t* ring, int fd,
+                      wuring_recv_fn fn, void* udt)
+{
+    int slot;
+    if (ring->nrecv == WURING_MAX_RECV)
+        return -ENOSPC;
+    slot = ring->nrecv++;
+    ring->rcv[slot].fd  = fd;
+    ring->rcv[slot].fn  = fn;
+    ring->rcv[slot].udt = udt;
+    return wuring_arm_recv(ring, slot);
+}
+
+int
+wuring_sendmsg(wuring_t* ring, int fd, struct msghdr* msg)
+{
+    struct io_uring_sqe* sqe;
+    if ((sqe = wuring_get_sqe(ring)) == NULL)
+        return -EBUSY;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->user_data = WURING_UD_SEND;
+    ring->nsends++;
+    return 0;
+}
+
+int
+wuring_submit(wuring_t* ring)
+{
+    unsigned n = ring->sq_local-ring->sq_submitted;
+    if (n == 0)
+        return 0;
+    __atomic_store_n(ring->sq_tail, ring->sq_local, __ATOMIC_RELEASE);
+    ring->sq_submitted = ring->sq_local;
+    return wuring_enter(ring, n, 0, 0, NULL, 0);
+}
+
+static int
+wuring_reap(wuring_t* ring)
+{
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned nrecycled = 0;
+    int count = 0;
+    for (; head != tail; ++head, ++count) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+        if (cqe->user_data & WURING_UD_SEND) {
+            ring->nsends--;
+        } else if (cqe->user_data & WURING_UD_RECV) {
+            int slot = cqe->user_data & 0xff;
+            struct wuring_recv* r = &ring->rcv[slot];
+            if (cqe->flags & IORING_CQE_F_BUFFER) {
+                uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                if (cqe->res > 0)
+                    r->fn(&ring->bufs[(size_t)bid*ring->bufsz],
+                          cqe->res, r->udt);
+                // buffer goes straight back to the kernel
+                wuring_recycle(ring, bid, nrecycled++);
+            }
+            // multishot can be terminated by the kernel
+            // (e.g. -ENOBUFS), re-arm it
+            if (!(cqe->flags & IORING_CQE_F_MORE))
+                wuring_arm_recv(ring, slot);
+        }
+    }
+    if (nrecycled)
+        wuring_recycle_commit(ring, nrecycled);
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+int
+wuring_wait_sends(wuring_t* ring)
+{
+    int err;
+    wuring_submit(ring);
+    while (ring->nsends) {
+        if ((err = wuring_enter(ring, 0, 1, IORING_ENTER_GETEVENTS,
+                                NULL, 0)) < 0 && err != -EINTR)
+            return err;
+        wuring_reap(ring);
+    }
+    return 0;
+}
+
+int
+wuring_poll(wuring_t* ring, int ms)
+{
+    int err;
+    unsigned n = ring->sq_local-ring->sq_submitted;
+    struct __kernel_timespec ts = {
+        .tv_sec = ms/1000,
+        .tv_nsec = (ms%1000)*1000000ll
+    };
+    struct io_uring_getevents_arg arg = {
+        .sigmask = 0,
+        .sigmask_sz = _NSIG/8,
+        .ts = (uint64_t)(uintptr_t)&ts
+    };
+    __atomic_store_n(ring->sq_tail, ring->sq_local, __ATOMIC_RELEASE);
+    ring->sq_submitted = ring->sq_local;
+    err = wuring_enter(ring, n, 1, IORING_ENTER_GETEVENTS |
+                       IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (err < 0 && err != -ETIME && err != -EINTR)
+        return err;
+    return wuring_reap(ring);
+}
+
+void
+wuring_close(wuring_t* ring)
+{
+    if (ring->br)
+        munmap(ring->br, ring->br_sz);
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_sz);
+    if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED &&
+        ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_sz);
+    if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED)
+        munmap(ring->sq_ptr, ring->sq_sz);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    memset(ring, 0, sizeof(struct wuring));
+    ring->fd = -1;
+}
@@ -1,11 +1,914 @@
+#define _GNU_SOURCE // strcasecmp, getifaddrs
 #include <wpn114/network/zeroconf.h>
-#include <dependencies/mongoose/mongoose.h>
+#include <wpn114/types.h>
+#include <wpn114/utilities.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <poll.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WZ_MDNS_GROUP   "224.0.0.251"
+#define WZ_MDNS_PORT    5353
+#define WZ_MAXPKT       1472
+
+#define WZ_TYPE_A       1
+#define WZ_TYPE_PTR     12
+#define WZ_TYPE_TXT     16
+#define WZ_TYPE_SRV     33
+#define WZ_TYPE_ANY     255
+#define WZ_CLASS_IN     1
+#define WZ_CACHE_FLUSH  0x8000  // rr class: unique record
+#define WZ_UNICAST      0x8000  // question class: unicast response
+#define WZ_FLAG_QR      0x8000
+#define WZ_FLAG_AA      0x0400
+#define WZ_FLAG_TC      0x0200
+
+// rfc 6762, 10: host records, and everything else
+#define WZ_TTL_HOST     120
+#define WZ_TTL_OTHER    4500
+
+// browser query backoff (ms)
+#define WZ_QUERY_FIRST  1000
+#define WZ_QUERY_MAX    3600000
+
+const char*
+wz_strerr(int err)
+{
+    switch (err) {
+    case WZ_NOERROR:
+        return "no error";
+    case WZ_SOCKET_ERR:
+        return "could not open mdns socket";
+    case WZ_NAME_TOO_LONG:
+        return "name exceeds WZ_MAXNAME";
+    case WZ_ADDR_INVALID:
+        return "invalid IPv4 address";
+    case WZ_NOT_RUNNING:
+        return "service/browser is not running";
+    case WZ_MAX_TARGETS:
+        return "max number of browser targets reached";
+    default:
+        return "unknown error code";
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// DNS MESSAGES
+// ------------------------------------------------------------------------------------------------
+
+struct wzpkt {
+    byte_t dat[WZ_MAXPKT];
+    int len;
+    bool overflow;
+};
+
+struct wzrr {
+    char name[2*WZ_MAXNAME];
+    uint16_t type;
+    uint16_t cls;
+    uint32_t ttl;
+    int rdpos;      // rdata offset in packet
+    uint16_t rdlen;
+};
+
+static uint64_t
+wznow(void)
+{
+    return wpnclock_ns() / 1000000;
+}
+
+static void
+wzpkt_u16(struct wzpkt* pkt, uint16_t v)
+{
+    if (pkt->len+2 > WZ_MAXPKT) {
+        pkt->overflow = true;
+        return;
+    }
+    pkt->dat[pkt->len++] = v >> 8;
+    pkt->dat[pkt->len++] = v;
+}
+
+static void
+wzpkt_u32(struct wzpkt* pkt, uint32_t v)
+{
+    wzpkt_u16(pkt, v >> 16);
+    wzpkt_u16(pkt, v);
+}
+
+static void
+wzpkt_bytes(struct wzpkt* pkt, const void* src, int len)
+{
+    if (pkt->len+len > WZ_MAXPKT) {
+        pkt->overflow = true;
+        return;
+    }
+    memcpy(&pkt->dat[pkt->len], src, len);
+    pkt->len += len;
+}
+
+// single label, which may contain dots (instance names)
+static void
+wzpkt_label(struct wzpkt* pkt, const char* label)
+{
+    byte_t len = strlen(label);
+    wzpkt_bytes(pkt, &len, 1);
+    wzpkt_bytes(pkt, label, len);
+}
+
+// dotted name, not compressed
+static void
+wzpkt_name(struct wzpkt* pkt, const char* name)
+{
+    while (*name) {
+        byte_t len = strcspn(name, ".");
+        wzpkt_bytes(pkt, &len, 1);
+        wzpkt_bytes(pkt, name, len);
+        name += len;
+        if (*name == '.')
+            name++;
+    }
+    wzpkt_bytes(pkt, "", 1);
+}
+
+static void
+wzpkt_header(struct wzpkt* pkt, uint16_t id, uint16_t flags)
+{
+    pkt->len = 0;
+    pkt->overflow = false;
+    wzpkt_u16(pkt, id);
+    wzpkt_u16(pkt, flags);
+    for (int n = 0; n < 4; ++n)
+         wzpkt_u16(pkt, 0);
+}
+
+// increments one of the header section counts (0: qd, 1: an, 3: ar)
+static void
+wzpkt_count(struct wzpkt* pkt, int section)
+{
+    byte_t* c = &pkt->dat[4+2*section];
+    uint16_t v = (c[0] << 8 | c[1]) + 1;
+    c[0] = v >> 8;
+    c[1] = v;
+}
+
+static uint16_t
+wzrd16(const byte_t* p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static uint32_t
+wzrd32(const byte_t* p)
+{
+    return (uint32_t)wzrd16(p) << 16 | wzrd16(p+2);
+}
+
+// reads a (possibly compressed) name at <pos> into <dst>,
+// returns position right after it, or -1 if malformed
+static int
+wzread_name(const byte_t* pkt, int len, int pos, char* dst, int cap)
+{
+    int end = -1, out = 0, jumps = 0;
+    while (pos < len) {
+        byte_t l = pkt[pos];
+        if (l == 0) {
+            dst[out > 0 ? out-1 : 0] = '\0';
+            return end < 0 ? pos+1 : end;
+        }
+        if ((l & 0xc0) == 0xc0) {
+            if (pos+1 >= len || ++jumps > 16)
+                return -1;
+            if (end < 0)
+                end = pos+2;
+            pos = (l & 0x3f) << 8 | pkt[pos+1];
+            continue;
+        }
+        if (pos+1+l > len || out+l+1 >= cap)
+            return -1;
+        memcpy(&dst[out], &pkt[pos+1], l);
+        out += l;
+        dst[out++] = '.';
+        pos += l+1;
+    }
+    return -1;
+}
+
+static int
+wzread_rr(const byte_t* pkt, int len, int pos, struct wzrr* rr)
+{
+    if ((pos = wzread_name(pkt, len, pos, rr->name,
+                           sizeof(rr->name))) < 0 ||
+        pos+10 > len)
+        return -1;
+    rr->type = wzrd16(&pkt[pos]);
+    rr->cls = wzrd16(&pkt[pos+2]);
+    rr->ttl = wzrd32(&pkt[pos+4]);
+    rr->rdlen = wzrd16(&pkt[pos+8]);
+    rr->rdpos = pos+10;
+    if (rr->rdpos+rr->rdlen > len)
+        return -1;
+    return rr->rdpos+rr->rdlen;
+}
+
+// <name> is "<instance>.<suffix>", copies instance into <dst>
+static bool
+wzsplit_instance(const char* name, const char* suffix, char* dst)
+{
+    int nlen = strlen(name), slen = strlen(suffix);
+    if (nlen <= slen+1 || name[nlen-slen-1] != '.' ||
+        strcasecmp(&name[nlen-slen], suffix) ||
+        nlen-slen-1 >= WZ_MAXNAME)
+        return false;
+    memcpy(dst, name, nlen-slen-1);
+    dst[nlen-slen-1] = '\0';
+    return true;
+}
+
+static int
+wzset_iface(struct in_addr* dst, const char* addr)
+{
+    return inet_pton(AF_INET, addr, dst) == 1 ? 0 : WZ_ADDR_INVALID;
+}
+
+// first non-loopback IPv4 address, or loopback
+static struct in_addr
+wzdefault_iface(void)
+{
+    struct ifaddrs* ifs, *i;
+    struct in_addr addr = { htonl(INADDR_LOOPBACK) };
+    if (getifaddrs(&ifs))
+        return addr;
+    for (i = ifs; i; i = i->ifa_next) {
+        if (i->ifa_addr && i->ifa_addr->sa_family == AF_INET &&
+           (i->ifa_flags & IFF_UP) && !(i->ifa_flags & IFF_LOOPBACK)) {
+            addr = ((struct sockaddr_in*)i->ifa_addr)->sin_addr;
+            break;
+        }
+    }
+    freeifaddrs(ifs);
+    return addr;
+}
+
+static int
+wzsocket(struct in_addr iface)
+{
+    int fd, one = 1;
+    unsigned char ttl = 255;
+    struct sockaddr_in addr;
+    struct ip_mreq mreq;
+    if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK |
+                     SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(WZ_MDNS_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    inet_pton(AF_INET, WZ_MDNS_GROUP, &mreq.imr_multiaddr);
+    mreq.imr_interface = iface;
+    // every responder/browser on this host shares the port
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+        bind(fd, (struct sockaddr*) &addr, sizeof(addr)) ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                   &mreq, sizeof(mreq)) ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF,
+                   &iface, sizeof(iface)) ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL,
+                   &ttl, sizeof(ttl))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void
+wzsend(int fd, struct wzpkt* pkt, const struct sockaddr_in* dst)
+{
+    struct sockaddr_in group;
+    if (dst == NULL) {
+        memset(&group, 0, sizeof(group));
+        group.sin_family = AF_INET;
+        group.sin_port = htons(WZ_MDNS_PORT);
+        inet_pton(AF_INET, WZ_MDNS_GROUP, &group.sin_addr);
+        dst = &group;
+    }
+    sendto(fd, pkt->dat, pkt->len, 0,
+          (const struct sockaddr*) dst, sizeof(struct sockaddr_in));
+}
+
+// ------------------------------------------------------------------------------------------------
+// SERVICE
+// ------------------------------------------------------------------------------------------------
+
+enum wzrecord {
+    WZ_RR_PTR = 1,
+    WZ_RR_SRV = 2,
+    WZ_RR_TXT = 4,
+    WZ_RR_A = 8
+};
 
-// there surely is a lighter udp socket lib than mgws here...
 struct wzservice {
-    struct mg_mgr mgr;
+    char name[WZ_MAXNAME];
+    char type[WZ_MAXNAME];      // e.g. "_oscjson._tcp.local"
+    char host[WZ_MAXNAME];      // e.g. "foo.local"
+    struct in_addr iface;
+    struct wzpkt pkt;
+    uint64_t next_announce;
+    uint16_t port;
+    int announces;
+    int fd;
+};
+
+int
+wzservice_walloc(struct walloc_t* _allocator, wzservice_t** dst)
+{
+    int err;
+    if ((err = _allocator->alloc(dst,
+                sizeof(struct wzservice),
+               _allocator->data)) >= 0) {
+        struct wzservice* srv = *dst;
+        memset(srv, 0, sizeof(struct wzservice));
+        strcpy(srv->type, WZ_DEFAULT_TYPE ".local");
+        gethostname(srv->name, WZ_MAXNAME-7);
+        srv->name[WZ_MAXNAME-7] = '\0';
+        srv->name[strcspn(srv->name, ".")] = '\0';
+        snprintf(srv->host, WZ_MAXNAME, "%.*s.local",
+                 WZ_MAXNAME-7, srv->name);
+        srv->iface.s_addr = htonl(INADDR_ANY);
+        srv->fd = -1;
+        err = 0;
+    }
+    return err;
+}
+
+int
+wzservice_settype(wzservice_t* srv, const char* type)
+{
+    if (strlen(type)+sizeof(".local") > WZ_MAXNAME)
+        return WZ_NAME_TOO_LONG;
+    sprintf(srv->type, "%s.local", type);
+    return 0;
+}
+
+int
+wzservice_setname(wzservice_t* srv, const char* name)
+{
+    if (strlen(name) >= WZ_MAXNAME)
+        return WZ_NAME_TOO_LONG;
+    strcpy(srv->name, name);
+    return 0;
+}
+
+int
+wzservice_setport(wzservice_t* srv, uint16_t port)
+{
+    srv->port = port;
+    return 0;
+}
+
+int
+wzservice_setiface(wzservice_t* srv, const char* addr)
+{
+    return wzset_iface(&srv->iface, addr);
+}
+
+static void
+wzservice_write_rr(wzservice_t* srv, struct wzpkt* pkt,
+                   enum wzrecord rr, bool goodbye)
+{
+    switch (rr) {
+    case WZ_RR_PTR:
+        // shared record, no cache-flush bit
+        wzpkt_name(pkt, srv->type);
+        wzpkt_u16(pkt, WZ_TYPE_PTR);
+        wzpkt_u16(pkt, WZ_CLASS_IN);
+        wzpkt_u32(pkt, goodbye ? 0 : WZ_TTL_OTHER);
+        wzpkt_u16(pkt, strlen(srv->name)+1 + strlen(srv->type)+2);
+        wzpkt_label(pkt, srv->name);
+        wzpkt_name(pkt, srv->type);
+        break;
+    case WZ_RR_SRV:
+        wzpkt_label(pkt, srv->name);
+        wzpkt_name(pkt, srv->type);
+        wzpkt_u16(pkt, WZ_TYPE_SRV);
+        wzpkt_u16(pkt, WZ_CLASS_IN | WZ_CACHE_FLUSH);
+        wzpkt_u32(pkt, goodbye ? 0 : WZ_TTL_HOST);
+        wzpkt_u16(pkt, 6 + strlen(srv->host)+2);
+        wzpkt_u16(pkt, 0);  // priority
+        wzpkt_u16(pkt, 0);  // weight
+        wzpkt_u16(pkt, srv->port);
+        wzpkt_name(pkt, srv->host);
+        break;
+    case WZ_RR_TXT:
+        // empty TXT: a single zero-length string
+        wzpkt_label(pkt, srv->name);
+        wzpkt_name(pkt, srv->type);
+        wzpkt_u16(pkt, WZ_TYPE_TXT);
+        wzpkt_u16(pkt, WZ_CLASS_IN | WZ_CACHE_FLUSH);
+        wzpkt_u32(pkt, goodbye ? 0 : WZ_TTL_OTHER);
+        wzpkt_u16(pkt, 1);
+        wzpkt_bytes(pkt, "", 1);
+        break;
+    case WZ_RR_A:
+        wzpkt_name(pkt, srv->host);
+        wzpkt_u16(pkt, WZ_TYPE_A);
+        wzpkt_u16(pkt, WZ_CLASS_IN | WZ_CACHE_FLUSH);
+        wzpkt_u32(pkt, goodbye ? 0 : WZ_TTL_HOST);
+        wzpkt_u16(pkt, 4);
+        wzpkt_bytes(pkt, &srv->iface, 4);
+        break;
+    }
+}
+
+// sends <answers>, other records as additionals
+static void
+wzservice_respond(wzservice_t* srv, int answers, uint16_t id,
+                  const struct sockaddr_in* dst, bool goodbye)
+{
+    struct wzpkt* pkt = &srv->pkt;
+    int additionals = 0;
+    // a PTR answer is useless without SRV/TXT/A,
+    // and SRV without A: save a round-trip
+    if (answers & WZ_RR_PTR)
+        additionals = (WZ_RR_SRV | WZ_RR_TXT | WZ_RR_A) & ~answers;
+    else if (answers & WZ_RR_SRV)
+        additionals = WZ_RR_A & ~answers;
+    wzpkt_header(pkt, id, WZ_FLAG_QR | WZ_FLAG_AA);
+    for (int rr = WZ_RR_PTR; rr <= WZ_RR_A; rr <<= 1) {
+        if (answers & rr) {
+            wzservice_write_rr(srv, pkt, rr, goodbye);
+            wzpkt_count(pkt, 1);
+        }
+    }
+    for (int rr = WZ_RR_PTR; rr <= WZ_RR_A; rr <<= 1) {
+        if (additionals & rr) {
+            wzservice_write_rr(srv, pkt, rr, goodbye);
+            wzpkt_count(pkt, 3);
+        }
+    }
+    if (!pkt->overflow)
+        wzsend(srv->fd, pkt, dst);
+}
+
+// which of our records does this rr name
+static int
+wzservice_match(wzservice_t* srv, const char* name, uint16_t type)
+{
+    char inst[WZ_MAXNAME];
+    int rr = 0;
+    bool any = type == WZ_TYPE_ANY;
+    if (strcasecmp(name, srv->type) == 0) {
+        if (any || type == WZ_TYPE_PTR)
+            rr |= WZ_RR_PTR;
+    } else if (wzsplit_instance(name, srv->type, inst) &&
+               strcasecmp(inst, srv->name) == 0) {
+        if (any || type == WZ_TYPE_SRV)
+            rr |= WZ_RR_SRV;
+        if (any || type == WZ_TYPE_TXT)
+            rr |= WZ_RR_TXT;
+    } else if (strcasecmp(name, srv->host) == 0) {
+        if (any || type == WZ_TYPE_A)
+            rr |= WZ_RR_A;
+    }
+    return rr;
+}
+
+static uint32_t
+wzservice_ttl(enum wzrecord rr)
+{
+    return rr & (WZ_RR_SRV | WZ_RR_A) ? WZ_TTL_HOST : WZ_TTL_OTHER;
+}
+
+static void
+wzservice_query(wzservice_t* srv, const byte_t* dat, int len,
+                const struct sockaddr_in* src)
+{
+    int pos = 12, answers = 0;
+    bool unicast = false;
+    uint16_t qdcount = wzrd16(&dat[4]), ancount = wzrd16(&dat[6]);
+    for (int n = 0; n < qdcount; ++n) {
+        char name[2*WZ_MAXNAME];
+        if ((pos = wzread_name(dat, len, pos, name, sizeof(name))) < 0 ||
+             pos+4 > len)
+            return;
+        answers |= wzservice_match(srv, name, wzrd16(&dat[pos]));
+        unicast |= (wzrd16(&dat[pos+2]) & WZ_UNICAST) != 0;
+        pos += 4;
+    }
+    // known-answer suppression (rfc 6762, 7.1): querier already
+    // has our record, with at least half of its ttl remaining
+    for (int n = 0; n < ancount && answers; ++n) {
+        struct wzrr rr;
+        int match;
+        if ((pos = wzread_rr(dat, len, pos, &rr)) < 0)
+            return;
+        match = wzservice_match(srv, rr.name, rr.type);
+        if (match == WZ_RR_PTR) {
+            char target[2*WZ_MAXNAME], inst[WZ_MAXNAME];
+            if (wzread_name(dat, len, rr.rdpos, target,
+                            sizeof(target)) < 0 ||
+               !wzsplit_instance(target, srv->type, inst) ||
+                strcasecmp(inst, srv->name))
+                match = 0;
+        }
+        if (match && rr.ttl >= wzservice_ttl(match)/2)
+            answers &= ~match;
+    }
+    if (answers == 0)
+        return;
+    // legacy (one-shot) queriers get a direct reply
+    if (ntohs(src->sin_port) != WZ_MDNS_PORT)
+        wzservice_respond(srv, answers, wzrd16(dat), src, false);
+    else
+        wzservice_respond(srv, answers, 0, unicast ? src : NULL, false);
+}
+
+int
+wzservice_publish(wzservice_t* srv)
+{
+    if (srv->iface.s_addr == htonl(INADDR_ANY))
+        srv->iface = wzdefault_iface();
+    if (srv->fd < 0 && (srv->fd = wzsocket(srv->iface)) < 0)
+        return WZ_SOCKET_ERR;
+    // announced twice, one second apart (rfc 6762, 8.3)
+    srv->announces = 2;
+    srv->next_announce = 0;
+    return wzservice_iter(srv, 0);
+}
+
+int
+wzservice_iter(wzservice_t* srv, int ms)
+{
+    struct pollfd pfd = { srv->fd, POLLIN, 0 };
+    uint64_t now = wznow(), until = now+ms;
+    if (srv->fd < 0)
+        return WZ_NOT_RUNNING;
+    do {
+        if (srv->announces && now >= srv->next_announce) {
+            wzservice_respond(srv, WZ_RR_PTR | WZ_RR_SRV |
+                              WZ_RR_TXT | WZ_RR_A, 0, NULL, false);
+            srv->announces--;
+            srv->next_announce = now+1000;
+        }
+        if (poll(&pfd, 1, until > now ? wpnmin(until-now, 1000) : 0) > 0) {
+            struct sockaddr_in src;
+            socklen_t slen = sizeof(src);
+            int len;
+            while ((len = recvfrom(srv->fd, srv->pkt.dat, WZ_MAXPKT, 0,
+                   (struct sockaddr*) &src, &slen)) >= 12) {
+                // our own responses loop back, ignore them
+                if (!(wzrd16(&srv->pkt.dat[2]) & WZ_FLAG_QR))
+                    wzservice_query(srv, srv->pkt.dat, len, &src);
+                slen = sizeof(src);
+            }
+        }
+        now = wznow();
+    } while (now < until);
+    return 0;
+}
+
+int
+wzservice_stop(wzservice_t* srv)
+{
+    if (srv->fd < 0)
+        return WZ_NOT_RUNNING;
+    wzservice_respond(srv, WZ_RR_PTR | WZ_RR_SRV | WZ_RR_TXT | WZ_RR_A,
+                      0, NULL, true);
+    close(srv->fd);
+    srv->fd = -1;
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// BROWSER
+// ------------------------------------------------------------------------------------------------
+
+struct wzentry {
+    char name[WZ_MAXNAME];
+    char host[WZ_MAXNAME];
+    struct in_addr addr;
+    uint64_t expires;       // PTR expiry (ms)
+    uint64_t refresh;       // next refresh query (ms)
+    uint32_t ttl;           // PTR original ttl
+    uint16_t port;
+    bool used;
 };
 
 struct wzbrowser {
-    struct mg_mgr mgr;
+    char type[WZ_MAXNAME];
+    char targets[WZBROWSER_MAX_TARGETS][WZ_MAXNAME];
+    struct wzentry cache[WZBROWSER_MAX_RESULTS];
+    struct wzpkt pkt;
+    struct in_addr iface;
+    uint64_t next_query;
+    uint32_t interval;
+    int ntargets;
+    int fd;
 };
+
+int
+wzbrowser_walloc(struct walloc_t* _allocator, wzbrowser_t** dst)
+{
+    int err;
+    if ((err = _allocator->alloc(dst,
+                sizeof(struct wzbrowser),
+               _allocator->data)) >= 0) {
+        memset(*dst, 0, sizeof(struct wzbrowser));
+        strcpy((*dst)->type, WZ_DEFAULT_TYPE ".local");
+        (*dst)->iface.s_addr = htonl(INADDR_ANY);
+        (*dst)->fd = -1;
+        err = 0;
+    }
+    return err;
+}
+
+int
+wzbrowser_settype(wzbrowser_t* bws, const char* type)
+{
+    if (strlen(type)+sizeof(".local") > WZ_MAXNAME)
+        return WZ_NAME_TOO_LONG;
+    sprintf(bws->type, "%s.local", type);
+    return 0;
+}
+
+int
+wzbrowser_setiface(wzbrowser_t* bws, const char* addr)
+{
+    return wzset_iface(&bws->iface, addr);
+}
+
+int
+wzbrowser_addtarget(wzbrowser_t* bws, const char* target)
+{
+    if (bws->ntargets == WZBROWSER_MAX_TARGETS)
+        return WZ_MAX_TARGETS;
+    if (strlen(target) >= WZ_MAXNAME)
+        return WZ_NAME_TOO_LONG;
+    strcpy(bws->targets[bws->ntargets++], target);
+    return 0;
+}
+
+static struct wzentry*
+wzbrowser_find(wzbrowser_t* bws, const char* name)
+{
+    for (int n = 0; n < WZBROWSER_MAX_RESULTS; ++n)
+         if (bws->cache[n].used && strcasecmp(bws->cache[n].name, name) == 0)
+             return &bws->cache[n];
+    return NULL;
+}
+
+static bool
+wzbrowser_wanted(wzbrowser_t* bws, const char* name)
+{
+    if (bws->ntargets == 0)
+        return true;
+    for (int n = 0; n < bws->ntargets; ++n)
+         if (strcasecmp(bws->targets[n], name) == 0)
+             return true;
+    return false;
+}
+
+// new cache entry, evicting the one that expires first if full
+static struct wzentry*
+wzbrowser_insert(wzbrowser_t* bws, const char* name)
+{
+    struct wzentry* e = &bws->cache[0];
+    for (int n = 0; n < WZBROWSER_MAX_RESULTS; ++n) {
+        if (!bws->cache[n].used) {
+            e = &bws->cache[n];
+            break;
+        }
+        if (bws->cache[n].expires < e->expires)
+            e = &bws->cache[n];
+    }
+    memset(e, 0, sizeof(struct wzentry));
+    strcpy(e->name, name);
+    e->used = true;
+    return e;
+}
+
+static void
+wzbrowser_ptr(wzbrowser_t* bws, const byte_t* dat, int len,
+              struct wzrr* rr, uint64_t now)
+{
+    char target[2*WZ_MAXNAME], inst[WZ_MAXNAME];
+    struct wzentry* e;
+    if (strcasecmp(rr->name, bws->type) ||
+        wzread_name(dat, len, rr->rdpos, target, sizeof(target)) < 0 ||
+       !wzsplit_instance(target, bws->type, inst) ||
+       !wzbrowser_wanted(bws, inst))
+        return;
+    e = wzbrowser_find(bws, inst);
+    if (rr->ttl == 0) {
+        // goodbye
+        if (e)
+            e->used = false;
+        return;
+    }
+    if (e == NULL)
+        e = wzbrowser_insert(bws, inst);
+    e->ttl = rr->ttl;
+    e->expires = now + rr->ttl*1000ull;
+    // rfc 6762, 5.2: refresh at 80% of ttl
+    e->refresh = now + rr->ttl*800ull;
+}
+
+static void
+wzbrowser_srv(wzbrowser_t* bws, const byte_t* dat, int len,
+              struct wzrr* rr)
+{
+    char inst[WZ_MAXNAME];
+    struct wzentry* e;
+    if (!wzsplit_instance(rr->name, bws->type, inst) ||
+       (e = wzbrowser_find(bws, inst)) == NULL ||
+        rr->rdlen < 7)
+        return;
+    e->port = wzrd16(&dat[rr->rdpos+4]);
+    if (wzread_name(dat, len, rr->rdpos+6, e->host, WZ_MAXNAME) < 0)
+        e->host[0] = '\0';
+}
+
+static void
+wzbrowser_a(wzbrowser_t* bws, struct wzrr* rr, const byte_t* dat)
+{
+    if (rr->rdlen != 4)
+        return;
+    for (int n = 0; n < WZBROWSER_MAX_RESULTS; ++n) {
+        struct wzentry* e = &bws->cache[n];
+        if (e->used && strcasecmp(e->host, rr->name) == 0)
+            memcpy(&e->addr, &dat[rr->rdpos], 4);
+    }
+}
+
+static void
+wzbrowser_response(wzbrowser_t* bws, const byte_t* dat, int len)
+{
+    uint64_t now = wznow();
+    int nrr = wzrd16(&dat[6]) + wzrd16(&dat[8]) + wzrd16(&dat[10]);
+    int start = 12, pos;
+    uint16_t qdcount = wzrd16(&dat[4]);
+    for (int n = 0; n < qdcount; ++n) {
+        char name[2*WZ_MAXNAME];
+        if ((start = wzread_name(dat, len, start,
+                                 name, sizeof(name))) < 0)
+            return;
+        start += 4;
+    }
+    // records can come in any order: PTRs create
+    // cache entries, then SRVs give their host, then A
+    for (int pass = 0; pass < 3; ++pass) {
+        pos = start;
+        for (int n = 0; n < nrr; ++n) {
+            struct wzrr rr;
+            if ((pos = wzread_rr(dat, len, pos, &rr)) < 0)
+                return;
+            if (pass == 0 && rr.type == WZ_TYPE_PTR)
+                wzbrowser_ptr(bws, dat, len, &rr, now);
+            else if (pass == 1 && rr.type == WZ_TYPE_SRV)
+                wzbrowser_srv(bws, dat, len, &rr);
+            else if (pass == 2 && rr.type == WZ_TYPE_A)
+                wzbrowser_a(bws, &rr, dat);
+        }
+    }
+}
+
+// PTR query, with known answers (rfc 6762, 7.1) and SRV questions
+// for unresolved entries. Known answers that don't fit go in
+// follow-up packets, all but the last one being truncated (TC)
+static void
+wzbrowser_query(wzbrowser_t* bws, uint64_t now)
+{
+    struct wzpkt* pkt = &bws->pkt;
+    int n = 0;
+    do {
+        wzpkt_header(pkt, 0, 0);
+        wzpkt_name(pkt, bws->type);
+        wzpkt_u16(pkt, WZ_TYPE_PTR);
+        wzpkt_u16(pkt, WZ_CLASS_IN);
+        wzpkt_count(pkt, 0);
+        for (int i = 0; n == 0 && i < WZBROWSER_MAX_RESULTS; ++i) {
+            struct wzentry* e = &bws->cache[i];
+            int len = pkt->len;
+            if (!e->used || e->port)
+                continue;
+            wzpkt_label(pkt, e->name);
+            wzpkt_u16(pkt, 0xc000 | 12);
+            wzpkt_u16(pkt, WZ_TYPE_SRV);
+            wzpkt_u16(pkt, WZ_CLASS_IN);
+            if (pkt->overflow) {
+                pkt->len = len;
+                pkt->overflow = false;
+                break;
+            }
+            wzpkt_count(pkt, 0);
+        }
+        for (; n < WZBROWSER_MAX_RESULTS; ++n) {
+            struct wzentry* e = &bws->cache[n];
+            uint32_t remaining;
+            int len = pkt->len;
+            if (!e->used || e->expires <= now)
+                continue;
+            remaining = (e->expires-now)/1000;
+            if (remaining < e->ttl/2)
+                continue;
+            // type name is the question, at offset 12
+            wzpkt_u16(pkt, 0xc000 | 12);
+            wzpkt_u16(pkt, WZ_TYPE_PTR);
+            wzpkt_u16(pkt, WZ_CLASS_IN);
+            wzpkt_u32(pkt, remaining);
+            wzpkt_u16(pkt, strlen(e->name)+3);
+            wzpkt_label(pkt, e->name);
+            wzpkt_u16(pkt, 0xc000 | 12);
+            if (pkt->overflow) {
+                pkt->len = len;
+                pkt->overflow = false;
+                pkt->dat[2] |= WZ_FLAG_TC >> 8;
+                break;
+            }
+            wzpkt_count(pkt, 1);
+        }
+        wzsend(bws->fd, pkt, NULL);
+    } while (n < WZBROWSER_MAX_RESULTS);
+    bws->next_query = now + bws->interval;
+    bws->interval = wpnmin(bws->interval*2, WZ_QUERY_MAX);
+}
+
+int
+wzbrowser_run(wzbrowser_t* bws)
+{
+    if (bws->iface.s_addr == htonl(INADDR_ANY))
+        bws->iface = wzdefault_iface();
+    if (bws->fd < 0 && (bws->fd = wzsocket(bws->iface)) < 0)
+        return WZ_SOCKET_ERR;
+    bws->interval = WZ_QUERY_FIRST;
+    bws->next_query = 0;
+    return wzbrowser_iter(bws, 0);
+}
+
+int
+wzbrowser_iter(wzbrowser_t* bws, int ms)
+{
+    struct pollfd pfd = { bws->fd, POLLIN, 0 };
+    uint64_t now = wznow(), until = now+ms;
+    if (bws->fd < 0)
+        return WZ_NOT_RUNNING;
+    do {
+        bool query = now >= bws->next_query;
+        for (int n = 0; n < WZBROWSER_MAX_RESULTS; ++n) {
+            struct wzentry* e = &bws->cache[n];
+            if (!e->used)
+                continue;
+            if (e->expires <= now)
+                e->used = false;
+            else if (e->refresh <= now) {
+                // next refresh at 90%, then let it expire
+                query = true;
+                e->refresh = e->refresh+e->ttl*100ull < e->expires-e->ttl*50ull
+                           ? e->refresh+e->ttl*100ull : UINT64_MAX;
+            }
+        }
+        if (query)
+            wzbrowser_query(bws, now);
+        if (poll(&pfd, 1, until > now ? wpnmin(until-now, 1000) : 0) > 0) {
+            int len;
+            while ((len = recv(bws->fd, bws->pkt.dat, WZ_MAXPKT, 0)) >= 12)
+                if (wzrd16(&bws->pkt.dat[2]) & WZ_FLAG_QR)
+                    wzbrowser_response(bws, bws->pkt.dat, len);
+        }
+        now = wznow();
+    } while (now < until);
+    return 0;
+}
+
+int
+wzbrowser_results(wzbrowser_t* bws, struct wzresult* dst, int max)
+{
+    uint64_t now = wznow();
+    int count = 0;
+    for (int n = 0; n < WZBROWSER_MAX_RESULTS && count < max; ++n) {
+        struct wzentry* e = &bws->cache[n];
+        if (!e->used || e->port == 0 || e->addr.s_addr == 0 ||
+            e->expires <= now)
+            continue;
+        strcpy(dst[count].name, e->name);
+        strcpy(dst[count].host, e->host);
+        dst[count].addr = e->addr;
+        dst[count].port = e->port;
+        dst[count].ttl = (e->expires-now)/1000;
+        count++;
+    }
+    return count;
+}
+
+int
+wzbrowser_stop(wzbrowser_t* bws)
+{
+    if (bws->fd < 0)
+        return WZ_NOT_RUNNING;
+    close(bws->fd);
+    bws->fd = -1;
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef WPN_BENCH_H
+#define WPN_BENCH_H
+
+#include <time.h>
+#include <stdint.h>
+#include "tests.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Monotonic clock, in nanoseconds */
+static inline uint64_t
+wbench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+#define wbench_begin(_name)                                     \
+    const char* _bname = #_name;                                \
+    wpnout("starting wpn_bench_" #_name "\n")
+
+#define wbench_report(_label, _count, _ns)                      \
+    wpnout("%s, %-24s %12.0f ops/s (%.1f ns/op)\n",             \
+           _bname, _label, (double)(_count)*1e9/(_ns),          \
+           (double)(_ns)/((_count) ? (_count) : 1))
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,75 @@
+#include <wpn114/network/oscquery.h>
+#include <wpn114/utilities.h>
+#include <stdlib.h>
+#include "bench.h"
+
+// blob throughput: encoding, zero-copy decoding, and
+// decoding into a blob node (one copy), for a few
+// kilobyte-sized waveform thumbnails
+
+#define NITER 200000
+
+static const uint32_t s_sizes[] = { 1024, 4096, 16384, 60000 };
+
+// keeps zero-copy reads from being optimized out
+static volatile byte_t s_sink;
+
+static void
+bench_size(wqnode_t* nd, uint32_t size)
+{
+    wbench_begin(blob);
+    byte_t* wave = malloc(size);
+    byte_t* pkt = malloc(size+64);
+    const byte_t* view;
+    uint32_t len, plen = 0;
+    uint64_t t0;
+    char label[32];
+    womsg_t* msg;
+    womsg_alloca(&msg);
+    for (uint32_t n = 0; n < size; ++n)
+         wave[n] = n;
+
+    t0 = wbench_now();
+    for (int n = 0; n < NITER; ++n) {
+         womsg_setbuf(msg, pkt, size+64);
+         womsg_seturi(msg, "/wave");
+         womsg_settag(msg, "b");
+         womsg_writeblob(msg, wave, size);
+         plen = womsg_getlen(msg);
+    }
+    snprintf(label, sizeof(label), "encode %u", size);
+    wbench_report(label, NITER, wbench_now()-t0);
+
+    t0 = wbench_now();
+    for (int n = 0; n < NITER; ++n) {
+         womsg_decode(msg, pkt, plen);
+         womsg_readblob(msg, &view, &len);
+         s_sink = view[len-1];
+    }
+    snprintf(label, sizeof(label), "decode (view) %u", size);
+    wbench_report(label, NITER, wbench_now()-t0);
+
+    t0 = wbench_now();
+    for (int n = 0; n < NITER; ++n) {
+         womsg_decode(msg, pkt, plen);
+         womsg_readblob(msg, &view, &len);
+         wqnode_setblob(nd, view, len);
+    }
+    snprintf(label, sizeof(label), "decode (node) %u", size);
+    wbench_report(label, NITER, wbench_now()-t0);
+
+    free(wave);
+    free(pkt);
+}
+
+int
+main(void)
+{
+    wqtree_t* tree;
+    wqnode_t* nd;
+    wqtree_walloc(&s_malloc, &tree);
+    wqtree_addndblob(tree, "/wave", &nd, 60000);
+    for (int n = 0; n < sizeof(s_sizes)/sizeof(s_sizes[0]); ++n)
+         bench_size(nd, s_sizes[n]);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <wpn114/network/oscquery.h>
+#include <wpn114/utilities.h>
+#include <stdlib.h>
+#include "bench.h"
+
+// tree construction, node by node and in bulk, for a 10k node
+// tree made of 100 modules of 100 parameters, and for a flat one
+// (a single level of 10k nodes, the worst case for sibling lists)
+
+#define NMODULES    100
+#define NPARAMS     100
+#define NNODES      (NMODULES*(NPARAMS+1))
+#define NRUNS       5
+
+static struct wqnode_desc s_nested[NNODES];
+static struct wqnode_desc s_flat[NNODES];
+
+static void
+bench_descs(void)
+{
+    int n = 0;
+    for (int m = 0; m < NMODULES; ++m) {
+         s_nested[n].uri = malloc(16);
+         snprintf((char*) s_nested[n].uri, 16, "/module_%03d", m);
+         s_nested[n++].type = WOSC_TYPE_NIL;
+         for (int p = 0; p < NPARAMS; ++p) {
+              s_nested[n].uri = malloc(32);
+              snprintf((char*) s_nested[n].uri, 32, "/module_%03d/param_%03d", m, p);
+              s_nested[n++].type = WOSC_TYPE_FLOAT;
+         }
+    }
+    for (n = 0; n < NNODES; ++n) {
+         s_flat[n].uri = malloc(16);
+         snprintf((char*) s_flat[n].uri, 16, "/param_%05d", n);
+         s_flat[n].type = WOSC_TYPE_FLOAT;
+    }
+}
+
+// trees are not freed, there's no api for it
+static void
+bench_tree(const char* label, const char* blabel,
+           const struct wqnode_desc* descs)
+{
+    wbench_begin(build);
+    wqtree_t* tree;
+    wqnode_t* nd;
+    uint64_t t0, t = 0;
+    for (int r = 0; r < NRUNS; ++r) {
+         wqtree_walloc(&s_malloc, &tree);
+         t0 = wbench_now();
+         for (int n = 0; n < NNODES; ++n) {
+              if (descs[n].type == WOSC_TYPE_NIL)
+                  wqtree_addndN(tree, descs[n].uri, &nd);
+              else
+                  wqtree_addndf(tree, descs[n].uri, &nd);
+         }
+         t += wbench_now()-t0;
+    }
+    wbench_report(label, NRUNS*NNODES, t);
+    t = 0;
+    for (int r = 0; r < NRUNS; ++r) {
+         wqtree_walloc(&s_malloc, &tree);
+         t0 = wbench_now();
+         wqtree_build(tree, descs, NNODES, NULL);
+         t += wbench_now()-t0;
+    }
+    wbench_report(blabel, NRUNS*NNODES, t);
+}
+
+int
+main(void)
+{
+    bench_descs();
+    bench_tree("nested, addnd", "nested, build", s_nested);
+    bench_tree("flat, addnd", "flat, build", s_flat);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <wpn114/network/oscquery.hpp>
+#include <wpn114/utilities.h>
+#include "bench.h"
+
+// C++ layer overhead: the same set/get/callback loops,
+// through raw C calls and through typed nodes
+
+using namespace wpn114::query;
+
+#define NITER 20000000
+
+struct sink {
+    float sum = 0;
+    void add(float f) { sum += f; }
+};
+
+static void
+sink_fn(wqnode_t*, wvalue_t* v, void* udt)
+{
+    static_cast<sink*>(udt)->add(v->u.f);
+}
+
+static void
+bench_c(void)
+{
+    wbench_begin(c);
+    wqtree_t* tree;
+    wqnode_t* nd;
+    sink s;
+    float f, sum = 0;
+    uint64_t t0;
+    wqtree_walloc(&s_malloc, &tree);
+    wqtree_addndf(tree, "/gain", &nd);
+
+    t0 = wbench_now();
+    for (int n = 0; n < NITER; ++n)
+         wqnode_setf(nd, n);
+    wbench_report("set", NITER, wbench_now()-t0);
+
+    t0 = wbench_now();
+    for (int n = 0; n < NITER; ++n) {
+         wqnode_getf(nd, &f);
+         sum += f;
+    }
+    wbench_report("get", NITER, wbench_now()-t0);
+
+    wqnode_set_fn(nd, sink_fn, &s);
+    t0 = wbench_now();
+    for (int n = 0; n < NITER; ++n)
+         wqnode_setf(nd, n);
+    wbench_report("set (callback)", NITER, wbench_now()-t0);
+    wpnout("%f %f\n", sum, s.sum);
+}
+
+static void
+bench_cpp(void)
+{
+    wbench_begin(cpp);
+    Tree tree;
+    Node<float> nd;
+    sink s;
+    float sum = 0;
+    uint64_t t0;
+    tree.add("/gain", &nd);
+
+    t0 = wbench_now();
+    for (int n = 0; n < NITER; ++n)
+         nd.set(n);
+    wbench_report("set", NITER, wbench_now()-t0);
+
+    t0 = wbench_now();
+    for (int n = 0; n < NITER; ++n)
+         sum += nd.get();
+    wbench_report("get", NITER, wbench_now()-t0);
+
+    nd.bind<&sink::add>(&s);
+    t0 = wbench_now();
+    for (int n = 0; n < NITER; ++n)
+         nd.set(n);
+    wbench_report("set (callback)", NITER, wbench_now()-t0);
+    wpnout("%f %f\n", sum, s.sum);
+}
+
+int
+main(void)
+{
+    bench_c();
+    bench_cpp();
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <wpn114/network/oscquery.h>
+#include <wpn114/utilities.h>
+#include <stdlib.h>
+#include "bench.h"
+
+// node lookups (wqtree_get_node), by fan-out of the parent:
+// a few children (sibling list) and 512 of them (sorted array)
+
+#define NLOOKUPS    4000000
+
+static void
+bench_fanout(wqtree_t* tree, const char* label, int nchildren)
+{
+    wbench_begin(lookup);
+    wqnode_t* nd;
+    char** uris = malloc(nchildren*sizeof(char*));
+    uint64_t t0;
+    uintptr_t sum = 0;
+    char* parent = malloc(32);
+    snprintf(parent, 32, "/fanout_%d", nchildren);
+    wqtree_addndN(tree, parent, &nd);
+    for (int n = 0; n < nchildren; ++n) {
+         uris[n] = malloc(48);
+         snprintf(uris[n], 48, "%s/channel_%d/gain", parent, n);
+         wqtree_addndN(tree, strndup(uris[n], strrchr(uris[n], '/')-uris[n]), &nd);
+         wqtree_addndf(tree, uris[n], &nd);
+    }
+    t0 = wbench_now();
+    for (uint32_t n = 0, k = 0; n < NLOOKUPS; ++n, k = (k+7919) % nchildren)
+         sum += (uintptr_t) wqtree_get_node(tree, uris[k]);
+    wbench_report(label, NLOOKUPS, wbench_now()-t0);
+    if (sum == 0)
+        wpnout("not found\n");
+}
+
+int
+main(void)
+{
+    wqtree_t* tree;
+    wqtree_walloc(&s_malloc, &tree);
+    bench_fanout(tree, "8 children", 8);
+    bench_fanout(tree, "64 children", 64);
+    bench_fanout(tree, "512 children", 512);
+    return 0;
+}
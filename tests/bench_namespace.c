@@ -0,0 +1,70 @@
+#include <wpn114/network/oscquery.h>
+#include <wpn114/utilities.h>
+#include <stdlib.h>
+#include "bench.h"
+
+// namespace replies: size of the json and of its gzipped copy,
+// cost of serializing (and compressing) it once per tree version,
+// and of serving the cached copy, for a ~2MB namespace
+
+#define NMODULES    200
+#define NPARAMS     100
+#define NCOLD       20
+#define NWARM       1000000
+
+// nodes keep a pointer to their uri
+static char*
+bench_uri(const char* fmt, int a, int b)
+{
+    char* uri = malloc(64);
+    snprintf(uri, 64, fmt, a, b);
+    return uri;
+}
+
+int
+main(void)
+{
+    wbench_begin(namespace);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* nd;
+    const void* dat;
+    const char* etag;
+    uint32_t jlen, zlen = 0, len;
+    char* json;
+    uint64_t t0;
+    wqtree_walloc(&s_malloc, &tree);
+    for (int m = 0; m < NMODULES; ++m) {
+         wqtree_addndN(tree, bench_uri("/module_%03d", m, 0), &nd);
+         for (int p = 0; p < NPARAMS; ++p)
+              wqtree_addndf(tree, bench_uri("/module_%03d/parameter_%03d", m, p), &nd);
+    }
+    wqserver_walloc(&s_malloc, &server);
+    wqserver_expose(server, tree);
+
+    wqtree_print_json(tree, wqtree_get_node(tree, "/"), NULL, 0, &jlen);
+    json = malloc(jlen+1);
+    t0 = wbench_now();
+    for (int n = 0; n < NCOLD; ++n)
+         wqtree_print_json(tree, wqtree_get_node(tree, "/"), json, jlen+1, &len);
+    wbench_report("serialize", NCOLD, wbench_now()-t0);
+
+    // every tree change invalidates the cached copies
+    t0 = wbench_now();
+    for (int n = 0; n < NCOLD; ++n) {
+         wqtree_addndf(tree, bench_uri("/module_%03d/extra_%03d", 0, n), &nd);
+         if (wqserver_get_namespace(server, true, &dat, &zlen, &etag))
+             wqserver_get_namespace(server, false, &dat, &len, &etag);
+    }
+    wbench_report("rebuild (tree changed)", NCOLD, wbench_now()-t0);
+
+    t0 = wbench_now();
+    for (int n = 0; n < NWARM; ++n)
+         wqserver_get_namespace(server, zlen > 0, &dat, &len, &etag);
+    wbench_report("cached", NWARM, wbench_now()-t0);
+
+    wpnout("%s, json %u bytes, gzip %u bytes (%.1f%%)\n", _bname,
+           jlen, zlen, zlen*100.0/jlen);
+    free(json);
+    return 0;
+}
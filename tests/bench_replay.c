@@ -0,0 +1,101 @@
+#include <wpn114/network/oscquery.h>
+#include <wpn114/network/record.h>
+#include <wpn114/utilities.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "bench.h"
+
+// replays a recorded log into a tree: bench_replay [log [speed]]
+// the tree is built from the uris and types found in the log,
+// speed defaults to 0 (as fast as possible). without arguments,
+// a synthetic log of float updates over 64 nodes is generated
+
+#define NNODES      64
+#define NPACKETS    200000
+#define SYNTHLOG    "/tmp/wquery_bench_replay.log"
+
+static int
+node_add(wqtree_t* tree, const char* uri, char tag)
+{
+    wqnode_t* nd;
+    char* dup;
+    if (wqtree_get_node(tree, uri))
+        return 0;
+    // nodes must outlive the log mapping, and
+    // intermediate nodes are not created by the tree
+    dup = strdup(uri);
+    for (char* sep = strchr(dup+1, '/'); sep; sep = strchr(sep+1, '/')) {
+         *sep = 0;
+         if (wqtree_get_node(tree, dup) == NULL)
+             wqtree_addndN(tree, strdup(dup), &nd);
+         *sep = '/';
+    }
+    switch (tag) {
+    case 'i': return wqtree_addndi(tree, dup, &nd);
+    case 'f': return wqtree_addndf(tree, dup, &nd);
+    case 'c': return wqtree_addndc(tree, dup, &nd);
+    case 's': return wqtree_addnds(tree, dup, &nd, 256);
+    case 'T':
+    case 'F': return wqtree_addndb(tree, dup, &nd);
+    default:  return wqtree_addndN(tree, dup, &nd);
+    }
+}
+
+static void
+scan_fn(byte_t* data, uint32_t len, uint64_t ts, void* udt)
+{
+    womsg_t* msg;
+    womsg_alloca(&msg);
+    if (womsg_decode(msg, data, len) == 0)
+        node_add(udt, womsg_geturi(msg), *womsg_gettag(msg));
+}
+
+static int
+synthesize(wqrec_t* rec)
+{
+    byte_t pkts[NNODES][32];
+    uint32_t lens[NNODES];
+    int err;
+    if ((err = wqrec_create(rec, SYNTHLOG, 64, 1 << 20)))
+        return err;
+    for (int n = 0; n < NNODES; ++n) {
+         char uri[16];
+         womsg_t* msg;
+         womsg_alloca(&msg);
+         snprintf(uri, sizeof(uri), "/replay/%d", n);
+         womsg_setbuf(msg, pkts[n], sizeof(pkts[n]));
+         womsg_seturi(msg, uri);
+         womsg_settag(msg, "f");
+         womsg_writef(msg, (float) n);
+         lens[n] = womsg_getlen(msg);
+    }
+    for (int n = 0; n < NPACKETS; ++n)
+         wqrec_write(rec, pkts[n%NNODES], lens[n%NNODES]);
+    return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+    wbench_begin(replay);
+    wqrec_t* rec;
+    wqtree_t* tree;
+    double speed = argc > 2 ? atof(argv[2]) : 0;
+    uint64_t t0;
+    int err, count;
+
+    wqrec_walloc(&s_malloc, &rec);
+    wqtree_walloc(&s_malloc, &tree);
+    if ((err = argc > 1 ? wqrec_open(rec, argv[1]) : synthesize(rec))) {
+        wpnerr("%s\n", wqrec_strerr(err));
+        return 1;
+    }
+    wqrec_foreach(rec, scan_fn, tree);
+    t0 = wbench_now();
+    count = wqtree_replay(tree, rec, speed);
+    wbench_report("packets", count, wbench_now()-t0);
+    wqrec_close(rec);
+    if (argc == 1)
+        unlink(SYNTHLOG);
+    return 0;
+}
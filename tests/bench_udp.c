@@ -0,0 +1,166 @@
+#include <wpn114/network/oscquery.h>
+#include <wpn114/utilities.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "bench.h"
+
+// udp ingest throughput over loopback: single-threaded
+// mongoose and io_uring backends, then from 1 to 8
+// SO_REUSEPORT workers, with and without lookup caches.
+// senders blast pre-encoded messages,
+// each node callback counts the updates it received
+// (under its shard lock, so no atomics are required)
+
+#define NNODES      64
+#define NSENDERS    8
+#define NSOCKETS    4
+#define DURATION_MS 1000
+
+static char
+s_uris[NNODES][16];
+
+static uint64_t
+s_counts[NNODES];
+
+static volatile bool
+s_sending;
+
+static volatile bool
+s_polling;
+
+struct sender {
+    pthread_t thread;
+    uint16_t port;
+    int id;
+};
+
+static void
+count_fn(wqnode_t* nd, wvalue_t* v, void* udt)
+{
+    (*(uint64_t*)udt)++;
+}
+
+static void*
+sender_run(void* v)
+{
+    struct sender* s = v;
+    struct sockaddr_in addr;
+    byte_t msgs[NNODES][32];
+    int lens[NNODES], fds[NSOCKETS];
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s->port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int n = 0; n < NNODES; ++n) {
+         womsg_t* msg;
+         womsg_alloca(&msg);
+         womsg_setbuf(msg, msgs[n], sizeof(msgs[n]));
+         womsg_seturi(msg, s_uris[n]);
+         womsg_settag(msg, "f");
+         womsg_writef(msg, (float) n);
+         lens[n] = womsg_getlen(msg);
+    }
+    // several source ports per sender,
+    // so that reuseport hashing spreads the load
+    for (int n = 0; n < NSOCKETS; ++n) {
+         fds[n] = socket(AF_INET, SOCK_DGRAM, 0);
+         connect(fds[n], (struct sockaddr*) &addr, sizeof(addr));
+    }
+    for (unsigned int n = s->id; s_sending; ++n)
+         send(fds[n%NSOCKETS], msgs[n%NNODES], lens[n%NNODES], 0);
+    for (int n = 0; n < NSOCKETS; ++n)
+         close(fds[n]);
+    return 0;
+}
+
+static void*
+poller_run(void* v)
+{
+    while (s_polling)
+        wqserver_iterate(v, 10);
+    return 0;
+}
+
+static uint64_t
+bench_run(int nworkers, enum wqbackend_t backend, int ncache,
+          uint16_t uport, uint16_t tport)
+{
+    wqserver_t* server;
+    wqtree_t* tree;
+    pthread_t poller;
+    struct sender senders[NSENDERS];
+    uint64_t total = 0, hits, misses;
+    wqnode_t* nd;
+
+    wqtree_walloc(&s_malloc, &tree);
+    wqtree_addndN(tree, "/bench", &nd);
+    for (int n = 0; n < NNODES; ++n) {
+         wqtree_addndf(tree, s_uris[n], &nd);
+         wqnode_set_fn(nd, count_fn, &s_counts[n]);
+         s_counts[n] = 0;
+    }
+    wqserver_walloc(&s_malloc, &server);
+    wqserver_expose(server, tree);
+    if (wqserver_set_backend(server, backend) ||
+        wqserver_set_udp_workers(server, nworkers)) {
+        wpnout("backend unavailable, skipping\n");
+        return 0;
+    }
+    if (ncache)
+        wqserver_set_lookup_cache(server, ncache);
+    if (wqserver_run(server, uport, tport)) {
+        wpnerr("could not run server on port %d\n", uport);
+        return 0;
+    }
+    // single-threaded backends are driven from the server loop
+    if ((s_polling = nworkers == 0))
+        pthread_create(&poller, 0, poller_run, server);
+    s_sending = true;
+    for (int n = 0; n < NSENDERS; ++n) {
+         senders[n].port = uport;
+         senders[n].id = n;
+         pthread_create(&senders[n].thread, 0, sender_run, &senders[n]);
+    }
+    usleep(DURATION_MS*1000);
+    // stop ingest first, so that counters are stable
+    if (s_polling) {
+        s_polling = false;
+        pthread_join(poller, 0);
+    }
+    wqserver_stop(server);
+    s_sending = false;
+    for (int n = 0; n < NSENDERS; ++n)
+         pthread_join(senders[n].thread, 0);
+    for (int n = 0; n < NNODES; ++n)
+         total += s_counts[n];
+    if (wqserver_get_lookup_stats(server, &hits, &misses) == 0)
+        wpnout("lookup cache: %llu hits, %llu misses\n",
+               (unsigned long long) hits, (unsigned long long) misses);
+    return total;
+}
+
+int
+main(void)
+{
+    wbench_begin(udp_workers);
+    for (int n = 0; n < NNODES; ++n)
+         snprintf(s_uris[n], sizeof(s_uris[n]), "/bench/%d", n);
+    wbench_report("mongoose", bench_run(0, WQSERVER_BACKEND_MONGOOSE, 0,
+                  9000, 9100), DURATION_MS*1000000ull);
+    wbench_report("io_uring", bench_run(0, WQSERVER_BACKEND_URING, 0,
+                  9010, 9110), DURATION_MS*1000000ull);
+    for (int nw = 1; nw <= 8; ++nw) {
+         char label[32];
+         uint64_t count = bench_run(nw, WQSERVER_BACKEND_MONGOOSE, 0,
+                                    9020+nw, 9120+nw);
+         snprintf(label, sizeof(label), "%d worker(s)", nw);
+         wbench_report(label, count, DURATION_MS*1000000ull);
+         count = bench_run(nw, WQSERVER_BACKEND_MONGOOSE, 256,
+                           9030+nw, 9130+nw);
+         snprintf(label, sizeof(label), "%d worker(s), cached", nw);
+         wbench_report(label, count, DURATION_MS*1000000ull);
+    }
+    return 0;
+}
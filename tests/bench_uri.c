@@ -0,0 +1,90 @@
+#include <wpn114/network/osc.h>
+#include <wpn114/network/oscquery.h>
+#include <wpn114/utilities.h>
+#include <stdlib.h>
+#include "bench.h"
+
+// uri scanning primitives, vectorized and scalar, on a typical
+// method (30 bytes, 4 segments) and a long one (120 bytes, 8 segments),
+// followed by node lookups, which scan each method once
+
+#define NCALLS      10000000
+
+static const char* s_uris[] = {
+    "/synth/voice12/osc2/frequency",
+    "/a_rather_long_module_name/with_a_long_submodule_name/and_parameters/"
+    "that_are/nested/somewhat/deeply/before_the_value",
+};
+
+static void
+bench_isa(const char* isa, wqtree_t* tree)
+{
+    wbench_begin(uri);
+    struct wuri_segs segs;
+    char label[64];
+    uint64_t t0;
+    uintptr_t sum = 0;
+    if (wuri_set_isa(isa))
+        return;
+    for (int u = 0; u < 2; ++u) {
+         const char* uri = s_uris[u];
+         const char* sz = u ? "long" : "short";
+         t0 = wbench_now();
+         for (int n = 0; n < NCALLS; ++n) {
+              __asm__ volatile("" : "+r"(uri));
+              sum += wuri_depth(uri);
+         }
+         snprintf(label, sizeof(label), "%s, depth (%s)", isa, sz);
+         wbench_report(label, NCALLS, wbench_now()-t0);
+         t0 = wbench_now();
+         for (int n = 0; n < NCALLS; ++n) {
+              __asm__ volatile("" : "+r"(uri));
+              sum += (uintptr_t) wuri_last(uri);
+         }
+         snprintf(label, sizeof(label), "%s, last (%s)", isa, sz);
+         wbench_report(label, NCALLS, wbench_now()-t0);
+         t0 = wbench_now();
+         for (int n = 0; n < NCALLS; ++n) {
+              __asm__ volatile("" : "+r"(uri));
+              sum += wuri_seglen(uri);
+         }
+         snprintf(label, sizeof(label), "%s, seglen (%s)", isa, sz);
+         wbench_report(label, NCALLS, wbench_now()-t0);
+         t0 = wbench_now();
+         for (int n = 0; n < NCALLS; ++n) {
+              __asm__ volatile("" : "+r"(uri));
+              sum += wuri_scan(uri, &segs);
+         }
+         snprintf(label, sizeof(label), "%s, scan (%s)", isa, sz);
+         wbench_report(label, NCALLS, wbench_now()-t0);
+         t0 = wbench_now();
+         for (int n = 0; n < NCALLS; ++n) {
+              __asm__ volatile("" : "+r"(uri));
+              sum += (uintptr_t) wqtree_get_node(tree, uri);
+         }
+         snprintf(label, sizeof(label), "%s, lookup (%s)", isa, sz);
+         wbench_report(label, NCALLS, wbench_now()-t0);
+    }
+    if (sum == 0)
+        wpnout("\n");
+}
+
+int
+main(void)
+{
+    wqtree_t* tree;
+    wqnode_t* nd;
+    wqtree_walloc(&s_malloc, &tree);
+    for (int u = 0; u < 2; ++u) {
+         const char* uri = s_uris[u];
+         for (const char* c = strchr(uri+1, '/'); c; c = strchr(c+1, '/'))
+              wqtree_addndN(tree, strndup(uri, c-uri), &nd);
+         wqtree_addndf(tree, uri, &nd);
+    }
+    // unsupported ones are skipped
+    bench_isa("scalar", tree);
+    bench_isa("sse2", tree);
+    bench_isa("avx2", tree);
+    bench_isa("neon", tree);
+    return 0;
+}
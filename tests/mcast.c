@@ -0,0 +1,110 @@
+#include <wpn114/network/oscquery.h>
+#include <wpn114/utilities.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include "tests.h"
+
+#define MCAST_GROUP     "239.255.41.14"
+#define MCAST_PORT      5114
+#define MCAST_OSC_PORT  5110
+#define MCAST_WS_PORT   5111
+#define UCAST_PORT_A    5112
+#define UCAST_PORT_B    5113
+
+static int
+udp_socket(uint16_t port, const char* group)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0), one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)))
+        return -1;
+    if (group) {
+        struct ip_mreq mreq;
+        inet_pton(AF_INET, group, &mreq.imr_multiaddr);
+        inet_pton(AF_INET, "127.0.0.1", &mreq.imr_interface);
+        if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                       &mreq, sizeof(mreq)))
+            return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+// returns the number of datagrams read from <fd>,
+// checking that they all address <uri>
+static int
+udp_drain(int fd, const char* uri)
+{
+    byte_t buf[256];
+    int count = 0, len;
+    while ((len = recv(fd, buf, sizeof(buf), 0)) > 0)
+        if (strncmp((char*)buf, uri, len) == 0)
+            count++;
+    return count;
+}
+
+/// two LISTENing clients, one of them streaming through the group,
+/// everything over loopback: each change is sent once to the group,
+/// and once more to the unicast client
+wtest(mcast_01)
+{
+    wtest_begin(mcast_01);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* meter;
+    int group, ucast_a, ucast_b, ws_a, ws_b;
+    wtest_fassert_soft(wqtree_walloc(&s_malloc, &tree));
+    wtest_fassert_soft(wqtree_addndf(tree, "/meter", &meter));
+    wtest_fassert_soft(wqserver_walloc(&s_malloc, &server));
+    wqserver_expose(server, tree);
+    wtest_assert_soft(wqserver_set_multicast(server, "127.0.0.1",
+                      MCAST_PORT, NULL) == WQUERY_ADDR_INVALID);
+    wtest_fassert_soft(wqserver_set_multicast(server, MCAST_GROUP,
+                       MCAST_PORT, "127.0.0.1"));
+    wtest_fassert_soft(wqserver_run(server, MCAST_OSC_PORT, MCAST_WS_PORT));
+
+    group = udp_socket(MCAST_PORT, MCAST_GROUP);
+    ucast_a = udp_socket(UCAST_PORT_A, NULL);
+    ucast_b = udp_socket(UCAST_PORT_B, NULL);
+    wtest_assert_soft(group >= 0 && ucast_a >= 0 && ucast_b >= 0);
+    wtest_assert_soft((ws_a = wtest_ws_open(server, MCAST_WS_PORT)) >= 0);
+    wtest_assert_soft((ws_b = wtest_ws_open(server, MCAST_WS_PORT)) >= 0);
+
+    wtest_ws_send(server, ws_a, "{\"COMMAND\":\"LISTEN\",\"DATA\":\"/meter\"}");
+    wtest_ws_send(server, ws_a, "{\"COMMAND\":\"START_OSC_STREAMING\","
+                 "\"DATA\":{\"LOCAL_SERVER_PORT\":5112,\"MULTICAST\":true}}");
+    wtest_ws_send(server, ws_b, "{\"COMMAND\":\"START_OSC_STREAMING\","
+                 "\"DATA\":{\"LOCAL_SERVER_PORT\":5113}}");
+
+    for (int n = 0; n < 8; ++n) {
+        wqnode_setf(meter, n*0.125f);
+        wqserver_iterate(server, 1);
+    }
+    usleep(10000);
+    wtest_assert_soft(udp_drain(group, "/meter") == 8);
+    wtest_assert_soft(udp_drain(ucast_a, "/meter") == 0);
+    wtest_assert_soft(udp_drain(ucast_b, "/meter") == 8);
+
+    wqserver_stop(server);
+    close(ws_a);
+    close(ws_b);
+    close(group);
+    close(ucast_a);
+    close(ucast_b);
+    wtest_end;
+}
+
+int
+main(void)
+{
+    return wpn_unittest_mcast_01();
+}
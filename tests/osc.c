@@ -2,6 +2,8 @@
 #include <wpn114/utilities.h>
 #include <stdio.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "tests.h"
 
 /// simple encoding-decoding
@@ -101,11 +103,282 @@ wtest(osc_02)
     wtest_end;
 }
 
+struct deframed {
+    int count;
+    int bad;
+};
+
+static void
+deframe_fn(byte_t* data, uint32_t len, void* udt)
+{
+    struct deframed* d = udt;
+    womsg_t* msg;
+    int32_t i;
+    womsg_alloca(&msg);
+    if (womsg_decode(msg, data, len) ||
+        strcmp(womsg_geturi(msg), "/stream") ||
+        womsg_readi(msg, &i) || (i & 0xff) != d->count)
+        d->bad++;
+    d->count++;
+}
+
+// frames 16 messages with <framing>, and feeds
+// them to a deframer <chunk> bytes at a time
+static int
+deframe_chunked(enum wostream_t framing, int chunk)
+{
+    byte_t stream[2048], buf[2048], msgbuf[32];
+    struct deframed d = { 0 };
+    wodeframer_t dfr;
+    uint32_t slen = 0, blen = 0;
+    for (int n = 0; n < 16; ++n) {
+        womsg_t* msg;
+        womsg_alloca(&msg);
+        womsg_setbuf(msg, msgbuf, sizeof(msgbuf));
+        womsg_seturi(msg, "/stream");
+        womsg_settag(msg, "i");
+        // SLIP: make sure END/ESC bytes get escaped
+        womsg_writei(msg, n | (n % 2 ? 0xc0db00 : 0xdbc000));
+        slen += woframe(framing, msgbuf, womsg_getlen(msg),
+                        &stream[slen], sizeof(stream)-slen);
+    }
+    wodeframer_init(&dfr, framing);
+    for (uint32_t pos = 0; pos < slen; pos += chunk) {
+        int n = wpnmin((uint32_t)chunk, slen-pos);
+        memcpy(&buf[blen], &stream[pos], n);
+        blen += n;
+        if ((n = wodeframe(&dfr, buf, blen, deframe_fn, &d)) < 0)
+            return -1;
+        memmove(buf, &buf[n], blen-n);
+        blen -= n;
+    }
+    return d.bad ? -1 : d.count;
+}
+
+/// stream framing, partial reads
+wtest(osc_03)
+{
+    wtest_begin(osc_03);
+    byte_t big[8] = { 0x00, 0x10, 0x00, 0x01 };
+    byte_t small[4];
+    wodeframer_t dfr;
+    struct deframed d = { 0 };
+    wtest_assert_soft(deframe_chunked(WOSTREAM_LENGTH, 1) == 16);
+    wtest_assert_soft(deframe_chunked(WOSTREAM_LENGTH, 7) == 16);
+    wtest_assert_soft(deframe_chunked(WOSTREAM_LENGTH, 2048) == 16);
+    wtest_assert_soft(deframe_chunked(WOSTREAM_SLIP, 1) == 16);
+    wtest_assert_soft(deframe_chunked(WOSTREAM_SLIP, 7) == 16);
+    wtest_assert_soft(deframe_chunked(WOSTREAM_SLIP, 2048) == 16);
+    wtest_assert_soft(woframe(WOSTREAM_SLIP, big, sizeof(big),
+                              small, sizeof(small)) < 0);
+    wodeframer_init(&dfr, WOSTREAM_LENGTH);
+    wtest_assert_soft(wodeframe(&dfr, big, sizeof(big),
+                                deframe_fn, &d) < 0);
+    wtest_end;
+}
+
+/// arrays, written and read in one go
+wtest(osc_04)
+{
+    wtest_begin(osc_04);
+    float xyz[3] = { 0.25f, -1.f, 47.f };
+    const float* rxyz;
+    const int32_t* rbands;
+    int32_t bands[2] = { 4, 7 };
+    float wide[64] = { 0 };
+    char wtag[67] = "[";
+    byte_t buf[64], wbuf[128];
+    womsg_t* msg;
+    int n, i;
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, buf, sizeof(buf));
+    womsg_seturi(msg, "/xyz");
+    wtest_fassert_soft(womsg_settag(msg, "[fff][ii]i"));
+    wtest_assert_soft(womsg_writea(msg, 'f', xyz, 2));
+    wtest_assert_soft(womsg_writea(msg, 'i', xyz, 3));
+    wtest_fassert_soft(womsg_writea(msg, 'f', xyz, 3));
+    wtest_fassert_soft(womsg_writea(msg, 'i', bands, 2));
+    wtest_fassert_soft(womsg_writei(msg, 1));
+    // uri (8) + tag (12) + 6*4 bytes of arguments
+    wtest_assert_soft(womsg_getlen(msg) == 44);
+    wtest_fassert_soft(womsg_decode(msg, buf, womsg_getlen(msg)));
+    wtest_assert_soft(womsg_reada(msg, 'i', (const void**) &rbands, &n));
+    wtest_fassert_soft(womsg_reada(msg, 'f', (const void**) &rxyz, &n));
+    wtest_assert_soft(n == 3 && rxyz[1] == -1.f && rxyz[2] == 47.f);
+    // elements point into the message buffer
+    wtest_assert_soft((byte_t*) rxyz == &buf[20]);
+    wtest_fassert_soft(womsg_reada(msg, 'i', (const void**) &rbands, &n));
+    wtest_assert_soft(n == 2 && rbands[0] == 4 && rbands[1] == 7);
+    wtest_fassert_soft(womsg_readi(msg, &i));
+    wtest_assert_soft(i == 1);
+    // 256 bytes of floats, not to be mistaken for 0
+    memset(&wtag[1], 'f', 64);
+    strcpy(&wtag[65], "]");
+    womsg_setbuf(msg, wbuf, sizeof(wbuf));
+    womsg_seturi(msg, "/wide");
+    wtest_fassert_soft(womsg_settag(msg, wtag));
+    n = womsg_getlen(msg);
+    i = womsg_writea(msg, 'f', wide, 64);
+    wtest_fassert_soft(strcmp(wosc_strerr(i), "buffer overflow"));
+    wtest_assert_soft(womsg_getlen(msg) == n);
+    wtest_end;
+}
+
+/// 64-bit types, midi and blobs
+wtest(osc_05)
+{
+    wtest_begin(osc_05);
+    uint8_t midi[4] = { 0, 0x90, 60, 127 }, rmidi[4];
+    byte_t wave[4099], buf[4200];
+    const byte_t* rwave;
+    uint32_t len;
+    int64_t h;
+    double d;
+    uint64_t t;
+    char* s;
+    womsg_t* msg;
+    int i;
+    for (int n = 0; n < sizeof(wave); ++n)
+         wave[n] = n;
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, buf, sizeof(buf));
+    womsg_seturi(msg, "/wave");
+    wtest_fassert_soft(womsg_settag(msg, "hdtmsbi"));
+    wtest_fassert_soft(womsg_writeh(msg, -(1ll << 40)));
+    wtest_fassert_soft(womsg_writed(msg, 1.0/3.0));
+    wtest_fassert_soft(womsg_writet(msg, 1ull << 32 | 1));
+    wtest_fassert_soft(womsg_writem(msg, midi));
+    wtest_fassert_soft(womsg_writes(msg, "thumb"));
+    wtest_fassert_soft(womsg_writeblob(msg, wave, sizeof(wave)));
+    wtest_fassert_soft(womsg_writei(msg, 47));
+    // uri (8) + tag (12) + 8*3 + 4 + 8 + 4+4100 + 4
+    wtest_assert_soft(womsg_getlen(msg) == 4164);
+    wtest_fassert_soft(womsg_decode(msg, buf, womsg_getlen(msg)));
+    wtest_fassert_soft(womsg_readh(msg, &h));
+    wtest_fassert_soft(womsg_readd(msg, &d));
+    wtest_fassert_soft(womsg_readt(msg, &t));
+    wtest_fassert_soft(womsg_readm(msg, rmidi));
+    wtest_assert_soft(h == -(1ll << 40) && d == 1.0/3.0);
+    wtest_assert_soft(t == (1ull << 32 | 1));
+    wtest_fassert_soft(memcmp(midi, rmidi, 4));
+    wtest_fassert_soft(womsg_reads(msg, &s));
+    wtest_fassert_soft(strcmp(s, "thumb"));
+    wtest_fassert_soft(womsg_readblob(msg, &rwave, &len));
+    // view on the message buffer, not a copy
+    wtest_assert_soft(len == sizeof(wave) && rwave == &buf[60]);
+    wtest_fassert_soft(memcmp(rwave, wave, len));
+    wtest_fassert_soft(womsg_readi(msg, (int*) &len));
+    wtest_assert_soft(len == 47);
+    // truncated blob
+    wtest_fassert_soft(womsg_decode(msg, buf, 200));
+    womsg_readh(msg, &h);
+    womsg_readd(msg, &d);
+    womsg_readt(msg, &t);
+    womsg_readm(msg, rmidi);
+    womsg_reads(msg, &s);
+    wtest_assert_soft(womsg_readblob(msg, &rwave, &len));
+    // truncated scalars, timetag would be read past the end
+    wtest_fassert_soft(womsg_decode(msg, buf, 36));
+    wtest_fassert_soft(womsg_readh(msg, &h));
+    wtest_fassert_soft(womsg_readd(msg, &d));
+    i = womsg_readt(msg, &t);
+    wtest_fassert_soft(strcmp(wosc_strerr(i), "buffer overflow"));
+    // 4+1020 bytes, not to be mistaken for 0
+    womsg_setbuf(msg, buf, 64);
+    womsg_seturi(msg, "/wave");
+    wtest_fassert_soft(womsg_settag(msg, "b"));
+    len = womsg_getlen(msg);
+    i = womsg_writeblob(msg, wave, 1020);
+    wtest_fassert_soft(strcmp(wosc_strerr(i), "buffer overflow"));
+    wtest_assert_soft(womsg_getlen(msg) == len);
+    wtest_end;
+}
+
+// malformed packets are rejected when decoding
+wtest(osc_06)
+{
+    wtest_begin(osc_06);
+    byte_t ok[] = "/foo\0\0\0\0,f\0\0\0\0\0\0";
+    byte_t nouri[] = "garbage";
+    byte_t unterminated[] = { '/', 'f', 'o', 'o', 'b', 'a', 'r', '!' };
+    byte_t notag[] = "/foo\0\0\0\0f\0\0\0";
+    womsg_t* msg;
+    womsg_alloca(&msg);
+    wtest_fassert_soft(womsg_decode(msg, ok, 16));
+    wtest_assert_soft(*womsg_gettag(msg) == 'f');
+    wtest_assert_soft(womsg_decode(msg, nouri, sizeof(nouri)));
+    wtest_assert_soft(womsg_decode(msg, ok, 2));
+    wtest_assert_soft(womsg_decode(msg, unterminated, sizeof(unterminated)));
+    wtest_assert_soft(womsg_decode(msg, notag, 12));
+    // typetag running past the packet
+    wtest_assert_soft(womsg_decode(msg, ok, 10));
+    wtest_end;
+}
+
+// vectorized uri scanning matches the scalar one, for every
+// alignment, including methods ending right before an unmapped page
+wtest(osc_07)
+{
+    wtest_begin(osc_07);
+    const char* isas[] = { "avx2", "sse2", "neon" };
+    const char* uris[] = {
+        "/", "/a", "/foo/bar", "/foo/bar/", "/synth/voice12/osc2/frequency",
+        "/a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q/r/s/t/u/v/w/x/y/z/0/1/2/3/4/5/6/7",
+        "/a_rather_long_module_name_running_past_a_block/parameter"
+    };
+    const char* isa = wuri_get_isa();
+    struct wuri_segs ref, segs;
+    long pgsz = sysconf(_SC_PAGESIZE);
+    char* pages = mmap(NULL, 2*pgsz, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bool eq = true;
+    mprotect(pages+pgsz, pgsz, PROT_NONE);
+    wpnout("uri scanning: %s\n", isa);
+    wtest_fassert_soft(wuri_set_isa("scalar"));
+    wtest_assert_soft(wuri_set_isa("mmx") != 0);
+    for (size_t i = 0; i < sizeof(isas)/sizeof(char*); ++i) {
+         if (wuri_set_isa(isas[i]))
+             continue;
+         for (size_t u = 0; u < sizeof(uris)/sizeof(char*); ++u) {
+              size_t len = strlen(uris[u]);
+              for (size_t a = 0; a < 64; ++a) {
+                   // runs from various alignments, up to the page end
+                   char* uri = pages+pgsz-len-1-a;
+                   memcpy(uri, uris[u], len+1);
+                   wuri_set_isa(isas[i]);
+                   int depth = wuri_depth(uri), seglen = wuri_seglen(uri);
+                   const char* last = wuri_last(uri);
+                   int n = wuri_scan(uri, &segs);
+                   wuri_set_isa("scalar");
+                   eq &= depth == wuri_depth(uri) && seglen == wuri_seglen(uri) &&
+                         last == wuri_last(uri) && n == wuri_scan(uri, &ref) &&
+                         segs.len == ref.len &&
+                         !memcmp(segs.offs, ref.offs, (n+1)*sizeof(uint32_t));
+              }
+         }
+    }
+    wtest_assert_soft(eq);
+    // deeper than WURI_MAXSEGS
+    wtest_assert_soft(wuri_scan(uris[5], &segs) == WURI_MAXSEGS);
+    wtest_assert_soft(segs.len == 0 && segs.offs[WURI_MAXSEGS] == 64);
+    wtest_assert_soft(wuri_scan(uris[4], &segs) == 4);
+    wtest_assert_soft(segs.len == 29 && segs.offs[2] == 14 && segs.offs[4] == 29);
+    wtest_assert_soft(strcmp(wuri_last(uris[3]), "/bar/") == 0);
+    wtest_fassert_soft(wuri_set_isa(isa));
+    munmap(pages, 2*pgsz);
+    wtest_end;
+}
+
 int
 main(void)
 {
     int err = 0;
     err += wpn_unittest_osc_01();
     err += wpn_unittest_osc_02();
+    err += wpn_unittest_osc_03();
+    err += wpn_unittest_osc_04();
+    err += wpn_unittest_osc_05();
+    err += wpn_unittest_osc_06();
+    err += wpn_unittest_osc_07();
     return err;
 }
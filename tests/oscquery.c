@@ -2,6 +2,9 @@
 #include <wpn114/utilities.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <assert.h>
 #include "tests.h"
 
@@ -209,6 +212,1100 @@ wtest(query_05)
     wtest_end;
 }
 
+// OSC over TCP, SLIP framed packets split across writes
+wpn_declstatic_alloc_mp(wqmp_06, 1024);
+wtest(query_06)
+{
+    wtest_begin(query_06);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* ndn, *ndi, *ndf;
+    womsg_t* msg;
+    byte_t mbuf[32], stream[128];
+    int fd, len = 0, v;
+    float f;
+    struct sockaddr_in addr;
+    wtest_fassert_soft(wqtree_walloc(&wqmp_06, &tree));
+    wtest_fassert_soft(wqtree_addndN(tree, "/stream", &ndn));
+    wtest_fassert_soft(wqtree_addndi(tree, "/stream/int", &ndi));
+    wtest_fassert_soft(wqtree_addndf(tree, "/stream/float", &ndf));
+    wtest_fassert_soft(wqserver_walloc(&wqmp_06, &server));
+    wqserver_expose(server, tree);
+    wtest_fassert_soft(wqserver_bind_stream(server, 5683, WOSTREAM_SLIP));
+    wtest_fassert_soft(wqserver_run(server, 5681, 5682));
+
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, mbuf, sizeof(mbuf));
+    womsg_seturi(msg, "/stream/int");
+    womsg_settag(msg, "i");
+    womsg_writei(msg, 0xc0dbc0);
+    len += woframe(WOSTREAM_SLIP, mbuf, womsg_getlen(msg),
+                   stream, sizeof(stream));
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, mbuf, sizeof(mbuf));
+    womsg_seturi(msg, "/stream/float");
+    womsg_settag(msg, "f");
+    womsg_writef(msg, 47.31);
+    len += woframe(WOSTREAM_SLIP, mbuf, womsg_getlen(msg),
+                   &stream[len], sizeof(stream)-len);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(5683);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    wtest_fassert_soft(connect(fd, (struct sockaddr*) &addr, sizeof(addr)));
+    for (int n = 0; n < 5; ++n)
+         wqserver_iterate(server, 10);
+    // first packet, and half of the second one
+    send(fd, stream, len-7, 0);
+    for (int n = 0; n < 5; ++n)
+         wqserver_iterate(server, 10);
+    wtest_fassert_soft(wqnode_geti(ndi, &v));
+    wtest_assert_soft(v == 0xc0dbc0);
+    send(fd, &stream[len-7], 7, 0);
+    for (int n = 0; n < 5; ++n)
+         wqserver_iterate(server, 10);
+    wtest_fassert_soft(wqnode_getf(ndf, &f));
+    wtest_assert_soft(f == 47.31f);
+    close(fd);
+    wqserver_stop(server);
+    wtest_end;
+}
+
+// snapshot, then restore into a second tree, per node and in bulk
+static int s_nfn, s_nrestored;
+
+static void
+count_fn(wqnode_t* nd, wvalue_t* v, void* udt)
+{
+    s_nfn++;
+}
+
+struct rampback {
+    wqtree_t* tree;
+    wqnode_t* nd;
+};
+
+// ramps another node back to 0, once done
+static void
+rampback_fn(wqnode_t* nd, wvalue_t* v, void* udt)
+{
+    struct rampback* rb = udt;
+    wvalue_t zero = { .t = WOSC_TYPE_INT, .u.i = 0 };
+    if (v->u.f == 0.f)
+        wqtree_ramp(rb->tree, rb->nd, &zero, 10);
+}
+
+static void
+restored_fn(wqtree_t* tree, int count, void* udt)
+{
+    s_nrestored = count;
+}
+
+wpn_declstatic_alloc_mp(wqmp_07, 2048);
+wtest(query_07)
+{
+    wtest_begin(query_07);
+    wqtree_t* src, *dst;
+    wqnode_t* nd, *ndi, *ndf, *nds;
+    byte_t snap[256];
+    uint32_t len;
+    int i;
+    float f;
+    const char* s;
+    wtest_fassert_soft(wqtree_walloc(&wqmp_07, &src));
+    wtest_fassert_soft(wqtree_walloc(&wqmp_07, &dst));
+    wqtree_addndN(src, "/snap", &nd);
+    wqtree_addndi(src, "/snap/int", &ndi);
+    wqtree_addndf(src, "/snap/float", &ndf);
+    wqtree_addnds(src, "/snap/string", &nds, 32);
+    wqnode_seti(ndi, 47);
+    wqnode_setf(ndf, 0.5f);
+    wqnode_sets(nds, "fire walk with me");
+    // header + 3 index entries + 2*8 + 4+20 bytes of values
+    wtest_assert_soft(wqtree_snapshot_size(src) == 16+3*8+16+24);
+    wtest_assert_soft(wqtree_snapshot(src, snap, 32, &len)
+                      == WQUERY_SNAPSHOT_OVERFLOW);
+    wtest_fassert_soft(wqtree_snapshot(src, snap, sizeof(snap), &len));
+    wtest_assert_soft(len == wqtree_snapshot_size(src));
+    // destination misses a node, and has another one of a different type
+    wqtree_addndN(dst, "/snap", &nd);
+    wqtree_addndi(dst, "/snap/int", &ndi);
+    wqtree_addndi(dst, "/snap/float", &ndf);
+    wqtree_addnds(dst, "/snap/string", &nds, 32);
+    wqnode_set_fn(ndi, count_fn, NULL);
+    wqnode_set_fn(nds, count_fn, NULL);
+    wqtree_set_restored_fn(dst, restored_fn, NULL);
+    wtest_fassert_soft(wqtree_restore(dst, snap, len, WQRESTORE_NODE_FN));
+    wtest_assert_soft(s_nfn == 2 && s_nrestored == 0);
+    wqnode_geti(ndi, &i);
+    wqnode_gets(nds, &s);
+    wtest_assert_soft(i == 47);
+    wtest_assert_soft(strcmp(s, "fire walk with me") == 0);
+    wtest_assert_soft(wqnode_getf(ndf, &f) == WQUERY_TYPE_MISMATCH);
+    wqnode_seti(ndi, 0);
+    wqnode_sets(nds, "");
+    s_nfn = 0;
+    wtest_fassert_soft(wqtree_restore(dst, snap, len, WQRESTORE_BULK));
+    wtest_assert_soft(s_nfn == 0 && s_nrestored == 2);
+    wqnode_geti(ndi, &i);
+    wtest_assert_soft(i == 47);
+    wtest_assert_soft(strcmp(s, "fire walk with me") == 0);
+    // through a mapped file
+    wqnode_seti(ndi, 0);
+    wtest_fassert_soft(wqtree_snapshot_save(src, "/tmp/wquery_07.snap"));
+    wtest_assert_soft(access("/tmp/wquery_07.snap.tmp", F_OK) < 0);
+    wtest_fassert_soft(wqtree_snapshot_load(dst, "/tmp/wquery_07.snap",
+                                            WQRESTORE_BULK));
+    wqnode_geti(ndi, &i);
+    wtest_assert_soft(i == 47);
+    unlink("/tmp/wquery_07.snap");
+    wtest_assert_soft(wqtree_restore(dst, snap, 8, WQRESTORE_BULK)
+                      == WQUERY_SNAPSHOT_INVALID);
+    snap[0] ^= 0xff;
+    wtest_assert_soft(wqtree_restore(dst, snap, len, WQRESTORE_BULK)
+                      == WQUERY_SNAPSHOT_INVALID);
+    wtest_end;
+}
+
+// ramps, stepped locally then through an osc message
+wpn_declstatic_alloc_mp(wqmp_08, 4096);
+wtest(query_08)
+{
+    wtest_begin(query_08);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* nd, *ndf, *ndi, *ndv;
+    wvalue_t vf = { .t = WOSC_TYPE_FLOAT, .u.f = 1.f };
+    float xyz[3] = { 1.f, -2.f, 4.f };
+    const float* rxyz;
+    wvalue_t vi = { .t = WOSC_TYPE_INT, .u.i = 5 };
+    struct rampback rb;
+    struct sockaddr_in addr;
+    byte_t pkt[64];
+    womsg_t* msg;
+    float f;
+    int i, fd;
+    wtest_fassert_soft(wqtree_walloc(&wqmp_08, &tree));
+    wqtree_addndN(tree, "/ramp", &nd);
+    wqtree_addndf(tree, "/ramp/float", &ndf);
+    wqtree_addndi(tree, "/ramp/int", &ndi);
+    wqtree_addndv3(tree, "/ramp/xyz", &ndv);
+    wqnode_set_fn(ndi, count_fn, NULL);
+    wtest_assert_soft(wqtree_ramp(tree, ndf, &vf, 50) == WQUERY_ATTR_UNSUPPORTED);
+    wtest_fassert_soft(wqtree_set_ramps(tree, 2, 5));
+    wtest_assert_soft(wqtree_ramps_tick(tree) == 5);
+    wtest_assert_soft(wqtree_ramp(tree, ndf, &vi, 50) == WQUERY_TYPE_MISMATCH);
+    wtest_fassert_soft(wqtree_ramp(tree, ndf, &vf, 50));
+    wtest_fassert_soft(wqtree_ramp(tree, ndi, &vi, 50));
+    wtest_assert_soft(wqtree_ramp(tree, nd, &vi, 50) == WQUERY_TYPE_MISMATCH);
+    // replacing a running ramp doesn't take another slot
+    wtest_fassert_soft(wqtree_ramp(tree, ndi, &vi, 50));
+    s_nfn = 0;
+    usleep(20000);
+    wtest_assert_soft(wqtree_ramps_advance(tree) == 2);
+    wqnode_getf(ndf, &f);
+    wtest_assert_soft(f > 0.2f && f < 1.f);
+    while (wqtree_ramps_advance(tree))
+           usleep(1000);
+    wqnode_getf(ndf, &f);
+    wqnode_geti(ndi, &i);
+    wtest_assert_soft(f == 1.f && i == 5);
+    // int node is only set when its value changes
+    wtest_assert_soft(s_nfn == 5);
+    wtest_assert_soft(wqtree_ramp(tree, ndi, &vi, -1) == WQUERY_ATTR_UNSUPPORTED);
+    // callbacks can start ramps of their own
+    rb.tree = tree;
+    rb.nd = ndi;
+    wqnode_set_fn(ndf, rampback_fn, &rb);
+    vf.u.f = 0.f;
+    wtest_fassert_soft(wqtree_ramp(tree, ndf, &vf, 10));
+    for (int n = 0; n < 100 && wqtree_ramps_advance(tree); ++n)
+         usleep(1000);
+    wqnode_geti(ndi, &i);
+    wtest_assert_soft(i == 0);
+    // vectors ramp all of their components
+    wtest_assert_soft(wqtree_rampfv(tree, ndv, xyz, 2, 10) == WQUERY_TYPE_MISMATCH);
+    wtest_assert_soft(wqtree_rampfv(tree, ndf, xyz, 1, 10) == WQUERY_TYPE_MISMATCH);
+    wtest_fassert_soft(wqtree_rampfv(tree, ndv, xyz, 3, 20));
+    usleep(10000);
+    wqtree_ramps_advance(tree);
+    wqnode_getfv(ndv, &rxyz, &i);
+    wtest_assert_soft(rxyz[0] > 0.f && rxyz[0] < 1.f && rxyz[1] < 0.f);
+    for (int n = 0; n < 100 && wqtree_ramps_advance(tree); ++n)
+         usleep(1000);
+    wtest_fassert_soft(memcmp(rxyz, xyz, sizeof(xyz)));
+    // "/ramp/float ,fi 0 30"
+    wqserver_walloc(&wqmp_08, &server);
+    wqserver_expose(server, tree);
+    wqserver_set_udp_workers(server, 1);
+    wtest_fassert_soft(wqserver_run(server, 5685, 5686));
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, pkt, sizeof(pkt));
+    womsg_seturi(msg, "/ramp/float");
+    womsg_settag(msg, "fi");
+    womsg_writef(msg, 0.f);
+    womsg_writei(msg, 30);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(5685);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sendto(fd, pkt, womsg_getlen(msg), 0,
+          (struct sockaddr*) &addr, sizeof(addr));
+    // udp worker runs on its own thread, give it some time
+    for (int n = 0; n < 200 && (wqnode_getf(ndf, &f), f != 0.f); ++n) {
+         wqserver_iterate(server, 5);
+         usleep(1000);
+    }
+    wtest_assert_soft(f == 0.f);
+    // "/ramp/xyz ,[fff]i 0 0 0 20"
+    memset(xyz, 0, sizeof(xyz));
+    womsg_setbuf(msg, pkt, sizeof(pkt));
+    womsg_seturi(msg, "/ramp/xyz");
+    womsg_settag(msg, "[fff]i");
+    womsg_writea(msg, 'f', xyz, 3);
+    womsg_writei(msg, 20);
+    sendto(fd, pkt, womsg_getlen(msg), 0,
+          (struct sockaddr*) &addr, sizeof(addr));
+    for (int n = 0; n < 200 && memcmp(rxyz, xyz, sizeof(xyz)); ++n) {
+         wqserver_iterate(server, 5);
+         usleep(1000);
+    }
+    wtest_fassert_soft(memcmp(rxyz, xyz, sizeof(xyz)));
+    // "/ramp/float ,f 7" while ramping: the explicit set wins
+    vf.u.f = 1.f;
+    wtest_fassert_soft(wqtree_ramp(tree, ndf, &vf, 30));
+    womsg_setbuf(msg, pkt, sizeof(pkt));
+    womsg_seturi(msg, "/ramp/float");
+    womsg_settag(msg, "f");
+    womsg_writef(msg, 7.f);
+    sendto(fd, pkt, womsg_getlen(msg), 0,
+          (struct sockaddr*) &addr, sizeof(addr));
+    for (int n = 0; n < 60; ++n) {
+         wqserver_iterate(server, 5);
+         usleep(1000);
+    }
+    wqnode_getf(ndf, &f);
+    wtest_assert_soft(f == 7.f);
+    close(fd);
+    wqserver_stop(server);
+    wtest_end;
+}
+
+// history ring, wrapping around
+wpn_declstatic_alloc_mp(wqmp_09, 1024);
+wtest(query_09)
+{
+    wtest_begin(query_09);
+    wqtree_t* tree;
+    wqnode_t* ndf, *nds;
+    struct wqsample smp[8];
+    wtest_fassert_soft(wqtree_walloc(&wqmp_09, &tree));
+    wqtree_addndf(tree, "/meter", &ndf);
+    wqtree_addnds(tree, "/label", &nds, 16);
+    wqnode_set_fn(ndf, count_fn, NULL);
+    wtest_assert_soft(wqnode_get_history(ndf, smp, 8) == -WQUERY_ATTR_UNSUPPORTED);
+    wtest_assert_soft(wqtree_set_history(tree, nds, 4) == WQUERY_TYPE_MISMATCH);
+    wtest_fassert_soft(wqtree_set_history(tree, ndf, 4));
+    wtest_assert_soft(wqtree_set_history(tree, ndf, 4) == WQUERY_ATTR_UNSUPPORTED);
+    s_nfn = 0;
+    wqnode_setf(ndf, 1.f);
+    wqnode_setf(ndf, 2.f);
+    wtest_assert_soft(wqnode_get_history(ndf, smp, 8) == 2);
+    wtest_assert_soft(smp[0].u.f == 1.f && smp[1].u.f == 2.f);
+    wtest_assert_soft(smp[0].ts <= smp[1].ts);
+    for (int n = 3; n <= 6; ++n)
+         wqnode_setf(ndf, n);
+    // user callback is still triggered
+    wtest_assert_soft(s_nfn == 6);
+    wtest_assert_soft(wqnode_get_history(ndf, smp, 8) == 4);
+    wtest_assert_soft(smp[0].u.f == 3.f && smp[3].u.f == 6.f);
+    wtest_assert_soft(wqnode_get_history(ndf, smp, 2) == 2);
+    wtest_assert_soft(smp[0].u.f == 5.f && smp[1].u.f == 6.f);
+    wqnode_set_fn(ndf, ndf_fn, NULL);
+    wqnode_setf(ndf, 7.f);
+    wtest_assert_soft(s_nfn == 6);
+    wtest_assert_soft(wqnode_get_history(ndf, smp, 8) == 4);
+    wtest_assert_soft(smp[3].u.f == 7.f);
+    wtest_end;
+}
+
+// bitmask flags, NOREPEAT and float deadband
+wpn_declstatic_alloc_mp(wqmp_10, 1024);
+wtest(query_10)
+{
+    wtest_begin(query_10);
+    wqtree_t* tree;
+    wqnode_t* ndi, *ndf, *nds;
+    struct wqsample smp[8];
+    wtest_fassert_soft(wqtree_walloc(&wqmp_10, &tree));
+    wqtree_addndi(tree, "/int", &ndi);
+    wqtree_addndf(tree, "/float", &ndf);
+    wqtree_addnds(tree, "/string", &nds, 16);
+    wtest_fassert_soft(wqnode_set_flags(ndi, WQNODE_CRITICAL));
+    wtest_fassert_soft(wqnode_set_flags(ndi, WQNODE_READONLY));
+    wtest_assert_soft(wqnode_get_access(ndi) == WQNODE_ACCESS_R);
+    wtest_assert_soft(wqnode_set_flags(ndi, WQNODE_WRITEONLY) == WQUERY_ATTR_UNSUPPORTED);
+    wtest_assert_soft(wqnode_set_flags(ndi, WQTREE_CREATE_INTERMEDIATE) == WQUERY_ATTR_UNSUPPORTED);
+    wqnode_clear_flags(ndi, WQNODE_READONLY | WQNODE_CRITICAL);
+    wtest_assert_soft(wqnode_get_access(ndi) == WQNODE_ACCESS_RW);
+    wtest_fassert_soft(wqnode_set_flags(ndi, WQNODE_NOREPEAT));
+    wtest_fassert_soft(wqnode_set_flags(ndf, WQNODE_NOREPEAT));
+    wtest_fassert_soft(wqnode_set_flags(nds, WQNODE_NOREPEAT));
+    wtest_assert_soft(wqnode_set_epsilon(ndi, 0.1f) == WQUERY_TYPE_MISMATCH);
+    wtest_fassert_soft(wqnode_set_epsilon(ndf, 0.01f));
+    wqnode_set_fn(ndi, count_fn, NULL);
+    wqnode_set_fn(nds, count_fn, NULL);
+    wtest_fassert_soft(wqtree_set_history(tree, ndf, 8));
+    s_nfn = 0;
+    wqnode_seti(ndi, 1);
+    wqnode_seti(ndi, 1);
+    wqnode_seti(ndi, 2);
+    wtest_assert_soft(s_nfn == 2);
+    wqnode_sets(nds, "one");
+    wqnode_sets(nds, "one");
+    wtest_assert_soft(s_nfn == 3);
+    // deadband is relative to the last accepted value
+    wqnode_setf(ndf, 0.5f);
+    wqnode_setf(ndf, 0.505f);
+    wqnode_setf(ndf, 0.509f);
+    wqnode_setf(ndf, 0.52f);
+    wtest_assert_soft(wqnode_get_history(ndf, smp, 8) == 2);
+    wtest_assert_soft(smp[1].u.f == 0.52f);
+    wtest_end;
+}
+
+// vector and array nodes, set locally, restored and sent as osc arrays
+wpn_declstatic_alloc_mp(wqmp_11, 4096);
+wtest(query_11)
+{
+    wtest_begin(query_11);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* ndv, *nda, *ndi;
+    float xyz[3] = { 1.f, 2.f, 3.f }, bands[64];
+    int32_t ints[2] = { 4, 7 };
+    const float* fv;
+    const int32_t* iv;
+    struct sockaddr_in addr;
+    byte_t pkt[512], snap[1024];
+    uint32_t len;
+    womsg_t* msg;
+    char tag[67];
+    int n, fd;
+    wtest_fassert_soft(wqtree_walloc(&wqmp_11, &tree));
+    wtest_fassert_soft(wqtree_addndv3(tree, "/xyz", &ndv));
+    wtest_fassert_soft(wqtree_addndfa(tree, "/spectrum", &nda, 64));
+    wtest_fassert_soft(wqtree_addndia(tree, "/ints", &ndi, 4));
+    wtest_assert_soft(wqtree_addndfa(tree, "/big", &nda, WARR_MAXLEN+1)
+                      == WQUERY_ATTR_UNSUPPORTED);
+    nda = wqtree_get_node(tree, "/spectrum");
+    // vectors are full from the start, arrays are empty
+    wtest_fassert_soft(wqnode_getfv(ndv, &fv, &n));
+    wtest_assert_soft(n == 3 && fv[2] == 0.f);
+    wtest_fassert_soft(wqnode_getfv(nda, &fv, &n));
+    wtest_assert_soft(n == 0);
+    wtest_assert_soft(wqnode_setfv(ndv, xyz, 2) == WQUERY_TYPE_MISMATCH);
+    wtest_assert_soft(wqnode_setiv(ndv, ints, 3) == WQUERY_TYPE_MISMATCH);
+    wtest_assert_soft(wqnode_setiv(ndi, ints, 5) == WQUERY_STRBUF_OVERFLOW);
+    wtest_assert_soft(wqnode_getiv(ndv, &iv, &n) == WQUERY_TYPE_MISMATCH);
+    wqnode_set_fn(ndv, count_fn, NULL);
+    wqnode_set_flags(ndv, WQNODE_NOREPEAT);
+    s_nfn = 0;
+    wtest_fassert_soft(wqnode_setfv(ndv, xyz, 3));
+    wtest_fassert_soft(wqnode_setfv(ndv, xyz, 3));
+    wtest_assert_soft(s_nfn == 1);
+    wtest_fassert_soft(wqnode_setiv(ndi, ints, 2));
+    wtest_fassert_soft(wqnode_getiv(ndi, &iv, &n));
+    wtest_assert_soft(n == 2 && iv[1] == 7);
+    // snapshot, then restore over cleared values
+    wtest_fassert_soft(wqtree_snapshot(tree, snap, sizeof(snap), &len));
+    xyz[0] = 0.f;
+    wqnode_setfv(ndv, xyz, 3);
+    wqnode_setiv(ndi, ints, 0);
+    wtest_fassert_soft(wqtree_restore(tree, snap, len, WQRESTORE_BULK));
+    wqnode_getfv(ndv, &fv, &n);
+    wtest_assert_soft(fv[0] == 1.f && fv[2] == 3.f);
+    wqnode_getiv(ndi, &iv, &n);
+    wtest_assert_soft(n == 2 && iv[0] == 4);
+    // a 64-band spectrum, as a single "[f...f]" message
+    for (n = 0; n < 64; ++n)
+         bands[n] = n*0.5f;
+    tag[0] = '[';
+    memset(&tag[1], 'f', 64);
+    tag[65] = ']';
+    tag[66] = 0;
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, pkt, sizeof(pkt));
+    womsg_seturi(msg, "/spectrum");
+    womsg_settag(msg, tag);
+    wtest_fassert_soft(womsg_writea(msg, 'f', bands, 64));
+    wqserver_walloc(&wqmp_11, &server);
+    wqserver_expose(server, tree);
+    wqserver_set_udp_workers(server, 1);
+    wtest_fassert_soft(wqserver_run(server, 5687, 5688));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(5687);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sendto(fd, pkt, womsg_getlen(msg), 0,
+          (struct sockaddr*) &addr, sizeof(addr));
+    for (int k = 0; k < 200 && (wqnode_getfv(nda, &fv, &n), n != 64); ++k) {
+         wqserver_iterate(server, 5);
+         usleep(1000);
+    }
+    wtest_assert_soft(n == 64 && fv[63] == 31.5f);
+    close(fd);
+    wqserver_stop(server);
+    wtest_end;
+}
+
+// 64-bit, midi and blob nodes
+wpn_declstatic_alloc_mp(wqmp_12, 16384);
+wtest(query_12)
+{
+    wtest_begin(query_12);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* ndh, *ndd, *ndm, *ndb;
+    uint8_t midi[4] = { 0, 0x90, 60, 127 }, rmidi[4];
+    static byte_t wave[4096], pkt[4200], snap[8192];
+    struct sockaddr_in addr;
+    const byte_t* rwave;
+    uint32_t len;
+    int64_t h;
+    double d;
+    womsg_t* msg;
+    int fd;
+    for (int n = 0; n < sizeof(wave); ++n)
+         wave[n] = n*7;
+    wtest_fassert_soft(wqtree_walloc(&wqmp_12, &tree));
+    wqtree_addndh(tree, "/frames", &ndh);
+    wqtree_addndd(tree, "/time", &ndd);
+    wqtree_addndm(tree, "/note", &ndm);
+    wtest_fassert_soft(wqtree_addndblob(tree, "/wave", &ndb, sizeof(wave)));
+    wtest_fassert_soft(wqnode_seth(ndh, 1ll << 33));
+    wtest_fassert_soft(wqnode_setd(ndd, 1.0/3.0));
+    wtest_fassert_soft(wqnode_setm(ndm, midi));
+    wtest_assert_soft(wqnode_setd(ndh, 0.5) == WQUERY_TYPE_MISMATCH);
+    wtest_assert_soft(wqnode_setblob(ndb, wave, sizeof(wave)+1)
+                      == WQUERY_STRBUF_OVERFLOW);
+    wqnode_set_fn(ndb, count_fn, NULL);
+    wqnode_set_flags(ndb, WQNODE_NOREPEAT);
+    s_nfn = 0;
+    wtest_fassert_soft(wqnode_setblob(ndb, wave, 100));
+    wtest_fassert_soft(wqnode_setblob(ndb, wave, 100));
+    wtest_assert_soft(s_nfn == 1);
+    // snapshot, then restore over cleared values
+    wtest_fassert_soft(wqtree_snapshot(tree, snap, sizeof(snap), &len));
+    wqnode_seth(ndh, 0);
+    wqnode_setd(ndd, 0);
+    wqnode_setblob(ndb, wave, 0);
+    wtest_fassert_soft(wqtree_restore(tree, snap, len, WQRESTORE_BULK));
+    wqnode_geth(ndh, &h);
+    wqnode_getd(ndd, &d);
+    wqnode_getm(ndm, rmidi);
+    wqnode_getblob(ndb, &rwave, &len);
+    wtest_assert_soft(h == 1ll << 33 && d == 1.0/3.0);
+    wtest_fassert_soft(memcmp(rmidi, midi, 4));
+    wtest_assert_soft(len == 100 && rwave[99] == wave[99]);
+    // a 4k blob, sent as a single packet
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, pkt, sizeof(pkt));
+    womsg_seturi(msg, "/wave");
+    womsg_settag(msg, "b");
+    wtest_fassert_soft(womsg_writeblob(msg, wave, sizeof(wave)));
+    wqserver_walloc(&wqmp_12, &server);
+    wqserver_expose(server, tree);
+    wqserver_set_udp_workers(server, 1);
+    wtest_fassert_soft(wqserver_run(server, 5689, 5690));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(5689);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sendto(fd, pkt, womsg_getlen(msg), 0,
+          (struct sockaddr*) &addr, sizeof(addr));
+    for (int n = 0; n < 200 && (wqnode_getblob(ndb, &rwave, &len),
+                                len != sizeof(wave)); ++n) {
+         wqserver_iterate(server, 5);
+         usleep(1000);
+    }
+    wtest_assert_soft(len == sizeof(wave));
+    wtest_fassert_soft(memcmp(rwave, wave, sizeof(wave)));
+    close(fd);
+    wqserver_stop(server);
+    wtest_end;
+}
+
+static wqbuf_t* s_kept[32];
+static int s_nkept;
+
+static void
+keep_fn(wqnode_t* nd, wvalue_t* v, void* udt)
+{
+    s_kept[s_nkept] = v->u.sv->buf;
+    wqbuf_retain(s_kept[s_nkept++]);
+}
+
+// string views, on pooled buffers
+wpn_declstatic_alloc_mp(wqmp_13, 65536*3);
+wtest(query_13)
+{
+    wtest_begin(query_13);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* nd, *nds;
+    struct sockaddr_in addr;
+    byte_t pkt[256], snap[256];
+    const char* s;
+    uint32_t len;
+    womsg_t* msg;
+    int fd;
+    wtest_fassert_soft(wqtree_walloc(&wqmp_13, &tree));
+    wtest_assert_soft(wqtree_addndsv(tree, "/cue", &nd) == WQUERY_ATTR_UNSUPPORTED);
+    wtest_fassert_soft(wqtree_set_strpool(tree, 20, 8192));
+    wtest_fassert_soft(wqtree_addndsv(tree, "/cue", &nd));
+    wtest_fassert_soft(wqtree_addndsv(tree, "/lyrics", &nds));
+    wtest_fassert_soft(wqnode_gets(nd, &s));
+    wtest_assert_soft(*s == 0);
+    // set locally, strings are copied into the pool: previous
+    // buffers go back to it, unless they are retained
+    for (int n = 0; n < 40; ++n)
+         wtest_fassert_soft(wqnode_sets(nd, "cue one"));
+    wqnode_set_fn(nd, keep_fn, NULL);
+    for (int n = 0; n < 20; ++n)
+         wtest_fassert_soft(wqnode_sets(nd, "cue two"));
+    wtest_assert_soft(wqnode_sets(nd, "cue three") == WQUERY_POOL_EMPTY);
+    wqnode_gets(nd, &s);
+    wtest_fassert_soft(strcmp(s, "cue two"));
+    wtest_fassert_soft(wqnode_drop(nd));
+    wqnode_gets(nd, &s);
+    wtest_assert_soft(*s == 0);
+    while (s_nkept)
+           wqbuf_release(s_kept[--s_nkept]);
+    wqnode_set_fn(nd, count_fn, NULL);
+    wtest_fassert_soft(wqnode_sets(nd, "cue four"));
+    wtest_fassert_soft(wqtree_snapshot(tree, snap, sizeof(snap), &len));
+    wtest_fassert_soft(wqnode_drop(nd));
+    s_nfn = 0;
+    wtest_fassert_soft(wqtree_restore(tree, snap, len, WQRESTORE_BULK));
+    wqnode_gets(nd, &s);
+    wtest_fassert_soft(strcmp(s, "cue four"));
+    wtest_assert_soft(s_nfn == 0);
+    // received by udp workers, straight into the pool
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, pkt, sizeof(pkt));
+    womsg_seturi(msg, "/lyrics");
+    womsg_settag(msg, "s");
+    womsg_writes(msg, "in the dark of night");
+    wqserver_walloc(&wqmp_13, &server);
+    wqserver_expose(server, tree);
+    wqserver_set_udp_workers(server, 1);
+    wtest_fassert_soft(wqserver_run(server, 5691, 5692));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(5691);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sendto(fd, pkt, womsg_getlen(msg), 0,
+          (struct sockaddr*) &addr, sizeof(addr));
+    for (int n = 0; n < 200 && (wqnode_gets(nds, &s), *s == 0); ++n) {
+         wqserver_iterate(server, 5);
+         usleep(1000);
+    }
+    wtest_fassert_soft(strcmp(s, "in the dark of night"));
+    // view on the datagram: string follows uri and tag
+    wtest_fassert_soft(memcmp(s-12, "/lyrics\0,s\0\0", 12));
+    close(fd);
+    wqserver_stop(server);
+    wtest_end;
+}
+
+// server metrics, udp worker path
+wpn_declstatic_alloc_mp(wqmp_14, 65536);
+wtest(query_14)
+{
+    wtest_begin(query_14);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* nd;
+    char metrics[8192];
+    uint32_t len;
+#ifdef WQUERY_METRICS
+    struct sockaddr_in addr;
+    float f = 0;
+    int fd;
+#endif
+    wqtree_walloc(&wqmp_14, &tree);
+    wqtree_addndf(tree, "/gain", &nd);
+    wqserver_walloc(&wqmp_14, &server);
+#ifndef WQUERY_METRICS
+    wqserver_expose(server, tree);
+    wtest_assert_soft(wqserver_get_metrics(server, metrics, sizeof(metrics), &len)
+                      == WQUERY_ATTR_UNSUPPORTED);
+#else
+    wtest_fassert_soft(wtest_run(server, tree, 5695));
+    fd = wtest_loopback(&addr, 5695);
+    // garbage, unknown address, then a valid update
+    sendto(fd, "garbage", 8, 0, (struct sockaddr*) &addr, sizeof(addr));
+    wtest_sendf(fd, &addr, "/nope", 1.f);
+    wtest_sendf(fd, &addr, "/gain", 0.5f);
+    wtest_poll(server, (wqnode_getf(nd, &f), f == 0.5f));
+    wtest_assert_soft(f == 0.5f);
+    wtest_fassert_soft(wqserver_get_metrics(server, metrics, sizeof(metrics), &len));
+    wtest_assert_soft(len == strlen(metrics));
+    wtest_assert_soft(strstr(metrics, "wquery_rx_packets_total{transport=\"udp\"} 3\n") != NULL);
+    wtest_assert_soft(strstr(metrics, "wquery_errors_total{kind=\"decode\"} 1\n") != NULL);
+    wtest_assert_soft(strstr(metrics, "wquery_errors_total{kind=\"uri\"} 1\n") != NULL);
+    wtest_assert_soft(strstr(metrics, "wquery_stage_seconds_count{stage=\"lookup\"} 2\n") != NULL);
+    wtest_assert_soft(strstr(metrics, "wquery_stage_seconds_count{stage=\"update\"} 1\n") != NULL);
+    wtest_assert_soft(strstr(metrics, "wquery_stage_seconds_bucket{stage=\"update\",le=\"+Inf\"} 1\n") != NULL);
+    wtest_assert_soft(wqserver_get_metrics(server, metrics, 64, &len)
+                      == WQUERY_STRBUF_OVERFLOW);
+    close(fd);
+    wqserver_stop(server);
+#endif
+    wtest_end;
+}
+
+wpn_declstatic_alloc_mp(wqmp_15, 65536);
+
+wtest(query_15)
+{
+    wtest_begin(query_15);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* a, *b, *c;
+    struct wqnode_stats st;
+    struct wqhot hot[4];
+    struct sockaddr_in addr;
+    float f = 0;
+    int n, fd, len = 0;
+    wqtree_walloc(&wqmp_15, &tree);
+    wqtree_addndN(tree, "/mix", &a);
+    wqtree_addndf(tree, "/mix/a", &a);
+    wqtree_addndf(tree, "/mix/b", &b);
+    wqtree_addndf(tree, "/mix/c", &c);
+    wtest_assert_soft(wqtree_get_hot(tree, hot, 4) == -WQUERY_ATTR_UNSUPPORTED);
+    wtest_assert_soft(wqtree_get_stats(tree, a, &st) == WQUERY_ATTR_UNSUPPORTED);
+    wtest_fassert_soft(wqtree_set_stats(tree, 16, 2));
+    wtest_assert_soft(wqtree_set_stats(tree, 16, 2) == WQUERY_ATTR_UNSUPPORTED);
+    wqserver_walloc(&wqmp_15, &server);
+    wtest_fassert_soft(wtest_run(server, tree, 5697));
+    fd = wtest_loopback(&addr, 5697);
+    // skewed traffic: 8 to /mix/b, 4 to /mix/a, then 1 to /mix/c
+    for (n = 1; n <= 13; ++n)
+         len = wtest_sendf(fd, &addr, n <= 8 ? "/mix/b" :
+                           n <= 12 ? "/mix/a" : "/mix/c", n);
+    wtest_poll(server, (wqnode_getf(c, &f), f == 13.f));
+    wtest_assert_soft(f == 13.f);
+    wtest_fassert_soft(wqtree_get_stats(tree, b, &st));
+    wtest_assert_soft(st.rx == 8);
+    wtest_assert_soft(st.rx_bytes == 8*len);
+    wtest_assert_soft(st.tx == 0);
+    wtest_assert_soft(st.last != 0);
+    wtest_fassert_soft(wqtree_get_stats(tree, c, &st));
+    wtest_assert_soft(st.rx == 1);
+    // /mix/c took /mix/a's place in the sketch, inheriting its count
+    wtest_assert_soft(wqtree_get_hot(tree, hot, 4) == 2);
+    wtest_assert_soft(hot[0].node == b && hot[0].count == 8 && hot[0].error == 0);
+    wtest_assert_soft(hot[1].node == c && hot[1].count == 5 && hot[1].error == 4);
+    wtest_assert_soft(wqtree_get_hot(tree, hot, 1) == 1);
+    wtest_assert_soft(hot[0].node == b);
+    close(fd);
+    wqserver_stop(server);
+    wtest_end;
+}
+
+#ifdef WQUERY_TRACE
+wpn_declstatic_alloc_mp(wqmp_16, 65536);
+
+static int s_fn16;
+
+static void
+query_16_fn(wqnode_t* nd, wvalue_t* v, void* udt)
+{
+    s_fn16++;
+}
+#endif
+
+wtest(query_16)
+{
+    wtest_begin(query_16);
+#ifndef WQUERY_TRACE
+    wtest_assert_soft(wqtrace_start() == WQUERY_ATTR_UNSUPPORTED);
+    wtest_assert_soft(wqtrace_write("/tmp/wquery_16.json") == WQUERY_ATTR_UNSUPPORTED);
+#else
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* nd;
+    struct sockaddr_in addr;
+    char trace[65536];
+    FILE* f;
+    size_t len;
+    int fd;
+    wqtree_walloc(&wqmp_16, &tree);
+    wqtree_addndf(tree, "/gain", &nd);
+    wqnode_set_fn(nd, query_16_fn, NULL);
+    wqserver_walloc(&wqmp_16, &server);
+    wtest_fassert_soft(wtest_run(server, tree, 5699));
+    wtest_fassert_soft(wqtrace_start());
+    fd = wtest_loopback(&addr, 5699);
+    wtest_sendf(fd, &addr, "/gain", 0.5f);
+    wtest_poll(server, s_fn16 > 0);
+    wtest_assert_soft(s_fn16 == 1);
+    wtest_fassert_soft(wqtrace_write("/tmp/wquery_16.json"));
+    f = fopen("/tmp/wquery_16.json", "r");
+    wtest_assert_soft(f != NULL);
+    len = fread(trace, 1, sizeof(trace)-1, f);
+    trace[len] = 0;
+    fclose(f);
+    unlink("/tmp/wquery_16.json");
+    wtest_assert_soft(strncmp(trace, "{\"traceEvents\":[", 16) == 0);
+    wtest_assert_soft(strstr(trace, "\"name\":\"mg_mgr_poll\",\"ph\":\"B\"") != NULL);
+    wtest_assert_soft(strstr(trace, "\"name\":\"womsg_decode\",\"ph\":\"E\"") != NULL);
+    wtest_assert_soft(strstr(trace, "\"name\":\"wqtree_get_node\",\"ph\":\"B\"") != NULL);
+    wtest_assert_soft(strstr(trace, "\"name\":\"wqnode_fn\",\"ph\":\"E\"") != NULL);
+    wtest_assert_soft(strcmp(&trace[len-3], "]}\n") == 0);
+    close(fd);
+    wqserver_stop(server);
+#endif
+    wtest_end;
+}
+
+wpn_declstatic_alloc_mp(wqmp_17, 65536);
+
+// reads the binary frames received on websocket <fd>,
+// returns their number, <f> being set to the last value
+static int
+query_17_recv(wqserver_t* server, int fd, float* f)
+{
+    byte_t buf[1024];
+    womsg_t* msg;
+    int len = 0, r, count = 0;
+    womsg_alloca(&msg);
+    for (int n = 0; n < 10; ++n) {
+         wqserver_iterate(server, 5);
+         if ((r = recv(fd, &buf[len], sizeof(buf)-len, 0)) > 0)
+             len += r;
+    }
+    // server frames are not masked, and small enough
+    // for their length to fit in the second byte
+    for (int off = 0; off+2 <= len && off+2+buf[off+1] <= len;
+         off += 2+buf[off+1]) {
+         if (buf[off] == 0x82 &&
+             womsg_decode(msg, &buf[off+2], buf[off+1]) == 0 &&
+             womsg_readf(msg, f) == 0)
+             count++;
+    }
+    return count;
+}
+
+// critical node updated faster than a client's budget allows:
+// updates it can't take are coalesced, and it only gets
+// the latest value once its tokens are refilled
+wtest(query_17)
+{
+    wtest_begin(query_17);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* nd;
+    struct wqclient_lag lag[4];
+    uint64_t coalesced;
+    float f = 0;
+    int fd;
+    wqserver_walloc(&wqmp_17, &server);
+    wtest_assert_soft(wqserver_set_client_budget(server, 0, 0, 1024, 512)
+                      == WQUERY_ATTR_UNSUPPORTED);
+    wtest_fassert_soft(wqserver_set_client_budget(server, 65536, 100, 512, 1024));
+    wtest_fassert_soft(wqserver_set_client_budget(server, 0, 0, 0, 0));
+    wtest_assert_soft(wqserver_get_client_lag(server, lag, 4) == 0);
+    wqtree_walloc(&wqmp_17, &tree);
+    wqtree_addndf(tree, "/crit", &nd);
+    wqnode_set_flags(nd, WQNODE_CRITICAL);
+    // 2 messages per second, no watermarks
+    wtest_fassert_soft(wqserver_set_client_budget(server, 0, 2, 0, 0));
+    wtest_fassert_soft(wtest_run(server, tree, 5703));
+    wtest_assert_soft((fd = wtest_ws_open(server, 5704)) >= 0);
+    wtest_ws_send(server, fd, "{\"COMMAND\":\"LISTEN\",\"DATA\":\"/crit\"}");
+    wtest_ws_send(server, fd, "{\"COMMAND\":\"START_OSC_STREAMING\","
+                  "\"DATA\":{\"LOCAL_SERVER_PORT\":5705}}");
+    for (int n = 1; n <= 6; ++n) {
+         wqnode_setf(nd, n);
+         wqserver_iterate(server, 1);
+    }
+    // 1 and 2 are sent, 3 is pending, then replaced by 4, 5 and 6
+    wtest_assert_soft(query_17_recv(server, fd, &f) == 2 && f == 2.f);
+    wtest_assert_soft(wqserver_get_client_lag(server, lag, 4) == 1);
+    wtest_assert_soft(lag[0].pending == 1 && lag[0].coalesced == 3);
+    coalesced = lag[0].coalesced;
+    wqnode_setf(nd, 7.f);
+    wqserver_iterate(server, 1);
+    wqserver_get_client_lag(server, lag, 4);
+    wtest_assert_soft(lag[0].coalesced > coalesced);
+    // tokens refill at 2 per second
+    usleep(600000);
+    wtest_assert_soft(query_17_recv(server, fd, &f) == 1 && f == 7.f);
+    wqserver_get_client_lag(server, lag, 4);
+    wtest_assert_soft(lag[0].pending == 0);
+    close(fd);
+    wqserver_stop(server);
+    wtest_end;
+}
+
+wpn_declstatic_alloc_mp(wqmp_18, 65536);
+
+wtest(query_18)
+{
+    wtest_begin(query_18);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* nd;
+    const void* dat, *prev;
+    const char* etag;
+    char json[1024], tag[24];
+    uint32_t len, jlen, v;
+    static char uris[32][24];
+    wqtree_walloc(&wqmp_18, &tree);
+    v = wqtree_get_version(tree);
+    wqtree_addndN(tree, "/synth", &nd);
+    for (int n = 0; n < 32; ++n) {
+         snprintf(uris[n], sizeof(uris[n]), "/synth/voice%d", n);
+         wqtree_addndf(tree, uris[n], &nd);
+    }
+    wtest_assert_soft(wqtree_get_version(tree) == v+33);
+    v += 33;
+    // access is part of the namespace
+    wtest_fassert_soft(wqtree_set_node_flags(tree, nd, WQNODE_READONLY));
+    wtest_assert_soft(wqtree_get_version(tree) == v+1);
+    wtest_fassert_soft(wqtree_set_node_flags(tree, nd, WQNODE_READONLY | WQNODE_CRITICAL));
+    wtest_assert_soft(wqtree_get_version(tree) == ++v);
+    wtest_assert_soft(wqtree_print_json(tree, nd, json, 8, &len)
+                      == WQUERY_STRBUF_OVERFLOW);
+    wtest_fassert_soft(wqtree_print_json(tree, nd, json, sizeof(json), &jlen));
+    wtest_assert_soft(jlen == len && jlen == strlen(json));
+    wtest_assert_soft(strcmp(json, "{\"FULL_PATH\":\"/synth/voice31\","
+                                   "\"ACCESS\":1,\"TYPE\":\"f\"}") == 0);
+    wqserver_walloc(&wqmp_18, &server);
+    wqserver_expose(server, tree);
+    wtest_fassert_soft(wqserver_get_namespace(server, false, &dat, &jlen, &etag));
+    wtest_assert_soft(strncmp(dat, "{\"FULL_PATH\":\"/\",\"ACCESS\":0,"
+                              "\"CONTENTS\":{\"synth\":{", 42) == 0);
+    wtest_assert_soft(strstr(dat, "\"voice7\":{\"FULL_PATH\":\"/synth/voice7\"") != NULL);
+    strcpy(tag, etag);
+    // cached, until the tree changes
+    prev = dat;
+    wtest_fassert_soft(wqserver_get_namespace(server, false, &dat, &len, &etag));
+    wtest_assert_soft(dat == prev && len == jlen && strcmp(tag, etag) == 0);
+#ifdef WQUERY_ZLIB
+    wtest_fassert_soft(wqserver_get_namespace(server, true, &dat, &len, &etag));
+    wtest_assert_soft(len > 0 && len < jlen);
+    wtest_assert_soft(((const byte_t*) dat)[0] == 0x1f && ((const byte_t*) dat)[1] == 0x8b);
+    // distinct representation, distinct tag
+    wtest_assert_soft(strncmp(etag, tag, strlen(tag)-1) == 0 &&
+                      strcmp(&etag[strlen(tag)-1], "-gz\"") == 0);
+#else
+    wtest_assert_soft(wqserver_get_namespace(server, true, &dat, &len, &etag)
+                      == WQUERY_ATTR_UNSUPPORTED);
+#endif
+    wqtree_clear_node_flags(tree, nd, WQNODE_READONLY);
+    wtest_fassert_soft(wqserver_get_namespace(server, false, &dat, &len, &etag));
+    wtest_assert_soft(strcmp(tag, etag) != 0);
+    wtest_assert_soft(strstr(dat, "\"voice31\":{\"FULL_PATH\":\"/synth/voice31\","
+                                  "\"ACCESS\":3,") != NULL);
+    strcpy(tag, etag);
+    wqtree_addndi(tree, "/synth/poly", &nd);
+    wtest_assert_soft(wqtree_get_version(tree) == v+2);
+    wtest_fassert_soft(wqserver_get_namespace(server, false, &dat, &len, &etag));
+    wtest_assert_soft(len > jlen && strcmp(tag, etag) != 0);
+    wtest_assert_soft(strstr(dat, "\"poly\":{\"FULL_PATH\":\"/synth/poly\","
+                                  "\"ACCESS\":3,\"TYPE\":\"i\"}") != NULL);
+    // whole tree
+    wtest_assert_soft(wqtree_print_json(tree, NULL, NULL, 0, &jlen)
+                      == WQUERY_STRBUF_OVERFLOW);
+    wtest_assert_soft(jlen == len);
+    wtest_end;
+}
+
+wpn_declstatic_alloc_mp(wqmp_19, 16384);
+
+wtest(query_19)
+{
+    wtest_begin(query_19);
+    wqtree_t* tree, *ref;
+    wqnode_t* nd, *nodes[8];
+    char json[1024], rjson[1024];
+    uint32_t len, v;
+    const struct wqnode_desc descs[] = {
+        { "/fx", WOSC_TYPE_NIL, 0 },
+        { "/fx/delay", WOSC_TYPE_NIL, 0 },
+        { "/fx/delay/time", WOSC_TYPE_FLOAT, 0 },
+        { "/fx/delay/wet", WOSC_TYPE_FLOAT, WQNODE_CRITICAL },
+        { "/fx/gain", WOSC_TYPE_INT, WQNODE_READONLY },
+        { "/fx/reverb", WOSC_TYPE_NIL, 0 },
+        { "/fx/reverb/size", WOSC_TYPE_DOUBLE, 0 },
+        { "/master/mute", WOSC_TYPE_BOOL, 0 },
+    };
+    const struct wqnode_desc bad[] = {
+        { "/fx2", WOSC_TYPE_NIL, 0 },
+        { "/fx2/name", WOSC_TYPE_STRING, 0 },
+    };
+    const struct wqnode_desc orphan[] = {
+        { "/a", WOSC_TYPE_NIL, 0 },
+        { "/a/b/c", WOSC_TYPE_NIL, 0 },
+        { "/a/b/c/d", WOSC_TYPE_INT, 0 },
+    };
+    const struct wqnode_desc unordered[] = {
+        { "/x", WOSC_TYPE_NIL, 0 },
+        { "/y", WOSC_TYPE_NIL, 0 },
+        { "/x/z", WOSC_TYPE_INT, 0 },
+    };
+    wqtree_walloc(&wqmp_19, &tree);
+    wqtree_addndN(tree, "/master", &nd);
+    wqtree_addndf(tree, "/master/level", &nd);
+    v = wqtree_get_version(tree);
+    wtest_assert_soft(wqtree_build(tree, bad, 2, nodes) == WQUERY_TYPE_MISMATCH);
+    wtest_assert_soft(wqtree_get_version(tree) == v);
+    wtest_assert_soft(wqtree_get_node(tree, "/fx2") == NULL);
+    // parents come first, depth-first, or are in the tree
+    wtest_assert_soft(wqtree_build(tree, orphan, 3, nodes) == WQUERY_URI_INVALID);
+    wtest_assert_soft(wqtree_build(tree, unordered, 3, nodes) == WQUERY_URI_INVALID);
+    wtest_assert_soft(wqtree_get_version(tree) == v);
+    wtest_assert_soft(wqtree_get_node(tree, "/a") == NULL);
+    wtest_fassert_soft(wqtree_build(tree, descs, 8, nodes));
+    wtest_assert_soft(wqtree_get_version(tree) == v+8);
+    for (int n = 0; n < 8; ++n)
+         wtest_assert_soft(wqtree_get_node(tree, descs[n].uri) == nodes[n]);
+    wtest_assert_soft(wqnode_get_access(nodes[4]) == WQNODE_ACCESS_R);
+    // same tree, one node at a time
+    wqtree_walloc(&wqmp_19, &ref);
+    wqtree_addndN(ref, "/master", &nd);
+    wqtree_addndf(ref, "/master/level", &nd);
+    wqtree_addndN(ref, "/fx", &nd);
+    wqtree_addndN(ref, "/fx/delay", &nd);
+    wqtree_addndf(ref, "/fx/delay/time", &nd);
+    wqtree_addndf(ref, "/fx/delay/wet", &nd);
+    wqtree_addndi(ref, "/fx/gain", &nd);
+    wqtree_set_node_flags(ref, nd, WQNODE_READONLY);
+    wqtree_addndN(ref, "/fx/reverb", &nd);
+    wqtree_addndd(ref, "/fx/reverb/size", &nd);
+    wqtree_addndb(ref, "/master/mute", &nd);
+    wtest_fassert_soft(wqtree_print_json(tree, wqtree_get_node(tree, "/"),
+                                         json, sizeof(json), &len));
+    wtest_fassert_soft(wqtree_print_json(ref, wqtree_get_node(ref, "/"),
+                                         rjson, sizeof(rjson), &len));
+    wtest_assert_soft(strcmp(json, rjson) == 0);
+    wtest_end;
+}
+
+wpn_declstatic_alloc_mp(wqmp_20, 131072);
+
+wtest(query_20)
+{
+    wtest_begin(query_20);
+    wqtree_t* tree;
+    wqnode_t* nd, *mixer, *gain, *nodes[64];
+    static char uris[512][24];
+    static char buris[64][24];
+    static char json[65536];
+    char name[24];
+    const char* prev, *pos;
+    uint32_t len;
+    struct wqnode_desc descs[64];
+    bool found = true, ordered = true;
+    int n = 0;
+    wqtree_walloc(&wqmp_20, &tree);
+    wqtree_addndN(tree, "/mixer", &mixer);
+    for (n = 0; n < 512; ++n) {
+         snprintf(uris[n], sizeof(uris[n]), "/mixer/ch%d", n);
+         wqtree_addndN(tree, uris[n], &nd);
+    }
+    wqtree_addndf(tree, "/mixer/ch7/gain", &gain);
+    for (n = 0; n < 512; ++n)
+         found &= (nd = wqtree_get_node(tree, uris[n])) != NULL &&
+                  strcmp(wqnode_get_name(nd), uris[n]+7) == 0;
+    wtest_assert_soft(found);
+    wtest_assert_soft(wqtree_get_node(tree, "/mixer/ch7/gain") == gain);
+    wtest_assert_soft(wqtree_get_node(tree, "/mixer/ch512") == NULL);
+    wtest_assert_soft(wqtree_get_node(tree, "/mixer/ch") == NULL);
+    wtest_assert_soft(wqtree_get_node(tree, "/mixer/ch1/gain") == NULL);
+    // children are still listed in insertion order
+    wtest_fassert_soft(wqtree_print_json(tree, mixer, json, sizeof(json), &len));
+    for (n = 0, prev = json; n < 512; ++n) {
+         snprintf(name, sizeof(name), "\"%s\":", uris[n]+7);
+         ordered &= (pos = strstr(json, name)) > prev;
+         prev = pos;
+    }
+    wtest_assert_soft(ordered);
+    // bulk built ones are indexed when their batch is done
+    for (n = 0; n < 64; ++n) {
+         snprintf(buris[n], sizeof(buris[n]), "/mixer/bus%d", n);
+         descs[n].uri = buris[n];
+         descs[n].type = WOSC_TYPE_FLOAT;
+         descs[n].flags = 0;
+    }
+    wtest_fassert_soft(wqtree_build(tree, descs, 64, nodes));
+    found = true;
+    for (n = 0; n < 64; ++n)
+         found &= wqtree_get_node(tree, buris[n]) == nodes[n];
+    wtest_assert_soft(found);
+    wtest_assert_soft(wqtree_get_node(tree, "/mixer/ch511") != NULL);
+    wtest_end;
+}
+
+wpn_declstatic_alloc_mp(wqmp_21, 65536);
+
+wtest(query_21)
+{
+    wtest_begin(query_21);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* a, *b, *lg;
+    struct sockaddr_in addr;
+    const char* luri = "/mix/a_parameter_name_long_enough_not_to_be_cached";
+    uint64_t hits, misses;
+    float f = 0;
+    int n, fd;
+    wqtree_walloc(&wqmp_21, &tree);
+    wqtree_addndN(tree, "/mix", &a);
+    wqtree_addndf(tree, "/mix/a", &a);
+    wqtree_addndf(tree, luri, &lg);
+    wqserver_walloc(&wqmp_21, &server);
+    wtest_assert_soft(wqserver_get_lookup_stats(server, &hits, &misses)
+                      == WQUERY_ATTR_UNSUPPORTED);
+    wtest_assert_soft(wqserver_set_lookup_cache(server, 1) == WQUERY_ATTR_UNSUPPORTED);
+    wtest_fassert_soft(wqserver_set_lookup_cache(server, 64));
+    wtest_fassert_soft(wtest_run(server, tree, 5701));
+    fd = wtest_loopback(&addr, 5701);
+    for (n = 1; n <= 10; ++n)
+         wtest_sendf(fd, &addr, "/mix/a", n);
+    wtest_poll(server, (wqnode_getf(a, &f), f == 10.f));
+    wtest_assert_soft(f == 10.f);
+    wtest_fassert_soft(wqserver_get_lookup_stats(server, &hits, &misses));
+    wtest_assert_soft(hits == 9 && misses == 1);
+    // adding a node invalidates all lines (worker is idle by now)
+    wqtree_addndf(tree, "/mix/b", &b);
+    wtest_sendf(fd, &addr, "/mix/a", 11);
+    // unknown addresses are not cached, long ones bypass the cache
+    wtest_sendf(fd, &addr, "/mix/c", 1);
+    wtest_sendf(fd, &addr, "/mix/c", 2);
+    wtest_sendf(fd, &addr, luri, 1);
+    wtest_sendf(fd, &addr, "/mix/b", 12);
+    wtest_poll(server, (wqnode_getf(b, &f), f == 12.f));
+    wtest_assert_soft(f == 12.f);
+    wqnode_getf(lg, &f);
+    wtest_assert_soft(f == 1.f);
+    wtest_fassert_soft(wqserver_get_lookup_stats(server, &hits, &misses));
+    wtest_assert_soft(hits == 9 && misses == 5);
+    close(fd);
+    wqserver_stop(server);
+    wtest_end;
+}
+
 int
 main(void)
 {
@@ -218,5 +1315,21 @@ main(void)
     err += wpn_unittest_query_03();
     err += wpn_unittest_query_04();
     err += wpn_unittest_query_05();
+    err += wpn_unittest_query_06();
+    err += wpn_unittest_query_07();
+    err += wpn_unittest_query_08();
+    err += wpn_unittest_query_09();
+    err += wpn_unittest_query_10();
+    err += wpn_unittest_query_11();
+    err += wpn_unittest_query_12();
+    err += wpn_unittest_query_13();
+    err += wpn_unittest_query_14();
+    err += wpn_unittest_query_15();
+    err += wpn_unittest_query_16();
+    err += wpn_unittest_query_17();
+    err += wpn_unittest_query_18();
+    err += wpn_unittest_query_19();
+    err += wpn_unittest_query_20();
+    err += wpn_unittest_query_21();
     return err;
 }
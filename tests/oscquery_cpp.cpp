@@ -0,0 +1,131 @@
+#include <wpn114/network/oscquery.hpp>
+#include <wpn114/utilities.h>
+#include "tests.h"
+
+using namespace wpn114::query;
+
+// upstream resource, keeping track of outstanding bytes
+class counting_resource : public std::pmr::memory_resource {
+public:
+    size_t outstanding = 0;
+    int nallocs = 0;
+
+private:
+    void* do_allocate(size_t n, size_t align) override {
+        outstanding += n;
+        nallocs++;
+        return std::pmr::new_delete_resource()->allocate(n, align);
+    }
+    void do_deallocate(void* p, size_t n, size_t align) override {
+        outstanding -= n;
+        std::pmr::new_delete_resource()->deallocate(p, n, align);
+    }
+    bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+struct synth {
+    float gain = 0;
+    int ncalls = 0;
+    std::string_view name;
+    void set_gain(float g) { gain = g; ncalls++; }
+    void set_name(std::string_view n) { name = n; }
+};
+
+static int s_voices;
+static void set_voices(int v) { s_voices = v; }
+
+// typed nodes, member/function binding
+static int
+wpn_unittest_query_cpp_01(void)
+{
+    wtest_begin(query_cpp_01);
+    Tree tree;
+    Node<float> gain;
+    Node<int> voices;
+    Node<bool> mute;
+    Node<double> tempo;
+    Node<std::string_view> name;
+    synth s;
+    wtest_fassert_soft(tree.add("/synth"));
+    wtest_fassert_soft(tree.add("/clock"));
+    wtest_fassert_soft(tree.add("/synth/gain", &gain));
+    wtest_fassert_soft(tree.add("/synth/voices", &voices));
+    wtest_fassert_soft(tree.add("/synth/mute", &mute));
+    wtest_fassert_soft(tree.add("/clock/tempo", &tempo));
+    wtest_fassert_soft(tree.add("/synth/name", &name, 16));
+
+    gain.bind<&synth::set_gain>(&s);
+    wtest_fassert_soft(gain.set(0.5f));
+    wtest_assert_soft(s.gain == 0.5f && s.ncalls == 1);
+    wtest_assert_soft(gain.get() == 0.5f);
+    gain.set(0.25f);
+    wtest_assert_soft(s.gain == 0.25f && s.ncalls == 2);
+
+    voices.bind<&set_voices>();
+    voices.set(12);
+    wtest_assert_soft(s_voices == 12);
+    wtest_assert_soft(voices.get() == 12);
+
+    mute.set(true);
+    tempo.set(96.5);
+    wtest_assert_soft(mute.get() == true);
+    wtest_assert_soft(tempo.get() == 96.5);
+
+    // views don't have to be zero-terminated
+    name.bind<&synth::set_name>(&s);
+    std::string_view full("sawtooth-lead");
+    wtest_fassert_soft(name.set(full.substr(0, 8)));
+    wtest_assert_soft(s.name == "sawtooth");
+    wtest_assert_soft(name.get() == "sawtooth");
+    wtest_assert_soft(name.set(full.substr(0, 0)) == 0);
+    wtest_assert_soft(name.set("a name way too long for it") == WQUERY_STRBUF_OVERFLOW);
+    wtest_assert_soft(name.get().empty());
+
+    // lookup
+    wtest_assert_soft(tree.get<float>("/synth/gain").get() == 0.25f);
+    wtest_assert_soft(!tree.get<float>("/synth/foo"));
+    // type mismatch gives an empty node
+    wtest_assert_soft(!tree.get<int>("/synth/gain"));
+    wtest_assert_soft(!!tree.get<std::string_view>("/synth/name"));
+    wtest_end;
+}
+
+// memory comes from the given resource, and goes back to it
+static int
+wpn_unittest_query_cpp_02(void)
+{
+    wtest_begin(query_cpp_02);
+    counting_resource mr;
+    {
+        Tree tree(&mr);
+        Node<float> nd;
+        // uris are not copied
+        static char uris[64][16];
+        tree.add("/bank");
+        for (int n = 0; n < 64; ++n) {
+             snprintf(uris[n], sizeof(uris[n]), "/bank/%d", n);
+             tree.add(uris[n], &nd);
+        }
+        wtest_assert_soft(mr.nallocs > 0);
+        wtest_assert_soft(mr.outstanding > 0);
+        {
+            Server server(&mr);
+            wtest_fassert_soft(server.expose(tree));
+            wtest_fassert_soft(server.run(5693, 5694));
+            server.iterate(10);
+        }
+    }
+    wtest_assert_soft(mr.outstanding == 0);
+    wtest_end;
+}
+
+int
+main(void)
+{
+    int err = 0;
+    err += wpn_unittest_query_cpp_01();
+    err += wpn_unittest_query_cpp_02();
+    return err;
+}
@@ -0,0 +1,197 @@
+#include <wpn114/network/oscquery.h>
+#include <wpn114/network/record.h>
+#include <wpn114/utilities.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include "tests.h"
+#include "bench.h"
+
+#define LOGPATH "/tmp/wquery_record.log"
+
+struct packets {
+    int count;
+    uint64_t ts;
+    byte_t first;
+    byte_t last;
+};
+
+static void
+pkt_fn(byte_t* data, uint32_t len, uint64_t ts, void* udt)
+{
+    struct packets* p = udt;
+    if (p->count++ == 0)
+        p->first = data[0];
+    p->last = data[0];
+    p->ts = ts;
+}
+
+static uint32_t
+encodei(byte_t* dst, uint32_t cap, const char* uri, int i)
+{
+    womsg_t* msg;
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, dst, cap);
+    womsg_seturi(msg, uri);
+    womsg_settag(msg, "i");
+    womsg_writei(msg, i);
+    return womsg_getlen(msg);
+}
+
+/// segments are recycled oldest first, packets are read in order
+wtest(record_01)
+{
+    wtest_begin(record_01);
+    wqrec_t* rec;
+    byte_t pkt[1000];
+    struct packets p = { 0 };
+    wtest_fassert_soft(wqrec_walloc(&s_malloc, &rec));
+    wtest_assert_soft(wqrec_create(rec, LOGPATH, 2, 1000) == WQREC_INVALID);
+    wtest_fassert_soft(wqrec_create(rec, LOGPATH, 3, 4096));
+    wtest_assert_soft(wqrec_write(rec, pkt, 4096) == WQREC_FRAME_TOO_LARGE);
+    // 1016 bytes per packet, 4 of them per segment:
+    // packets 0 to 3 are overwritten by the 13th one
+    for (int n = 0; n < 13; ++n) {
+         pkt[0] = n;
+         wtest_fassert_soft(wqrec_write(rec, pkt, sizeof(pkt)));
+    }
+    wtest_assert_soft(wqrec_foreach(rec, pkt_fn, &p) == 9);
+    wtest_assert_soft(p.first == 4 && p.last == 12);
+    wqrec_close(rec);
+    // read-only mapping of the same file
+    memset(&p, 0, sizeof(p));
+    wtest_fassert_soft(wqrec_open(rec, LOGPATH));
+    wtest_assert_soft(wqrec_write(rec, pkt, 8) == WQREC_READONLY);
+    wtest_assert_soft(wqrec_foreach(rec, pkt_fn, &p) == 9);
+    wtest_assert_soft(p.first == 4 && p.last == 12);
+    wqrec_close(rec);
+    unlink(LOGPATH);
+    wtest_end;
+}
+
+/// replay as fast as possible, then at original (doubled) speed
+wtest(record_02)
+{
+    wtest_begin(record_02);
+    wqrec_t* rec;
+    wqtree_t* tree;
+    wqnode_t* nd;
+    byte_t pkt[64];
+    uint64_t t0;
+    int i;
+    wqrec_walloc(&s_malloc, &rec);
+    wtest_fassert_soft(wqrec_create(rec, LOGPATH, 1, 4096));
+    for (int n = 1; n <= 3; ++n) {
+         wqrec_write(rec, pkt, encodei(pkt, sizeof(pkt), "/int", n));
+         usleep(20000);
+    }
+    wqtree_walloc(&s_malloc, &tree);
+    wqtree_addndi(tree, "/int", &nd);
+    // replayed packets are not recorded again
+    wqtree_set_recorder(tree, rec);
+    t0 = wbench_now();
+    wtest_assert_soft(wqtree_replay(tree, rec, 0) == 3);
+    wtest_assert_soft(wbench_now()-t0 < 10000000);
+    wqnode_geti(nd, &i);
+    wtest_assert_soft(i == 3);
+    wqnode_seti(nd, 0);
+    // 40ms between first and last packets
+    t0 = wbench_now();
+    wtest_assert_soft(wqtree_replay(tree, rec, 2) == 3);
+    t0 = wbench_now()-t0;
+    wtest_assert_soft(t0 > 19000000 && t0 < 30000000);
+    wqnode_geti(nd, &i);
+    wtest_assert_soft(i == 3);
+    // 40ms scaled by 1e-12 does not fit in nanoseconds
+    wtest_assert_soft(wqtree_replay(tree, rec, 1e-12) == -WQUERY_REPLAY_SPEED);
+    wtest_assert_soft(wqtree_replay(tree, rec, NAN) == -WQUERY_REPLAY_SPEED);
+    wqrec_close(rec);
+    unlink(LOGPATH);
+    wtest_end;
+}
+
+/// packets received by the server are recorded
+wtest(record_03)
+{
+    wtest_begin(record_03);
+    wqserver_t* server;
+    wqtree_t* tree;
+    wqnode_t* nd;
+    wqrec_t* rec;
+    struct sockaddr_in addr;
+    struct packets p = { 0 };
+    byte_t pkt[64];
+    int fd, i;
+    wqrec_walloc(&s_malloc, &rec);
+    wtest_fassert_soft(wqrec_create(rec, LOGPATH, 4, 4096));
+    wqtree_walloc(&s_malloc, &tree);
+    wqtree_addndi(tree, "/int", &nd);
+    wqtree_set_recorder(tree, rec);
+    wqserver_walloc(&s_malloc, &server);
+    wqserver_expose(server, tree);
+    wqserver_set_udp_workers(server, 1);
+    wtest_fassert_soft(wqserver_run(server, 5120, 5121));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(5120);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    for (int n = 1; n <= 8; ++n) {
+         uint32_t len = encodei(pkt, sizeof(pkt), "/int", n);
+         sendto(fd, pkt, len, 0, (struct sockaddr*) &addr, sizeof(addr));
+    }
+    for (int n = 0; n < 100 && wqnode_geti(nd, &i) == 0 && i != 8; ++n)
+         usleep(1000);
+    wqserver_stop(server);
+    close(fd);
+    wtest_assert_soft(i == 8);
+    wtest_assert_soft(wqrec_foreach(rec, pkt_fn, &p) == 8);
+    wqrec_close(rec);
+    unlink(LOGPATH);
+    wtest_end;
+}
+
+/// truncated logs are rejected, corrupt segments skipped
+wtest(record_04)
+{
+    wtest_begin(record_04);
+    wqrec_t* rec;
+    byte_t pkt[1000];
+    struct packets p = { 0 };
+    uint32_t used = ~0u;
+    int fd;
+    wqrec_walloc(&s_malloc, &rec);
+    wtest_fassert_soft(wqrec_create(rec, LOGPATH, 2, 4096));
+    // 4 packets in the first segment, 2 in the second
+    for (int n = 0; n < 6; ++n) {
+         pkt[0] = n;
+         wqrec_write(rec, pkt, sizeof(pkt));
+    }
+    wqrec_close(rec);
+    // header + first segment, 'used' field of the latter
+    fd = open(LOGPATH, O_RDWR);
+    wtest_assert_soft(pwrite(fd, &used, sizeof(used), 4096+8) == 4);
+    wtest_fassert_soft(wqrec_open(rec, LOGPATH));
+    wtest_assert_soft(wqrec_foreach(rec, pkt_fn, &p) == 2);
+    wtest_assert_soft(p.first == 4 && p.last == 5);
+    wqrec_close(rec);
+    wtest_assert_soft(ftruncate(fd, 4096*2) == 0);
+    close(fd);
+    wtest_assert_soft(wqrec_open(rec, LOGPATH) == WQREC_INVALID);
+    unlink(LOGPATH);
+    wtest_end;
+}
+
+int
+main(void)
+{
+    int err = 0;
+    err += wpn_unittest_record_01();
+    err += wpn_unittest_record_02();
+    err += wpn_unittest_record_03();
+    err += wpn_unittest_record_04();
+    return err;
+}
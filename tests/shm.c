@@ -0,0 +1,210 @@
+#define _GNU_SOURCE // memfd_create
+#include <wpn114/network/shm.h>
+#include <wpn114/utilities.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include "tests.h"
+#include "bench.h"
+
+struct frames {
+    int count;
+    uint32_t bytes;
+    byte_t last[64];
+};
+
+static void
+frame_fn(byte_t* data, uint32_t len, void* udt)
+{
+    struct frames* f = udt;
+    f->count++;
+    f->bytes += len;
+    memcpy(f->last, data, wpnmin(len, sizeof(f->last)));
+}
+
+/// push/pop, full ring and wrap-around, between two mappings
+wtest(shm_01)
+{
+    wtest_begin(shm_01);
+    wshm_t* cons, *prod;
+    int memfd, bell;
+    byte_t frame[40];
+    struct frames f = { 0 };
+    wtest_fassert_soft(wshm_walloc(&s_malloc, &cons));
+    wtest_fassert_soft(wshm_walloc(&s_malloc, &prod));
+    wtest_fassert_soft(wshm_create(cons, 256));
+    wtest_fassert_soft(wshm_get_fds(cons, &memfd, &bell));
+    wtest_fassert_soft(wshm_attach(prod, dup(memfd), dup(bell)));
+    memset(frame, 'w', sizeof(frame));
+    // 44 bytes per frame, 5 of them fit in 256 bytes
+    for (int n = 0; n < 5; ++n) {
+         wtest_fassert_soft(wshm_push(prod, frame, sizeof(frame)));
+    }
+    wtest_assert_soft(wshm_push(prod, frame, sizeof(frame)) == WSHM_FULL);
+    wtest_assert_soft(wshm_pop(cons, frame_fn, &f) == 5);
+    wtest_assert_soft(f.bytes == 5*sizeof(frame));
+    // next frames wrap around the end of the ring
+    for (int n = 0; n < 3; ++n) {
+         frame[0] = n;
+         wtest_fassert_soft(wshm_push(prod, frame, sizeof(frame)));
+    }
+    wtest_assert_soft(wshm_pop(cons, frame_fn, &f) == 3);
+    wtest_assert_soft(f.last[0] == 2);
+    wtest_assert_soft(wshm_push(prod, frame, 512) == WSHM_FRAME_TOO_LARGE);
+    wshm_close(prod);
+    wshm_close(cons);
+    wtest_end;
+}
+
+/// doorbell is only rung for a parked consumer
+wtest(shm_02)
+{
+    wtest_begin(shm_02);
+    wshm_t* cons, *prod;
+    int memfd, bell;
+    byte_t frame[8] = { 0 };
+    struct pollfd pfd;
+    struct frames f = { 0 };
+    wshm_walloc(&s_malloc, &cons);
+    wshm_walloc(&s_malloc, &prod);
+    wtest_fassert_soft(wshm_create(cons, 1024));
+    wshm_get_fds(cons, &memfd, &bell);
+    wtest_fassert_soft(wshm_attach(prod, dup(memfd), dup(bell)));
+    pfd.fd = wshm_doorbell(cons);
+    pfd.events = POLLIN;
+    wtest_fassert_soft(wshm_push(prod, frame, sizeof(frame)));
+    wtest_assert_soft(poll(&pfd, 1, 0) == 0);
+    // frames pending, consumer should not sleep
+    wtest_assert_soft(wshm_park(cons));
+    wtest_assert_soft(wshm_pop(cons, frame_fn, &f) == 1);
+    wtest_fassert_soft(wshm_park(cons));
+    wtest_fassert_soft(wshm_push(prod, frame, sizeof(frame)));
+    wtest_assert_soft(poll(&pfd, 1, 0) == 1);
+    wshm_unpark(cons);
+    wtest_assert_soft(poll(&pfd, 1, 0) == 0);
+    wtest_assert_soft(wshm_pop(cons, frame_fn, &f) == 1);
+    wshm_close(prod);
+    wshm_close(cons);
+    wtest_end;
+}
+
+#define NPINGS 20000
+
+/// two processes, descriptors passed over a unix socket,
+/// measures round-trip latency of polling peers (yielding,
+/// so that it still makes progress on a single core)
+wtest(shm_03)
+{
+    wtest_begin(shm_03);
+    int sks[2], status;
+    pid_t pid;
+    wtest_fassert_soft(socketpair(AF_UNIX, SOCK_DGRAM, 0, sks));
+    if ((pid = fork()) == 0) {
+        // child: echoes every frame back
+        wshm_t* in, *out;
+        int memfd, bell;
+        struct frames f = { 0 };
+        wshm_walloc(&s_malloc, &in);
+        wshm_walloc(&s_malloc, &out);
+        if (wshm_recv_fds(sks[1], &memfd, &bell) ||
+            wshm_attach(in, memfd, bell) ||
+            wshm_recv_fds(sks[1], &memfd, &bell) ||
+            wshm_attach(out, memfd, bell))
+            _exit(1);
+        while (f.count < NPINGS) {
+            int n = f.count;
+            if (wshm_pop(in, frame_fn, &f) == 0)
+                sched_yield();
+            for (; n < f.count; ++n)
+                 while (wshm_push(out, f.last, 16) == WSHM_FULL)
+                        sched_yield();
+        }
+        _exit(0);
+    } else {
+        wshm_t* ping, *pong;
+        byte_t frame[16] = "/ping\0\0\0,\0\0\0";
+        struct frames f = { 0 };
+        uint64_t t0;
+        wshm_walloc(&s_malloc, &ping);
+        wshm_walloc(&s_malloc, &pong);
+        wtest_fassert_soft(wshm_create(ping, 4096));
+        wtest_fassert_soft(wshm_create(pong, 4096));
+        wtest_fassert_soft(wshm_send_fds(ping, sks[0]));
+        wtest_fassert_soft(wshm_send_fds(pong, sks[0]));
+        t0 = wbench_now();
+        for (int n = 0; n < NPINGS; ++n) {
+             wshm_push(ping, frame, sizeof(frame));
+             while (wshm_pop(pong, frame_fn, &f) == 0)
+                    sched_yield();
+        }
+        wpnout("shm round-trip: %.1f ns\n",
+               (double)(wbench_now()-t0)/NPINGS);
+        waitpid(pid, &status, 0);
+        wtest_assert_soft(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        wtest_assert_soft(f.count == NPINGS);
+        wtest_assert_soft(memcmp(f.last, frame, 16) == 0);
+        wshm_close(ping);
+        wshm_close(pong);
+    }
+    wtest_end;
+}
+
+// private layout (see shm.c), for corrupting rings
+#define SHM_MAGIC   0x7773686d
+#define SHM_HDRSZ   256
+
+/// rings mapped from, or written by a peer that
+/// doesn't play by the rules are rejected
+wtest(shm_04)
+{
+    wtest_begin(shm_04);
+    wshm_t* cons, *prod;
+    int memfd, bell, fd;
+    uint32_t hdr[2] = { SHM_MAGIC, 100 };
+    byte_t frame[40] = { 0 };
+    byte_t* map;
+    struct frames f = { 0 };
+    wshm_walloc(&s_malloc, &cons);
+    wshm_walloc(&s_malloc, &prod);
+    // capacity not a power of two, then larger than the file
+    fd = memfd_create("shm_04", 0);
+    wtest_fassert_soft(ftruncate(fd, SHM_HDRSZ+128));
+    wtest_assert_soft(pwrite(fd, hdr, sizeof(hdr), 0) == sizeof(hdr));
+    wtest_assert_soft(wshm_attach(prod, fd, -1) == WSHM_INVALID);
+    hdr[1] = 256;
+    wtest_assert_soft(pwrite(fd, hdr, sizeof(hdr), 0) == sizeof(hdr));
+    wtest_assert_soft(wshm_attach(prod, fd, -1) == WSHM_INVALID);
+    close(fd);
+    // frame length running past the end of the ring
+    wtest_fassert_soft(wshm_create(cons, 256));
+    wshm_get_fds(cons, &memfd, &bell);
+    wtest_fassert_soft(wshm_attach(prod, dup(memfd), dup(bell)));
+    wtest_fassert_soft(wshm_push(prod, frame, sizeof(frame)));
+    map = mmap(0, SHM_HDRSZ+256, PROT_READ | PROT_WRITE,
+               MAP_SHARED, memfd, 0);
+    wtest_assert_soft(map != MAP_FAILED);
+    *(uint32_t*)&map[SHM_HDRSZ] = 1000;
+    wtest_assert_soft(wshm_pop(cons, frame_fn, &f) == -WSHM_INVALID);
+    wtest_assert_soft(f.count == 0);
+    // ring is usable again, past the dropped frames
+    wtest_fassert_soft(wshm_push(prod, frame, sizeof(frame)));
+    wtest_assert_soft(wshm_pop(cons, frame_fn, &f) == 1);
+    munmap(map, SHM_HDRSZ+256);
+    wshm_close(prod);
+    wshm_close(cons);
+    wtest_end;
+}
+
+int
+main(void)
+{
+    int err = 0;
+    err += wpn_unittest_shm_01();
+    err += wpn_unittest_shm_02();
+    err += wpn_unittest_shm_03();
+    err += wpn_unittest_shm_04();
+    return err;
+}
@@ -0,0 +1,134 @@
+#include <wpn114/network/stree.h>
+#include <wpn114/utilities.h>
+#include "tests.h"
+#include "stree_ns.h"
+
+// tests/stree_ns.h is generated from tests/stree_ns.json:
+// tools/wqgen.py tests/stree_ns.json stree_ns > tests/stree_ns.h
+
+struct updates {
+    int count;
+    int last;
+};
+
+static void
+update_fn(const struct wqstree* tree, int n, wvalue_t* v, void* udt)
+{
+    struct updates* u = udt;
+    u->count++;
+    u->last = n;
+}
+
+static uint32_t
+encode(byte_t* dst, uint32_t cap, const char* uri, const char* tag)
+{
+    womsg_t* msg;
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, dst, cap);
+    womsg_seturi(msg, uri);
+    womsg_settag(msg, tag);
+    switch (*tag) {
+    case WOSC_TYPE_FLOAT:
+        womsg_writef(msg, 0.25f);
+        break;
+    case WOSC_TYPE_INT:
+        womsg_writei(msg, 16);
+        break;
+    case WOSC_TYPE_DOUBLE:
+        womsg_writed(msg, 96.5);
+        break;
+    }
+    return womsg_getlen(msg);
+}
+
+// every node is found at its own index, anything else misses
+static int
+wpn_unittest_stree_01(void)
+{
+    wtest_begin(stree_01);
+    for (int n = 0; n < stree_ns.nnodes; ++n)
+         wtest_assert_soft(wqstree_lookup(&stree_ns, stree_ns_nodes[n].uri) == n);
+    wtest_assert_soft(wqstree_lookup(&stree_ns, "/synth/gain/") == -1);
+    wtest_assert_soft(wqstree_lookup(&stree_ns, "/synth/gai") == -1);
+    wtest_assert_soft(wqstree_lookup(&stree_ns, "/foo") == -1);
+    wtest_assert_soft(wqstree_lookup(&stree_ns, "") == -1);
+    // tree structure
+    wtest_assert_soft(stree_ns_nodes[STREE_NS_SYNTH_GAIN].parent == STREE_NS_SYNTH);
+    wtest_assert_soft(stree_ns_nodes[STREE_NS_CLOCK].child == STREE_NS_CLOCK_TEMPO);
+    wtest_assert_soft(stree_ns_nodes[STREE_NS_SYNTH].sibling == STREE_NS_CLOCK);
+    wtest_assert_soft(stree_ns_nodes[STREE_NS_CLOCK].sibling == WQSTREE_NONE);
+    wtest_end;
+}
+
+// osc updates, with type and access checks
+static int
+wpn_unittest_stree_02(void)
+{
+    wtest_begin(stree_02);
+    byte_t pkt[128];
+    uint32_t len;
+    struct updates u = { 0, -1 };
+    wtest_assert_soft(stree_ns_values[STREE_NS_SYNTH_GAIN].u.f == 0.5f);
+    wtest_assert_soft(stree_ns_values[STREE_NS_SYNTH_VOICES].u.i == 8);
+
+    len = encode(pkt, sizeof(pkt), "/synth/gain", "f");
+    wtest_fassert_soft(wqstree_update_osc(&stree_ns, pkt, len, update_fn, &u));
+    wtest_assert_soft(stree_ns_values[STREE_NS_SYNTH_GAIN].u.f == 0.25f);
+    wtest_assert_soft(u.count == 1 && u.last == STREE_NS_SYNTH_GAIN);
+
+    len = encode(pkt, sizeof(pkt), "/clock/tempo", "d");
+    wtest_fassert_soft(wqstree_update_osc(&stree_ns, pkt, len, update_fn, &u));
+    wtest_assert_soft(stree_ns_values[STREE_NS_CLOCK_TEMPO].u.d == 96.5);
+
+    len = encode(pkt, sizeof(pkt), "/synth/mute", "T");
+    wtest_fassert_soft(wqstree_update_osc(&stree_ns, pkt, len, NULL, NULL));
+    wtest_assert_soft(stree_ns_values[STREE_NS_SYNTH_MUTE].u.b == true);
+
+    // wrong type, unknown uri, read-only node, container
+    len = encode(pkt, sizeof(pkt), "/synth/voices", "f");
+    wtest_assert_soft(wqstree_update_osc(&stree_ns, pkt, len, update_fn, &u)
+                      == WQUERY_TYPE_MISMATCH);
+    wtest_assert_soft(stree_ns_values[STREE_NS_SYNTH_VOICES].u.i == 8);
+    len = encode(pkt, sizeof(pkt), "/synth/foo", "i");
+    wtest_assert_soft(wqstree_update_osc(&stree_ns, pkt, len, update_fn, &u)
+                      == WQUERY_URI_INVALID);
+    len = encode(pkt, sizeof(pkt), "/synth/version", "i");
+    wtest_assert_soft(wqstree_update_osc(&stree_ns, pkt, len, update_fn, &u)
+                      == WQUERY_ATTR_UNSUPPORTED);
+    wtest_assert_soft(stree_ns_values[STREE_NS_SYNTH_VERSION].u.i == 3);
+    len = encode(pkt, sizeof(pkt), "/synth", "i");
+    wtest_assert_soft(wqstree_update_osc(&stree_ns, pkt, len, update_fn, &u)
+                      == WQUERY_TYPE_MISMATCH);
+    wtest_assert_soft(u.count == 2);
+    wtest_end;
+}
+
+// pre-rendered namespace slices
+static int
+wpn_unittest_stree_03(void)
+{
+    wtest_begin(stree_03);
+    const char* json;
+    uint32_t len;
+    len = wqstree_get_json(&stree_ns, STREE_NS_ROOT, &json);
+    wtest_assert_soft(len == strlen(stree_ns_json));
+    len = wqstree_get_json(&stree_ns, STREE_NS_SYNTH_GAIN, &json);
+    wtest_fassert_soft(strncmp(json, "{\"FULL_PATH\":\"/synth/gain\"", 26));
+    wtest_assert_soft(json[len-1] == '}');
+    wtest_assert_soft(json[len] == ',');
+    len = wqstree_get_json(&stree_ns, STREE_NS_CLOCK, &json);
+    wtest_fassert_soft(strncmp(json, "{\"FULL_PATH\":\"/clock\"", 21));
+    wtest_assert_soft(strstr(json, "/clock/note") < json+len);
+    wtest_assert_soft(strstr(json, "/synth") == NULL);
+    wtest_end;
+}
+
+int
+main(void)
+{
+    int err = 0;
+    err += wpn_unittest_stree_01();
+    err += wpn_unittest_stree_02();
+    err += wpn_unittest_stree_03();
+    return err;
+}
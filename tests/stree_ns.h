@@ -0,0 +1,65 @@
+// generated by tools/wqgen.py from tests/stree_ns.json, do not edit
+#ifndef STREE_NS_H
+#define STREE_NS_H
+
+#include <wpn114/network/stree.h>
+
+enum {
+    STREE_NS_ROOT = 0,
+    STREE_NS_SYNTH = 1,
+    STREE_NS_SYNTH_GAIN = 2,
+    STREE_NS_SYNTH_VOICES = 3,
+    STREE_NS_SYNTH_MUTE = 4,
+    STREE_NS_SYNTH_VERSION = 5,
+    STREE_NS_CLOCK = 6,
+    STREE_NS_CLOCK_TEMPO = 7,
+    STREE_NS_CLOCK_TICKS = 8,
+    STREE_NS_CLOCK_NOTE = 9,
+};
+
+static const struct wqsnode stree_ns_nodes[] = {
+    { "/", 0xffff, 0x0001, 0xffff, WOSC_TYPE_NIL, 3, 0, 564 },
+    { "/synth", 0x0000, 0x0002, 0x0006, WOSC_TYPE_NIL, 3, 48, 284 },
+    { "/synth/gain", 0x0001, 0xffff, 0x0003, WOSC_TYPE_FLOAT, 3, 100, 49 },
+    { "/synth/voices", 0x0001, 0xffff, 0x0004, WOSC_TYPE_INT, 3, 159, 51 },
+    { "/synth/mute", 0x0001, 0xffff, 0x0005, WOSC_TYPE_BOOL, 3, 218, 49 },
+    { "/synth/version", 0x0001, 0xffff, 0xffff, WOSC_TYPE_INT, 1, 278, 52 },
+    { "/clock", 0x0000, 0x0007, 0xffff, WOSC_TYPE_NIL, 3, 341, 221 },
+    { "/clock/tempo", 0x0006, 0xffff, 0x0008, WOSC_TYPE_DOUBLE, 3, 394, 50 },
+    { "/clock/ticks", 0x0006, 0xffff, 0x0009, WOSC_TYPE_INT64, 3, 453, 50 },
+    { "/clock/note", 0x0006, 0xffff, 0xffff, WOSC_TYPE_MIDI, 3, 511, 49 },
+};
+
+static const uint16_t stree_ns_disp[] = { 1, 4, 46 };
+static const uint16_t stree_ns_slots[] = { 0x0006, 0x0009, 0x0000, 0x0007, 0x0003, 0x0004, 0x0001, 0x0005, 0x0008, 0x0002 };
+
+static const char stree_ns_json[] =
+    "{\"FULL_PATH\":\"/\",\"ACCESS\":3,\"CONTENTS\":{\"synth\":{\"FULL_PATH\":\"/synth\",\"A"
+    "CCESS\":3,\"CONTENTS\":{\"gain\":{\"FULL_PATH\":\"/synth/gain\",\"ACCESS\":3,\"TYPE\""
+    ":\"f\"},\"voices\":{\"FULL_PATH\":\"/synth/voices\",\"ACCESS\":3,\"TYPE\":\"i\"},\"mute"
+    "\":{\"FULL_PATH\":\"/synth/mute\",\"ACCESS\":3,\"TYPE\":\"F\"},\"version\":{\"FULL_PAT"
+    "H\":\"/synth/version\",\"ACCESS\":1,\"TYPE\":\"i\"}}},\"clock\":{\"FULL_PATH\":\"/cloc"
+    "k\",\"ACCESS\":3,\"CONTENTS\":{\"tempo\":{\"FULL_PATH\":\"/clock/tempo\",\"ACCESS\":3"
+    ",\"TYPE\":\"d\"},\"ticks\":{\"FULL_PATH\":\"/clock/ticks\",\"ACCESS\":3,\"TYPE\":\"h\"},"
+    "\"note\":{\"FULL_PATH\":\"/clock/note\",\"ACCESS\":3,\"TYPE\":\"m\"}}}}}"
+    ;
+
+static wvalue_t stree_ns_values[] = {
+    { .t = WOSC_TYPE_NIL },
+    { .t = WOSC_TYPE_NIL },
+    { .u.f = 0.5, .t = WOSC_TYPE_FLOAT },
+    { .u.i = 8, .t = WOSC_TYPE_INT },
+    { .u.b = false, .t = WOSC_TYPE_BOOL },
+    { .u.i = 3, .t = WOSC_TYPE_INT },
+    { .t = WOSC_TYPE_NIL },
+    { .u.d = 120.0, .t = WOSC_TYPE_DOUBLE },
+    { .u.h = 0, .t = WOSC_TYPE_INT64 },
+    { .u.m = { 0, 144, 60, 100 }, .t = WOSC_TYPE_MIDI },
+};
+
+static const struct wqstree stree_ns = {
+    stree_ns_nodes, stree_ns_disp, stree_ns_slots, stree_ns_values, stree_ns_json,
+    10, 3, 10
+};
+
+#endif
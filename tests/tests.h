@@ -1,6 +1,16 @@
 #ifndef WPN_TESTS_H
 #define WPN_TESTS_H
 
+#include <wpn114/alloc.h>
+#include <wpn114/network/oscquery.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,6 +43,105 @@ extern "C" {
             (100.f/_testno)*(_testno-_nerr));                       \
     return _nerr
 
+/** Heap allocator, for tests that don't need a fixed pool */
+static struct walloc_t
+s_malloc __attribute__((unused)) = { walloc_dynamic, wfree_dynamic, NULL };
+
+/** Exposes <tree> on <server>, with a single udp worker,
+ * on ports <udp> and <udp>+1 (tcp) */
+static inline int
+wtest_run(wqserver_t* server, wqtree_t* tree, uint16_t udp)
+{
+    wqserver_expose(server, tree);
+    wqserver_set_udp_workers(server, 1);
+    return wqserver_run(server, udp, udp+1);
+}
+
+/** Sets <addr> to 127.0.0.1:<port>, and returns a new udp socket */
+static inline int
+wtest_loopback(struct sockaddr_in* addr, uint16_t port)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr->sin_addr);
+    return socket(AF_INET, SOCK_DGRAM, 0);
+}
+
+/** Sends "<uri> ,f <f>" to <addr>, returns the packet length */
+static inline int
+wtest_sendf(int fd, struct sockaddr_in* addr, const char* uri, float f)
+{
+    byte_t pkt[128];
+    womsg_t* msg;
+    womsg_alloca(&msg);
+    womsg_setbuf(msg, pkt, sizeof(pkt));
+    womsg_seturi(msg, uri);
+    womsg_settag(msg, "f");
+    womsg_writef(msg, f);
+    sendto(fd, pkt, womsg_getlen(msg), 0,
+          (struct sockaddr*) addr, sizeof(*addr));
+    return womsg_getlen(msg);
+}
+
+/** Minimal websocket client: sends an upgrade request to 127.0.0.1:<port>,
+ * returns the (non-blocking) socket once switched, -1 otherwise */
+static inline int
+wtest_ws_open(wqserver_t* server, uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0), len = 0;
+    char buf[512];
+    struct sockaddr_in addr;
+    static const char* upgrade =
+        "GET / HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n";
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)))
+        return -1;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    send(fd, upgrade, strlen(upgrade), 0);
+    for (int n = 0; n < 100; ++n) {
+        int r;
+        wqserver_iterate(server, 10);
+        if ((r = recv(fd, &buf[len], sizeof(buf)-len-1, 0)) > 0) {
+            len += r;
+            buf[len] = '\0';
+            if (strstr(buf, "\r\n\r\n"))
+                return strstr(buf, " 101 ") ? fd : -1;
+        }
+    }
+    return -1;
+}
+
+/** Sends <text> as a single (masked, with a zero key) text frame */
+static inline void
+wtest_ws_send(wqserver_t* server, int fd, const char* text)
+{
+    byte_t frame[128] = { 0x81 };
+    int len = strlen(text);
+    assert(len < 126);
+    frame[1] = 0x80 | len;
+    memcpy(&frame[6], text, len);
+    send(fd, frame, len+6, 0);
+    for (int n = 0; n < 5; ++n)
+        wqserver_iterate(server, 10);
+}
+
+/** Iterates <_server> until <_cond> holds, for about 200ms at most:
+ * udp workers run on their own threads, and have to be given time */
+#define wtest_poll(_server, _cond)                                  \
+    for (int _n = 0; _n < 200 && !(_cond); ++_n) {                  \
+         wqserver_iterate(_server, 5);                              \
+         usleep(1000);                                              \
+    }
+
 #ifdef __cplusplus
 }
 #endif
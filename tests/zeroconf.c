@@ -0,0 +1,109 @@
+#include <wpn114/network/zeroconf.h>
+#include <wpn114/utilities.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "tests.h"
+
+// waits (up to <ms>) until browser has <count> results
+static int
+browse_until(wzbrowser_t* bws, struct wzresult* res, int count, int ms)
+{
+    int n = 0;
+    for (int t = 0; t < ms; t += 50)
+        if (wzbrowser_iter(bws, 50) == 0 &&
+           (n = wzbrowser_results(bws, res, 4)) == count)
+            break;
+    return n;
+}
+
+/// service and browser in two processes, over loopback:
+/// resolution, then goodbye
+wtest(zeroconf_01)
+{
+    wtest_begin(zeroconf_01);
+    int sync[2], status;
+    pid_t pid;
+    char c = 0;
+    wtest_fassert_soft(pipe(sync));
+    if ((pid = fork()) == 0) {
+        wzservice_t* srv;
+        close(sync[1]);
+        fcntl(sync[0], F_SETFL, O_NONBLOCK);
+        if (wzservice_walloc(&s_malloc, &srv) ||
+            wzservice_setname(srv, "wzservice test") ||
+            wzservice_setport(srv, 5678) ||
+            wzservice_setiface(srv, "127.0.0.1") ||
+            wzservice_publish(srv))
+            _exit(1);
+        // serve until parent is done browsing
+        while (read(sync[0], &c, 1) < 0)
+            wzservice_iter(srv, 50);
+        wzservice_stop(srv);
+        _exit(0);
+    } else {
+        wzbrowser_t* bws;
+        struct wzresult res[4];
+        close(sync[0]);
+        wtest_fassert_soft(wzbrowser_walloc(&s_malloc, &bws));
+        wtest_fassert_soft(wzbrowser_setiface(bws, "127.0.0.1"));
+        wtest_fassert_soft(wzbrowser_addtarget(bws, "wzservice test"));
+        wtest_fassert_soft(wzbrowser_run(bws));
+        wtest_assert_soft(browse_until(bws, res, 1, 3000) == 1);
+        wtest_fassert_soft(strcmp(res[0].name, "wzservice test"));
+        wtest_assert_soft(res[0].port == 5678);
+        wtest_assert_soft(res[0].addr.s_addr == htonl(INADDR_LOOPBACK));
+        wtest_assert_soft(res[0].ttl > 4000);
+        write(sync[1], &c, 1);
+        waitpid(pid, &status, 0);
+        wtest_assert_soft(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        wtest_assert_soft(browse_until(bws, res, 0, 1000) == 0);
+        wzbrowser_stop(bws);
+    }
+    wtest_end;
+}
+
+/// services that don't match browser targets are not cached
+wtest(zeroconf_02)
+{
+    wtest_begin(zeroconf_02);
+    wzservice_t* a, *b;
+    wzbrowser_t* bws;
+    struct wzresult res[4];
+    wtest_fassert_soft(wzservice_walloc(&s_malloc, &a));
+    wtest_fassert_soft(wzservice_walloc(&s_malloc, &b));
+    wtest_fassert_soft(wzbrowser_walloc(&s_malloc, &bws));
+    wzservice_setname(a, "target");
+    wzservice_setname(b, "other");
+    wzservice_setport(a, 1234);
+    wzservice_setport(b, 4321);
+    wzservice_setiface(a, "127.0.0.1");
+    wzservice_setiface(b, "127.0.0.1");
+    wzbrowser_setiface(bws, "127.0.0.1");
+    wtest_assert_soft(wzbrowser_setiface(bws, "local") == WZ_ADDR_INVALID);
+    wtest_fassert_soft(wzbrowser_addtarget(bws, "target"));
+    wtest_fassert_soft(wzservice_publish(a));
+    wtest_fassert_soft(wzservice_publish(b));
+    wtest_fassert_soft(wzbrowser_run(bws));
+    for (int t = 0; t < 20; ++t) {
+        wzservice_iter(a, 10);
+        wzservice_iter(b, 10);
+        wzbrowser_iter(bws, 10);
+    }
+    wtest_assert_soft(wzbrowser_results(bws, res, 4) == 1);
+    wtest_assert_soft(res[0].port == 1234);
+    wzservice_stop(a);
+    wzservice_stop(b);
+    wzbrowser_stop(bws);
+    wtest_end;
+}
+
+int
+main(void)
+{
+    int err = 0;
+    err += wpn_unittest_zeroconf_01();
+    err += wpn_unittest_zeroconf_02();
+    return err;
+}
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Generates static tree tables (see wpn114/network/stree.h)
+from an OSCQuery JSON namespace:
+
+    wqgen.py namespace.json <name> > <name>.h
+
+Nodes are read from nested "CONTENTS" objects, with their "TYPE"
+(a single OSC tag, "T"/"F" for booleans, none for containers),
+"ACCESS" (defaults to 3) and initial "VALUE". The output defines
+<name> (a const struct wqstree), its tables, and an enum of node
+indices (<NAME>_<PATH>), in a single header."""
+
+import json
+import re
+import sys
+
+NONE = 0xffff
+TYPES = {
+    'i': 'WOSC_TYPE_INT', 'f': 'WOSC_TYPE_FLOAT', 'c': 'WOSC_TYPE_CHAR',
+    'h': 'WOSC_TYPE_INT64', 'd': 'WOSC_TYPE_DOUBLE',
+    't': 'WOSC_TYPE_TIMETAG', 'm': 'WOSC_TYPE_MIDI',
+    'T': 'WOSC_TYPE_BOOL', 'F': 'WOSC_TYPE_BOOL', 'N': 'WOSC_TYPE_NIL',
+}
+MEMBERS = {'i': 'i', 'f': 'f', 'c': 'c', 'h': 'h', 'd': 'd', 't': 't'}
+
+
+def fnv(seed, uri):
+    h = 2166136261 ^ seed
+    for b in uri.encode():
+        h ^= b
+        h = (h * 16777619) & 0xffffffff
+    return h
+
+
+class Node:
+    def __init__(self, uri, obj, parent):
+        self.uri = uri
+        self.parent = parent
+        self.type = obj.get('TYPE', 'N')
+        self.access = obj.get('ACCESS', 3)
+        self.value = obj.get('VALUE', [None])[0]
+        self.children = []
+        self.joff = self.jlen = 0
+        if self.type not in TYPES:
+            sys.exit('%s: unsupported type "%s"' % (uri, self.type))
+
+
+def walk(obj, uri, parent, nodes):
+    nd = Node(uri, obj, parent)
+    nd.index = len(nodes)
+    nodes.append(nd)
+    for name, sub in obj.get('CONTENTS', {}).items():
+        child = walk(sub, uri.rstrip('/') + '/' + name, nd, nodes)
+        nd.children.append(child)
+    return nd
+
+
+def render(nd, out):
+    # namespace without values, which change at runtime
+    start = sum(len(s) for s in out)
+    out.append('{"FULL_PATH":%s,"ACCESS":%d' % (json.dumps(nd.uri), nd.access))
+    if nd.type != 'N':
+        out.append(',"TYPE":%s' % json.dumps(nd.type))
+    if nd.children:
+        out.append(',"CONTENTS":{')
+        for n, child in enumerate(nd.children):
+            name = child.uri.rsplit('/', 1)[1]
+            out.append('%s%s:' % (',' if n else '', json.dumps(name)))
+            render(child, out)
+        out.append('}')
+    out.append('}')
+    nd.joff = start
+    nd.jlen = sum(len(s) for s in out) - start
+
+
+def perfect_hash(uris):
+    # hash and displace: buckets are placed largest first,
+    # each one with the first seed that lands all of its
+    # keys in free slots
+    nslots = len(uris)
+    nbuckets = max(1, (len(uris) + 3) // 4)
+    buckets = [[] for _ in range(nbuckets)]
+    for n, uri in enumerate(uris):
+        buckets[fnv(0, uri) % nbuckets].append(n)
+    disp = [0] * nbuckets
+    slots = [NONE] * nslots
+    for b in sorted(range(nbuckets), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            continue
+        for d in range(1, 0x10000):
+            pos = [fnv(d, uris[n]) % nslots for n in buckets[b]]
+            if len(set(pos)) == len(pos) and all(slots[p] == NONE for p in pos):
+                break
+        else:
+            sys.exit('could not find a perfect hash')
+        disp[b] = d
+        for n, p in zip(buckets[b], pos):
+            slots[p] = n
+    return disp, slots
+
+
+def cvalue(nd):
+    tp = TYPES[nd.type]
+    if nd.type in 'TF':
+        return '{ .u.b = %s, .t = %s }' % (
+            'true' if nd.type == 'T' or nd.value else 'false', tp)
+    if nd.value is None:
+        return '{ .t = %s }' % tp
+    if nd.type == 'c':
+        return "{ .u.c = %d, .t = %s }" % (ord(nd.value), tp)
+    if nd.type == 'm':
+        return '{ .u.m = { %s }, .t = %s }' % (
+            ', '.join(str(b) for b in nd.value), tp)
+    return '{ .u.%s = %r, .t = %s }' % (MEMBERS[nd.type], nd.value, tp)
+
+
+def ident(name, uri):
+    sym = re.sub(r'[^0-9A-Za-z]+', '_', uri).strip('_').upper()
+    return '%s_%s' % (name.upper(), sym or 'ROOT')
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    with open(sys.argv[1]) as f:
+        ns = json.load(f)
+    name = sys.argv[2]
+    nodes = []
+    root = walk(ns, '/', None, nodes)
+    if len(nodes) >= NONE:
+        sys.exit('too many nodes')
+    out = []
+    render(root, out)
+    js = ''.join(out)
+    disp, slots = perfect_hash([nd.uri for nd in nodes])
+
+    guard = name.upper() + '_H'
+    w = sys.stdout.write
+    w('// generated by tools/wqgen.py from %s, do not edit\n' % sys.argv[1])
+    w('#ifndef %s\n#define %s\n\n' % (guard, guard))
+    w('#include <wpn114/network/stree.h>\n\n')
+    w('enum {\n')
+    for nd in nodes:
+        w('    %s = %d,\n' % (ident(name, nd.uri), nd.index))
+    w('};\n\n')
+    w('static const struct wqsnode %s_nodes[] = {\n' % name)
+    for nd in nodes:
+        child = nd.children[0].index if nd.children else NONE
+        sib = NONE
+        if nd.parent:
+            sibs = nd.parent.children
+            pos = sibs.index(nd)
+            if pos + 1 < len(sibs):
+                sib = sibs[pos + 1].index
+        w('    { %s, 0x%04x, 0x%04x, 0x%04x, %s, %d, %d, %d },\n' % (
+          json.dumps(nd.uri), nd.parent.index if nd.parent else NONE,
+          child, sib, TYPES[nd.type], nd.access, nd.joff, nd.jlen))
+    w('};\n\n')
+    w('static const uint16_t %s_disp[] = { %s };\n' % (
+      name, ', '.join(str(d) for d in disp)))
+    w('static const uint16_t %s_slots[] = { %s };\n\n' % (
+      name, ', '.join('0x%04x' % s for s in slots)))
+    w('static const char %s_json[] =\n' % name)
+    for n in range(0, len(js), 72):
+        w('    %s\n' % json.dumps(js[n:n+72]))
+    w('    ;\n\n')
+    w('static wvalue_t %s_values[] = {\n' % name)
+    for nd in nodes:
+        w('    %s,\n' % cvalue(nd))
+    w('};\n\n')
+    w('static const struct wqstree %s = {\n' % name)
+    w('    %s_nodes, %s_disp, %s_slots, %s_values, %s_json,\n' % (
+      (name,) * 5))
+    w('    %d, %d, %d\n};\n\n' % (len(nodes), len(disp), len(slots)))
+    w('#endif\n')
+
+
+if __name__ == '__main__':
+    main()